@@ -0,0 +1,97 @@
+#ifndef TRM_OBSERVING_BATCH
+#define TRM_OBSERVING_BATCH
+
+#include <vector>
+#include <functional>
+#include "trm/subs.h"
+#include "trm/date.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+#include "trm/ephem.h"
+#include "trm/observing.h"
+
+namespace Observing {
+
+  //! Working space of one thread
+
+  /** Observing::Context holds anything that a calculation wants to keep
+   * from one call to the next, so that none of it need be hidden inside
+   * the objects being computed. Each thread has its own Context; a Context
+   * must never be used by two threads at once.
+   *
+   * The library is reentrant in the following sense. The free functions
+   * (suntime, startime, when_visible, night, tcorr, time_to_phase,
+   * phase_to_time, moon etc) keep no state. The const methods of Moon,
+   * Limits, Track, Network and the Constraint classes change nothing, so
+   * one object can be shared by any number of threads. A Grid can be shared
+   * once prepare() has been called, and a Simulator once all of its
+   * targets have been added. Timeline, Coverage, Scheduler and Sweep are
+   * changed as they are used, and each belongs to one thread.
+   */
+
+  class Context {
+  public:
+
+    //! Constructor
+    Context(size_t thread=0) : ithread(thread), amtime(-1.e30) {}
+
+    //! Index of the thread, 0 upwards
+    size_t thread() const {return ithread;}
+
+    //! Apparent place parameters (as from slaMappa) for a TT, as an MJD
+    double* amprms(double tt);
+
+  private:
+    size_t ithread;
+    double amtime;
+    double amp[21];
+  };
+
+  //! Number of threads to use for njob jobs, with nthread = 0 meaning one per core
+  int nthreads(int nthread, size_t njob);
+
+  //! Calls func(i, context) for i = 0 to n-1, spread over nthread threads
+  void parallel_for(size_t n, int nthread, const std::function<void(size_t, Context&)>& func);
+
+  //! Period of visibility returned by the batch when_visible
+  struct Visibility {
+
+    //! Default constructor
+    Visibility() : visible(false) {}
+
+    //! True if the target is visible at all
+    bool visible;
+
+    //! Start and end of the visibility, if visible
+    Subs::Time first, last;
+  };
+
+  //! Rise or set of the Sun after each of a series of times
+  void suntime(const Subs::Telescope& tel, const std::vector<Subs::Time>& start, double altaim,
+	       std::vector<Subs::Time>& found, std::vector<char>& ok, int nthread, Sun_Model model=FULL_SUN);
+
+  //! Rise or set of each of a series of objects
+  void startime(const std::vector<const Subs::Position*>& obj, const Subs::Telescope& tel, const Subs::Time& start,
+		double altaim, std::vector<Subs::Time>& found, std::vector<char>& ok, int nthread);
+
+  //! Visibility of each of a series of objects
+  void when_visible(const std::vector<const Subs::Position*>& obj, const Subs::Telescope& telescope,
+		    const Subs::Time& tstart, const Subs::Time& tend, double airmass,
+		    std::vector<Visibility>& vis, int nthread);
+
+  //! Night times for each of a series of dates
+  void night(const Subs::Telescope& tel, const std::vector<Subs::Date>& date, double sunalt,
+	     std::vector<Night>& nights, std::vector<char>& ok, int nthread, Sun_Model model=FULL_SUN);
+
+  //! Altitude, azimuth and airmass of an object at each of a series of UTC MJDs
+  void altaz(const Subs::Position& obj, const Subs::Telescope& tel, const double* mjd, size_t n,
+	     double* alt, double* az, double* airmass, int nthread);
+
+  //! Orbital phase of an object at each of a series of UTC MJDs
+  void phase(const Subs::Position& obj, const Subs::Ephem& eph, const Subs::Telescope& tel,
+	     const double* mjd, size_t n, double* phase, int nthread);
+
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef TRM_OBSERVING_CATALOGUE
+#define TRM_OBSERVING_CATALOGUE
+
+#include <string>
+#include <vector>
+#include <map>
+#include "trm/subs.h"
+#include "trm/position.h"
+#include "trm/ephem.h"
+#include "trm/star.h"
+#include "trm/precise_ephem.h"
+
+namespace Observing {
+
+  //! A set of targets held in contiguous arrays
+
+  /** Observing::Catalogue holds the targets read from a star data file. In
+   * place of one heap object per target reached through a pointer, the
+   * positions, the ephemerides and the flags saying which targets have
+   * ephemerides are each kept in a single array, so that a pass over many
+   * targets runs through memory in order with no virtual calls. The names,
+   * which are only wanted for output, are kept apart, end to end in one
+   * string, so that they do not dilute the arrays used in the calculations.
+   *
+   * The file format is the usual one: a name line and a position line for
+   * each star, followed by an ephemeris or 'null'.
+   */
+
+  class Catalogue {
+  public:
+
+    //! Default constructor: no targets
+    Catalogue() : noff(1, 0), lmax(0) {}
+
+    //! Constructor from a file
+    Catalogue(const std::string& file, bool ephem_only=false);
+
+    //! Reads targets from a file, adding them to any already present
+    void load(const std::string& file, bool ephem_only=false);
+
+    //! Adds a target with no ephemeris
+    void add(const Subs::Star& star);
+
+    //! Adds a target with an ephemeris
+    void add(const Subs::Star& star, const Subs::Ephem& eph);
+
+    //! Reserves space for a number of targets
+    void reserve(size_t n);
+
+    //! Number of targets
+    size_t size() const {return pos.size();}
+
+    //! Position of target i
+    const Subs::Position& position(size_t i) const {return pos[i];}
+
+    //! True if target i has an ephemeris
+    bool has_ephem(size_t i) const {return haseph[i];}
+
+    //! Ephemeris of target i (a default one if it has none)
+    const Subs::Ephem& ephem(size_t i) const {return eph[i];}
+
+    //! Ephemeris of target i for precise conversions between time and phase
+    const Precise_Ephem& precise(size_t i) const {return peph[i];}
+
+    //! Name of target i
+    std::string name(size_t i) const {return names.substr(noff[i], noff[i+1]-noff[i]);}
+
+    //! Length of the longest name
+    size_t max_name() const {return lmax;}
+
+    //! Index of the first target with a name, compared after clean_name; size() if there is none
+    size_t find(const std::string& name) const;
+
+  private:
+    std::vector<Subs::Position> pos;
+    std::vector<Subs::Ephem>    eph;
+    std::vector<Precise_Ephem>  peph;
+    std::vector<char>           haseph;
+    std::string                 names;
+    std::vector<size_t>         noff;  // name i is names[noff[i]] to names[noff[i+1]-1]
+    size_t                      lmax;
+    std::map<std::string,size_t> index; // cleaned name to first target of that name
+  };
+
+  //! Removes leading and trailing blanks and collapses inner runs of them to one, so that names can be compared
+  std::string clean_name(const std::string& name);
+
+};
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef TRM_OBSERVING_CONSTRAINT
+#define TRM_OBSERVING_CONSTRAINT
+
+#include <string>
+#include <vector>
+#include <memory>
+#include "trm/subs.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+#include "trm/ephem.h"
+#include "trm/moon.h"
+
+namespace Observing {
+
+  //! Equally spaced times shared by all targets, with the Sun and Moon over them
+
+  /** Observing::Grid holds the times at which constraints are evaluated, for
+   * instance every few minutes over a night. Anything that does not depend
+   * upon the target, namely the altitude of the Sun and the Moon, is
+   * computed the first time it is needed and then shared by all targets.
+   * Call prepare before sharing a Grid between threads.
+   */
+
+  class Grid {
+  public:
+
+    //! Constructor
+    Grid(const Subs::Telescope& tel, const Subs::Time& tstart, const Subs::Time& tend, double step);
+
+    //! Number of times
+    size_t size() const {return npoint;}
+
+    //! UTC MJD of time i
+    double mjd(size_t i) const {return t0 + dt*i;}
+
+    //! Spacing, days
+    double spacing() const {return dt;}
+
+    //! The telescope
+    const Subs::Telescope& telescope() const {return tel;}
+
+    //! Altitude of the Sun at time i, degrees, including refraction
+    double sunalt(size_t i) const;
+
+    //! The Moon over the grid
+    const Moon& moon() const;
+
+    //! Computes the Sun (and the Moon) now rather than when first needed
+    void prepare(bool with_moon) const;
+
+    //! Converts a mask over the grid into time intervals
+    void intervals(const std::vector<char>& mask, std::vector<std::pair<double,double> >& ivals) const;
+
+  private:
+    Subs::Telescope tel;
+    double t0, dt;
+    size_t npoint;
+    mutable std::vector<double> sun;
+    mutable Moon lunar;
+    mutable bool moon_ready;
+  };
+
+  //! One target being evaluated on a Grid, caching what constraints ask for
+
+  class Evaluation {
+  public:
+
+    //! Constructor. eph may be 0 for targets without an ephemeris.
+    Evaluation(const Grid& grid, const Subs::Position& obj, const Subs::Ephem* eph);
+
+    //! The grid
+    const Grid& grid() const {return grd;}
+
+    //! The target
+    const Subs::Position& target() const {return *obj;}
+
+    //! Altitude, airmass etc of the target at time i
+    const Subs::Altaz& altaz(size_t i);
+
+    //! Orbital phase of the target at time i
+    double phase(size_t i);
+
+  private:
+    const Grid& grd;
+    const Subs::Position* obj;
+    const Subs::Ephem* eph;
+    std::vector<Subs::Altaz> alt;
+    std::vector<double> phs;
+    std::vector<char> alt_ok, phs_ok;
+  };
+
+  //! A condition on a target as a function of time
+
+  /** Constraints are evaluated on the points of a Grid with a mask in which
+   * only points still in contention are set; apply clears those at which
+   * the constraint fails and never looks at the others. This is what lets
+   * And and Or cut short the evaluation of their later, more expensive
+   * members. Each constraint has a cost which And and Or use to try the
+   * cheap ones first.
+   */
+
+  class Constraint {
+  public:
+
+    //! Destructor
+    virtual ~Constraint() {}
+
+    //! Clears the points of the mask at which the constraint fails
+    virtual void apply(Evaluation& eval, std::vector<char>& mask) const = 0;
+
+    //! Rough cost per point
+    virtual double cost() const = 0;
+
+    //! True if the constraint involves the Moon
+    virtual bool needs_moon() const {return false;}
+  };
+
+  //! Shared pointer to a Constraint, as held by And and Or
+  typedef std::shared_ptr<const Constraint> Constraint_Ptr;
+
+  //! Airmass below a limit (and the target above the horizon)
+  class Airmass_Limit : public Constraint {
+  public:
+    //! Constructor
+    Airmass_Limit(double airmass) : airmass(airmass) {}
+    void apply(Evaluation& eval, std::vector<char>& mask) const;
+    double cost() const {return 10.;}
+  private:
+    double airmass;
+  };
+
+  //! Sun below an altitude
+  class Sun_Limit : public Constraint {
+  public:
+    //! Constructor
+    Sun_Limit(double sunalt) : sunalt(sunalt) {}
+    void apply(Evaluation& eval, std::vector<char>& mask) const;
+    double cost() const {return 1.;}
+  private:
+    double sunalt;
+  };
+
+  //! Hour angle within a range (hours, the range may run through 12)
+  class Hour_Angle_Range : public Constraint {
+  public:
+    //! Constructor
+    Hour_Angle_Range(double ha1, double ha2) : ha1(ha1), ha2(ha2) {}
+    void apply(Evaluation& eval, std::vector<char>& mask) const;
+    double cost() const {return 10.;}
+  private:
+    double ha1, ha2;
+  };
+
+  //! Separation from the Moon above a limit while the Moon is up
+  class Moon_Limit : public Constraint {
+  public:
+    //! Constructor
+    Moon_Limit(double moonsep) : moonsep(moonsep) {}
+    void apply(Evaluation& eval, std::vector<char>& mask) const;
+    double cost() const {return 3.;}
+    bool needs_moon() const {return true;}
+  private:
+    double moonsep;
+  };
+
+  //! Orbital phase within a range (which may run through phase 0)
+  class Phase_Limit : public Constraint {
+  public:
+    //! Constructor
+    Phase_Limit(double p1, double p2) : p1(p1), p2(p2) {}
+    void apply(Evaluation& eval, std::vector<char>& mask) const;
+    double cost() const {return 5.;}
+  private:
+    double p1, p2;
+  };
+
+  //! UT within a range of hours (which may run through midnight)
+  class Time_Window : public Constraint {
+  public:
+    //! Constructor
+    Time_Window(double ut1, double ut2) : ut1(ut1), ut2(ut2) {}
+    void apply(Evaluation& eval, std::vector<char>& mask) const;
+    double cost() const {return 0.1;}
+  private:
+    double ut1, ut2;
+  };
+
+  //! Satisfied when all of its members are
+  class And : public Constraint {
+  public:
+    //! Adds a member
+    And& add(const Constraint_Ptr& con);
+    void apply(Evaluation& eval, std::vector<char>& mask) const;
+    double cost() const;
+    bool needs_moon() const;
+  private:
+    std::vector<Constraint_Ptr> member;
+  };
+
+  //! Satisfied when any of its members is
+  class Or : public Constraint {
+  public:
+    //! Adds a member
+    Or& add(const Constraint_Ptr& con);
+    void apply(Evaluation& eval, std::vector<char>& mask) const;
+    double cost() const;
+    bool needs_moon() const;
+  private:
+    std::vector<Constraint_Ptr> member;
+  };
+
+  //! Builds a constraint from an expression such as "airmass(2) & sun(-15) & (moon(30) | phase(0.9,1.1))"
+  Constraint_Ptr parse_constraint(const std::string& expr);
+
+};
+
+#endif
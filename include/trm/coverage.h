@@ -0,0 +1,119 @@
+#ifndef TRM_OBSERVING_COVERAGE
+#define TRM_OBSERVING_COVERAGE
+
+#include <vector>
+#include "trm/subs.h"
+
+namespace Observing {
+
+  //! Orbital phase coverage accumulated from many observed intervals
+
+  /** Observing::Coverage accumulates observed phase ranges such as those
+   * derived from the lines of a .times file and works out how much of the
+   * orbit they cover, where the gaps are and how many times each phase has
+   * been observed. Ranges are folded into [0,1) as they are added, splitting
+   * any that wrap through phase 0 or span more than a cycle. compute() then
+   * sorts their end points and sweeps through them once, so n ranges cost
+   * O(n log n). Ranges flagged as taken in poor conditions count towards the
+   * totals but can be excluded from any of the queries.
+   */
+
+  class Coverage {
+  public:
+
+    //! A range of phase in [0,1) observed a given number of times
+    struct Segment {
+
+      //! Constructor
+      Segment(double lo, double hi, int nall, int ngood) :
+	lo(lo), hi(hi), nall(nall), ngood(ngood) {}
+
+      //! Lower phase limit
+      double lo;
+
+      //! Upper phase limit
+      double hi;
+
+      //! Number of times observed, whatever the conditions
+      int nall;
+
+      //! Number of times observed in good conditions
+      int ngood;
+    };
+
+    //! A gap in phase. hi may exceed 1 for gaps that run through phase 0
+    struct Gap {
+
+      //! Constructor
+      Gap(double lo, double hi) : lo(lo), hi(hi) {}
+
+      //! Start of the gap
+      double lo;
+
+      //! End of the gap
+      double hi;
+
+      //! Length in phase
+      double length() const {return hi-lo;}
+
+      //! For sorting into decreasing order of length
+      bool operator<(const Gap& gap) const {return length() > gap.length();}
+    };
+
+    //! Default constructor
+    Coverage() : ncycle(0), ncycle_good(0), nrange(0), ready(true) {
+      gaps_ready[0] = gaps_ready[1] = false;
+    }
+
+    //! Adds an observed phase range
+    void add(double p1, double p2, bool poor=false);
+
+    //! Clears everything
+    void clear();
+
+    //! Number of ranges added
+    size_t size() const {return nrange;}
+
+    //! Sorts and merges the ranges; called automatically by the queries
+    void compute();
+
+    //! Returns the segments in order of phase
+    const std::vector<Segment>& segments();
+
+    //! Fraction of the orbit observed at least once
+    double fraction(bool good_only=false);
+
+    //! Merged observed ranges, in order of phase
+    void intervals(std::vector<Gap>& ranges, bool good_only=false);
+
+    //! Unobserved phase ranges, longest first
+    void gaps(std::vector<Gap>& gap, bool good_only=false);
+
+    //! Fraction of the orbit not yet observed that a new phase range would cover
+    double gain(double p1, double p2, std::vector<Gap>& pieces, bool good_only=false);
+
+    //! Mean number of times each of nbin phase bins has been observed
+    void histogram(int nbin, std::vector<double>& hist, bool good_only=false);
+
+  private:
+
+    // Folded ranges; poor ones are marked
+    struct Range {
+      double lo, hi;
+      bool poor;
+    };
+
+    int ncycle, ncycle_good;
+    size_t nrange;
+    bool ready;
+    std::vector<Range> range;
+    std::vector<Segment> segment;
+
+    // gaps cached for gain, index 1 for good conditions only
+    bool gaps_ready[2];
+    std::vector<Gap> gap_cache[2];
+  };
+
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef TRM_OBSERVING_EPHEM_FIT
+#define TRM_OBSERVING_EPHEM_FIT
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace Observing {
+
+  //! The time of one event, such as the middle of an eclipse
+
+  struct Timing {
+
+    //! Default constructor
+    Timing() : cycle(0.), time(0.), error(1.) {}
+
+    //! Constructor
+    Timing(double cycle, double time, double error) : cycle(cycle), time(time), error(error) {}
+
+    //! Cycle number
+    double cycle;
+
+    //! Time of the event (days, e.g. a JD or MJD)
+    double time;
+
+    //! Uncertainty of the time, in the same units
+    double error;
+  };
+
+  //! Reads a file of timings, one "cycle time error" per line
+  void read_timings(const std::string& file, std::vector<Timing>& timings);
+
+  //! Weighted least-squares fit of a linear or quadratic ephemeris to timings
+
+  /** Observing::Ephem_Fit fits T = T0 + P E + Q E^2 (Q = 0 for a linear
+   * ephemeris) to times T of cycles E, weighted by the inverse squares of
+   * their uncertainties. Timings are added one at a time. Once there are
+   * enough of them the first solution comes from the normal equations;
+   * after that each new timing updates the coefficients and their
+   * covariance matrix by a rank-1 (Sherman-Morrison) update, and the
+   * chi-squared by the square of its prediction residual, so a fit kept in
+   * a file can take in a few new timings without going back over the old.
+   *
+   * The fit is made to times measured from a reference time and to cycles
+   * divided by a scale, both fixed when the fit is constructed, so that
+   * the quadratic term stays well conditioned far from cycle 0.
+   *
+   * A fit can be written to and read back from a stream, to carry it from
+   * one run to the next.
+   */
+
+  class Ephem_Fit {
+  public:
+
+    //! Constructor from the number of terms (2 for linear, 3 for quadratic), reference time and cycle scale
+    Ephem_Fit(int nterm=2, double tref=0., double escale=1.);
+
+    //! Adds a timing
+    void add(const Timing& timing);
+
+    //! Number of terms
+    int nterm() const {return nterms;}
+
+    //! Number of timings added
+    size_t size() const {return ntime;}
+
+    //! True once there have been enough timings for a solution
+    bool solved() const {return ok;}
+
+    //! Coefficient i: 0 = T0, 1 = period, 2 = quadratic term
+    double coeff(int i) const;
+
+    //! Covariance of coefficients i and j
+    double covar(int i, int j) const;
+
+    //! Uncertainty of coefficient i
+    double error(int i) const;
+
+    //! Chi-squared of the fit
+    double chisq() const {return chi2;}
+
+    //! Number of degrees of freedom
+    long dof() const {return long(ntime) - nterms;}
+
+    //! Time of a cycle predicted by the fit
+    double time(double cycle) const;
+
+    //! Observed minus calculated time of a timing
+    double oc(const Timing& timing) const {return timing.time - time(timing.cycle);}
+
+    //! Writes the state of the fit
+    friend std::ostream& operator<<(std::ostream& ostr, const Ephem_Fit& fit);
+
+    //! Reads the state of a fit, setting failbit if it cannot
+    friend std::istream& operator>>(std::istream& istr, Ephem_Fit& fit);
+
+  private:
+
+    int nterms;
+    double tref, escale;
+    size_t ntime;
+    bool ok;
+    double x[3], cov[3][3], chi2;
+
+    // timings kept until there are enough for a first solution
+    std::vector<Timing> pending;
+
+    // the basis functions at a cycle
+    void basis(double cycle, double a[3]) const;
+
+    // solves the normal equations of the pending timings
+    bool batch();
+  };
+
+  //! Writes the state of a fit
+  std::ostream& operator<<(std::ostream& ostr, const Ephem_Fit& fit);
+
+  //! Reads the state of a fit, setting failbit if it cannot
+  std::istream& operator>>(std::istream& istr, Ephem_Fit& fit);
+
+};
+
+#endif
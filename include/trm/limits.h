@@ -0,0 +1,95 @@
+#ifndef TRM_OBSERVING_LIMITS
+#define TRM_OBSERVING_LIMITS
+
+#include <string>
+#include <vector>
+#include "trm/subs.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+
+namespace Observing {
+
+  //! Where a telescope can point: horizon profile and hour angle and declination limits
+
+  /** Observing::Limits describes the parts of the sky a telescope can reach
+   * beyond a simple airmass cut: a minimum altitude that varies with azimuth
+   * because of the dome or nearby obstructions, limits on declination and
+   * limits on hour angle that may depend upon declination, as for many
+   * equatorial mounts. The horizon is held as a table at every degree of
+   * azimuth and the hour angle limits at every degree of declination, so
+   * that each test takes a few operations whatever the number of points
+   * used to describe them.
+   *
+   * Limits are read from a file with one entry per line:
+   *
+   *  horizon az alt   -- minimum altitude alt at azimuth az (degrees); linearly interpolated
+   *  dec dmin dmax    -- declination range, degrees
+   *  ha hmin hmax     -- hour angle range, hours
+   *  ha dec hmin hmax -- hour angle range at a given declination; linearly interpolated
+   *
+   * Blank lines and lines starting with # are ignored. Anything not given is
+   * not limited. Several lines of horizon and of ha with a declination make
+   * up the profile and the hour angle limits. This is the format of the
+   * files given to the limits parameter of eclipsers, gapfill, schedule and
+   * simnight.
+   */
+
+  class Limits {
+  public:
+
+    //! Default constructor: no limits
+    Limits();
+
+    //! Constructor from a file
+    Limits(const std::string& file);
+
+    //! Reads limits from a file
+    void load(const std::string& file);
+
+    //! True if there are no limits
+    bool empty() const {return none;}
+
+    //! Sets the horizon profile from points of azimuth and altitude, degrees
+    void set_horizon(const std::vector<double>& az, const std::vector<double>& alt);
+
+    //! Sets the declination limits, degrees
+    void set_dec(double dmin, double dmax);
+
+    //! Sets the hour angle limits as a function of declination
+    void set_ha(const std::vector<double>& dec, const std::vector<double>& hmin, const std::vector<double>& hmax);
+
+    //! Minimum altitude at an azimuth, degrees
+    double horizon(double az) const;
+
+    //! Steepest slope of the horizon profile, degrees of altitude per degree of azimuth
+    double horizon_slope() const {return hslope;}
+
+    //! Hour angle limits at a declination
+    void ha_limits(double dec, double& hmin, double& hmax) const;
+
+    //! True if a declination is within the limits
+    bool dec_ok(double dec) const {return dec >= dmin && dec <= dmax;}
+
+    //! How far inside the limits a target is, degrees, negative if outside
+    double margin(const Subs::Altaz& altaz, double dec, double altmin) const;
+
+  private:
+    bool none;
+    double dmin, dmax, hslope;
+    std::vector<double> hor;      // minimum altitude at az = 0, 1, .. 360
+    std::vector<double> hlo, hhi; // hour angle limits at dec = -90, -89, .. 90
+  };
+
+  //! Computes next time an object enters or leaves the reachable sky above a given altitude
+  bool startime(const Subs::Position& obj, const Subs::Telescope& tel, const Limits& limits,
+		const Subs::Time& start, double altaim, Subs::Time& found);
+
+  //! Calculates when an object is visible and within the limits of the telescope
+  bool when_visible(const Subs::Position& obj, const Subs::Telescope& telescope, const Limits& limits,
+		    const Subs::Time& tstart, const Subs::Time& tend, double airmass,
+		    Subs::Time& firstvis, Subs::Time& lastvis);
+
+};
+
+#endif
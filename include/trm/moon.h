@@ -0,0 +1,93 @@
+#ifndef TRM_OBSERVING_MOON
+#define TRM_OBSERVING_MOON
+
+#include <vector>
+#include "trm/subs.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+
+namespace Observing {
+
+  //! Position, altitude and illumination of the Moon at one time
+
+  struct Moon_Info {
+
+    //! Topocentric right ascension, hours, J2000
+    double ra;
+
+    //! Topocentric declination, degrees, J2000
+    double dec;
+
+    //! Altitude, degrees, without refraction
+    double alt;
+
+    //! Illuminated fraction of the disc, 0 to 1
+    double illum;
+  };
+
+  //! Computes the position, altitude and illumination of the Moon
+  Moon_Info moon(const Subs::Telescope& tel, const Subs::Time& time);
+
+  //! Angular separation between the Moon and an object, degrees
+  double separation(const Moon_Info& moon, const Subs::Position& obj);
+
+  //! The Moon over a night, interpolated
+
+  /** Observing::Moon evaluates the Moon with slalib at a set of equally spaced
+   * times over an interval, typically a night, and then interpolates between
+   * them with four-point Lagrange polynomials. The direction is interpolated
+   * as a unit vector along with the altitude and illumination, so that the
+   * separation from a target costs a dot product. With the default spacing
+   * of half an hour the interpolation errors are well under an arcminute,
+   * far smaller than any sensible separation limit. Times outside the interval
+   * are extrapolated, and become inaccurate more than an hour or so beyond it.
+   */
+
+  class Moon {
+  public:
+
+    //! Default constructor; call set before use
+    Moon() : t0(0.), dt(1.) {}
+
+    //! Constructor
+    Moon(const Subs::Telescope& tel, const Subs::Time& tstart, const Subs::Time& tend, double step=0.5);
+
+    //! Sets up the interpolation over an interval
+    void set(const Subs::Telescope& tel, const Subs::Time& tstart, const Subs::Time& tend, double step=0.5);
+
+    //! Moon at a UTC MJD
+    Moon_Info info(double mjd) const;
+
+    //! Altitude of the Moon at a UTC MJD, degrees
+    double altitude(double mjd) const;
+
+    //! Illuminated fraction of the Moon at a UTC MJD
+    double illumination(double mjd) const;
+
+    //! Angular separation between the Moon and an object at a UTC MJD, degrees
+    double separation(const Subs::Position& obj, double mjd) const;
+
+    //! True if the Moon is up and closer to an object than a limit
+    bool too_close(const Subs::Position& obj, double mjd, double minsep) const;
+
+  private:
+
+    // interpolation index and weights
+    void weights(double mjd, size_t& i, double w[4]) const;
+
+    // interpolated unit vector of the Moon
+    void direction(double mjd, double v[3]) const;
+
+    double t0, dt;
+    std::vector<double> x, y, z, alt, illum;
+  };
+
+  //! Calculates when an object is visible, away from the Moon
+  bool when_visible(const Subs::Position& obj, const Subs::Telescope& telescope,
+		    const Subs::Time& tstart, const Subs::Time& tend, double airmass,
+		    const Moon& moon, double moonsep, Subs::Time& firstvis, Subs::Time& lastvis);
+
+};
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef TRM_OBSERVING_NETWORK
+#define TRM_OBSERVING_NETWORK
+
+#include <vector>
+#include "trm/subs.h"
+#include "trm/date.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+#include "trm/ephem.h"
+#include "trm/observing.h"
+
+namespace Observing {
+
+  //! Visibility of targets from several telescopes over the same run
+
+  /** Observing::Network handles a set of telescopes observing the same
+   * targets over a range of dates. The work is split into what depends
+   * upon the site and what does not, so that the latter is only done once
+   * however many sites there are. The nights of each site are found once
+   * when the Network is built and shared by all targets. For each target,
+   * the times of a given orbital phase over the whole run are then
+   * computed once, with the heliocentric or barycentric correction
+   * evaluated once a day and interpolated (the correction changes by
+   * no more than ~10 seconds a day and the difference between sites is
+   * tens of milliseconds at most), while each site only has to find the
+   * window during which the target is up in each of its nights. Deciding
+   * which sites see an event is then a look-up in these windows.
+   */
+
+  class Network {
+  public:
+
+    //! A time interval, start and end UTC MJD
+    typedef std::pair<double,double> Interval;
+
+    //! A time of the phase of interest and the sites from which it can be seen
+    struct Event {
+
+      //! Cycle number plus phase
+      double cycle;
+
+      //! UTC MJD
+      double mjd;
+
+      //! Indices of the sites that can see it
+      std::vector<size_t> site;
+    };
+
+    //! Constructor
+    Network(const std::vector<Subs::Telescope>& sites, const Subs::Date& start, const Subs::Date& end, double sunalt);
+
+    //! Number of sites
+    size_t size() const {return tel.size();}
+
+    //! Site i
+    const Subs::Telescope& site(size_t i) const {return tel[i];}
+
+    //! Dark periods of site i, one per night found
+    const std::vector<Interval>& dark(size_t i) const {return drk[i];}
+
+    //! Start of the earliest night at any site, UTC MJD
+    double first() const {return tfirst;}
+
+    //! End of the latest night at any site, UTC MJD
+    double last() const {return tlast;}
+
+    //! Periods during which a target is visible, for every site
+    void windows(const Subs::Position& obj, double airmass, std::vector<std::vector<Interval> >& win) const;
+
+    //! Times of a given phase over the run, and the sites that see them
+    void events(const Subs::Position& obj, const Subs::Ephem& eph, double phase,
+		const std::vector<std::vector<Interval> >& win, std::vector<Event>& ev) const;
+
+  private:
+    std::vector<Subs::Telescope> tel;
+    std::vector<std::vector<Interval> > drk;
+    double tfirst, tlast;
+  };
+
+};
+
+#endif
@@ -2,9 +2,11 @@
 #define TRM_OBSERVING
 
 #include "trm/subs.h"
+#include "trm/date.h"
 #include "trm/telescope.h"
 #include "trm/time.h"
 #include "trm/position.h"
+#include "trm/ephem.h"
 
 //! Namespace of observing related routines
 
@@ -20,6 +22,9 @@ namespace Observing {
   //! Environment variable for switching directory for command defaults
   const char OBSERVING_ENV[] = "OBSERVING_ENV";
 
+  //! Offset to convert an MJD to a JD
+  const double MJD2JD = 2400000.5;
+
   //! An exception class.
 
   /** Observing::Observing_Error is the error class for the Observing programs.
@@ -35,9 +40,25 @@ namespace Observing {
     Observing_Error(const std::string& err) : std::string(err) {} 
   };
 
+  //! How the position of the Sun is computed
+
+  /** FULL_SUN uses the solar ephemeris of Subs::Position::set_to_sun, good
+   * to well under an arcsecond. FAST_SUN uses a short analytic series (see
+   * fast_sun), good to about an arcminute, which is ample for twilight and
+   * costs far less, so it is worth using when finding the nights of a long
+   * run of dates.
+   */
+  enum Sun_Model {FULL_SUN, FAST_SUN};
+
+  //! Low-precision RA and declination of the Sun (radians, equinox of date) at a TT
+  void fast_sun(double tt, double& ra, double& dec);
+
+  //! Position of the Sun in the sky at a given time and place
+  Subs::Altaz sun_altaz(const Subs::Telescope& tel, const Subs::Time& time, Sun_Model model=FULL_SUN);
+
   //! Computes next rise or set time of the Sun
   bool suntime(const Subs::Telescope& tel, const Subs::Time& start, double altaim, 
-	       Subs::Time& found);
+	       Subs::Time& found, Sun_Model model=FULL_SUN);
 
   //! Computes next rise or set time of a star
   bool startime(const Subs::Position& obj, const Subs::Telescope& tel, const Subs::Time& start, 
@@ -48,6 +69,42 @@ namespace Observing {
 		    const Subs::Time& tstart, const Subs::Time& tend, double airmass,
 		    Subs::Time& firstvis, Subs::Time& lastvis);
 
+  //! Offset in days to put a UTC MJD onto the timescale of an ephemeris
+  double tcorr(const Subs::Position& obj, const Subs::Ephem& eph, const Subs::Time& time, 
+	       const Subs::Telescope& tel);
+
+  //! Returns true if an ephemeris is expressed as a JD rather than an MJD
+  bool is_jd(const Subs::Ephem& eph);
+
+  //! Orbital phase at a UTC time
+  double time_to_phase(const Subs::Position& obj, const Subs::Ephem& eph, const Subs::Time& time, 
+		       const Subs::Telescope& tel);
+
+  //! UTC MJD at which a given orbital phase occurs
+  double phase_to_time(const Subs::Position& obj, const Subs::Ephem& eph, double phase, 
+		       const Subs::Telescope& tel);
+
+  //! The times that define a night
+
+  struct Night {
+
+    //! Sunset (Sun at -1 degrees)
+    Subs::Time sunset;
+
+    //! End of evening twilight
+    Subs::Time twiend;
+
+    //! Start of morning twilight
+    Subs::Time twistart;
+
+    //! Sunrise (Sun at -1 degrees)
+    Subs::Time sunrise;
+  };
+
+  //! Computes sunset, twilight and sunrise for the night starting on a given date
+  bool night(const Subs::Telescope& tel, const Subs::Date& date, double sunalt, Night& night,
+	     Sun_Model model=FULL_SUN);
+
 };
 
 #endif
@@ -0,0 +1,81 @@
+#ifndef TRM_OBSERVING_PRECISE_EPHEM
+#define TRM_OBSERVING_PRECISE_EPHEM
+
+#include <cmath>
+#include "trm/subs.h"
+#include "trm/ephem.h"
+
+namespace Observing {
+
+  //! Conversions between time and orbital phase that keep their precision far from T0
+
+  /** Observing::Precise_Ephem converts between times and orbital phases
+   * with the whole number of cycles held apart from the fraction of a
+   * cycle, and T0 held as an MJD in two parts. Working through a JD and a
+   * single double, as Subs::Ephem::phase and time do, the resolution of
+   * a time is about 40 microseconds and that of a phase shrinks as the
+   * cycle count grows; here a time is good to a few microseconds (the
+   * resolution of an MJD) and the fraction of a cycle to the precision of
+   * a double however many cycles have passed. The products of the period
+   * and the cycle number are formed exactly with fma, so this costs only a
+   * few more floating point operations than the plain calculation, with no
+   * long double.
+   *
+   * The coefficients (T0, period and any quadratic term) are recovered from
+   * Subs::Ephem::time at cycles far either side of T0 when the object is
+   * constructed; the timescale is that of the ephemeris, but with times
+   * always as MJDs, whether the ephemeris is in JD or MJD.
+   */
+
+  class Precise_Ephem {
+  public:
+
+    //! Default constructor: T0 = 0, period = 1
+    Precise_Ephem() : t0hi(0.), t0lo(0.), period(1.), quad(0.) {}
+
+    //! Constructor from an ephemeris
+    Precise_Ephem(const Subs::Ephem& eph);
+
+    //! Splits the phase at an MJD (on the timescale of the ephemeris) into cycle and fraction
+    void phase(double mjd, long& cycle, double& frac) const;
+
+    //! Phase at an MJD (on the timescale of the ephemeris)
+    double phase(double mjd) const {
+      long cycle;
+      double frac;
+      phase(mjd, cycle, frac);
+      return double(cycle) + frac;
+    }
+
+    //! MJD (on the timescale of the ephemeris) of a cycle number plus a fraction of a cycle
+    double time(long cycle, double frac) const;
+
+    //! MJD (on the timescale of the ephemeris) of a phase
+    double time(double phase) const {
+      double cycle = floor(phase);
+      return time(long(cycle), phase-cycle);
+    }
+
+    //! First cycle of a given phase at or after an MJD
+    long first(double mjd, double phase) const {
+      long cycle;
+      double frac;
+      this->phase(mjd, cycle, frac);
+      return frac > phase ? cycle + 1 : cycle;
+    }
+
+    //! Last cycle of a given phase at or before an MJD
+    long last(double mjd, double phase) const {
+      long cycle;
+      double frac;
+      this->phase(mjd, cycle, frac);
+      return frac < phase ? cycle - 1 : cycle;
+    }
+
+  private:
+    double t0hi, t0lo, period, quad;
+  };
+
+};
+
+#endif
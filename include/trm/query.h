@@ -0,0 +1,134 @@
+#ifndef TRM_OBSERVING_QUERY
+#define TRM_OBSERVING_QUERY
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include "trm/subs.h"
+#include "trm/date.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/observing.h"
+#include "trm/batch.h"
+#include "trm/catalogue.h"
+
+namespace Observing {
+
+  //! Answers one-line queries on a catalogue, keeping what it works out for the next
+
+  /** Observing::Query holds a catalogue and a telescope and answers queries
+   * put to it as lines of text, such as the times of a given phase over a
+   * range of nights or the airmasses and phases of the targets at a given
+   * time. It is meant to stay in memory across many queries, in a server or
+   * a batch run, so the catalogue is read and the telescope set up once, and
+   * the almanac of each night (sunset, twilight and sunrise) is kept once
+   * found, along with the times each target is visible that night and the
+   * timescale corrections of each target used to find the times of phases.
+   * Each of these is only computed when first asked for.
+   *
+   * A query is a command followed by its arguments, separated by blanks.
+   * Arguments of the form key=value set the limits of that query only:
+   * airmass=A for the maximum airmass, sunalt=S for the maximum altitude of
+   * the Sun and step=M for the interval in minutes of the airmass command.
+   * Dates are single words such as 1/5/2002, times are UTC MJDs or
+   * 'now'. Anything left over after the arguments is the name of a target
+   * to restrict the answer to; without it every target is included. The
+   * commands are:
+   *
+   *  stars                         -- index, 1 or 0 for whether it has an ephemeris, name
+   *  night date                    -- sunset, end of twilight, start of twilight, sunrise (MJD)
+   *  visible date [star]           -- first and last times visible (MJD), name
+   *  ephemeris date1 date2 phase [star] -- MJD, cycle, phase error, airmass, Sun's altitude, name
+   *  status time [star]            -- a line of MJD and Sun's altitude, then hour angle,
+   *                                   airmass, PA, azimuth, phase, phase error, name
+   *  airmass date [star]           -- MJD, airmass, name from sunset to sunrise while the
+   *                                   target is up, every step=M minutes (default 10)
+   *  reload                        -- reads the catalogue again
+   *  help                          -- lists the commands
+   *  quit                          -- ends the session
+   *
+   * Each answer is any number of lines of data, with the name of the target
+   * at the end of those that refer to one, then a line 'ok', or a line
+   * 'error' followed by a message if the query could not be answered.
+   * Phases of targets without ephemerides are given as '-'.
+   *
+   * Queries can also be read from a stream in bulk with batch, each line
+   * starting with a tag that is put at the start of every line of its
+   * answer, so that answers can be matched to queries.
+   */
+
+  class Query {
+  public:
+
+    //! Constructor
+    Query(const std::string& stars, const std::string& telescope, double airmass, double sunalt,
+	  Sun_Model model=FULL_SUN, int nthread=0);
+
+    //! Constructor from a catalogue already loaded, which must outlive the Query and cannot be reloaded
+    Query(const Catalogue& catalogue, const Subs::Telescope& telescope, double airmass, double sunalt,
+	  Sun_Model model=FULL_SUN, int nthread=0);
+
+    //! Answers a query, returning false if it ends the session
+    bool answer(const std::string& line, std::ostream& ostr);
+
+    //! Answers tagged queries read from a stream, putting each after a command
+    void batch(std::istream& istr, std::ostream& ostr, const std::string& command="");
+
+    //! Reads the catalogue again, dropping everything that depends upon it
+    void reload();
+
+    //! The catalogue
+    const Catalogue& catalogue() const {return *cat;}
+
+    //! The telescope
+    const Subs::Telescope& telescope() const {return tel;}
+
+  private:
+
+    // what is known about one night at one Sun altitude
+    struct Almanac {
+      bool ok;
+      Night night;
+      double vairmass;               // airmass limit of vis; 0 if not yet found
+      std::vector<Visibility> vis;
+      std::vector<double> off;       // timescale corrections at mid-night, days
+      std::vector<char> hasoff;
+    };
+
+    // arguments, limits and targets of one query
+    struct Request {
+      std::vector<std::string> arg;
+      double airmass, sunalt, step;
+      std::vector<size_t> star;
+    };
+
+    std::string stars;
+    Subs::Telescope tel;
+    double airmass, sunalt;
+    Sun_Model model;
+    int nthread;
+    Catalogue own;                 // the catalogue when read from stars
+    const Catalogue* cat;          // the catalogue in use, own or the caller's
+    std::map<std::pair<long,double>,Almanac> almanacs;
+
+    // cat may point to own, so a copy would point to the wrong one
+    Query(const Query&);
+    Query& operator=(const Query&);
+
+    void load();
+    Almanac& almanac(const Subs::Date& date, double sunalt);
+    const std::vector<Visibility>& visible(Almanac& alm, double airmass);
+    double offset(Almanac& alm, size_t j);
+    Request parse(const std::vector<std::string>& word, size_t nfixed);
+
+    void night(const std::vector<std::string>& word, std::ostream& ostr);
+    void visible(const std::vector<std::string>& word, std::ostream& ostr);
+    void ephemeris(const std::vector<std::string>& word, std::ostream& ostr);
+    void status(const std::vector<std::string>& word, std::ostream& ostr);
+    void airmasses(const std::vector<std::string>& word, std::ostream& ostr);
+  };
+
+};
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef TRM_OBSERVING_SCHEDULER
+#define TRM_OBSERVING_SCHEDULER
+
+#include <vector>
+#include "trm/subs.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+#include "trm/ephem.h"
+#include "trm/observing.h"
+#include "trm/coverage.h"
+#include "trm/limits.h"
+
+namespace Observing {
+
+  //! Assigns blocks of time over a run to maximise weighted phase coverage
+
+  /** Observing::Scheduler plans a run of several nights at one telescope. Each
+   * target has a range of orbital phase that it is wanted over and a
+   * priority; the aim is to maximise the sum over targets of priority times
+   * the fraction of the wanted range that gets covered. Each block of time
+   * costs a fixed overhead for acquisition, and blocks cannot overlap.
+   *
+   * The visibility window of every target on every night is computed once,
+   * when the night is added. Planning starts with a greedy pass that
+   * repeatedly takes the block giving the most coverage per hour, and
+   * then improves the plan by local search, removing each block in turn and
+   * refilling greedily, keeping the change if the objective goes up (and
+   * otherwise putting back just the nights and targets it altered). Blocks
+   * on the same target that end up back to back are finally joined. The
+   * best block of each target on each night is cached and only re-evaluated
+   * for the night and the target that the last block changed. Nights can be
+   * removed and the run re-planned quickly, e.g. after losing one to the
+   * weather.
+   */
+
+  class Scheduler {
+  public:
+
+    //! A scheduled block of time
+    struct Block {
+
+      //! Index of the target
+      size_t target;
+
+      //! Index of the night
+      size_t night;
+
+      //! UTC MJD at which the overhead starts
+      double start;
+
+      //! UTC MJD at which data taking starts
+      double t1;
+
+      //! UTC MJD at which data taking ends
+      double t2;
+
+      //! Start phase (cycle plus phase)
+      double p1;
+
+      //! End phase
+      double p2;
+
+      //! Increase in the objective due to this block when it was added
+      double gain;
+
+      //! Score used in the greedy choice (gain per hour)
+      double score;
+
+      //! For sorting into time order
+      bool operator<(const Block& block) const {return start < block.start;}
+    };
+
+    //! Constructor
+    Scheduler(const Subs::Telescope& tel, double airmass, double overhead, double minblock,
+	      const Limits& limits=Limits());
+
+    //! Adds a target wanted over a range of phase
+    size_t add_target(const Subs::Position& obj, const Subs::Ephem& eph,
+		      double pstart, double pend, double priority);
+
+    //! Marks phases of a target as already observed
+    void add_observed(size_t target, double p1, double p2);
+
+    //! Sets the number of threads used for the visibilities, 0 for one per core
+    void set_threads(int nthread) {nthr = nthread;}
+
+    //! Adds a night, computing the visibility of every target in it
+    size_t add_night(const Night& night);
+
+    //! Removes a night from the plan (it stays in the numbering)
+    void remove_night(size_t night);
+
+    //! Plans the run
+    void plan(int niter);
+
+    //! Returns the blocks, in time order
+    std::vector<Block> blocks() const;
+
+    //! Returns the value of the objective
+    double objective() const {return total;}
+
+    //! Fraction of the wanted phase range of a target that is covered
+    double covered(size_t target) const;
+
+  private:
+
+    struct Target {
+      const Subs::Position* obj;
+      const Subs::Ephem*    eph;
+      double wanted, priority;
+      std::vector<Coverage::Gap> observed;
+    };
+
+    struct Free {
+      Free(double t1, double t2) : t1(t1), t2(t2) {}
+      double t1, t2;
+    };
+
+    // Best candidate block for a target on a night
+    bool best_block(size_t target, size_t night, Block& block);
+
+    // Greedy filling of the current free time
+    void fill();
+
+    // Rebuilds coverage, free time and the objective from the blocks
+    void rebuild();
+
+    // Takes a block out of the free time of its night
+    void occupy(const Block& block);
+
+    // Saves the state of a night and of a target before a trial move of the
+    // local search first changes them
+    void save(size_t night, size_t target);
+
+    // Ends a trial move, putting back what it changed unless it is kept
+    void end_trial(bool keep);
+
+    Subs::Telescope telescope;
+    Limits limits;
+    double airmass, overhead, minblock;
+    int nthr;
+    std::vector<Target> target;
+    std::vector<Night>  night;
+    std::vector<bool>   active;
+
+    // visible window of each target on each night, [night][target], start > end if never
+    std::vector<std::vector<Free> > window;
+
+    // current state
+    std::vector<Block> block;
+    std::vector<std::vector<Free> > free;
+    std::vector<Coverage> coverage;
+    std::vector<double> gained;
+    double total;
+
+    // cache of best candidate per [night][target]
+    std::vector<std::vector<Block> > cand;
+    std::vector<std::vector<char> >  cand_ok, cand_stale;
+
+    // state of a night (free time, candidates) or of a target (coverage,
+    // candidates) as it was before the current trial move changed it
+    struct Saved {
+      bool is_night;
+      size_t index;
+      std::vector<Free> free;
+      Coverage coverage;
+      double gained;
+      std::vector<Block> cand;
+      std::vector<char> cand_ok, cand_stale;
+    };
+    bool trial;
+    std::vector<Saved> saved;
+    std::vector<char> night_saved, target_saved;
+  };
+
+};
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef TRM_OBSERVING_SIMULATOR
+#define TRM_OBSERVING_SIMULATOR
+
+#include <vector>
+#include <random>
+#include "trm/subs.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+#include "trm/observing.h"
+#include "trm/limits.h"
+
+namespace Observing {
+
+  //! Discrete-event simulation of a night spent on a sequence of targets
+
+  /** Observing::Simulator steps through a night in which a list of targets
+   * is observed in a fixed order, each with an acquisition overhead and a
+   * number of exposures of given length and readout time. Rather than
+   * stepping in time, it jumps from event to event (start of the night,
+   * acquisition over, target rising or setting, cloud arriving or clearing,
+   * end of the night) held in a priority queue. The visibility window of
+   * each target is found once, with when_visible, when it is added, so that
+   * each simulated night costs only a few dozen heap operations and
+   * thousands of nights with random weather can be run in well under a
+   * second.
+   *
+   * There are two ways of running. By default the sequence is followed
+   * blindly from the end of evening twilight until sunrise and any data
+   * taken above the airmass limit or after the start of morning twilight
+   * are flagged. In strict mode the observer waits for each target to rise
+   * and stops it when it sets or morning twilight starts, skipping
+   * targets that cannot get even one exposure.
+   *
+   * Weather is a two-state Markov process: spells of clear and cloudy sky
+   * have exponentially distributed lengths with given means. Cloud stops the
+   * current exposure, which is lost; once it clears the target is acquired
+   * again and its remaining exposures taken.
+   */
+
+  class Simulator {
+  public:
+
+    //! Outcome of a visit
+    enum Status {
+      DONE,        /**< all exposures taken */
+      PARTIAL,     /**< some but not all exposures taken */
+      SKIPPED,     /**< none taken because the target could not be observed when its turn came */
+      NOT_REACHED  /**< the night ended before its turn came */
+    };
+
+    //! Flags for broken constraints
+    enum {
+      AIRMASS = 1, /**< some data were taken above the airmass limit */
+      SUN     = 2  /**< some data were taken after morning twilight started */
+    };
+
+    //! What happened to one visit in a simulated night
+    struct Result {
+
+      //! Default constructor
+      Result() : start(0.), t1(0.), t2(0.), nexp(0), nacq(0), status(NOT_REACHED), flags(0) {}
+
+      //! UTC MJD at which acquisition first started
+      double start;
+
+      //! UTC MJD at which the first exposure started
+      double t1;
+
+      //! UTC MJD at which the last exposure finished
+      double t2;
+
+      //! Number of exposures taken
+      int nexp;
+
+      //! Number of times the target was acquired
+      int nacq;
+
+      //! Outcome
+      Status status;
+
+      //! Constraints broken, a combination of AIRMASS and SUN
+      int flags;
+    };
+
+    //! Weather model
+    struct Weather {
+
+      //! Constructor. Means of zero give a permanently clear sky.
+      Weather(double clear=0., double cloudy=0.) : clear(clear), cloudy(cloudy) {}
+
+      //! Mean length of clear spells, hours
+      double clear;
+
+      //! Mean length of cloudy spells, hours
+      double cloudy;
+    };
+
+    //! Constructor
+    Simulator(const Subs::Telescope& tel, const Night& night, double airmass, bool strict,
+	      const Limits& limits=Limits());
+
+    //! Adds a visit to the end of the sequence
+    size_t add(const Subs::Position& obj, int nexp, double expose, double readout, double acquire);
+
+    //! Number of visits
+    size_t size() const {return visit.size();}
+
+    //! Simulates the night
+    double run(const Weather& weather, std::mt19937& rng, std::vector<Result>& results) const;
+
+  private:
+
+    struct Visit {
+      double first, last;   // visibility window, UTC MJD; first > last if never visible
+      int    nexp;
+      double cycle, expose, acquire; // days
+    };
+
+    Subs::Telescope telescope;
+    Limits limits;
+    Night  nit;
+    double airmass;
+    bool   strict;
+    std::vector<Visit> visit;
+  };
+
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef TRM_OBSERVING_STATS
+#define TRM_OBSERVING_STATS
+
+#include <string>
+#include <iostream>
+
+namespace Observing {
+
+  //! Counters and timers of where a run spends its time
+
+  /** Observing::Stats keeps counts of the expensive calls made in the
+   * library and programs (positions in the sky, positions of the Sun,
+   * steps of bisection, timescale corrections and bytes of files parsed)
+   * and the wall-clock time spent in each phase of a program. Each thread
+   * counts into its own block so that counting costs an increment and no
+   * locking. Counts are only made when the package is configured with
+   * --enable-stats, which defines OBSERVING_STATS; otherwise the
+   * OBSERVING_COUNT and OBSERVING_TIME macros expand to nothing, and the
+   * report says that there is nothing to show.
+   */
+
+  namespace Stats {
+
+    //! The things counted
+    enum Counter {
+      ALTAZ,       //!< positions of a target in the sky
+      SUN_FULL,    //!< positions of the Sun from the full solar ephemeris
+      SUN_FAST,    //!< positions of the Sun from the low-precision series
+      BISECT,      //!< steps of bisection for rise, set and twilight times
+      TCORR_HEL,   //!< heliocentric corrections
+      TCORR_BAR,   //!< barycentric corrections
+      PARSE_BYTES, //!< bytes of input files parsed
+      NCOUNTER
+    };
+
+    //! The phases of a program that are timed
+    enum Phase {
+      LOAD,        //!< reading the targets
+      NIGHTS,      //!< finding sunset, twilight and sunrise
+      VISIBILITY,  //!< finding when targets can be observed
+      EVENTS,      //!< computing phases and times of events
+      OUTPUT,      //!< printing and plotting
+      NPHASE
+    };
+
+    //! True if the counters were compiled in
+    bool enabled();
+
+    //! Adds n to a counter of the calling thread
+    void add(Counter counter, unsigned long n=1);
+
+    //! Total of a counter over all threads
+    unsigned long count(Counter counter);
+
+    //! Time spent in a phase, seconds
+    double seconds(Phase phase);
+
+    //! Adds time to a phase
+    void add_time(Phase phase, double seconds);
+
+    //! Times a phase from construction to destruction
+    class Timer {
+    public:
+
+      //! Constructor: starts the clock
+      Timer(Phase phase);
+
+      //! Destructor: adds the time since construction to the phase
+      ~Timer();
+
+    private:
+      Phase phase;
+      double start;
+      Timer(const Timer&);
+      Timer& operator=(const Timer&);
+    };
+
+    //! Reports the counts and times as a table, or as JSON
+    void report(std::ostream& ostr, bool json);
+
+    //! Reports according to the value of a program's 'stats' parameter: none, text or json
+    void report(const std::string& mode);
+  }
+};
+
+#ifdef OBSERVING_STATS
+#define OBSERVING_COUNT(counter)      Observing::Stats::add(Observing::Stats::counter)
+#define OBSERVING_COUNT_N(counter, n) Observing::Stats::add(Observing::Stats::counter, n)
+#define OBSERVING_TIME(phase)         Observing::Stats::Timer observing_timer_##phase(Observing::Stats::phase)
+#else
+#define OBSERVING_COUNT(counter)
+#define OBSERVING_COUNT_N(counter, n)
+#define OBSERVING_TIME(phase)
+#endif
+
+#endif
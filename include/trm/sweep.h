@@ -0,0 +1,55 @@
+#ifndef TRM_OBSERVING_SWEEP
+#define TRM_OBSERVING_SWEEP
+
+#include <vector>
+#include "trm/subs.h"
+
+namespace Observing {
+
+  //! Totals over a grid of airmass and Sun altitude limits from one pass
+
+  /** Observing::Sweep answers "how much would pass these limits?" for a
+   * whole grid of maximum airmass and maximum Sun altitude at once. Each
+   * sample (an event, or a slice of time) is added with its airmass, the
+   * altitude of the Sun and a weight. Since a sample that passes a pair of
+   * limits also passes any looser pair, it is enough to bin each sample at
+   * the tightest limits it passes and then form cumulative sums along both
+   * axes, so n samples and a grid of m limits cost O(n log m + m) rather
+   * than O(nm). The airmass and Sun altitude of each sample need be
+   * computed only once however many limits are tried.
+   */
+
+  class Sweep {
+  public:
+
+    //! Constructor
+    Sweep(const std::vector<double>& airmass, const std::vector<double>& sunalt);
+
+    //! Adds a sample
+    void add(double airmass, double sunalt, double weight=1.);
+
+    //! Removes all samples
+    void clear();
+
+    //! Number of airmass limits
+    size_t nairmass() const {return alim.size();}
+
+    //! Number of Sun altitude limits
+    size_t nsunalt() const {return slim.size();}
+
+    //! Total weight of the samples passing the ia-th airmass limit and is-th Sun limit
+    double total(size_t ia, size_t is) const;
+
+  private:
+
+    std::vector<double> alim, slim;
+
+    // weight binned at the tightest limits passed, then cumulated on demand
+    std::vector<double> bin;
+    mutable std::vector<double> cum;
+    mutable bool stale;
+  };
+
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef TRM_OBSERVING_TIMELINE
+#define TRM_OBSERVING_TIMELINE
+
+#include <vector>
+#include <queue>
+#include "trm/subs.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+#include "trm/ephem.h"
+
+namespace Observing {
+
+  //! A single phase event of one of the stars of a Timeline
+
+  struct Event {
+
+    //! Default constructor
+    Event() : star(0), cycle(0.), pherr(0.), airmass(0.), sunalt(0.) {}
+
+    //! UTC time of the event
+    Subs::Time time;
+
+    //! Index of the star, in the order in which stars were added to the Timeline
+    size_t star;
+
+    //! Cycle number plus phase, i.e. the orbital 'phase' of the event
+    double cycle;
+
+    //! Uncertainty in the phase
+    double pherr;
+
+    //! Airmass of the star at the event
+    double airmass;
+
+    //! Altitude of the Sun at the event (degrees, including refraction)
+    double sunalt;
+  };
+
+  //! Merged, time-ordered stream of phase events over a set of binaries
+
+  /** Observing::Timeline generates the times at which each of a set of
+   * binary stars passes through a given orbital phase and merges them into
+   * a single time-ordered stream. Events are generated lazily, one per star
+   * at a time, with the earliest pending event of each star held in a heap
+   * so that extracting the next event across N stars costs O(log N). The
+   * stream can be filtered by airmass and altitude of the Sun so that it
+   * only returns events that can be observed. Nothing is computed beyond the
+   * events actually requested.
+   *
+   * The Timeline keeps references to the positions and ephemerides added to
+   * it, so these must outlive it.
+   */
+
+  class Timeline {
+  public:
+
+    //! Constructor
+    Timeline(const Subs::Telescope& tel, double phase, double airmass, double sunalt);
+
+    //! Adds a star to the timeline
+    void add(const Subs::Position& obj, const Subs::Ephem& eph);
+
+    //! Number of stars
+    size_t size() const {return source.size();}
+
+    //! Sets the number of threads used by start, 0 for one per core
+    void set_threads(int nthread) {nthr = nthread;}
+
+    //! Positions the timeline at a given time
+    void start(const Subs::Time& time);
+
+    //! Returns the next event, observable or not
+    bool next(const Subs::Time& tend, Event& event);
+
+    //! Returns the next observable event
+    bool next_observable(const Subs::Time& tend, Event& event);
+
+    //! Returns up to nmax observable events between two times
+    size_t query(const Subs::Time& tstart, const Subs::Time& tend, size_t nmax,
+		 std::vector<Event>& events);
+
+  private:
+
+    // The next pending event of one star
+    struct Pending {
+      double mjd;
+      size_t star;
+      bool operator>(const Pending& other) const {
+	return mjd > other.mjd || (mjd == other.mjd && star > other.star);
+      }
+    };
+
+    // Per-star information
+    struct Source {
+      const Subs::Position* obj;
+      const Subs::Ephem*    eph;
+      long cycle;
+    };
+
+    // Computes the UTC MJD of the current cycle of a source
+    double event_mjd(const Source& src) const;
+
+    Subs::Telescope telescope;
+    double phase, airmass, sunalt;
+    int nthr;
+    std::vector<Source> source;
+    std::priority_queue<Pending, std::vector<Pending>, std::greater<Pending> > heap;
+    Subs::Position Sun;
+  };
+
+};
+
+#endif
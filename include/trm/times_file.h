@@ -0,0 +1,58 @@
+#ifndef TRM_OBSERVING_TIMES_FILE
+#define TRM_OBSERVING_TIMES_FILE
+
+#include <string>
+#include <vector>
+#include "trm/subs.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+#include "trm/ephem.h"
+#include "trm/precise_ephem.h"
+
+namespace Observing {
+
+  //! An observed range of orbital phase, from one line of a .times file
+
+  struct Phase_Range {
+
+    //! Default constructor
+    Phase_Range() : p1(0.), p2(0.), poor(false) {}
+
+    //! Constructor
+    Phase_Range(double p1, double p2, bool poor) : p1(p1), p2(p2), poor(poor) {}
+
+    //! Start phase
+    double p1;
+
+    //! End phase
+    double p2;
+
+    //! Taken in poor conditions
+    bool poor;
+  };
+
+  //! Reads the observed phase ranges from a .times file
+  bool read_times(const std::string& file, const Subs::Position& obj, const Subs::Ephem& eph,
+		  const Subs::Telescope& tel, std::vector<Phase_Range>& ranges);
+
+  //! Reads a .times file, re-using phases cached by earlier reads
+  bool read_times_cached(const std::string& file, const Subs::Position& obj, const Subs::Ephem& eph,
+			 const Subs::Telescope& tel, std::vector<Phase_Range>& ranges);
+
+  //! Parses .times lines held in memory into phase ranges
+  size_t parse_times(const char* buff, size_t nbyte, const std::string& file,
+		     const Subs::Position& obj, const Subs::Ephem& eph,
+		     const Subs::Telescope& tel, std::vector<Phase_Range>& ranges);
+
+  //! Converts a UTC time interval into a range of orbital phase
+  Phase_Range phase_range(double mjd1, double mjd2, bool poor, const Subs::Position& obj,
+			  const Subs::Ephem& eph, const Subs::Telescope& tel);
+
+  //! As above, with the ephemeris also set up for precise conversions
+  Phase_Range phase_range(double mjd1, double mjd2, bool poor, const Subs::Position& obj,
+			  const Subs::Ephem& eph, const Precise_Ephem& peph, const Subs::Telescope& tel);
+
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef TRM_OBSERVING_TRACE
+#define TRM_OBSERVING_TRACE
+
+#include <string>
+#include <iostream>
+
+namespace Observing {
+
+  //! Spans of time on each thread, written in the Chrome trace-event format
+
+  /** Observing::Trace records when spans of work (loading targets, finding
+   * sunset on one night, computing one target, output) start and stop on
+   * each thread, so that a run can be laid out on a timeline by
+   * chrome://tracing or Perfetto to see where threads stall or run out of
+   * work. Tracing is off until start() is called; a span then costs two
+   * reads of the clock and a store into a ring buffer belonging to its
+   * thread, with no locking. When a buffer fills, the oldest spans of that
+   * thread are overwritten and counted as dropped.
+   */
+
+  namespace Trace {
+
+    //! Switches tracing on, keeping up to capacity spans per thread
+    void start(const std::string& file, size_t capacity=65536);
+
+    //! True while tracing
+    bool active();
+
+    //! Switches tracing off and writes the spans to the file given to start
+    void stop();
+
+    //! Writes the spans recorded so far as a trace-event JSON object
+    void write(std::ostream& ostr);
+
+    //! A span lasting from construction to destruction
+    class Span {
+    public:
+
+      //! Constructor: name must be a string literal, arg an index such as a target or night, -1 for none
+      Span(const char* name, long arg=-1);
+
+      //! Destructor: records the span
+      ~Span();
+
+    private:
+      const char* name;
+      long arg;
+      double begin;
+      Span(const Span&);
+      Span& operator=(const Span&);
+    };
+  }
+};
+
+// Spans are named after the line they start on so that one can follow another in a scope
+#define OBSERVING_SPAN_VAR2(line) observing_span_##line
+#define OBSERVING_SPAN_VAR(line)  OBSERVING_SPAN_VAR2(line)
+#define OBSERVING_SPAN(name)      Observing::Trace::Span OBSERVING_SPAN_VAR(__LINE__)(name)
+#define OBSERVING_SPAN_N(name, n) Observing::Trace::Span OBSERVING_SPAN_VAR(__LINE__)(name, long(n))
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef TRM_OBSERVING_TRACK
+#define TRM_OBSERVING_TRACK
+
+#include <string>
+#include <vector>
+#include "trm/subs.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+#include "trm/batch.h"
+
+namespace Observing {
+
+  //! A moving target such as a comet or asteroid, from a table of positions
+
+  /** Observing::Track represents a target whose position changes, read from
+   * a table of positions at a series of times, e.g. as produced by JPL
+   * Horizons. The table is fitted with a Chebyshev series in each of a
+   * number of short segments, in the unit vector towards the target rather
+   * than in RA and Dec so that nothing goes wrong at RA = 0 or near the
+   * poles. Each evaluation then costs a handful of multiplications, and
+   * altitudes, airmasses etc come out at much the same cost as for a star.
+   *
+   * The file should look like this:
+   *
+   *  # comment
+   *  name C/2023 A3
+   *  60400.0  1.23456  -12.3456  1.234
+   *  60400.5  1.23789  -12.4012  1.231
+   *  ..
+   *
+   * with the UTC as an MJD (or JD), the RA in decimal hours and the
+   * declination in decimal degrees, both J2000 astrometric, and optionally
+   * the distance in AU. The times must increase. For targets near enough
+   * for the parallax to matter, the positions should be topocentric for
+   * the telescope used.
+   */
+
+  class Track {
+  public:
+
+    //! Default constructor
+    Track() : hasdist(false) {}
+
+    //! Constructor from a file
+    Track(const std::string& file);
+
+    //! Reads the table of positions from a file
+    void load(const std::string& file);
+
+    //! Name of the target
+    const std::string& name() const {return nm;}
+
+    //! First UTC MJD covered
+    double start() const {return seg.empty() ? 0. : seg.front().t1;}
+
+    //! Last UTC MJD covered
+    double end() const {return seg.empty() ? 0. : seg.back().t2;}
+
+    //! True if the time lies within the table
+    bool covers(double mjd) const {return !seg.empty() && mjd >= start() && mjd <= end();}
+
+    //! J2000 RA (hours) and declination (degrees) at a UTC MJD
+    void radec(double mjd, double& ra, double& dec) const;
+
+    //! Distance, AU, at a UTC MJD, 0 if not given
+    double distance(double mjd) const;
+
+    //! Position in the sky at a given time and place
+    Subs::Altaz altaz(const Subs::Time& time, const Subs::Telescope& tel) const;
+
+    //! Position in the sky, re-using the apparent place parameters of a Context
+    Subs::Altaz altaz(const Subs::Time& time, const Subs::Telescope& tel, Context& context) const;
+
+  private:
+
+    // Chebyshev coefficients for each part of the unit vector and the distance over t1 to t2
+    struct Segment {
+      double t1, t2;
+      std::vector<double> cx, cy, cz, cd;
+    };
+
+    // returns the segment covering mjd and the matching argument of the polynomials
+    const Segment& find(double mjd, double& x) const;
+
+    std::string nm;
+    bool hasdist;
+    std::vector<Segment> seg;
+  };
+
+  //! Computes next time a moving target rises or sets through a given altitude
+  bool startime(const Track& obj, const Subs::Telescope& tel, const Subs::Time& start,
+		double altaim, Subs::Time& found);
+
+  //! Calculates when a moving target is visible
+  bool when_visible(const Track& obj, const Subs::Telescope& telescope,
+		    const Subs::Time& tstart, const Subs::Time& tend, double airmass,
+		    Subs::Time& firstvis, Subs::Time& lastvis);
+
+};
+
+#endif
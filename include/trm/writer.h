@@ -0,0 +1,162 @@
+#ifndef TRM_OBSERVING_WRITER
+#define TRM_OBSERVING_WRITER
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+
+namespace Observing {
+
+  //! Buffered text output that formats numbers as an ostream would
+
+  /** Observing::Writer stands in for std::cout in the loops that print long
+   * tables. It keeps the precision, width, fill, justification and fixed
+   * flag that the manipulators would have set on the stream, with the same
+   * rules (the width applies to the next item only, the rest persist), so
+   * the same sequence of calls gives text identical to the stream's.
+   * Numbers and strings are formatted without allocating straight into a
+   * large buffer, which goes to the stream in one write when it fills and
+   * when flush() is called or the Writer is destroyed. Lines end with a
+   * plain newline rather than the flush of std::endl. Anything else, a
+   * Subs::Time for instance, is formatted by its own operator<< with the
+   * same settings. A Writer starts with the settings the stream has, and
+   * hands its own back to the stream each time it flushes, so it can take
+   * over from the stream part way through a table.
+   *
+   * Nothing else should write to the stream while a Writer holds unflushed
+   * text.
+   */
+
+  class Writer {
+  public:
+
+    //! Constructor from the stream to write to and the size of the buffer
+    Writer(std::ostream& ostr, size_t size=1 << 20);
+
+    //! Destructor: flushes
+    ~Writer();
+
+    //! Sets the number of significant figures (or of decimals if fixed)
+    Writer& precision(int prec) {nprec = prec; return *this;}
+
+    //! Sets the width of the next item
+    Writer& width(int wid) {nwidth = wid; return *this;}
+
+    //! Sets the fill character
+    Writer& fill(char c) {cfill = c; return *this;}
+
+    //! Left-justifies (true) or right-justifies (false) padded items
+    Writer& left(bool l=true) {lft = l; return *this;}
+
+    //! Sets fixed-point (true) or general (false) format for floating point numbers
+    Writer& fixed(bool f=true) {fxd = f; return *this;}
+
+    //! Ends a line, without flushing
+    Writer& endl() {put('\n'); return *this;}
+
+    Writer& operator<<(double x);
+    Writer& operator<<(float x) {return *this << double(x);}
+    Writer& operator<<(int n) {return *this << long(n);}
+    Writer& operator<<(long n);
+    Writer& operator<<(unsigned long n);
+    Writer& operator<<(char c);
+    Writer& operator<<(const char* str);
+    Writer& operator<<(const std::string& str);
+
+    //! Anything else, formatted by its operator<<
+    template <class T>
+    Writer& operator<<(const T& obj) {return via_stream(obj);}
+
+    //! Sends the buffer to the stream
+    void flush();
+
+  private:
+
+    std::ostream& ostr;
+    std::vector<char> buff;
+    size_t nbuff;
+    int nprec, nwidth;
+    char cfill;
+    bool lft, fxd;
+    std::ostringstream oss;
+
+    std::ios_base::fmtflags flags() const;
+
+    // formats through an ostringstream set up as the stream would be
+    template <class T>
+    Writer& via_stream(const T& obj){
+      oss.str("");
+      oss.flags(flags());
+      oss.precision(nprec);
+      oss.width(nwidth);
+      oss.fill(cfill);
+      oss << obj;
+      nwidth = 0;
+      std::string s = oss.str();
+      append(s.data(), s.length());
+      return *this;
+    }
+
+    // adds n characters unpadded
+    void append(const char* str, size_t n);
+
+    // adds n characters padded to the width, which is then reset
+    void pad(const char* str, size_t n);
+
+    // adds one character unpadded
+    void put(char c){
+      if(nbuff == buff.size()) flush();
+      buff[nbuff++] = c;
+    }
+
+    Writer(const Writer&);
+    Writer& operator=(const Writer&);
+  };
+
+  //! A table of numbers saved by column in a binary file
+
+  /** Observing::Columns gathers rows of numbers for a binary file in which
+   * each column is stored whole, one after another, so that a program
+   * reading it can pick out the columns it wants without parsing text.
+   * Columns hold doubles; a column of targets holds indices into a list of
+   * names saved with the table.
+   *
+   * The file is
+   *
+   *   "OBSCOL01" (8 bytes)
+   *   number of columns (uint32), number of rows (uint64)
+   *   for each column: length of its name (uint32) and the name
+   *   number of target names (uint32), then for each: length (uint32) and name
+   *   each column in turn: number of rows doubles
+   *
+   * all in the byte order of the machine that wrote it.
+   */
+
+  class Columns {
+  public:
+
+    //! Constructor from the names of the columns
+    Columns(const std::vector<std::string>& names);
+
+    //! Sets the names that a column of target indices refers to
+    void set_targets(const std::vector<std::string>& targets) {tnames = targets;}
+
+    //! Adds a row with one value per column
+    void add(const double* row);
+
+    //! Number of rows
+    size_t size() const {return nrow;}
+
+    //! Writes the table to a file
+    void write(const std::string& file) const;
+
+  private:
+    std::vector<std::string> cnames, tnames;
+    std::vector<std::vector<double> > data;
+    size_t nrow;
+  };
+
+};
+
+#endif
@@ -0,0 +1,394 @@
+// Python module 'observing': the batch functions of libobserving applied to
+// NumPy arrays.
+//
+// Arrays of times are used where they are if they are already contiguous
+// arrays of doubles (as those from numpy.linspace and the like are), and
+// results are written straight into the arrays returned, so the only cost
+// above the calculations themselves is for the functions of the library that
+// take Subs::Time rather than MJDs (suntime). The interpreter lock is let go
+// while the calculations run, which are spread over threads as in the
+// programs.
+//
+// Usage:
+//
+//   import numpy as np, observing
+//   cat = observing.Catalogue('stardata', 'WHT')
+//   mjd = np.linspace(58000.8, 58001.3, 1000000)
+//   alt, az, airmass = cat.altaz('DQ Her', mjd)
+//   phase = cat.phase(0, mjd)
+//   found, ok = observing.suntime('WHT', mjd[:10], -18.)
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <memory>
+#include <exception>
+#include "trm/subs.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+#include "trm/observing.h"
+#include "trm/batch.h"
+#include "trm/catalogue.h"
+
+namespace {
+
+  // Runs a calculation with the interpreter lock let go, turning any
+  // exception into a Python one. Returns false if there was one.
+  template <class Func>
+  bool run(Func func){
+    std::string err;
+    bool ok = true;
+    Py_BEGIN_ALLOW_THREADS
+    try{
+      func();
+    }
+    catch(const std::string& str){
+      err = str;
+      ok = false;
+    }
+    catch(const std::exception& exc){
+      err = exc.what();
+      ok = false;
+    }
+    Py_END_ALLOW_THREADS
+    if(!ok) PyErr_SetString(PyExc_RuntimeError, err.c_str());
+    return ok;
+  }
+
+  // An array of doubles from any Python sequence or array, the array
+  // itself if it is already a contiguous array of doubles
+  PyArrayObject* in_array(PyObject* obj){
+    return reinterpret_cast<PyArrayObject*>(PyArray_FROM_OTF(obj, NPY_DOUBLE, NPY_ARRAY_IN_ARRAY));
+  }
+
+  // A new array of the same shape as another
+  PyArrayObject* new_array(PyArrayObject* like, int type=NPY_DOUBLE){
+    return reinterpret_cast<PyArrayObject*>(PyArray_SimpleNew(PyArray_NDIM(like), PyArray_DIMS(like), type));
+  }
+
+  // A new one-dimensional array
+  PyArrayObject* new_array(size_t n, int type=NPY_DOUBLE){
+    npy_intp dim = n;
+    return reinterpret_cast<PyArrayObject*>(PyArray_SimpleNew(1, &dim, type));
+  }
+
+  double* data(PyArrayObject* arr){
+    return static_cast<double*>(PyArray_DATA(arr));
+  }
+
+  // Catalogue: the targets of a star data file and a telescope
+
+  struct CatalogueObject {
+    PyObject_HEAD
+    Observing::Catalogue* cat;
+    Subs::Telescope* tel;
+  };
+
+  void Catalogue_dealloc(CatalogueObject* self){
+    delete self->cat;
+    delete self->tel;
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+  }
+
+  int Catalogue_init(CatalogueObject* self, PyObject* args, PyObject* kwds){
+    static const char* kwlist[] = {"stars", "telescope", NULL};
+    const char *stars, *telescope;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "ss", const_cast<char**>(kwlist), &stars, &telescope))
+      return -1;
+
+    // the methods use cat and tel with the GIL released, so they must not
+    // be replaced under them: a Catalogue is set up once only
+    if(self->cat){
+      PyErr_SetString(PyExc_RuntimeError, "the Catalogue has already been initialised");
+      return -1;
+    }
+    try{
+      std::unique_ptr<Subs::Telescope> tel(new Subs::Telescope(telescope));
+      std::unique_ptr<Observing::Catalogue> cat(new Observing::Catalogue(stars));
+      self->tel = tel.release();
+      self->cat = cat.release();
+    }
+    catch(const std::string& err){
+      PyErr_SetString(PyExc_RuntimeError, err.c_str());
+      return -1;
+    }
+    catch(const std::exception& exc){
+      PyErr_SetString(PyExc_RuntimeError, exc.what());
+      return -1;
+    }
+    return 0;
+  }
+
+  // Index of a target given by number or by name; -1 with an exception set
+  // if there is no such target
+  Py_ssize_t target(CatalogueObject* self, PyObject* obj){
+    if(!self->cat){
+      PyErr_SetString(PyExc_RuntimeError, "the Catalogue has not been initialised");
+      return -1;
+    }
+    if(PyUnicode_Check(obj)){
+      const char* name = PyUnicode_AsUTF8(obj);
+      if(!name) return -1;
+      size_t j = self->cat->find(name);
+      if(j < self->cat->size()) return j;
+      PyErr_Format(PyExc_KeyError, "no target called '%s'", name);
+      return -1;
+    }
+    Py_ssize_t j = PyNumber_AsSsize_t(obj, PyExc_IndexError);
+    if(j == -1 && PyErr_Occurred()) return -1;
+    if(j < 0 || size_t(j) >= self->cat->size()){
+      PyErr_SetString(PyExc_IndexError, "target index out of range");
+      return -1;
+    }
+    return j;
+  }
+
+  Py_ssize_t Catalogue_len(CatalogueObject* self){
+    return self->cat ? self->cat->size() : 0;
+  }
+
+  PyObject* Catalogue_names(CatalogueObject* self, PyObject*){
+    if(!self->cat) return PyList_New(0);
+    PyObject* list = PyList_New(self->cat->size());
+    if(!list) return NULL;
+    for(size_t j=0; j<self->cat->size(); j++)
+      PyList_SET_ITEM(list, j, PyUnicode_FromString(self->cat->name(j).c_str()));
+    return list;
+  }
+
+  PyObject* Catalogue_has_ephem(CatalogueObject* self, PyObject* obj){
+    Py_ssize_t j = target(self, obj);
+    if(j < 0) return NULL;
+    return PyBool_FromLong(self->cat->has_ephem(j));
+  }
+
+  PyObject* Catalogue_altaz(CatalogueObject* self, PyObject* args, PyObject* kwds){
+    static const char* kwlist[] = {"target", "mjd", "threads", NULL};
+    PyObject *otarget, *omjd;
+    int nthread = 0;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "OO|i", const_cast<char**>(kwlist), &otarget, &omjd, &nthread))
+      return NULL;
+    Py_ssize_t j = target(self, otarget);
+    if(j < 0) return NULL;
+
+    PyArrayObject* mjd = in_array(omjd);
+    if(!mjd) return NULL;
+    PyArrayObject *alt = new_array(mjd), *az = new_array(mjd), *airmass = new_array(mjd);
+    if(alt && az && airmass &&
+       run([&](){Observing::altaz(self->cat->position(j), *self->tel, data(mjd), PyArray_SIZE(mjd),
+				  data(alt), data(az), data(airmass), nthread);})){
+      Py_DECREF(mjd);
+      return Py_BuildValue("NNN", alt, az, airmass);
+    }
+    Py_DECREF(mjd);
+    Py_XDECREF(alt);
+    Py_XDECREF(az);
+    Py_XDECREF(airmass);
+    return NULL;
+  }
+
+  PyObject* Catalogue_phase(CatalogueObject* self, PyObject* args, PyObject* kwds){
+    static const char* kwlist[] = {"target", "mjd", "threads", NULL};
+    PyObject *otarget, *omjd;
+    int nthread = 0;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "OO|i", const_cast<char**>(kwlist), &otarget, &omjd, &nthread))
+      return NULL;
+    Py_ssize_t j = target(self, otarget);
+    if(j < 0) return NULL;
+    if(!self->cat->has_ephem(j)){
+      PyErr_Format(PyExc_ValueError, "target '%s' has no ephemeris", self->cat->name(j).c_str());
+      return NULL;
+    }
+
+    PyArrayObject* mjd = in_array(omjd);
+    if(!mjd) return NULL;
+    PyArrayObject* phase = new_array(mjd);
+    if(phase &&
+       run([&](){Observing::phase(self->cat->position(j), self->cat->ephem(j), *self->tel, data(mjd),
+				  PyArray_SIZE(mjd), data(phase), nthread);})){
+      Py_DECREF(mjd);
+      return reinterpret_cast<PyObject*>(phase);
+    }
+    Py_DECREF(mjd);
+    Py_XDECREF(phase);
+    return NULL;
+  }
+
+  PyObject* Catalogue_when_visible(CatalogueObject* self, PyObject* args, PyObject* kwds){
+    static const char* kwlist[] = {"tstart", "tend", "airmass", "threads", NULL};
+    double tstart, tend, airmass;
+    int nthread = 0;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "ddd|i", const_cast<char**>(kwlist), &tstart, &tend, &airmass, &nthread))
+      return NULL;
+    if(!self->cat) return PyErr_Format(PyExc_RuntimeError, "the Catalogue has not been initialised");
+
+    size_t n = self->cat->size();
+    std::vector<Observing::Visibility> vis;
+    if(!run([&](){
+	  std::vector<const Subs::Position*> obj(n);
+	  for(size_t j=0; j<n; j++) obj[j] = &self->cat->position(j);
+	  Observing::when_visible(obj, *self->tel, Subs::Time(tstart), Subs::Time(tend), airmass, vis, nthread);
+	})) return NULL;
+
+    PyArrayObject *visible = new_array(n, NPY_BOOL), *first = new_array(n), *last = new_array(n);
+    if(!visible || !first || !last){
+      Py_XDECREF(visible);
+      Py_XDECREF(first);
+      Py_XDECREF(last);
+      return NULL;
+    }
+    npy_bool* v = static_cast<npy_bool*>(PyArray_DATA(visible));
+    for(size_t j=0; j<n; j++){
+      v[j] = vis[j].visible;
+      data(first)[j] = vis[j].visible ? vis[j].first.mjd() : NAN;
+      data(last)[j]  = vis[j].visible ? vis[j].last.mjd()  : NAN;
+    }
+    return Py_BuildValue("NNN", visible, first, last);
+  }
+
+  PyObject* Catalogue_startime(CatalogueObject* self, PyObject* args, PyObject* kwds){
+    static const char* kwlist[] = {"start", "altaim", "threads", NULL};
+    double start, altaim;
+    int nthread = 0;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "dd|i", const_cast<char**>(kwlist), &start, &altaim, &nthread))
+      return NULL;
+    if(!self->cat) return PyErr_Format(PyExc_RuntimeError, "the Catalogue has not been initialised");
+
+    size_t n = self->cat->size();
+    std::vector<Subs::Time> found;
+    std::vector<char> ok;
+    if(!run([&](){
+	  std::vector<const Subs::Position*> obj(n);
+	  for(size_t j=0; j<n; j++) obj[j] = &self->cat->position(j);
+	  Observing::startime(obj, *self->tel, Subs::Time(start), altaim, found, ok, nthread);
+	})) return NULL;
+
+    PyArrayObject *time = new_array(n), *isok = new_array(n, NPY_BOOL);
+    if(!time || !isok){
+      Py_XDECREF(time);
+      Py_XDECREF(isok);
+      return NULL;
+    }
+    npy_bool* o = static_cast<npy_bool*>(PyArray_DATA(isok));
+    for(size_t j=0; j<n; j++){
+      o[j] = ok[j];
+      data(time)[j] = ok[j] ? found[j].mjd() : NAN;
+    }
+    return Py_BuildValue("NN", time, isok);
+  }
+
+  PyMethodDef Catalogue_methods[] = {
+    {"names", reinterpret_cast<PyCFunction>(Catalogue_names), METH_NOARGS,
+     "names() -- list of the names of the targets"},
+    {"has_ephem", reinterpret_cast<PyCFunction>(Catalogue_has_ephem), METH_O,
+     "has_ephem(target) -- True if the target (index or name) has an ephemeris"},
+    {"altaz", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(Catalogue_altaz)), METH_VARARGS | METH_KEYWORDS,
+     "altaz(target, mjd, threads=0) -- arrays of true altitude, azimuth (degrees) and airmass\n"
+     "(0 below the horizon) of a target (index or name) at an array of UTC MJDs"},
+    {"phase", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(Catalogue_phase)), METH_VARARGS | METH_KEYWORDS,
+     "phase(target, mjd, threads=0) -- array of orbital phases (cycle number plus phase) of a\n"
+     "target at an array of UTC MJDs"},
+    {"when_visible", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(Catalogue_when_visible)), METH_VARARGS | METH_KEYWORDS,
+     "when_visible(tstart, tend, airmass, threads=0) -- arrays of whether each target is\n"
+     "below an airmass between two UTC MJDs, and the first and last MJDs it is (NaN if not)"},
+    {"startime", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(Catalogue_startime)), METH_VARARGS | METH_KEYWORDS,
+     "startime(start, altaim, threads=0) -- arrays of the first UTC MJD after start at which\n"
+     "each target crosses an altitude (NaN if it does not) and whether it does"},
+    {NULL, NULL, 0, NULL}
+  };
+
+  PySequenceMethods Catalogue_sequence = {
+    reinterpret_cast<lenfunc>(Catalogue_len)
+  };
+
+  PyTypeObject CatalogueType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    "observing.Catalogue"
+  };
+
+  // Module functions
+
+  PyObject* suntime(PyObject*, PyObject* args, PyObject* kwds){
+    static const char* kwlist[] = {"telescope", "start", "altaim", "fast", "threads", NULL};
+    const char* telescope;
+    PyObject* ostart;
+    double altaim;
+    int fast = 0, nthread = 0;
+    if(!PyArg_ParseTupleAndKeywords(args, kwds, "sOd|pi", const_cast<char**>(kwlist), &telescope, &ostart,
+				    &altaim, &fast, &nthread))
+      return NULL;
+
+    PyArrayObject* start = in_array(ostart);
+    if(!start) return NULL;
+    PyArrayObject *found = new_array(start), *ok = new_array(start, NPY_BOOL);
+    if(found && ok &&
+       run([&](){
+	   Subs::Telescope tel(telescope);
+	   size_t n = PyArray_SIZE(start);
+	   std::vector<Subs::Time> tstart(n), tfound;
+	   std::vector<char> isok;
+	   for(size_t i=0; i<n; i++) tstart[i].set(data(start)[i]);
+	   Observing::suntime(tel, tstart, altaim, tfound, isok, nthread,
+			      fast ? Observing::FAST_SUN : Observing::FULL_SUN);
+	   npy_bool* o = static_cast<npy_bool*>(PyArray_DATA(ok));
+	   for(size_t i=0; i<n; i++){
+	     o[i] = isok[i];
+	     data(found)[i] = isok[i] ? tfound[i].mjd() : NAN;
+	   }
+	 })){
+      Py_DECREF(start);
+      return Py_BuildValue("NN", found, ok);
+    }
+    Py_DECREF(start);
+    Py_XDECREF(found);
+    Py_XDECREF(ok);
+    return NULL;
+  }
+
+  PyMethodDef methods[] = {
+    {"suntime", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(suntime)), METH_VARARGS | METH_KEYWORDS,
+     "suntime(telescope, start, altaim, fast=False, threads=0) -- arrays of the first UTC MJD\n"
+     "after each of an array of start MJDs at which the Sun crosses an altitude (NaN if it\n"
+     "does not) and whether it does"},
+    {NULL, NULL, 0, NULL}
+  };
+
+  PyModuleDef module = {
+    PyModuleDef_HEAD_INIT,
+    "observing",
+    "Visibility, airmasses and orbital phases of targets over arrays of times",
+    -1,
+    methods
+  };
+}
+
+PyMODINIT_FUNC PyInit_observing(void){
+
+  import_array();
+
+  CatalogueType.tp_basicsize   = sizeof(CatalogueObject);
+  CatalogueType.tp_flags       = Py_TPFLAGS_DEFAULT;
+  CatalogueType.tp_doc         = "Catalogue(stars, telescope) -- the targets of a star data file seen from a telescope";
+  CatalogueType.tp_new         = PyType_GenericNew;
+  CatalogueType.tp_init        = reinterpret_cast<initproc>(Catalogue_init);
+  CatalogueType.tp_dealloc     = reinterpret_cast<destructor>(Catalogue_dealloc);
+  CatalogueType.tp_methods     = Catalogue_methods;
+  CatalogueType.tp_as_sequence = &Catalogue_sequence;
+  if(PyType_Ready(&CatalogueType) < 0) return NULL;
+
+  PyObject* mod = PyModule_Create(&module);
+  if(!mod) return NULL;
+  Py_INCREF(&CatalogueType);
+  if(PyModule_AddObject(mod, "Catalogue", reinterpret_cast<PyObject*>(&CatalogueType)) < 0){
+    Py_DECREF(&CatalogueType);
+    Py_DECREF(mod);
+    return NULL;
+  }
+  return mod;
+}
@@ -28,6 +28,33 @@ Arguments:
   device :
     Plot device
 
+  tracks :
+    Comma-separated list of files of positions of moving targets such as
+    comets or asteroids, or 'none' (hidden, default none). Each file has an
+    optional line "name <name>" followed by lines of "MJD RA Dec [distance]",
+    with the UTC as an MJD or JD, the J2000 RA in decimal hours, Dec in decimal
+    degrees and distance in AU.
+
+  threads :
+    Number of threads to use (hidden, default 0, meaning one per core)
+
+  stats :
+    Counts of the expensive calls and the time spent in each phase of the
+    run: 'none', 'text' for a table or 'json' for JSON, both on stderr, or
+    the name of a file to write JSON to. Only collected if the package was
+    configured with --enable-stats. (hidden, default none)
+
+  batch :
+    true to print airmasses for many queries in one run rather than plot
+    them. date and device are not asked for; instead lines of "tag date
+    [step=M] [star]" are read from the standard input, with all stars
+    included unless one is named. Each answer is lines of MJD, airmass and
+    star name every M minutes (default 10) from sunset to sunrise while the
+    star is up, star by star, ending with a line 'ok' or 'error' and a
+    message, all starting with the tag of the query. The star data and the
+    times of sunset and sunrise of each night are worked out once for all
+    the queries. tracks do not apply. (hidden, default false)
+
 Input file format
 -----------------
 
@@ -62,6 +89,7 @@ plus an uncertainty would be needed.
 
 #include <cstdlib>
 #include <string>
+#include <exception>
 #include <iostream>
 #include <sstream>
 #include <fstream>
@@ -76,8 +104,12 @@ plus an uncertainty would be needed.
 #include "trm/telescope.h"
 #include "trm/position.h"
 #include "trm/star.h"
-#include "trm/binary_star.h"
 #include "trm/observing.h"
+#include "trm/track.h"
+#include "trm/batch.h"
+#include "trm/catalogue.h"
+#include "trm/stats.h"
+#include "trm/query.h"
 
 int main(int argc, char *argv[]){
 
@@ -93,41 +125,32 @@ int main(int argc, char *argv[]){
     input.sign_in("date",      Subs::Input::GLOBAL, Subs::Input::PROMPT);
     input.sign_in("telescope", Subs::Input::GLOBAL, Subs::Input::PROMPT);
     input.sign_in("device",    Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("tracks",    Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("threads",   Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("stats",     Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("batch",     Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
 
     // Get input
 
     std::string starfile;
     input.get_value("stars", starfile, "stardata", "file of star positions and ephemerides");
+    bool batch;
+    input.get_value("batch", batch, false, "answer queries read from the standard input?");
 
     // Load star data
 
-    std::ifstream file(starfile.c_str());
-    if(!file) throw std::string("Could not open file = ") + starfile;
-
-    Subs::Star   s;
-    Subs::Binary b;
-    Subs::Ephem  eph;
-    std::vector<Subs::Star*>  star;
-    while(file >> s){
-      if(file >> eph){
-	star.push_back(new Subs::Binary(s,eph));
-      }else{
-	if(file.bad()){
-	  std::cerr << "File stream corrupted" << std::endl;
-	  file.close();
-	  exit(EXIT_FAILURE);
-	}
-	file.clear();
-	star.push_back(new Subs::Star(s));
-      }
+    Observing::Catalogue catalogue;
+    {
+      OBSERVING_TIME(LOAD);
+      catalogue.load(starfile);
     }
-    file.close();
-    std::cout << "Found data on " << star.size() << " stars" << std::endl;
-    if(star.size() == 0)
+    (batch ? std::cerr : std::cout) << "Found data on " << catalogue.size() << " stars" << std::endl;
+    if(catalogue.size() == 0)
       throw std::string("Cannot have 0 stars!");
 
-    std::string sdate;
-    input.get_value("date", sdate, "17 Nov 1961", "date at start of night");
+    // the date comes with each query in batch mode, and nothing is plotted
+    std::string sdate("17 Nov 1961");
+    if(!batch) input.get_value("date", sdate, "17 Nov 1961", "date at start of night");
     Subs::Date date(sdate);
 
     std::string stelescope;
@@ -135,24 +158,54 @@ int main(int argc, char *argv[]){
     Subs::Telescope telescope(stelescope);
 
     std::string device;
-    input.get_value("device", device, "/xs", "plot device");
+    if(!batch) input.get_value("device", device, "/xs", "plot device");
+
+    std::string stracks;
+    input.get_value("tracks", stracks, "none", "files of moving target positions (comma-separated, 'none' to ignore)");
+    std::vector<Observing::Track> track;
+    if(stracks != "none"){
+      OBSERVING_TIME(LOAD);
+      std::string item;
+      std::istringstream lstr(stracks);
+      while(getline(lstr, item, ',')){
+	std::istringstream istr(item);
+	std::string tfile;
+	if(istr >> tfile) track.push_back(Observing::Track(tfile));
+      }
+    }
+
+    int nthread;
+    input.get_value("threads", nthread, 0, 0, 1024, "number of threads (0 for one per core)");
+    std::string sstats;
+    input.get_value("stats", sstats, "none", "statistics to report (none, text, json or a file for JSON)");
+
+    // Queries from the standard input, all sharing the catalogue and nights
+    if(batch){
+      Observing::Query query(catalogue, telescope, 2., -15., Observing::FULL_SUN, nthread);
+      query.batch(std::cin, std::cout, "airmass");
+      Observing::Stats::report(sstats);
+      return EXIT_SUCCESS;
+    }
 
     Subs::Time time(date), sunset, twiend, twistart, sunrise;
     time.add_hour(12.-telescope.longitude()/15.);
 
-    if(!Observing::suntime(telescope, time, -1., sunset))
-      throw std::string("Could not find sunset!!");
+    {
+      OBSERVING_TIME(NIGHTS);
+      if(!Observing::suntime(telescope, time, -1., sunset))
+	throw std::string("Could not find sunset!!");
 
-    if(!Observing::suntime(telescope, sunset, -15., twiend))
-      throw std::string("Sun never gets to -15 in evening!!");
+      if(!Observing::suntime(telescope, sunset, -15., twiend))
+	throw std::string("Sun never gets to -15 in evening!!");
 
-    time   = twiend;
-    time.add_hour(0.1);   
-    if(!Observing::suntime(telescope, time, -15., twistart))
-      throw std::string("Sun never gets to -15 in morning!!");
+      time   = twiend;
+      time.add_hour(0.1);   
+      if(!Observing::suntime(telescope, time, -15., twistart))
+	throw std::string("Sun never gets to -15 in morning!!");
 
-    if(!Observing::suntime(telescope, twistart, -1., sunrise))
-      throw std::string("Could not find sunset!!");
+      if(!Observing::suntime(telescope, twistart, -1., sunrise))
+	throw std::string("Could not find sunset!!");
+    }
 
     std::cout << "Sunset to sunrise: " << sunset << " to " << sunrise  << std::endl;
     std::cout << "       Sun < -15.: " << twiend << " to " << twistart << std::endl;
@@ -178,39 +231,65 @@ int main(int argc, char *argv[]){
     cpgsci(1);
 
     const int NPT=500;
-    float x[NPT], y[NPT];
-    double ut, mjd0 = floor(sunset.mjd()), mjd;
+    double mjd0 = floor(sunset.mjd());
     double twi1 = 24.*(twiend.mjd()-mjd0);
     double twi2 = 24.*(twistart.mjd()-mjd0);
-    int i, n;
-    float xt, yt;
-    for(size_t j=0; j<star.size(); j++){
-      for(i=0, n=0; i<NPT; i++){
-	xt = ut = ut1 + (ut2-ut1)*i/(NPT-1);
-	mjd = mjd0 + ut/24.;
-	time.set(mjd);
-	yt = star[j]->altaz(time,telescope).airmass;
-	if(yt > 0.5){
-	  x[n]   = xt;
-	  y[n++] = yt;
-	}
-      }
-      cpgline(n,x,y);
+
+    // The curves of the stars and then of the moving targets (where their
+    // tables cover the night) are computed in parallel, then plotted in order
+    size_t ncurve = catalogue.size() + track.size();
+    std::vector<std::vector<float> > x(ncurve), y(ncurve);
+    {
+      OBSERVING_TIME(VISIBILITY);
+      Observing::parallel_for(ncurve, nthread, [&](size_t j, Observing::Context& context){
+	  Subs::Time t;
+	  float xt, yt;
+	  for(int i=0; i<NPT; i++){
+	    double ut = ut1 + (ut2-ut1)*i/(NPT-1);
+	    double mjd = mjd0 + ut/24.;
+	    xt = ut;
+	    if(j < catalogue.size()){
+	      t.set(mjd);
+	      yt = catalogue.position(j).altaz(t,telescope).airmass;
+	      OBSERVING_COUNT(ALTAZ);
+	    }else{
+	      const Observing::Track& trk = track[j-catalogue.size()];
+	      if(!trk.covers(mjd)) continue;
+	      t.set(mjd);
+	      yt = trk.altaz(t,telescope,context).airmass;
+	    }
+	    if(yt > 0.5){
+	      x[j].push_back(xt);
+	      y[j].push_back(yt);
+	    }
+	  }
+	});
     }
 
-    cpgsci(1);
-    cpgsls(2);
-    cpgmove(twi1,y1);
-    cpgdraw(twi1,y2);
-    cpgmove(twi2,y1);
-    cpgdraw(twi2,y2);
+    {
+      OBSERVING_TIME(OUTPUT);
+      for(size_t j=0; j<ncurve; j++)
+	if(x[j].size()) cpgline(x[j].size(),&x[j][0],&y[j][0]);
+
+      cpgsci(1);
+      cpgsls(2);
+      cpgmove(twi1,y1);
+      cpgdraw(twi1,y2);
+      cpgmove(twi2,y1);
+      cpgdraw(twi2,y2);
+    }
 
+    Observing::Stats::report(sstats);
   }
 
   catch(const std::string& str){
     std::cerr << str << std::endl;
     exit(EXIT_FAILURE);
   }
+  catch(const std::exception& exc){
+    std::cerr << exc.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
   
 }
 
@@ -0,0 +1,225 @@
+// Observing::Context, parallel_for and batch versions of the basic
+// functions for many targets or times at once, spread over threads.
+
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <system_error>
+#include <algorithm>
+#include "slalib.h"
+#include "trm/subs.h"
+#include "trm/date.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+#include "trm/ephem.h"
+#include "trm/observing.h"
+#include "trm/batch.h"
+#include "trm/precise_ephem.h"
+#include "trm/stats.h"
+#include "trm/trace.h"
+
+namespace {
+
+  // Points handed to a thread at a time by the batch functions of many
+  // times, enough to make the cost of handing them out negligible
+  const size_t BLOCK = 1024;
+}
+
+/** Returns the apparent place parameters for a TT. They are only
+ * recomputed when the time moves by more than 0.01 days, which changes
+ * apparent places by much less than an arcsecond.
+ * \param tt TT as an MJD
+ */
+double* Observing::Context::amprms(double tt){
+  if(fabs(tt-amtime) > 0.01){
+    slaMappa(2000., tt, amp);
+    amtime = tt;
+  }
+  return amp;
+}
+
+/** Number of threads to use.
+ * \param nthread number asked for, 0 for one per core
+ * \param njob    number of jobs; there is no point in more threads than this
+ */
+int Observing::nthreads(int nthread, size_t njob){
+  if(nthread <= 0) nthread = std::max(1U, std::thread::hardware_concurrency());
+  return std::max(1, int(std::min(size_t(nthread), njob)));
+}
+
+/** Calls func(i, context) for every i from 0 to n-1. The calls are shared
+ * out one at a time between nthread threads (the caller being one of them)
+ * each with its own Context, so func must only write to places belonging
+ * to index i. If any calls throw, the exception of the lowest index is
+ * rethrown once all threads have finished, so what is reported does not
+ * depend upon the number of threads. Should fewer threads than nthread
+ * be available, the calls are shared between those that could be started.
+ * \param n       number of calls
+ * \param nthread number of threads, 0 for one per core
+ * \param func    the function to call
+ */
+void Observing::parallel_for(size_t n, int nthread, const std::function<void(size_t, Context&)>& func){
+
+  if(n == 0) return;
+  nthread = nthreads(nthread, n);
+
+  std::vector<std::exception_ptr> error(n);
+  std::atomic<size_t> inext(0);
+  auto worker = [&](size_t thread){
+    OBSERVING_SPAN_N("parallel_for worker", thread);
+    Context context(thread);
+    size_t i;
+    while((i = inext++) < n){
+      try{
+	func(i, context);
+      }
+      catch(...){
+	error[i] = std::current_exception();
+      }
+    }
+  };
+
+  // If the system will not give us all the threads asked for, those
+  // started so far (and the caller) do the work between them
+  std::vector<std::thread> pool;
+  pool.reserve(nthread-1);
+  for(int i=1; i<nthread; i++){
+    try{
+      pool.emplace_back(worker, size_t(i));
+    }
+    catch(const std::system_error&){
+      break;
+    }
+  }
+  worker(0);
+  for(size_t i=0; i<pool.size(); i++) pool[i].join();
+
+  for(size_t i=0; i<n; i++)
+    if(error[i]) std::rethrow_exception(error[i]);
+}
+
+/** Batch version of suntime.
+ * \param tel     the telescope
+ * \param start   the times to start from
+ * \param altaim  altitude of the Sun, degrees
+ * \param found   the times found, one per start time
+ * \param ok      1 where a time was found, 0 otherwise
+ * \param nthread number of threads, 0 for one per core
+ * \param model   how to compute the Sun
+ */
+void Observing::suntime(const Subs::Telescope& tel, const std::vector<Subs::Time>& start, double altaim,
+			std::vector<Subs::Time>& found, std::vector<char>& ok, int nthread, Sun_Model model){
+  found.resize(start.size());
+  ok.resize(start.size());
+  parallel_for(start.size(), nthread, [&](size_t i, Context&){
+      ok[i] = suntime(tel, start[i], altaim, found[i], model);
+    });
+}
+
+/** Batch version of startime.
+ * \param obj     the objects, which must not be changed while this runs
+ * \param tel     the telescope
+ * \param start   time to start from
+ * \param altaim  the altitude, degrees
+ * \param found   the times found, one per object
+ * \param ok      1 where a time was found, 0 otherwise
+ * \param nthread number of threads, 0 for one per core
+ */
+void Observing::startime(const std::vector<const Subs::Position*>& obj, const Subs::Telescope& tel, const Subs::Time& start,
+			 double altaim, std::vector<Subs::Time>& found, std::vector<char>& ok, int nthread){
+  found.resize(obj.size());
+  ok.resize(obj.size());
+  parallel_for(obj.size(), nthread, [&](size_t i, Context&){
+      ok[i] = startime(*obj[i], tel, start, altaim, found[i]);
+    });
+}
+
+/** Batch version of when_visible.
+ * \param obj       the objects, which must not be changed while this runs
+ * \param telescope the telescope
+ * \param tstart    start of the period of interest
+ * \param tend      end of the period of interest
+ * \param airmass   maximum airmass
+ * \param vis       the visibility of each object
+ * \param nthread   number of threads, 0 for one per core
+ */
+void Observing::when_visible(const std::vector<const Subs::Position*>& obj, const Subs::Telescope& telescope,
+			     const Subs::Time& tstart, const Subs::Time& tend, double airmass,
+			     std::vector<Visibility>& vis, int nthread){
+  vis.resize(obj.size());
+  parallel_for(obj.size(), nthread, [&](size_t i, Context&){
+      vis[i].visible = when_visible(*obj[i], telescope, tstart, tend, airmass, vis[i].first, vis[i].last);
+    });
+}
+
+/** Batch version of night.
+ * \param tel     the telescope
+ * \param date    the dates at the start of each night
+ * \param sunalt  altitude of the Sun defining twilight, degrees
+ * \param nights  the night of each date
+ * \param ok      1 where the night was found, 0 otherwise
+ * \param nthread number of threads, 0 for one per core
+ * \param model   how to compute the Sun
+ */
+void Observing::night(const Subs::Telescope& tel, const std::vector<Subs::Date>& date, double sunalt,
+		      std::vector<Night>& nights, std::vector<char>& ok, int nthread, Sun_Model model){
+  nights.resize(date.size());
+  ok.resize(date.size());
+  parallel_for(date.size(), nthread, [&](size_t i, Context&){
+      ok[i] = night(tel, date[i], sunalt, nights[i], model);
+    });
+}
+
+/** Altitude, azimuth and airmass of an object at each of a series of
+ * times. The times and results are plain arrays so that arrays held
+ * elsewhere, such as those of NumPy, can be used where they are.
+ * \param obj     the object
+ * \param tel     the telescope
+ * \param mjd     the UTC MJDs
+ * \param n       the number of times
+ * \param alt     the true altitudes, degrees, or 0 if not wanted
+ * \param az      the azimuths, degrees, or 0 if not wanted
+ * \param airmass the airmasses (0 when below the horizon), or 0 if not wanted
+ * \param nthread number of threads, 0 for one per core
+ */
+void Observing::altaz(const Subs::Position& obj, const Subs::Telescope& tel, const double* mjd, size_t n,
+		      double* alt, double* az, double* airmass, int nthread){
+  parallel_for((n+BLOCK-1)/BLOCK, nthread, [&](size_t ib, Context&){
+      Subs::Time t;
+      size_t iend = std::min(n, BLOCK*(ib+1));
+      for(size_t i=BLOCK*ib; i<iend; i++){
+	t.set(mjd[i]);
+	Subs::Altaz a = obj.altaz(t, tel);
+	OBSERVING_COUNT(ALTAZ);
+	if(alt)     alt[i]     = a.alt_true;
+	if(az)      az[i]      = a.az;
+	if(airmass) airmass[i] = a.airmass;
+      }
+    });
+}
+
+/** Orbital phase (cycle number plus phase) of an object at each of a
+ * series of times, with the timescale correction of the ephemeris
+ * computed at each. As for altaz, the times and phases are plain arrays.
+ * \param obj     the object
+ * \param eph     its ephemeris
+ * \param tel     the telescope
+ * \param mjd     the UTC MJDs
+ * \param n       the number of times
+ * \param phase   the phases
+ * \param nthread number of threads, 0 for one per core
+ */
+void Observing::phase(const Subs::Position& obj, const Subs::Ephem& eph, const Subs::Telescope& tel,
+		      const double* mjd, size_t n, double* phase, int nthread){
+  Precise_Ephem peph(eph);
+  parallel_for((n+BLOCK-1)/BLOCK, nthread, [&](size_t ib, Context&){
+      Subs::Time t;
+      size_t iend = std::min(n, BLOCK*(ib+1));
+      for(size_t i=BLOCK*ib; i<iend; i++){
+	t.set(mjd[i]);
+	phase[i] = peph.phase(mjd[i] + tcorr(obj, eph, t, tel));
+      }
+    });
+}
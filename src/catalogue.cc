@@ -0,0 +1,125 @@
+// Observing::Catalogue: targets held in contiguous arrays, with the names
+// kept apart from the data used in calculations.
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include "trm/subs.h"
+#include "trm/position.h"
+#include "trm/ephem.h"
+#include "trm/star.h"
+#include "trm/observing.h"
+#include "trm/catalogue.h"
+#include "trm/stats.h"
+#include "trm/trace.h"
+
+/** Constructor from a file.
+ * \param file       name of the file
+ * \param ephem_only true to skip targets without ephemerides
+ */
+Observing::Catalogue::Catalogue(const std::string& file, bool ephem_only) : noff(1, 0), lmax(0) {
+  load(file, ephem_only);
+}
+
+/** Reads targets from a file, in the format described in the class
+ * documentation. Throws an Observing_Error if the file cannot be read.
+ * \param file       name of the file
+ * \param ephem_only true to skip targets without ephemerides
+ */
+void Observing::Catalogue::load(const std::string& file, bool ephem_only){
+
+  OBSERVING_SPAN("catalogue load");
+  std::ifstream fin(file.c_str());
+  if(!fin) throw Observing_Error("Observing::Catalogue::load: could not open " + file);
+#ifdef OBSERVING_STATS
+  fin.seekg(0, std::ios::end);
+  if(fin.tellg() > 0) OBSERVING_COUNT_N(PARSE_BYTES, fin.tellg());
+  fin.seekg(0, std::ios::beg);
+  fin.clear();
+#endif
+
+  Subs::Star  s;
+  Subs::Ephem e;
+  while(fin >> s){
+    if(fin >> e){
+      add(s, e);
+    }else{
+      if(fin.bad())
+	throw Observing_Error("Observing::Catalogue::load: file stream corrupted reading " + file);
+      fin.clear();
+      if(!ephem_only) add(s);
+    }
+  }
+
+  // give back the slack left by growing the arrays
+  pos.shrink_to_fit();
+  eph.shrink_to_fit();
+  peph.shrink_to_fit();
+  haseph.shrink_to_fit();
+  names.shrink_to_fit();
+  noff.shrink_to_fit();
+}
+
+/** Adds a target with no ephemeris.
+ * \param star the target
+ */
+void Observing::Catalogue::add(const Subs::Star& star){
+  pos.push_back(star);
+  eph.push_back(Subs::Ephem());
+  peph.push_back(Precise_Ephem());
+  haseph.push_back(0);
+  names += star.name();
+  noff.push_back(names.length());
+  lmax = std::max(lmax, star.name().length());
+  index.insert(std::make_pair(clean_name(star.name()), pos.size()-1));
+}
+
+/** Adds a target with an ephemeris.
+ * \param star the target
+ * \param ephem its ephemeris
+ */
+void Observing::Catalogue::add(const Subs::Star& star, const Subs::Ephem& ephem){
+  add(star);
+  eph.back()    = ephem;
+  peph.back()   = Precise_Ephem(ephem);
+  haseph.back() = 1;
+}
+
+/** Reserves space for a number of targets, to avoid re-allocation when
+ * adding many of them one by one.
+ * \param n number of targets
+ */
+void Observing::Catalogue::reserve(size_t n){
+  pos.reserve(n);
+  eph.reserve(n);
+  peph.reserve(n);
+  haseph.reserve(n);
+  noff.reserve(n+1);
+}
+
+/** Finds a target by name. Names are compared after clean_name, so that
+ * the spacing within them does not matter.
+ * \param name the name
+ * \return index of the first target of that name, or size() if there is none
+ */
+size_t Observing::Catalogue::find(const std::string& name) const {
+  std::map<std::string,size_t>::const_iterator it = index.find(clean_name(name));
+  return it == index.end() ? size() : it->second;
+}
+
+/** Removes leading and trailing white space from a name and collapses
+ * internal runs of it to single blanks, so that names typed in different
+ * ways can be matched.
+ * \param name the name
+ * \return the cleaned name
+ */
+std::string Observing::clean_name(const std::string& name){
+  std::istringstream istr(name);
+  std::string word, result;
+  while(istr >> word){
+    if(!result.empty()) result += ' ';
+    result += word;
+  }
+  return result;
+}
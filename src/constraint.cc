@@ -0,0 +1,359 @@
+// Constraints on when targets can be observed, combined with And and Or and
+// evaluated over a grid of times shared by all targets.
+
+#include <cmath>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include "trm/subs.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+#include "trm/ephem.h"
+#include "trm/observing.h"
+#include "trm/moon.h"
+#include "trm/constraint.h"
+
+/** Constructor.
+ * \param tel    the telescope
+ * \param tstart first time
+ * \param tend   last time
+ * \param step   maximum spacing, minutes. The spacing is adjusted to fit the interval exactly.
+ */
+Observing::Grid::Grid(const Subs::Telescope& tel, const Subs::Time& tstart, const Subs::Time& tend, double step) :
+  tel(tel), t0(tstart.mjd()), moon_ready(false) {
+  if(tend < tstart || step <= 0.)
+    throw Observing_Error("Observing::Grid: invalid interval or step");
+  double span = tend.mjd() - t0;
+  npoint = std::max(size_t(2), size_t(ceil(1440.*span/step)) + 1);
+  dt     = span/(npoint-1);
+}
+
+//! Altitude of the Sun at time i, computed for all times on the first call
+double Observing::Grid::sunalt(size_t i) const {
+  if(sun.empty()){
+    sun.resize(npoint);
+    Subs::Position Sun;
+    Subs::Time time;
+    for(size_t j=0; j<npoint; j++){
+      time.set(mjd(j));
+      Sun.set_to_sun(time, tel);
+      sun[j] = Sun.altaz(time, tel).alt_obs;
+    }
+  }
+  return sun[i];
+}
+
+//! The Moon over the grid, set up on the first call
+const Observing::Moon& Observing::Grid::moon() const {
+  if(!moon_ready){
+    lunar.set(tel, Subs::Time(t0), Subs::Time(mjd(npoint-1)));
+    moon_ready = true;
+  }
+  return lunar;
+}
+
+/** Computes the altitude of the Sun at every time, and the Moon if wanted,
+ * after which the Grid does not change and can be used by several threads
+ * at once.
+ * \param with_moon true to set up the Moon as well
+ */
+void Observing::Grid::prepare(bool with_moon) const {
+  sunalt(0);
+  if(with_moon) moon();
+}
+
+/** Converts a mask into time intervals. Each run of set points becomes an
+ * interval extending half a step either side, clipped to the grid.
+ * \param mask  mask over the grid
+ * \param ivals the start and end UTC MJDs of each interval
+ */
+void Observing::Grid::intervals(const std::vector<char>& mask, std::vector<std::pair<double,double> >& ivals) const {
+  ivals.clear();
+  size_t i = 0;
+  while(i < npoint){
+    while(i < npoint && !mask[i]) i++;
+    if(i == npoint) break;
+    size_t j = i;
+    while(j < npoint && mask[j]) j++;
+    ivals.push_back(std::make_pair(std::max(t0, mjd(i)-dt/2.), std::min(mjd(npoint-1), mjd(j-1)+dt/2.)));
+    i = j;
+  }
+}
+
+/** Constructor.
+ * \param grid the grid
+ * \param obj  the target, which must outlive the Evaluation
+ * \param eph  its ephemeris, or 0 if there is none
+ */
+Observing::Evaluation::Evaluation(const Grid& grid, const Subs::Position& obj, const Subs::Ephem* eph) :
+  grd(grid), obj(&obj), eph(eph), alt(grid.size()), phs(grid.size()),
+  alt_ok(grid.size(), 0), phs_ok(grid.size(), 0) {}
+
+//! Position of the target in the sky at time i
+const Subs::Altaz& Observing::Evaluation::altaz(size_t i){
+  if(!alt_ok[i]){
+    Subs::Time time(grd.mjd(i));
+    alt[i]    = obj->altaz(time, grd.telescope());
+    alt_ok[i] = 1;
+  }
+  return alt[i];
+}
+
+//! Orbital phase of the target at time i. Throws an Observing_Error if it has no ephemeris.
+double Observing::Evaluation::phase(size_t i){
+  if(!phs_ok[i]){
+    if(!eph) throw Observing_Error("Observing::Evaluation::phase: target has no ephemeris");
+    Subs::Time time(grd.mjd(i));
+    phs[i]    = time_to_phase(*obj, *eph, time, grd.telescope());
+    phs_ok[i] = 1;
+  }
+  return phs[i];
+}
+
+namespace {
+
+  // True if x lies in the range x1 to x2 of a quantity that repeats every
+  // period, with ranges for which x2 < x1 running through the wrap point.
+  bool in_range(double x, double x1, double x2, double period){
+    if(x2 - x1 >= period) return true;
+    double len = x2 - x1, off = x - x1;
+    len -= period*floor(len/period);
+    off -= period*floor(off/period);
+    return off <= len;
+  }
+
+}
+
+void Observing::Airmass_Limit::apply(Evaluation& eval, std::vector<char>& mask) const {
+  for(size_t i=0; i<mask.size(); i++){
+    if(mask[i]){
+      double am = eval.altaz(i).airmass;
+      mask[i] = am > 0.5 && am < airmass;
+    }
+  }
+}
+
+void Observing::Sun_Limit::apply(Evaluation& eval, std::vector<char>& mask) const {
+  for(size_t i=0; i<mask.size(); i++)
+    if(mask[i]) mask[i] = eval.grid().sunalt(i) < sunalt;
+}
+
+void Observing::Hour_Angle_Range::apply(Evaluation& eval, std::vector<char>& mask) const {
+  for(size_t i=0; i<mask.size(); i++)
+    if(mask[i]) mask[i] = in_range(eval.altaz(i).ha, ha1, ha2, 24.);
+}
+
+void Observing::Moon_Limit::apply(Evaluation& eval, std::vector<char>& mask) const {
+  const Moon& moon = eval.grid().moon();
+  for(size_t i=0; i<mask.size(); i++)
+    if(mask[i]) mask[i] = !moon.too_close(eval.target(), eval.grid().mjd(i), moonsep);
+}
+
+void Observing::Phase_Limit::apply(Evaluation& eval, std::vector<char>& mask) const {
+  for(size_t i=0; i<mask.size(); i++)
+    if(mask[i]) mask[i] = in_range(eval.phase(i), p1, p2, 1.);
+}
+
+void Observing::Time_Window::apply(Evaluation& eval, std::vector<char>& mask) const {
+  for(size_t i=0; i<mask.size(); i++){
+    if(mask[i]){
+      double mjd = eval.grid().mjd(i);
+      mask[i] = in_range(24.*(mjd-floor(mjd)), ut1, ut2, 24.);
+    }
+  }
+}
+
+//! Adds a member, keeping them in order of increasing cost
+Observing::And& Observing::And::add(const Constraint_Ptr& con){
+  member.insert(std::upper_bound(member.begin(), member.end(), con,
+				 [](const Constraint_Ptr& c1, const Constraint_Ptr& c2){return c1->cost() < c2->cost();}), con);
+  return *this;
+}
+
+// Members are applied in turn, each only seeing the points that passed the
+// ones before, stopping if none are left
+void Observing::And::apply(Evaluation& eval, std::vector<char>& mask) const {
+  for(size_t m=0; m<member.size(); m++){
+    if(std::find(mask.begin(), mask.end(), 1) == mask.end()) return;
+    member[m]->apply(eval, mask);
+  }
+}
+
+double Observing::And::cost() const {
+  double sum = 0.;
+  for(size_t m=0; m<member.size(); m++) sum += member[m]->cost();
+  return sum;
+}
+
+bool Observing::And::needs_moon() const {
+  for(size_t m=0; m<member.size(); m++)
+    if(member[m]->needs_moon()) return true;
+  return false;
+}
+
+//! Adds a member, keeping them in order of increasing cost
+Observing::Or& Observing::Or::add(const Constraint_Ptr& con){
+  member.insert(std::upper_bound(member.begin(), member.end(), con,
+				 [](const Constraint_Ptr& c1, const Constraint_Ptr& c2){return c1->cost() < c2->cost();}), con);
+  return *this;
+}
+
+// Each member is only tried on the points that no earlier one has
+// satisfied, stopping once all are satisfied
+void Observing::Or::apply(Evaluation& eval, std::vector<char>& mask) const {
+  std::vector<char> pending = mask, result(mask.size(), 0), trial;
+  for(size_t m=0; m<member.size(); m++){
+    trial = pending;
+    member[m]->apply(eval, trial);
+    bool left = false;
+    for(size_t i=0; i<mask.size(); i++){
+      if(trial[i]){
+	result[i]  = 1;
+	pending[i] = 0;
+      }
+      if(pending[i]) left = true;
+    }
+    if(!left) break;
+  }
+  mask = result;
+}
+
+double Observing::Or::cost() const {
+  double sum = 0.;
+  for(size_t m=0; m<member.size(); m++) sum += member[m]->cost();
+  return sum;
+}
+
+bool Observing::Or::needs_moon() const {
+  for(size_t m=0; m<member.size(); m++)
+    if(member[m]->needs_moon()) return true;
+  return false;
+}
+
+namespace {
+
+  // Recursive descent parser of constraint expressions:
+  //
+  //  expr   := term { '|' term }
+  //  term   := factor { '&' factor }
+  //  factor := '(' expr ')' | name '(' number { ',' number } ')'
+
+  class Parser {
+  public:
+    Parser(const std::string& str) : str(str), pos(0) {}
+
+    Observing::Constraint_Ptr parse(){
+      Observing::Constraint_Ptr con = expr();
+      skip();
+      if(pos != str.size()) error("unexpected characters");
+      return con;
+    }
+
+  private:
+
+    void error(const std::string& what) const {
+      throw Observing::Observing_Error("Observing::parse_constraint: " + what + " at character " +
+				       Subs::str(pos+1) + " of \"" + str + "\"");
+    }
+
+    void skip(){
+      while(pos < str.size() && isspace(str[pos])) pos++;
+    }
+
+    bool accept(char c){
+      skip();
+      if(pos < str.size() && str[pos] == c){
+	pos++;
+	return true;
+      }
+      return false;
+    }
+
+    void expect(char c){
+      if(!accept(c)) error(std::string("expected '") + c + "'");
+    }
+
+    Observing::Constraint_Ptr expr(){
+      Observing::Constraint_Ptr con = term();
+      if(!accept('|')) return con;
+      std::shared_ptr<Observing::Or> any(new Observing::Or);
+      any->add(con);
+      do{
+	any->add(term());
+      }while(accept('|'));
+      return any;
+    }
+
+    Observing::Constraint_Ptr term(){
+      Observing::Constraint_Ptr con = factor();
+      if(!accept('&')) return con;
+      std::shared_ptr<Observing::And> all(new Observing::And);
+      all->add(con);
+      do{
+	all->add(factor());
+      }while(accept('&'));
+      return all;
+    }
+
+    Observing::Constraint_Ptr factor(){
+      if(accept('(')){
+	Observing::Constraint_Ptr con = expr();
+	expect(')');
+	return con;
+      }
+
+      skip();
+      size_t start = pos;
+      while(pos < str.size() && isalpha(str[pos])) pos++;
+      std::string name = str.substr(start, pos-start);
+      if(name.empty()) error("expected a constraint name");
+
+      std::vector<double> arg;
+      expect('(');
+      do{
+	skip();
+	const char* beg = str.c_str() + pos;
+	char* end;
+	double x = strtod(beg, &end);
+	if(end == beg) error("expected a number");
+	pos += end - beg;
+	arg.push_back(x);
+      }while(accept(','));
+      expect(')');
+
+      if(name == "airmass" && arg.size() == 1) return Observing::Constraint_Ptr(new Observing::Airmass_Limit(arg[0]));
+      if(name == "sun"     && arg.size() == 1) return Observing::Constraint_Ptr(new Observing::Sun_Limit(arg[0]));
+      if(name == "ha"      && arg.size() == 2) return Observing::Constraint_Ptr(new Observing::Hour_Angle_Range(arg[0], arg[1]));
+      if(name == "moon"    && arg.size() == 1) return Observing::Constraint_Ptr(new Observing::Moon_Limit(arg[0]));
+      if(name == "phase"   && arg.size() == 2) return Observing::Constraint_Ptr(new Observing::Phase_Limit(arg[0], arg[1]));
+      if(name == "ut"      && arg.size() == 2) return Observing::Constraint_Ptr(new Observing::Time_Window(arg[0], arg[1]));
+      pos = start;
+      error("unknown constraint or wrong number of arguments, \"" + name + "\"");
+      return Observing::Constraint_Ptr();
+    }
+
+    const std::string& str;
+    size_t pos;
+  };
+
+}
+
+/** Builds a constraint from an expression made of the following, combined
+ * with & (and), | (or) and parentheses, & binding more tightly than |:
+ *
+ *  airmass(a)    -- airmass less than a
+ *  sun(s)        -- Sun below s degrees
+ *  ha(h1,h2)     -- hour angle from h1 to h2 hours
+ *  moon(d)       -- at least d degrees from the Moon while it is up
+ *  phase(p1,p2)  -- orbital phase from p1 to p2
+ *  ut(u1,u2)     -- UT from u1 to u2 hours
+ *
+ * Ranges with the second value less than the first run through the wrap
+ * point, e.g. ut(22,2) or phase(0.9,0.1). Throws an Observing_Error if the
+ * expression cannot be understood.
+ */
+Observing::Constraint_Ptr Observing::parse_constraint(const std::string& expr){
+  Parser parser(expr);
+  return parser.parse();
+}
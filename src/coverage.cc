@@ -0,0 +1,242 @@
+// Observing::Coverage: accumulation of observed orbital phase ranges into
+// coverage fractions, gaps and histograms.
+
+#include <cmath>
+#include <algorithm>
+#include "trm/subs.h"
+#include "trm/coverage.h"
+
+namespace {
+
+  // Segments shorter than this are rounding noise from the folding
+  const double EPS = 1.e-10;
+
+  // Orders gaps by their start
+  struct Gap_Start {
+    bool operator()(const Observing::Coverage::Gap& g1, const Observing::Coverage::Gap& g2) const {
+      return g1.lo < g2.lo;
+    }
+  };
+
+  // End point of a folded range, used for the sweep
+  struct Edge {
+    Edge(double p, int dall, int dgood) : p(p), dall(dall), dgood(dgood) {}
+    double p;
+    int dall, dgood;
+    bool operator<(const Edge& edge) const {return p < edge.p;}
+  };
+
+}
+
+/** Adds a range of phase. The phases need not lie in [0,1): the range is
+ * folded, any whole cycles it spans being counted separately.
+ * \param p1   start phase
+ * \param p2   end phase
+ * \param poor true if the data were taken in poor conditions
+ */
+void Observing::Coverage::add(double p1, double p2, bool poor){
+  if(p2 < p1) std::swap(p1, p2);
+  nrange++;
+  ready = false;
+  gaps_ready[0] = gaps_ready[1] = false;
+
+  double length = p2 - p1;
+  int full = int(floor(length));
+  ncycle += full;
+  if(!poor) ncycle_good += full;
+  length -= full;
+  if(length <= 0.) return;
+
+  Range r;
+  r.poor = poor;
+  r.lo   = p1 - floor(p1);
+  r.hi   = r.lo + length;
+  if(r.hi <= 1.){
+    range.push_back(r);
+  }else{
+    double hi = r.hi - 1.;
+    r.hi = 1.;
+    range.push_back(r);
+    r.lo = 0.;
+    r.hi = hi;
+    range.push_back(r);
+  }
+}
+
+//! Clears all ranges
+void Observing::Coverage::clear(){
+  ncycle = ncycle_good = 0;
+  nrange = 0;
+  ready  = true;
+  gaps_ready[0] = gaps_ready[1] = false;
+  range.clear();
+  segment.clear();
+}
+
+/** Sweeps through the sorted end points of the ranges to divide [0,1) into
+ * segments of constant multiplicity. Neighbouring segments with the same
+ * counts are merged, and end points closer together than EPS are treated
+ * as coincident.
+ */
+void Observing::Coverage::compute(){
+  if(ready && !segment.empty()) return;
+
+  std::vector<Edge> edge;
+  edge.reserve(2*range.size());
+  for(size_t i=0; i<range.size(); i++){
+    int dgood = range[i].poor ? 0 : 1;
+    edge.push_back(Edge(range[i].lo,  1,  dgood));
+    edge.push_back(Edge(range[i].hi, -1, -dgood));
+  }
+  std::sort(edge.begin(), edge.end());
+
+  segment.clear();
+  int nall = ncycle, ngood = ncycle_good;
+  double prev = 0.;
+  for(size_t i=0; i<=edge.size(); i++){
+    double p = i < edge.size() ? edge[i].p : 1.;
+    if(p > prev + EPS){
+      if(!segment.empty() && segment.back().nall == nall && segment.back().ngood == ngood)
+	segment.back().hi = p;
+      else
+	segment.push_back(Segment(prev, p, nall, ngood));
+      prev = p;
+    }
+    if(i < edge.size()){
+      nall  += edge[i].dall;
+      ngood += edge[i].dgood;
+    }
+  }
+  ready = true;
+}
+
+//! Returns the segments dividing up [0,1), with their counts
+const std::vector<Observing::Coverage::Segment>& Observing::Coverage::segments(){
+  compute();
+  return segment;
+}
+
+/** Fraction of the orbit that has been observed at least once
+ * \param good_only true to ignore data taken in poor conditions
+ */
+double Observing::Coverage::fraction(bool good_only){
+  compute();
+  double sum = 0.;
+  for(size_t i=0; i<segment.size(); i++)
+    if((good_only ? segment[i].ngood : segment[i].nall) > 0) sum += segment[i].hi - segment[i].lo;
+  return sum;
+}
+
+/** Observed phase ranges after merging overlaps
+ * \param ranges    the ranges, in order of phase
+ * \param good_only true to ignore data taken in poor conditions
+ */
+void Observing::Coverage::intervals(std::vector<Gap>& ranges, bool good_only){
+  compute();
+  ranges.clear();
+  for(size_t i=0; i<segment.size(); i++){
+    if((good_only ? segment[i].ngood : segment[i].nall) > 0){
+      if(!ranges.empty() && ranges.back().hi == segment[i].lo)
+	ranges.back().hi = segment[i].hi;
+      else
+	ranges.push_back(Gap(segment[i].lo, segment[i].hi));
+    }
+  }
+}
+
+/** Unobserved phase ranges. A gap that runs through phase 0 is returned 
+ * as a single gap that starts below 1 and ends above it.
+ * \param gap       the gaps, longest first
+ * \param good_only true to ignore data taken in poor conditions
+ */
+void Observing::Coverage::gaps(std::vector<Gap>& gap, bool good_only){
+  compute();
+  gap.clear();
+  for(size_t i=0; i<segment.size(); i++){
+    if((good_only ? segment[i].ngood : segment[i].nall) == 0){
+      if(!gap.empty() && gap.back().hi == segment[i].lo)
+	gap.back().hi = segment[i].hi;
+      else
+	gap.push_back(Gap(segment[i].lo, segment[i].hi));
+    }
+  }
+  if(gap.size() > 1 && gap.front().lo == 0. && gap.back().hi == 1.){
+    gap.back().hi += gap.front().hi;
+    gap.erase(gap.begin());
+  }
+  std::sort(gap.begin(), gap.end());
+}
+
+/** Histogram of the number of times each phase has been observed. Each
+ * bin holds the mean count over its width.
+ * \param nbin      number of bins across [0,1)
+ * \param hist      the histogram
+ * \param good_only true to ignore data taken in poor conditions
+ */
+void Observing::Coverage::histogram(int nbin, std::vector<double>& hist, bool good_only){
+  compute();
+  hist.assign(nbin, 0.);
+  for(size_t i=0; i<segment.size(); i++){
+    int n = good_only ? segment[i].ngood : segment[i].nall;
+    if(n == 0) continue;
+    int b1 = std::max(0,      int(floor(nbin*segment[i].lo)));
+    int b2 = std::min(nbin-1, int(ceil(nbin*segment[i].hi))-1);
+    for(int b=b1; b<=b2; b++){
+      double lo = std::max(segment[i].lo, double(b)/nbin);
+      double hi = std::min(segment[i].hi, double(b+1)/nbin);
+      if(hi > lo) hist[b] += nbin*n*(hi-lo);
+    }
+  }
+}
+
+/** Works out how much of the orbit not yet covered would be covered by
+ * observing over a given range of phase. The range is not folded, so it can
+ * span several cycles, but each unobserved phase only counts once.
+ * \param p1        start of the range (cycle number plus phase)
+ * \param p2        end of the range
+ * \param pieces    the parts of p1 to p2 that fall in gaps, in order of 
+ *                  phase and in the same (unfolded) units as p1 and p2
+ * \param good_only true to treat data taken in poor conditions as gaps
+ * \return the fraction of the orbit that would be newly covered
+ */
+double Observing::Coverage::gain(double p1, double p2, std::vector<Gap>& pieces, bool good_only){
+  int ig = good_only ? 1 : 0;
+  if(!gaps_ready[ig]){
+    gaps(gap_cache[ig], good_only);
+    gaps_ready[ig] = true;
+  }
+  const std::vector<Gap>& gap = gap_cache[ig];
+
+  pieces.clear();
+  double total = 0.;
+  std::vector<Gap> local;
+  for(size_t i=0; i<gap.size(); i++){
+    local.clear();
+    long kmin = long(floor(p1 - gap[i].hi)), kmax = long(ceil(p2 - gap[i].lo));
+    for(long k=kmin; k<=kmax; k++){
+      double lo = std::max(p1, gap[i].lo + k), hi = std::min(p2, gap[i].hi + k);
+      if(hi > lo){
+	pieces.push_back(Gap(lo, hi));
+	local.push_back(Gap(lo - k, hi - k));
+      }
+    }
+
+    // overlaps from different cycles may cover the same part of the gap
+    if(local.size() > 1){
+      std::sort(local.begin(), local.end(), Gap_Start());
+      double lo = local[0].lo, hi = local[0].hi;
+      for(size_t j=1; j<local.size(); j++){
+	if(local[j].lo > hi){
+	  total += hi - lo;
+	  lo = local[j].lo;
+	}
+	hi = std::max(hi, local[j].hi);
+      }
+      total += hi - lo;
+    }else if(local.size() == 1){
+      total += local[0].length();
+    }
+  }
+  std::sort(pieces.begin(), pieces.end(), Gap_Start());
+  return total;
+}
@@ -46,12 +46,33 @@ Arguments:
   pend2 :
     End of second phase range to indicate. Put less than pstart2 to ignore.
 
+  limits :
+    File of horizon, declination and hour angle limits of the telescope in
+    the format described in trm/limits.h, or 'none' to apply only the airmass
+    limit (hidden, default none)
+
+  threads :
+    Number of threads to use (hidden, default 0, meaning one per core)
+
+  stats :
+    Counts of the expensive calls and the time spent in each phase of the
+    run: 'none', 'text' for a table or 'json' for JSON, both on stderr, or
+    the name of a file to write JSON to. Only collected if the package was
+    configured with --enable-stats. (hidden, default none)
+
+  trace :
+    Name of a file to write a timeline of the run to, in the Chrome
+    trace-event JSON format read by chrome://tracing and Perfetto, showing
+    when each thread loads, computes and writes; 'none' for no timeline.
+    (hidden, default none)
+
 !!sphinx
 
 */
 
 #include <cstdlib>
 #include <string>
+#include <exception>
 #include <iostream>
 #include <sstream>
 #include <vector>
@@ -67,8 +88,12 @@ Arguments:
 #include "trm/ephem.h"
 #include "trm/position.h"
 #include "trm/star.h"
-#include "trm/binary_star.h"
 #include "trm/observing.h"
+#include "trm/limits.h"
+#include "trm/batch.h"
+#include "trm/catalogue.h"
+#include "trm/stats.h"
+#include "trm/trace.h"
 
 int main(int argc, char *argv[]){
 
@@ -87,6 +112,10 @@ int main(int argc, char *argv[]){
 	input.sign_in("pend1",     Subs::Input::LOCAL,  Subs::Input::PROMPT);
 	input.sign_in("pstart2",   Subs::Input::LOCAL,  Subs::Input::PROMPT);
 	input.sign_in("pend2",     Subs::Input::LOCAL,  Subs::Input::PROMPT);
+	input.sign_in("limits",    Subs::Input::GLOBAL, Subs::Input::NOPROMPT);
+	input.sign_in("threads",   Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+	input.sign_in("stats",     Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+	input.sign_in("trace",     Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
 
 	// Get inputs
 	std::string device;
@@ -94,28 +123,18 @@ int main(int argc, char *argv[]){
 
 	std::string starfile;
 	input.get_value("stars", starfile, "stardata", "file of star positions and ephemerides");
+	std::string strace;
+	input.get_value("trace", strace, "none", "file for a trace-event timeline of the run ('none' to ignore)");
+	if(strace != "none") Observing::Trace::start(strace);
 
 	// Load star data
-	std::ifstream file(starfile.c_str());
-	if(!file) throw std::string("Could not open file = ") + starfile;
-
-	Subs::Star   star;
-	Subs::Ephem  eph;
-	std::vector<Subs::Binary>  binary;
-	while(file >> star){
-	    if(file >> eph){
-		binary.push_back(Subs::Binary( star, eph));
-	    }else{
-		if(file.bad()){
-		    file.close();
-		    throw std::string("File stream corrupted");
-		}
-		file.clear();
-	    }
+	Observing::Catalogue catalogue;
+	{
+	    OBSERVING_TIME(LOAD);
+	    catalogue.load(starfile, true);
 	}
-	file.close();
-	std::cout << "Found position and ephemeris data on " << binary.size() << " stars " << std::endl;
-	if(binary.size() == 0)
+	std::cout << "Found position and ephemeris data on " << catalogue.size() << " stars " << std::endl;
+	if(catalogue.size() == 0)
 	    throw std::string("Cannot have 0 stars!");
 
 	std::string sdate;
@@ -137,199 +156,221 @@ int main(int argc, char *argv[]){
 	input.get_value("pstart2", pstart2, 0.95f, 0.f, 1.f, "start phase of region 2");
 	float pend2;
 	input.get_value("pend2", pend2, 1.05f, 0.f, std::min(pstart2+1.f,2.f), "end phase of region 2");
+	std::string slimits;
+	input.get_value("limits", slimits, "none", "file of telescope horizon and pointing limits ('none' to ignore)");
+	Observing::Limits limits;
+	if(slimits != "none") limits.load(slimits);
+	int nthread;
+	input.get_value("threads", nthread, 0, 0, 1024, "number of threads (0 for one per core)");
+	std::string sstats;
+	input.get_value("stats", sstats, "none", "statistics to report (none, text, json or a file for JSON)");
 
 
 	Subs::Time time(date), sunset, twiend, twistart, sunrise;
 	time.add_hour(12.-telescope.longitude()/15.);
 
-	if(!Observing::suntime(telescope, time, -1., sunset))
-	    throw std::string("Could not find sunset!!");
-	if(!Observing::suntime(telescope, sunset, -15., twiend))
-	    throw std::string("Sun never gets to -15 in evening!!");
-
-	time   = twiend;
-	time.add_hour(0.1);   
-	if(!Observing::suntime(telescope, time, -15., twistart))
-	    throw std::string("Sun never gets to -15 in morning!!");
-	if(!Observing::suntime(telescope, twistart, -1., sunrise))
-	    throw std::string("Could not find sunset!!");
+	{
+	    OBSERVING_TIME(NIGHTS);
+	    if(!Observing::suntime(telescope, time, -1., sunset))
+		throw std::string("Could not find sunset!!");
+	    if(!Observing::suntime(telescope, sunset, -15., twiend))
+		throw std::string("Sun never gets to -15 in evening!!");
+
+	    time   = twiend;
+	    time.add_hour(0.1);   
+	    if(!Observing::suntime(telescope, time, -15., twistart))
+		throw std::string("Sun never gets to -15 in morning!!");
+	    if(!Observing::suntime(telescope, twistart, -1., sunrise))
+		throw std::string("Could not find sunset!!");
+	}
 
 	std::cout << "Sunset to sunrise: " << sunset << " to " << sunrise  << std::endl;
 	std::cout << "       Sun < -15.: " << twiend << " to " << twistart << std::endl;
 
-	Subs::Plot plot(device);
+	// Times when each object is visible, limited by sunrise and set,
+	// computed in parallel before any plotting
+	std::vector<Observing::Visibility> vis(catalogue.size());
+	{
+	    OBSERVING_TIME(VISIBILITY);
+	    Observing::parallel_for(catalogue.size(), nthread, [&](size_t j, Observing::Context&){
+		    vis[j].visible = Observing::when_visible(catalogue.position(j), telescope, limits, sunset, sunrise, airmass,
+							     vis[j].first, vis[j].last);
+		});
+	}
 
-	cpgsch(1.5);
-	cpgslw(2);
-	cpgscf(2);
-	cpgsci(4);
+	{
+	    OBSERVING_TIME(OUTPUT);
+	    OBSERVING_SPAN("output");
+	    Subs::Plot plot(device);
 
-	const int NRANGE = pend2 > pstart2 ? 2 : 1;
-	double ut1 = sunset.hour(), ut2 = ut1 + 24.*(sunrise.mjd()-sunset.mjd());
-	cpgsvp(0.24,0.96,0.15,0.87);
-	Subs::ut_plot(ut1, ut2, 0., binary.size()+3+NRANGE, false);
-	cpgsci(2);
-	cpglab("UT"," ",date.str().c_str());
+	    cpgsch(1.5);
+	    cpgslw(2);
+	    cpgscf(2);
+	    cpgsci(4);
 
-	cpgsch(1.);
-	cpgptxt(ut1, 1.03*(binary.size()+3+NRANGE), 0., 0.5,"sunset");
-	cpgptxt(ut2, 1.03*(binary.size()+3+NRANGE), 0., 0.5,"sunrise");
-	cpgsch(1.5);
+	    const int NRANGE = pend2 > pstart2 ? 2 : 1;
+	    double ut1 = sunset.hour(), ut2 = ut1 + 24.*(sunrise.mjd()-sunset.mjd());
+	    cpgsvp(0.24,0.96,0.15,0.87);
+	    Subs::ut_plot(ut1, ut2, 0., catalogue.size()+3+NRANGE, false);
+	    cpgsci(2);
+	    cpglab("UT"," ",date.str().c_str());
 
-	const double MJD2JD = 2400000.5;
+	    cpgsch(1.);
+	    cpgptxt(ut1, 1.03*(catalogue.size()+3+NRANGE), 0., 0.5,"sunset");
+	    cpgptxt(ut2, 1.03*(catalogue.size()+3+NRANGE), 0., 0.5,"sunrise");
+	    cpgsch(1.5);
 
-	double mjd0 = floor(sunset.mjd());
-	double twi1 = 24.*(twiend.mjd()-mjd0);
-	double twi2 = 24.*(twistart.mjd()-mjd0);
-	float x, y;
+	    double mjd0 = floor(sunset.mjd());
+	    double twi1 = 24.*(twiend.mjd()-mjd0);
+	    double twi2 = 24.*(twistart.mjd()-mjd0);
+	    float x, y;
 
-	for(size_t j=0; j<binary.size(); j++){
+	    for(size_t j=0; j<catalogue.size(); j++){
 
-	    // Print name
-	    cpgsci(2);
-	    cpgsch(1.2);
-	    x = ut1-(ut2-ut1)/30.;
-	    y = binary.size() - j;
-	    cpgslw(1);
-	    cpgptxt(x,y,0.,1.,binary[j].name().c_str());
+		// Print name
+		cpgsci(2);
+		cpgsch(1.2);
+		x = ut1-(ut2-ut1)/30.;
+		y = catalogue.size() - j;
+		cpgslw(1);
+		cpgptxt(x,y,0.,1.,catalogue.name(j).c_str());
+
+		const Subs::Position& pos = catalogue.position(j);
+		const Subs::Ephem&    eph = catalogue.ephem(j);
+		const Observing::Precise_Ephem& peph = catalogue.precise(j);
 	
-	    // Times when object is visible, limited by sunrise and set
-	    Subs::Time tfirst, tlast;
-	    if(Observing::when_visible(binary[j], telescope, sunset, sunrise, airmass, tfirst, tlast)){
+		const Subs::Time& tfirst = vis[j].first;
+		const Subs::Time& tlast  = vis[j].last;
+		if(vis[j].visible){
 	    
-		double t1 = 24.*(tfirst.mjd()-mjd0), t2 = 24.*(tlast.mjd()-mjd0);
-		time.set((sunset.mjd()+sunrise.mjd())/2.);
+		    double t1 = 24.*(tfirst.mjd()-mjd0), t2 = 24.*(tlast.mjd()-mjd0);
+		    time.set((sunset.mjd()+sunrise.mjd())/2.);
 	    
-		// Plot dashed line for visible period
-		cpgsci(1);
-		cpgsls(2);
-		cpgslw(1);
-		cpgmove(t1,y);
-		cpgdraw(t2,y);
-	    
-		double off, offm; 
-		if(binary[j].get_tscale() == Subs::Ephem::HJD || binary[j].get_tscale() == Subs::Ephem::HMJD){
-		    offm = off = binary[j].tcorr_hel(tfirst, telescope)/Constants::DAY;
-		}else if(binary[j].get_tscale() == Subs::Ephem::BJD || binary[j].get_tscale() == Subs::Ephem::BMJD){
-		    offm = off = (tfirst.dtt() + binary[j].tcorr_bar(tfirst, telescope))/Constants::DAY;
-		}else{
-		    throw std::string("Could not recognize type of timescale for star = " + binary[j].name());
-		}
+		    // Plot dashed line for visible period
+		    cpgsci(1);
+		    cpgsls(2);
+		    cpgslw(1);
+		    cpgmove(t1,y);
+		    cpgdraw(t2,y);
 	    
-		double time = tfirst.mjd() + off;
-		if(binary[j].get_tscale() == Subs::Ephem::HJD || binary[j].get_tscale() == Subs::Ephem::BJD)
-		    time += MJD2JD;
+		    double off, offm; 
+		    if(eph.get_tscale() == Subs::Ephem::HJD || eph.get_tscale() == Subs::Ephem::HMJD){
+			OBSERVING_COUNT(TCORR_HEL);
+			offm = off = pos.tcorr_hel(tfirst, telescope)/Constants::DAY;
+		    }else if(eph.get_tscale() == Subs::Ephem::BJD || eph.get_tscale() == Subs::Ephem::BMJD){
+			OBSERVING_COUNT(TCORR_BAR);
+			offm = off = (tfirst.dtt() + pos.tcorr_bar(tfirst, telescope))/Constants::DAY;
+		    }else{
+			throw std::string("Could not recognize type of timescale for star = " + catalogue.name(j));
+		    }
 	    
-		double phase1 = binary[j].phase(time);
+		    double phase1 = peph.phase(tfirst.mjd() + off);
 	    
-		if(binary[j].get_tscale() == Subs::Ephem::HJD || binary[j].get_tscale() == Subs::Ephem::HMJD){
-		    off = binary[j].tcorr_hel(tlast, telescope)/Constants::DAY;
-		}else if(binary[j].get_tscale() == Subs::Ephem::BJD || binary[j].get_tscale() == Subs::Ephem::BMJD){
-		    off = (tlast.dtt() + binary[j].tcorr_bar(tlast, telescope))/Constants::DAY;
-		}
+		    if(eph.get_tscale() == Subs::Ephem::HJD || eph.get_tscale() == Subs::Ephem::HMJD){
+			OBSERVING_COUNT(TCORR_HEL);
+			off = pos.tcorr_hel(tlast, telescope)/Constants::DAY;
+		    }else if(eph.get_tscale() == Subs::Ephem::BJD || eph.get_tscale() == Subs::Ephem::BMJD){
+			OBSERVING_COUNT(TCORR_BAR);
+			off = (tlast.dtt() + pos.tcorr_bar(tlast, telescope))/Constants::DAY;
+		    }
 
-		time = tlast.mjd() + off;
-		if(binary[j].get_tscale() == Subs::Ephem::HJD || binary[j].get_tscale() == Subs::Ephem::BJD)
-		    time += MJD2JD;
-		double phase2 = binary[j].phase(time);
+		    double phase2 = peph.phase(tlast.mjd() + off);
 	    
-		offm += off;
-		offm /= 2.;
+		    offm += off;
+		    offm /= 2.;
 	    
-		cpgsls(1);
-		double p1, p2;
-		double ip = floor(phase1);
-		while((p1 = ip+pstart1) < phase2){
-		    p1 = std::max(phase1, p1);
-		    p2 = std::min(phase2, ip+pend1);
-		    if(p1 < p2){
-			if(binary[j].get_tscale() == Subs::Ephem::HJD || binary[j].get_tscale() == Subs::Ephem::BJD){
-			    t1 = 24.*(binary[j].time(p1)-offm-mjd0-MJD2JD);
-			    t2 = 24.*(binary[j].time(p2)-offm-mjd0-MJD2JD);
-			}else{
-			    t1 = 24.*(binary[j].time(p1)-offm-mjd0);
-			    t2 = 24.*(binary[j].time(p2)-offm-mjd0);
-			}
-			
-			cpgsci(3);
-			cpgslw(12);
-			cpgmove(t1, y);
-			cpgdraw(t2, y);
-		    
-		    }
-		    ip++;
-		}
-		if(pend2 > pstart2){
-		    ip = floor(phase1);
-		    while((p1 = ip+pstart2) < phase2){
+		    cpgsls(1);
+		    double p1, p2;
+		    double ip = floor(phase1);
+		    while((p1 = ip+pstart1) < phase2){
 			p1 = std::max(phase1, p1);
-			p2 = std::min(phase2, ip+pend2);
+			p2 = std::min(phase2, ip+pend1);
 			if(p1 < p2){
-			    if(binary[j].get_tscale() == Subs::Ephem::HJD || binary[j].get_tscale() == Subs::Ephem::BJD){
-				t1 = 24.*(binary[j].time(p1)-offm-mjd0-MJD2JD);
-				t2 = 24.*(binary[j].time(p2)-offm-mjd0-MJD2JD);
-			    }else{
-				t1 = 24.*(binary[j].time(p1)-offm-mjd0);
-				t2 = 24.*(binary[j].time(p2)-offm-mjd0);
-			    }
+			    t1 = 24.*(peph.time(p1)-offm-mjd0);
+			    t2 = 24.*(peph.time(p2)-offm-mjd0);
 			
-			    cpgsci(2);
-			    cpgslw(6);
+			    cpgsci(3);
+			    cpgslw(12);
 			    cpgmove(t1, y);
 			    cpgdraw(t2, y);
-			
+		    
 			}
 			ip++;
 		    }
-		}
+		    if(pend2 > pstart2){
+			ip = floor(phase1);
+			while((p1 = ip+pstart2) < phase2){
+			    p1 = std::max(phase1, p1);
+			    p2 = std::min(phase2, ip+pend2);
+			    if(p1 < p2){
+				t1 = 24.*(peph.time(p1)-offm-mjd0);
+				t2 = 24.*(peph.time(p2)-offm-mjd0);
+			
+				cpgsci(2);
+				cpgslw(6);
+				cpgmove(t1, y);
+				cpgdraw(t2, y);
+			
+			    }
+			    ip++;
+			}
+		    }
 
-	    }else{
-		std::cout << binary[j].name() << " is never below airmass = " << airmass << " from sunset to sunrise." << std::endl;
+		}else{
+		    std::cout << catalogue.name(j) << " is never below airmass = " << airmass << " from sunset to sunrise." << std::endl;
+		}
 	    }
-	}
     
-	// Plot key
-	cpgsch(1.4);
-	x = ut1;
-	std::string label = "Phase range: " + Subs::str(pstart1,4) + " to " + Subs::str(pend1,4);
-	y = binary.size()+NRANGE+1;
-	cpgsci(3);
-	cpgslw(12);
-	cpgmove(x,y);
-	cpgdraw(x+(ut2-ut1)/20.,y);
-	cpgslw(1);
-	cpgptxt(x+(ut2-ut1)/15.,y-0.015,0.,0.,label.c_str());
-	if(pend2 > pstart2){
-	    label = "Phase range: " + Subs::str(pstart2,4) + " to " + Subs::str(pend2,4);
-	    y = binary.size()+NRANGE;
-	    cpgsci(2);
-	    cpgslw(6);
+	    // Plot key
+	    cpgsch(1.4);
+	    x = ut1;
+	    std::string label = "Phase range: " + Subs::str(pstart1,4) + " to " + Subs::str(pend1,4);
+	    y = catalogue.size()+NRANGE+1;
+	    cpgsci(3);
+	    cpgslw(12);
 	    cpgmove(x,y);
 	    cpgdraw(x+(ut2-ut1)/20.,y);
 	    cpgslw(1);
 	    cpgptxt(x+(ut2-ut1)/15.,y-0.015,0.,0.,label.c_str());
-	}
+	    if(pend2 > pstart2){
+		label = "Phase range: " + Subs::str(pstart2,4) + " to " + Subs::str(pend2,4);
+		y = catalogue.size()+NRANGE;
+		cpgsci(2);
+		cpgslw(6);
+		cpgmove(x,y);
+		cpgdraw(x+(ut2-ut1)/20.,y);
+		cpgslw(1);
+		cpgptxt(x+(ut2-ut1)/15.,y-0.015,0.,0.,label.c_str());
+	    }
     
-	// Plot dashed lines for when Sun is at -15
-	cpgsci(1);
-	cpgsls(2);
-	cpgmove(twi1,0.);
-	cpgdraw(twi1,1.05*binary.size());
-	cpgmove(twi2,0.);
-	cpgdraw(twi2,1.05*binary.size());
+	    // Plot dashed lines for when Sun is at -15
+	    cpgsci(1);
+	    cpgsls(2);
+	    cpgmove(twi1,0.);
+	    cpgdraw(twi1,1.05*catalogue.size());
+	    cpgmove(twi2,0.);
+	    cpgdraw(twi2,1.05*catalogue.size());
     
-	// Plot dotted lines on hour boundaries
-	cpgsls(4);
-	for(int j=int(ceil(twi1)); j<int(ceil(twi2)); j++){
-	    cpgmove(j,0.);
-	    cpgdraw(j,1.05*binary.size());
+	    // Plot dotted lines on hour boundaries
+	    cpgsls(4);
+	    for(int j=int(ceil(twi1)); j<int(ceil(twi2)); j++){
+		cpgmove(j,0.);
+		cpgdraw(j,1.05*catalogue.size());
+	    }
 	}
+
+	Observing::Trace::stop();
+	Observing::Stats::report(sstats);
     }
   
     catch(const std::string& str){
 	std::cerr << str << std::endl;
 	exit(EXIT_FAILURE);
     }
+    catch(const std::exception& exc){
+	std::cerr << exc.what() << std::endl;
+	exit(EXIT_FAILURE);
+    }
   
 }
 
@@ -0,0 +1,252 @@
+// Observing::Ephem_Fit: linear and quadratic ephemerides fitted to eclipse
+// timings, updated one timing at a time.
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include "trm/subs.h"
+#include "trm/observing.h"
+#include "trm/ephem_fit.h"
+
+/** Reads timings from a file with lines of cycle number, time and
+ * uncertainty. Blank lines and lines starting with # are skipped. Throws
+ * an Observing_Error if the file cannot be opened, a line cannot be read
+ * or an uncertainty is not positive.
+ * \param file    the file
+ * \param timings the timings, in the order of the file
+ */
+void Observing::read_timings(const std::string& file, std::vector<Timing>& timings){
+
+  std::ifstream fin(file.c_str());
+  if(!fin) throw Observing_Error("Observing::read_timings: could not open " + file);
+
+  timings.clear();
+  std::string line;
+  int nline = 0;
+  while(getline(fin, line)){
+    nline++;
+    size_t n = line.find_first_not_of(" \t\r");
+    if(n == std::string::npos || line[n] == '#') continue;
+    std::istringstream istr(line);
+    Timing t;
+    if(!(istr >> t.cycle >> t.time >> t.error))
+      throw Observing_Error("Observing::read_timings: could not read line " + Subs::str(nline) + " of " + file);
+    if(t.error <= 0.)
+      throw Observing_Error("Observing::read_timings: uncertainty must be > 0 on line " + Subs::str(nline) + " of " + file);
+    timings.push_back(t);
+  }
+}
+
+/** Constructor.
+ * \param nterm  2 for a linear ephemeris, 3 for a quadratic one
+ * \param tref   reference time, usually the first of the timings
+ * \param escale cycle scale, usually the largest cycle number expected
+ */
+Observing::Ephem_Fit::Ephem_Fit(int nterm, double tref, double escale) :
+  nterms(nterm), tref(tref), escale(escale > 0. ? escale : 1.), ntime(0), ok(false), chi2(0.) {
+  if(nterm != 2 && nterm != 3)
+    throw Observing_Error("Observing::Ephem_Fit: number of terms must be 2 or 3");
+  for(int i=0; i<3; i++){
+    x[i] = 0.;
+    for(int j=0; j<3; j++) cov[i][j] = 0.;
+  }
+}
+
+void Observing::Ephem_Fit::basis(double cycle, double a[3]) const {
+  double u = cycle/escale;
+  a[0] = 1.;
+  a[1] = u;
+  a[2] = u*u;
+}
+
+/** Adds a timing. Until there are enough timings to determine the
+ * coefficients they are held back; then the normal equations are solved,
+ * and from there on each timing is folded in by a rank-1 update of the
+ * solution and covariances.
+ * \param timing the timing
+ */
+void Observing::Ephem_Fit::add(const Timing& timing){
+
+  ntime++;
+  if(!ok){
+    pending.push_back(timing);
+    if(int(pending.size()) >= nterms && batch()) pending.clear();
+    return;
+  }
+
+  // gain k = C a / (s^2 + a' C a)
+  double a[3], ca[3], k[3];
+  basis(timing.cycle, a);
+  double y = timing.time - tref;
+  double r = y, s = timing.error*timing.error;
+  for(int i=0; i<nterms; i++){
+    r -= a[i]*x[i];
+    ca[i] = 0.;
+    for(int j=0; j<nterms; j++) ca[i] += cov[i][j]*a[j];
+    s += a[i]*ca[i];
+  }
+  for(int i=0; i<nterms; i++) k[i] = ca[i]/s;
+
+  for(int i=0; i<nterms; i++){
+    x[i] += k[i]*r;
+    for(int j=0; j<nterms; j++) cov[i][j] -= k[i]*ca[j];
+  }
+  chi2 += r*r/s;
+}
+
+/** Solves the normal equations of the pending timings by Gauss-Jordan
+ * elimination with pivoting. Returns false if they are singular, as when
+ * all the timings so far share a cycle number.
+ */
+bool Observing::Ephem_Fit::batch(){
+
+  const int n = nterms;
+  double m[3][6], a[3];
+  for(int i=0; i<n; i++)
+    for(int j=0; j<2*n; j++) m[i][j] = (j == n+i) ? 1. : 0.;
+  double b[3] = {0., 0., 0.};
+
+  for(size_t l=0; l<pending.size(); l++){
+    basis(pending[l].cycle, a);
+    double w = 1./(pending[l].error*pending[l].error);
+    double y = pending[l].time - tref;
+    for(int i=0; i<n; i++){
+      b[i] += w*a[i]*y;
+      for(int j=0; j<n; j++) m[i][j] += w*a[i]*a[j];
+    }
+  }
+
+  double big = 0.;
+  for(int i=0; i<n; i++) big = std::max(big, fabs(m[i][i]));
+
+  for(int c=0; c<n; c++){
+    int p = c;
+    for(int i=c+1; i<n; i++)
+      if(fabs(m[i][c]) > fabs(m[p][c])) p = i;
+    if(fabs(m[p][c]) <= 1.e-12*big) return false;
+    if(p != c)
+      for(int j=0; j<2*n; j++) std::swap(m[p][j], m[c][j]);
+    double d = m[c][c];
+    for(int j=0; j<2*n; j++) m[c][j] /= d;
+    for(int i=0; i<n; i++){
+      if(i != c){
+	double f = m[i][c];
+	for(int j=0; j<2*n; j++) m[i][j] -= f*m[c][j];
+      }
+    }
+  }
+
+  for(int i=0; i<n; i++){
+    x[i] = 0.;
+    for(int j=0; j<n; j++){
+      cov[i][j] = m[i][n+j];
+      x[i] += cov[i][j]*b[j];
+    }
+  }
+
+  chi2 = 0.;
+  for(size_t l=0; l<pending.size(); l++){
+    basis(pending[l].cycle, a);
+    double r = pending[l].time - tref;
+    for(int i=0; i<n; i++) r -= a[i]*x[i];
+    chi2 += r*r/(pending[l].error*pending[l].error);
+  }
+  ok = true;
+  return true;
+}
+
+/** Coefficient of the ephemeris: T0 (the time of cycle 0), the period or
+ * the quadratic term.
+ * \param i 0, 1 or 2
+ */
+double Observing::Ephem_Fit::coeff(int i) const {
+  if(i == 0) return tref + x[0];
+  if(i == 1) return x[1]/escale;
+  if(i == 2 && nterms == 3) return x[2]/(escale*escale);
+  return 0.;
+}
+
+/** Covariance of two coefficients, numbered as for coeff.
+ * \param i first coefficient
+ * \param j second coefficient
+ */
+double Observing::Ephem_Fit::covar(int i, int j) const {
+  if(i >= nterms || j >= nterms) return 0.;
+  return cov[i][j]/(pow(escale, i)*pow(escale, j));
+}
+
+double Observing::Ephem_Fit::error(int i) const {
+  return sqrt(covar(i,i));
+}
+
+/** Time of a cycle according to the fit.
+ * \param cycle the cycle number
+ */
+double Observing::Ephem_Fit::time(double cycle) const {
+  double a[3];
+  basis(cycle, a);
+  double t = 0.;
+  for(int i=0; i<nterms; i++) t += a[i]*x[i];
+  return tref + t;
+}
+
+/** Writes the state of a fit as text, to full precision, in a form that
+ * operator>> reads back. The format and precision of the stream are left
+ * as they were.
+ */
+std::ostream& Observing::operator<<(std::ostream& ostr, const Ephem_Fit& fit){
+  std::ios::fmtflags flags = ostr.flags();
+  std::streamsize prec = ostr.precision();
+  ostr << std::setprecision(17) << fit.nterms << " " << fit.tref << " " << fit.escale << " "
+       << fit.ntime << " " << fit.ok << " " << fit.chi2 << "\n";
+  for(int i=0; i<fit.nterms; i++){
+    ostr << fit.x[i];
+    for(int j=0; j<fit.nterms; j++) ostr << " " << fit.cov[i][j];
+    ostr << "\n";
+  }
+  ostr << fit.pending.size() << "\n";
+  for(size_t l=0; l<fit.pending.size(); l++)
+    ostr << fit.pending[l].cycle << " " << fit.pending[l].time << " " << fit.pending[l].error << "\n";
+  ostr.flags(flags);
+  ostr.precision(prec);
+  return ostr;
+}
+
+/** Reads the state of a fit written by operator<<. If the state cannot be
+ * read or does not hang together (a number of terms other than 2 or 3, or
+ * a number of held-back timings that does not match the number added) the
+ * failbit of the stream is set and the fit is left as it was.
+ */
+std::istream& Observing::operator>>(std::istream& istr, Ephem_Fit& fit){
+
+  Ephem_Fit f;
+  if(!(istr >> f.nterms >> f.tref >> f.escale >> f.ntime >> f.ok >> f.chi2)) return istr;
+  if((f.nterms != 2 && f.nterms != 3) || !(f.escale > 0.)){
+    istr.setstate(std::ios::failbit);
+    return istr;
+  }
+
+  for(int i=0; i<f.nterms; i++){
+    istr >> f.x[i];
+    for(int j=0; j<f.nterms; j++) istr >> f.cov[i][j];
+  }
+  size_t np = 0;
+  if(!(istr >> np)) return istr;
+
+  // timings are only held back until the first solution, so this also
+  // stops a corrupt count from being used to size anything
+  if(np != (f.ok ? 0 : f.ntime)){
+    istr.setstate(std::ios::failbit);
+    return istr;
+  }
+  Timing t;
+  for(size_t l=0; l<np && istr >> t.cycle >> t.time >> t.error; l++)
+    f.pending.push_back(t);
+
+  if(istr) fit = f;
+  return istr;
+}
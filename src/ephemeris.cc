@@ -33,17 +33,81 @@ Arguments:
   phase :
     Phase to report
 
+  moonsep :
+    Minimum separation from the Moon, degrees, applied while the Moon is up.
+    0 to ignore the Moon. (hidden, default 0)
+
+  threads :
+    Number of threads to use (hidden, default 0, meaning one per core)
+
+  fastsun :
+    true to compute the Sun from a short analytic series good to about an
+    arcminute rather than the full solar ephemeris. This is ample for twilight
+    and much faster over long runs of nights. (hidden, default false)
+
+  stats :
+    Counts of the expensive calls and the time spent in each phase of the
+    run: 'none', 'text' for a table or 'json' for JSON, both on stderr, or
+    the name of a file to write JSON to. Only collected if the package was
+    configured with --enable-stats. (hidden, default none)
+
+  trace :
+    Name of a file to write a timeline of the run to, in the Chrome
+    trace-event JSON format read by chrome://tracing and Perfetto, showing
+    when each thread loads, computes and writes; 'none' for no timeline.
+    (hidden, default none)
+
+  binary :
+    Name of a file to save the table to in binary, column by column (target
+    index, MJD, phase, phase error, airmass and Sun's altitude, as doubles,
+    with the target names), as described for Observing::Columns, or 'none'.
+    The text table is printed as well. (hidden, default none)
+
+  stream :
+    true to list the events of all the stars in time order, night by night,
+    and to skip any night on which the Sun does not reach 'sunalt' rather than
+    stopping there. Memory does not grow with the number of nights, so
+    decades can be covered in one run (except for any 'binary' table, which
+    is held until the end). (hidden, default false)
+
+  checkpoint :
+    Name of a file in which the end of the last night finished is saved as
+    an MJD, or 'none'. If the file exists when the run starts, nights and
+    events up to that time are passed over, so that a run that was stopped
+    can be started again with the same command, adding its output to what
+    was printed before. Each night's lines are held back until the
+    checkpoint that covers them has been saved, so a resumed run never
+    repeats lines; a run stopped in the moment between the two can lose
+    that night's lines instead. (hidden, default none)
+
+  batch :
+    true to answer many queries in one run. startdate, enddate and phase are
+    not asked for; instead lines of "tag startdate enddate phase [airmass=A]
+    [sunalt=S] [star]" are read from the standard input, with airmass and
+    sunalt defaulting to the values given to the program and all stars
+    included unless one is named. Each answer is lines of MJD, cycle number
+    plus phase, phase uncertainty, airmass, Sun's altitude and star name, in
+    time order, ending with a line 'ok' or 'error' and a message, all
+    starting with the tag of the query. Nights without the twilight wanted
+    are skipped. The star data and the times of twilight of each night are
+    worked out once for all the queries. moonsep, binary, stream and
+    checkpoint do not apply. (hidden, default false)
+
 !!sphinx
 
 */
 
 #include <cstdlib>
+#include <cstdio>
 #include <string>
+#include <exception>
 #include <iostream>
 #include <iomanip>
 #include <sstream>
 #include <vector>
-#include <map>
+#include <fstream>
+#include <memory>
+#include <algorithm>
 
 #include "trm/subs.h"
 #include "trm/constants.h"
@@ -54,14 +118,20 @@ Arguments:
 #include "trm/ephem.h"
 #include "trm/position.h"
 #include "trm/star.h"
-#include "trm/binary_star.h"
 #include "trm/observing.h"
+#include "trm/moon.h"
+#include "trm/batch.h"
+#include "trm/catalogue.h"
+#include "trm/stats.h"
+#include "trm/trace.h"
+#include "trm/writer.h"
+#include "trm/query.h"
 
-// Stores star name, orbital phase, airmass and altitude
-// of Sun. Used in a map keyed on time.
+// Stores the time, orbital phase, airmass and altitude
+// of Sun of an event.
 
 struct Info{
-  std::string name;
+  Subs::Time time;
   double phase, pherr, airmass, sunalt;
 };
 
@@ -83,41 +153,42 @@ int main(int argc, char *argv[]){
     input.sign_in("sunalt",    Subs::Input::LOCAL,  Subs::Input::PROMPT);
     input.sign_in("phase",     Subs::Input::LOCAL,  Subs::Input::PROMPT);
     input.sign_in("type",      Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("moonsep",   Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("threads",   Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("fastsun",   Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("stats",     Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("trace",     Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("binary",    Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("stream",    Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("checkpoint", Subs::Input::LOCAL, Subs::Input::NOPROMPT);
+    input.sign_in("batch",     Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
 
     // Get input
 
     std::string starfile;
     input.get_value("stars", starfile, "stardata", "file of star positions and ephemerides");
+    std::string strace;
+    input.get_value("trace", strace, "none", "file for a trace-event timeline of the run ('none' to ignore)");
+    if(strace != "none") Observing::Trace::start(strace);
+    bool batch;
+    input.get_value("batch", batch, false, "answer queries read from the standard input?");
 
     // Load star data
 
-    std::ifstream file(starfile.c_str());
-    if(!file) throw std::string("Could not open file = ") + starfile;
-
-    Subs::Star   s;
-    Subs::Ephem  eph;
-    std::vector<Subs::Binary>  binary;
-    while(file >> s){
-      if(file >> eph){
-	binary.push_back(Subs::Binary(s,eph));
-      }else{
-	if(file.bad()){
-	  std::cerr << "File stream corrupted" << std::endl;
-	  file.close();
-	  exit(EXIT_FAILURE);
-	}
-	file.clear();
-      }
+    Observing::Catalogue catalogue;
+    {
+      OBSERVING_TIME(LOAD);
+      catalogue.load(starfile, true);
     }
-    file.close();
-    std::cout << "Found position and ephemeris data on " << binary.size() << " stars" << std::endl;
-    if(binary.size() == 0)
+    (batch ? std::cerr : std::cout) << "Found position and ephemeris data on " << catalogue.size() << " stars" << std::endl;
+    if(catalogue.size() == 0)
       throw std::string("Cannot have 0 stars!");
 
-    std::string sdate;
-    input.get_value("startdate", sdate, "17 Nov 1961", "date at start of first night");
+    // dates and phase come with each query in batch mode
+    std::string sdate("17 Nov 1961");
+    if(!batch) input.get_value("startdate", sdate, "17 Nov 1961", "date at start of first night");
     Subs::Date start(sdate);
-    input.get_value("enddate", sdate, "17 Nov 1961", "date at start of last night");
+    if(!batch) input.get_value("enddate", sdate, "17 Nov 1961", "date at start of last night");
     Subs::Date end(sdate);
 
     if(start > end) throw std::string("Can't have a start date after the end date!");
@@ -130,127 +201,240 @@ int main(int argc, char *argv[]){
     input.get_value("airmass", airmass, 2., 1.001, 50., "maximum airmass to consider");
     double sunalt;
     input.get_value("sunalt", sunalt, -15., -80., 0., "maximum altitude of Sun");
-    double phase;
-    input.get_value("phase", phase, 0., 0., 1., "orbital phase");
+    double phase = 0.;
+    if(!batch) input.get_value("phase", phase, 0., 0., 1., "orbital phase");
+    double moonsep;
+    input.get_value("moonsep", moonsep, 0., 0., 180., "minimum separation from the Moon (degrees)");
+    int nthread;
+    input.get_value("threads", nthread, 0, 0, 1024, "number of threads (0 for one per core)");
+    bool fastsun;
+    input.get_value("fastsun", fastsun, false, "use the fast, low-precision Sun?");
+    Observing::Sun_Model smodel = fastsun ? Observing::FAST_SUN : Observing::FULL_SUN;
+    std::string sstats;
+    input.get_value("stats", sstats, "none", "statistics to report (none, text, json or a file for JSON)");
+
+    // Queries from the standard input, all sharing the catalogue and nights
+    if(batch){
+      Observing::Query query(catalogue, telescope, airmass, sunalt, smodel, nthread);
+      query.batch(std::cin, std::cout, "ephemeris");
+      Observing::Trace::stop();
+      Observing::Stats::report(sstats);
+      return EXIT_SUCCESS;
+    }
+    std::string sbinary;
+    input.get_value("binary", sbinary, "none", "file for a binary, column by column copy of the table ('none' to ignore)");
+    bool stream;
+    input.get_value("stream", stream, false, "list events in time order, skipping nights without the twilight wanted?");
+    std::string checkpoint;
+    input.get_value("checkpoint", checkpoint, "none", "file recording how far the run has got, to resume from ('none' to ignore)");
 
     int nday = int(end.mjd()-start.mjd()+1.5);
 
+    // Resume after the time saved in the checkpoint file, if there is one
+    double resume = -1.e30;
+    bool resumed = false;
+    if(checkpoint != "none"){
+      std::ifstream fchk(checkpoint.c_str());
+      if(fchk && !(fchk >> resume))
+	throw std::string("Could not read a time from the checkpoint file = " + checkpoint);
+      if(fchk){
+	std::cerr << "Resuming after MJD = " << std::setprecision(12) << resume << std::endl;
+	resumed = true;
+      }
+    }
+
     Subs::Time time, sunset, twiend, twistart, sunrise;
     Subs::Date date = start;
-    Subs::Position Sun;
-    double off[binary.size()];
-    double mjd, e1, e2, mjd1, mjd2;
-    int ie1, ie2;
-    Info info;
-    std::map<Subs::Time,Info> times;
-    typedef std::map<Subs::Time,Info>::const_iterator CI;
-
-    if(binary.size() == 1){
-      std::cout << "\nStar = " << binary[0].name() << ", " << (Subs::Ephem)binary[0] << "\n" << std::endl;
-    }else{
-      std::cout << "Star                  ";
+    Observing::Moon moon;
+    double mjd1, mjd2;
+
+    // Events of each star on one night, in time order. The vectors are
+    // cleared but keep their space from night to night, as does the list
+    // of all events of a night in time order used when streaming.
+    std::vector<std::vector<Info> > times(catalogue.size());
+    std::vector<std::pair<size_t,size_t> > order;
+
+    // a resumed run carries on from the table printed before
+    if(!resumed){
+      if(catalogue.size() == 1){
+	std::cout << "\nStar = " << catalogue.name(0) << ", " << catalogue.ephem(0) << "\n" << std::endl;
+      }else{
+	std::cout << "Star                  ";
+      }
+      std::cout << "  Date            Time           Phase     Error  Airmass  Sun's altitude\n" << std::endl;
+    }
+
+    // The table goes through a buffer and, if wanted, into a binary file
+    // too. With a checkpoint, each night is held in memory until the
+    // checkpoint for it has been saved.
+    std::ostringstream held;
+    Observing::Writer out(checkpoint != "none" ? static_cast<std::ostream&>(held) : std::cout);
+    std::unique_ptr<Observing::Columns> columns;
+    if(sbinary != "none"){
+      const char* cname[] = {"target", "mjd", "phase", "pherr", "airmass", "sunalt"};
+      columns.reset(new Observing::Columns(std::vector<std::string>(cname, cname+6)));
+      std::vector<std::string> tname(catalogue.size());
+      for(size_t nb=0; nb<catalogue.size(); nb++) tname[nb] = catalogue.name(nb);
+      columns->set_targets(tname);
     }
-    std::cout << "  Date            Time           Phase     Error  Airmass  Sun's altitude\n" << std::endl;
 
     // Now calculate info
-    for(int n=0; n<nday; n++){
+    for(int n=0; n<nday; n++, date.add_day(1)){
+      OBSERVING_SPAN_N("night", n);
       time.set(date);
       time.add_hour(12.+telescope.longitude()/15.);
 
-      if(!Observing::suntime(telescope, time, -1., sunset)){
-	std::cerr << "Could not find sunset on " << date << std::endl;
-	break;
-      }
-      if(!Observing::suntime(telescope, sunset, sunalt, twiend)){
-	std::cerr << "Sun never gets to " << sunalt << " in evening on " << date << std::endl;
-	break;
-      }
-      time   = twiend;
-      time.add_hour(0.1);   
-      if(!Observing::suntime(telescope, time, sunalt, twistart)){
-	std::cerr << "Sun never gets to " << sunalt << " in morning of night starting " 
-	     << date << std::endl;
-	break;
+      // A night without the twilight wanted ends the run, unless streaming,
+      // when it is skipped
+      std::ostringstream fault;
+      {
+	OBSERVING_TIME(NIGHTS);
+	if(!Observing::suntime(telescope, time, -1., sunset, smodel)){
+	  fault << "Could not find sunset on " << date;
+	}else if(!Observing::suntime(telescope, sunset, sunalt, twiend, smodel)){
+	  fault << "Sun never gets to " << sunalt << " in evening on " << date;
+	}else{
+	  time   = twiend;
+	  time.add_hour(0.1);   
+	  if(!Observing::suntime(telescope, time, sunalt, twistart, smodel)){
+	    fault << "Sun never gets to " << sunalt << " in morning of night starting " << date;
+	  }else if(!Observing::suntime(telescope, twistart, -1., sunrise, smodel)){
+	    fault << "Could not find sunrise in morning of night starting on " << date;
+	  }
+	}
       }
-      if(!Observing::suntime(telescope, twistart, -1., sunrise)){
-	std::cerr << "Could not find sunrise in morning of night starting on " <<
-	  date << std::endl;
+      if(!fault.str().empty()){
+	out.flush();
+	if(stream){
+	  std::cerr << fault.str() << "; skipped" << std::endl;
+	  continue;
+	}
+	std::cerr << fault.str() << std::endl;
 	break;
       }
 
+      // nights already done before a checkpoint
+      if(twistart.mjd() <= resume) continue;
+
       // compute corrections with single sun position half-way
       // between sunrise and sunset.
 
       time.set((sunset.mjd()+sunrise.mjd())/2.);
 
-      for(size_t j=0; j<binary.size(); j++){
-	if(binary[j].get_tscale() == Subs::Ephem::BJD || binary[j].get_tscale() == Subs::Ephem::BMJD){
-	  off[j] = (time.dtt() + binary[j].tcorr_bar(time,telescope))/Constants::DAY;
-	}else if(binary[j].get_tscale() == Subs::Ephem::HJD || binary[j].get_tscale() == Subs::Ephem::HMJD){
-	  off[j] = binary[j].tcorr_hel(time,telescope)/Constants::DAY;
-	}else{
-	  throw std::string("Could not recognize type of timescale for star = " + binary[j].name());
-	}
-      }
+      if(moonsep > 0.) moon.set(telescope, twiend, twistart);
 
-      mjd1 = twiend.mjd();
+      mjd1 = std::max(twiend.mjd(), resume);
       mjd2 = twistart.mjd();
-      const double MJD2JD = 2400000.5;
 
-      for(size_t nb=0; nb<binary.size(); nb++){
-	
-	if(binary[nb].get_tscale() == Subs::Ephem::HJD || binary[nb].get_tscale() == Subs::Ephem::BJD){
-	  e1 = binary[nb].phase(MJD2JD+mjd1+off[nb]);
-	  e2 = binary[nb].phase(MJD2JD+mjd2+off[nb]);
-	}else{
-	  e1 = binary[nb].phase(mjd1+off[nb]);
-	  e2 = binary[nb].phase(mjd2+off[nb]);
-	}
+      // The stars are computed in parallel, then reported in order
+
+      {
+	OBSERVING_TIME(EVENTS);
+	Observing::parallel_for(catalogue.size(), nthread, [&](size_t nb, Observing::Context&){
+
+	    OBSERVING_SPAN_N("target", nb);
+	    const Subs::Position& pos = catalogue.position(nb);
+	    const Subs::Ephem&    eph = catalogue.ephem(nb);
+	    const Observing::Precise_Ephem& peph = catalogue.precise(nb);
+	    double off, mjd;
+	    if(eph.get_tscale() == Subs::Ephem::BJD || eph.get_tscale() == Subs::Ephem::BMJD){
+	      OBSERVING_COUNT(TCORR_BAR);
+	      off = (time.dtt() + pos.tcorr_bar(time,telescope))/Constants::DAY;
+	    }else if(eph.get_tscale() == Subs::Ephem::HJD || eph.get_tscale() == Subs::Ephem::HMJD){
+	      OBSERVING_COUNT(TCORR_HEL);
+	      off = pos.tcorr_hel(time,telescope)/Constants::DAY;
+	    }else{
+	      throw std::string("Could not recognize type of timescale for star = " + catalogue.name(nb));
+	    }
+
+	    // cycles are counted apart from the phase so that times stay
+	    // precise far from T0
+	    long ie1 = peph.first(mjd1+off, phase);
+	    long ie2 = peph.last(mjd2+off, phase);
+	    Info info;
+	    for(long ie=ie1; ie<=ie2; ie++){
+	      mjd = peph.time(ie, phase)-off;
+	      if(mjd <= resume) continue;
+	      info.time.set(mjd);
+	      info.airmass = pos.altaz(info.time,telescope).airmass;
+	      OBSERVING_COUNT(ALTAZ);
+	      info.phase   = double(ie)+phase;
+	      info.pherr   = eph.pherr(eph.time(double(ie)+phase));
+	      if(info.airmass > 0.5 && info.airmass < airmass){
+		info.sunalt = Observing::sun_altaz(telescope, info.time, smodel).alt_obs;
+		if(info.sunalt < sunalt && !moon.too_close(pos, mjd, moonsep)) times[nb].push_back(info);
+	      }
+	    }
+	  });
+      }
 
-	ie1 = int(ceil(e1-phase));
-	ie2 = int(floor(e2-phase));
-	for(int ie=ie1; ie<=ie2; ie++){
-	  if(binary[nb].get_tscale() == Subs::Ephem::HJD || binary[nb].get_tscale() == Subs::Ephem::BJD){
-	    mjd  = binary[nb].time(double(ie)+phase)-off[nb]-MJD2JD;
-	  }else{
-	    mjd  = binary[nb].time(double(ie)+phase)-off[nb];
-	  }
-	  time.set(mjd);
-	  info.name    = binary[nb].name();
-	  info.airmass = binary[nb].altaz(time,telescope).airmass;
-	  info.phase   = double(ie)+phase;
-	  info.pherr   = binary[nb].pherr(binary[nb].time(double(ie)+phase));
-	  if(info.airmass > 0.5 && info.airmass < airmass){
-	    Sun.set_to_sun(time, telescope);
-	    info.sunalt = Sun.altaz(time,telescope).alt_obs;
-	    if(info.sunalt < sunalt) times[time]  = info;
-	  }
-	}
+      {
+	OBSERVING_TIME(OUTPUT);
+	OBSERVING_SPAN("output");
+
+	// Star by star, or all events of the night in time order when streaming
+	order.clear();
+	for(size_t nb=0; nb<catalogue.size(); nb++)
+	  for(size_t k=0; k<times[nb].size(); k++)
+	    order.push_back(std::make_pair(nb,k));
+	if(stream)
+	  std::stable_sort(order.begin(), order.end(),
+			   [&](const std::pair<size_t,size_t>& a, const std::pair<size_t,size_t>& b){
+			     return times[a.first][a.second].time.mjd() < times[b.first][b.second].time.mjd();
+			   });
 
 	// Now report results
-	for(CI ci=times.begin(); ci != times.end(); ++ci){
-	  if(binary.size() > 1){
-	    std::cout.setf(std::ios_base::left);
-	    std::cout << std::setfill(' ') << std::setw(20) << std::left << ci->second.name << " ";
+	for(size_t i=0; i<order.size(); i++){
+	  size_t nb = order[i].first;
+	  const Info& info = times[nb][order[i].second];
+	  if(catalogue.size() > 1){
+	    out.left();
+	    out.fill(' ').width(20).left() << catalogue.name(nb) << " ";
+	  }
+	  out << info.time << " ";
+	  out.left();
+	  out.precision(8).width(10).fill(' ') << info.phase << " ";
+	  out.precision(4).width(10).fill(' ') << info.pherr << "   ";
+	  out.left();
+	  out.fill(' ').width(5).precision(4) << info.airmass << "    " << info.sunalt;
+	  out.endl();
+	  if(columns){
+	    double row[] = {double(nb), info.time.mjd(), info.phase, info.pherr, info.airmass, info.sunalt};
+	    columns->add(row);
 	  }
-	  std::cout << ci->first << " ";
-	  std::cout.setf(std::ios_base::left);
-	  std::cout << std::setprecision(8) << std::setw(10) << std::setfill(' ') << ci->second.phase << " "
-		    << std::setprecision(4) << std::setw(10) << std::setfill(' ') << ci->second.pherr << "   ";
-	  std::cout.setf(std::ios_base::left);
-	  std::cout << std::setfill(' ') << std::setw(5) << std::setprecision(4)  << ci->second.airmass << "    " 
-		    << ci->second.sunalt << std::endl;
 	}
-	times.clear();
+	for(size_t nb=0; nb<catalogue.size(); nb++) times[nb].clear();
+      }
+
+      // Save the checkpoint covering this night, then print the night
+      if(checkpoint != "none"){
+	out.flush();
+	std::string tmp = checkpoint + ".tmp";
+	std::ofstream fchk(tmp.c_str());
+	fchk << std::setprecision(12) << mjd2 << std::endl;
+	fchk.close();
+	if(!fchk || rename(tmp.c_str(), checkpoint.c_str()))
+	  throw std::string("Could not write the checkpoint file = " + checkpoint);
+	std::cout << held.str() << std::flush;
+	held.str("");
       }
-      date.add_day(1);
     }
+
+    out.flush();
+    if(columns) columns->write(sbinary);
+
+    Observing::Trace::stop();
+    Observing::Stats::report(sstats);
   }
 
   catch(const std::string& str){
     std::cerr << str << std::endl;
     exit(EXIT_FAILURE);
   }
+  catch(const std::exception& exc){
+    std::cerr << exc.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
   
 }
 
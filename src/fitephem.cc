@@ -0,0 +1,259 @@
+/*
+
+!!sphinx
+
+*fitephem* -- fits an ephemeris to eclipse timings
+==================================================
+
+*fitephem* fits a linear or quadratic ephemeris to a file of eclipse times,
+each line of which holds a cycle number, a time and its uncertainty (days),
+as in the .times files of the examples directory. Lines starting with # are
+ignored. It prints the observed minus calculated (O-C) time of each eclipse,
+the ephemeris in the form used in star data files, the covariance matrix of
+its coefficients and the chi-squared of the fit.
+
+The fit can be kept from one run to the next in a file alongside the
+timings. New timings appended to the end of the timings file are then
+folded into the fit one by one, each by a rank-1 update of the coefficients
+and their covariances, without going back over those already fitted. If the
+timings already fitted have been changed (a checksum of them is kept with the
+fit), the number of terms differs or the file cannot be read, the fit is made
+again from scratch. Cycles of the fit are scaled by the largest
+at the time of the first fit, which the incremental updates then keep.
+
+The new ephemeris can also be written straight into a star data file in place
+of the one already there, so that the other programs use it at once.
+
+Invocation:
+  fitephem times nterm
+
+Arguments:
+
+  times :
+    File of eclipse timings, lines of cycle number, time and uncertainty.
+
+  nterm :
+    2 for a linear ephemeris, 3 for a quadratic one
+
+  incremental :
+    Keep the fit in <times>.fit and add only the timings appended since it was
+    last made (hidden, default false)
+
+  timescale :
+    Timescale of the times, e.g. BMJD or HJD, written at the start of the
+    ephemeris (hidden, default BMJD)
+
+  stars :
+    Star data file in which to replace the ephemeris of one star, or 'none'
+    (hidden, default none)
+
+  star :
+    Name of the star whose ephemeris is replaced (hidden, only needed when
+    stars is not 'none')
+
+!!sphinx
+
+*/
+
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <string>
+#include <exception>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "trm/subs.h"
+#include "trm/input.h"
+#include "trm/observing.h"
+#include "trm/catalogue.h"
+#include "trm/ephem_fit.h"
+
+namespace {
+
+  // Strips leading and trailing blanks
+  std::string trim(const std::string& str){
+    size_t n1 = str.find_first_not_of(" \t\r");
+    if(n1 == std::string::npos) return "";
+    size_t n2 = str.find_last_not_of(" \t\r");
+    return str.substr(n1, n2-n1+1);
+  }
+
+  // 64-bit FNV-1a hash of the first n timings, to tell whether any of those
+  // already fitted has been changed since
+  uint64_t checksum(const std::vector<Observing::Timing>& timings, size_t n){
+    uint64_t hash = 14695981039346656037ULL;
+    for(size_t i=0; i<n; i++){
+      const double v[3] = {timings[i].cycle, timings[i].time, timings[i].error};
+      const unsigned char* p = reinterpret_cast<const unsigned char*>(v);
+      for(size_t k=0; k<sizeof(v); k++){
+	hash ^= p[k];
+	hash *= 1099511628211ULL;
+      }
+    }
+    return hash;
+  }
+
+  // Replaces whatever ephemeris follows the position line of a star in a star
+  // data file, writing to a temporary file which is then renamed. The name
+  // is matched as Catalogue::find does, and the file keeps its permissions.
+  void replace_ephem(const std::string& file, const std::string& star, const std::string& ephem){
+
+    std::ifstream fin(file.c_str());
+    if(!fin) throw std::string("Could not open file = ") + file;
+    std::vector<std::string> lines;
+    std::string line;
+    while(getline(fin, line)) lines.push_back(line);
+    fin.close();
+
+    const std::string name = Observing::clean_name(star);
+    size_t n = 0;
+    while(n < lines.size() && (lines[n].empty() || lines[n][0] == '#' ||
+			       Observing::clean_name(lines[n]) != name)) n++;
+    if(n + 1 >= lines.size())
+      throw std::string("Could not find the name and position of ") + star + " in " + file;
+
+    // the ephemeris runs from the line after the position to the next blank line
+    size_t n1 = n + 2, n2 = n1;
+    while(n2 < lines.size() && !trim(lines[n2]).empty() && lines[n2][0] != '#') n2++;
+    lines.erase(lines.begin()+n1, lines.begin()+n2);
+    lines.insert(lines.begin()+n1, ephem);
+
+    std::string tmp = file + ".tmp";
+    std::ofstream fout(tmp.c_str());
+    for(size_t i=0; i<lines.size(); i++) fout << lines[i] << "\n";
+    fout.close();
+    struct stat st;
+    if(!fout || stat(file.c_str(), &st) || chmod(tmp.c_str(), st.st_mode & 07777) ||
+       rename(tmp.c_str(), file.c_str())){
+      unlink(tmp.c_str());
+      throw std::string("Could not write file = ") + file;
+    }
+  }
+}
+
+int main(int argc, char *argv[]){
+
+  try{
+
+    // Construct Input object
+
+    Subs::Input input(argc, argv, Observing::OBSERVING_ENV, Observing::OBSERVING_DIR);
+
+    // sign-in variables (equivalent to ADAM .ifl files). Unlike the other
+    // programs there is no 'threads': each timing is folded into the fit
+    // by an update that depends on the one before, and a fit of thousands
+    // of timings takes well under a millisecond, so there is nothing worth
+    // sharing out.
+
+    input.sign_in("times",       Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("nterm",       Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("incremental", Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("timescale",   Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("stars",       Subs::Input::GLOBAL, Subs::Input::NOPROMPT);
+    input.sign_in("star",        Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+
+    // Get input
+
+    std::string stimes;
+    input.get_value("times", stimes, "star.times", "file of eclipse timings");
+    std::vector<Observing::Timing> timings;
+    Observing::read_timings(stimes, timings);
+    if(timings.empty()) throw std::string("No timings found in ") + stimes;
+
+    int nterm;
+    input.get_value("nterm", nterm, 2, 2, 3, "number of terms (2 = linear, 3 = quadratic)");
+    if(int(timings.size()) < nterm)
+      throw std::string("Need at least ") + Subs::str(nterm) + " timings for " + Subs::str(nterm) + " terms";
+
+    bool incremental;
+    input.get_value("incremental", incremental, false, "add new timings to the fit kept in <times>.fit?");
+    std::string timescale;
+    input.get_value("timescale", timescale, "BMJD", "timescale of the times");
+    std::string sstars, sstar;
+    input.get_value("stars", sstars, "none", "star data file to update ('none' to ignore)");
+    if(sstars != "none")
+      input.get_value("star", sstar, "star", "name of the star to update");
+
+    // Pick up the fit from the last run if it covers the same timings as
+    // the start of the file. Anything else, including a file that cannot be
+    // read, means a fresh fit.
+
+    std::string sfit = stimes + ".fit";
+    Observing::Ephem_Fit fit;
+    size_t nold = 0;
+    if(incremental){
+      std::ifstream fin(sfit.c_str());
+      uint64_t sum;
+      if(fin >> fit >> sum && fit.nterm() == nterm && fit.size() > 0 &&
+	 fit.size() <= timings.size() && sum == checksum(timings, fit.size()))
+	nold = fit.size();
+    }
+
+    if(nold == 0){
+      double escale = 1.;
+      for(size_t i=0; i<timings.size(); i++) escale = std::max(escale, fabs(timings[i].cycle));
+      fit = Observing::Ephem_Fit(nterm, timings[0].time, escale);
+    }
+    for(size_t i=nold; i<timings.size(); i++) fit.add(timings[i]);
+    if(!fit.solved()) throw std::string("The timings do not determine the ephemeris; are the cycle numbers all the same?");
+
+    if(incremental){
+      std::ofstream fout(sfit.c_str());
+      fout << fit << checksum(timings, timings.size()) << std::endl;
+      if(!fout) throw std::string("Could not write file = ") + sfit;
+      if(nold)
+	std::cout << "Added " << timings.size() - nold << " timings to the fit of " << nold << " in " << sfit << std::endl;
+    }
+
+    // O-C of each timing
+
+    std::cout << "\n#  Cycle           Time      Error      O-C (d)  O-C (s)   O-C/err\n" << std::endl;
+    for(size_t i=0; i<timings.size(); i++){
+      double oc = fit.oc(timings[i]);
+      std::cout << std::fixed << std::setprecision(0) << std::setw(8) << timings[i].cycle << " "
+		<< std::setprecision(6) << std::setw(15) << timings[i].time << " "
+		<< std::setw(9) << timings[i].error << " "
+		<< std::setw(12) << oc << " "
+		<< std::setprecision(1) << std::setw(8) << 86400.*oc << " "
+		<< std::setprecision(2) << std::setw(9) << oc/timings[i].error << std::endl;
+    }
+    std::cout.unsetf(std::ios::fixed);
+
+    // The ephemeris, as it would go in a star data file
+
+    std::ostringstream ephem;
+    ephem << timescale << (nterm == 2 ? " linear " : " quadratic ") << std::setprecision(15) << fit.coeff(0)
+	  << " " << std::setprecision(4) << fit.error(0);
+    for(int i=1; i<nterm; i++)
+      ephem << " " << std::setprecision(15) << fit.coeff(i) << " " << std::setprecision(4) << fit.error(i);
+
+    std::cout << "\nEphemeris:\n\n" << ephem.str() << "\n\nCovariances:\n" << std::endl;
+    for(int i=0; i<nterm; i++){
+      for(int j=0; j<nterm; j++) std::cout << " " << std::setprecision(6) << std::setw(13) << fit.covar(i,j);
+      std::cout << std::endl;
+    }
+    std::cout << "\nChi**2 = " << fit.chisq() << ", degrees of freedom = " << fit.dof() << std::endl;
+
+    if(sstars != "none"){
+      replace_ephem(sstars, sstar, ephem.str());
+      std::cout << "Replaced the ephemeris of " << sstar << " in " << sstars << std::endl;
+    }
+  }
+
+  catch(const std::string& err){
+    std::cerr << err << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  catch(const std::exception& exc){
+    std::cerr << exc.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
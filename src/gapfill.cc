@@ -0,0 +1,280 @@
+/*
+
+!!sphinx
+
+*gapfill* -- when can I observe the phases I am missing?
+========================================================
+
+*gapfill* works out which orbital phases of each star have not yet been
+observed, using the <star>.times files read by *whatphases*, and then which
+nights of a forthcoming run could cover them. For each star and night it
+finds the period over which the star is below the airmass limit with the Sun
+below the altitude limit, converts this to a range of phase, and intersects
+that with the phase gaps. The result is a list of observing windows ranked
+by the fraction of the orbit that each would newly cover. Everything is done
+by interval arithmetic on the phase ranges, with no sampling in time.
+
+Each window is judged against the coverage already in the .times files,
+not against other windows in the list, so two windows on consecutive nights
+may well cover the same gap.
+
+Invocation:
+  gapfill stars telescope startdate enddate airmass sunalt nwindow
+
+Arguments:
+
+  stars :
+    Data file of star positions and ephemerides. Stars without ephemerides
+    are skipped; stars without a .times file are treated as never observed.
+
+  telescope :
+    e.g. wht
+
+  startdate :
+    Date of first night, e.g. 1/5/2002 = 1st May 2002
+
+  enddate :
+    Date of last night
+
+  airmass :
+    Maximum airmass
+
+  sunalt :
+    Maximum altitude of Sun (degrees)
+
+  nwindow :
+    Maximum number of windows to list
+
+  good :
+    true to regard phases only observed in poor conditions as still missing
+    (hidden, default false)
+
+  cache :
+    Keep the phases computed from each .times file in a .times.cache file
+    (hidden, default true)
+
+  limits :
+    File of horizon, declination and hour angle limits of the telescope in
+    the format described in trm/limits.h, or 'none' to apply only the airmass
+    limit (hidden, default none)
+
+  threads :
+    Number of threads to use (hidden, default 0, meaning one per core)
+
+!!sphinx
+
+*/
+
+#include <cstdlib>
+#include <string>
+#include <exception>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+
+#include "trm/subs.h"
+#include "trm/input.h"
+#include "trm/date.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/ephem.h"
+#include "trm/position.h"
+#include "trm/star.h"
+#include "trm/binary_star.h"
+#include "trm/observing.h"
+#include "trm/coverage.h"
+#include "trm/times_file.h"
+#include "trm/limits.h"
+#include "trm/batch.h"
+#include "trm/writer.h"
+
+// An observing window: star, UTC range, phase range and fraction of the
+// orbit newly covered
+struct Window {
+  size_t star;
+  Subs::Time t1, t2;
+  double p1, p2, gain;
+  bool operator<(const Window& win) const {return gain > win.gain;}
+};
+
+int main(int argc, char *argv[]){
+
+  try{
+
+    // Construct Input object
+
+    Subs::Input input(argc, argv, Observing::OBSERVING_ENV, Observing::OBSERVING_DIR);
+
+    // sign-in variables (equivalent to ADAM .ifl files)
+
+    input.sign_in("stars",     Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("telescope", Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("startdate", Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("enddate",   Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("airmass",   Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("sunalt",    Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("nwindow",   Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("good",      Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("cache",     Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("limits",    Subs::Input::GLOBAL, Subs::Input::NOPROMPT);
+    input.sign_in("threads",   Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+
+    // Get input
+
+    std::string starfile;
+    input.get_value("stars", starfile, "stardata", "file of star positions and ephemerides");
+
+    // Load star data
+
+    std::ifstream file(starfile.c_str());
+    if(!file) throw std::string("Could not open file = ") + starfile;
+
+    Subs::Star   s;
+    Subs::Ephem  eph;
+    std::vector<Subs::Binary>  binary;
+    while(file >> s){
+      if(file >> eph){
+	binary.push_back(Subs::Binary(s,eph));
+      }else{
+	if(file.bad()){
+	  file.close();
+	  throw std::string("File stream corrupted");
+	}
+	file.clear();
+      }
+    }
+    file.close();
+    std::cout << "Found position and ephemeris data on " << binary.size() << " stars" << std::endl;
+    if(binary.size() == 0)
+      throw std::string("Cannot have 0 stars!");
+
+    size_t lmax = 4;
+    for(size_t j=0; j<binary.size(); j++) lmax = std::max(lmax,binary[j].name().length());
+
+    std::string stelescope;
+    input.get_value("telescope", stelescope, "WHT", "telescope name");
+    Subs::Telescope telescope(stelescope);
+
+    std::string sdate;
+    input.get_value("startdate", sdate, "17 Nov 1961", "date at start of first night");
+    Subs::Date start(sdate);
+    input.get_value("enddate", sdate, "17 Nov 1961", "date at start of last night");
+    Subs::Date end(sdate);
+    if(start > end) throw std::string("Can't have a start date after the end date!");
+
+    double airmass;
+    input.get_value("airmass", airmass, 2., 1.001, 50., "maximum airmass to consider");
+    double sunalt;
+    input.get_value("sunalt", sunalt, -15., -80., 0., "maximum altitude of Sun");
+    int nwindow;
+    input.get_value("nwindow", nwindow, 20, 1, 100000, "maximum number of windows to list");
+    bool good;
+    input.get_value("good", good, false, "treat phases only observed in poor conditions as missing?");
+    bool cache;
+    input.get_value("cache", cache, true, "keep the phases computed from each .times file in a .times.cache file?");
+    std::string slimits;
+    input.get_value("limits", slimits, "none", "file of telescope horizon and pointing limits ('none' to ignore)");
+    Observing::Limits limits;
+    if(slimits != "none") limits.load(slimits);
+    int nthread;
+    input.get_value("threads", nthread, 0, 0, 1024, "number of threads (0 for one per core)");
+
+    // Current phase coverage of each star. The .times files are always
+    // converted using the WHT, as in whatphases.
+
+    Subs::Telescope dummy("WHT");
+    std::vector<Observing::Coverage> coverage(binary.size());
+    std::vector<Observing::Phase_Range> ranges;
+    for(size_t j=0; j<binary.size(); j++){
+      std::string times = binary[j].name() + ".times";
+      if(cache)
+	Observing::read_times_cached(times, binary[j], binary[j], dummy, ranges);
+      else
+	Observing::read_times(times, binary[j], binary[j], dummy, ranges);
+      for(size_t i=0; i<ranges.size(); i++)
+	coverage[j].add(ranges[i].p1, ranges[i].p2, ranges[i].poor);
+      std::cout << std::setfill(' ') << std::setw(lmax) << std::left << binary[j].name()
+		<< " " << std::setprecision(4) << 100.*coverage[j].fraction(good) << "% covered" << std::endl;
+    }
+
+    // Now go through the nights
+
+    int nday = int(end.mjd()-start.mjd()+1.5);
+    Subs::Date date = start;
+    Observing::Night night;
+    std::vector<Window> window, found(binary.size());
+    std::vector<char> ok(binary.size());
+
+    for(int n=0; n<nday; n++, date.add_day(1)){
+
+      if(!Observing::night(telescope, date, sunalt, night)){
+	std::cerr << "Could not find twilight times for the night starting " << date << "; skipped" << std::endl;
+	continue;
+      }
+
+      // Each star only touches its own coverage, so they can be done in parallel
+      Observing::parallel_for(binary.size(), nthread, [&](size_t j, Observing::Context&){
+	  ok[j] = 0;
+	  Subs::Time tfirst, tlast;
+	  if(!Observing::when_visible(binary[j], telescope, limits, night.twiend, night.twistart, airmass, tfirst, tlast))
+	    return;
+
+	  double p1 = Observing::time_to_phase(binary[j], binary[j], tfirst, telescope);
+	  double p2 = Observing::time_to_phase(binary[j], binary[j], tlast,  telescope);
+
+	  std::vector<Observing::Coverage::Gap> pieces;
+	  Window& win = found[j];
+	  win.gain = coverage[j].gain(p1, p2, pieces, good);
+	  if(win.gain <= 0.) return;
+
+	  // Trim the window to span just the pieces that fill gaps
+	  win.star = j;
+	  win.p1   = pieces.front().lo;
+	  win.p2   = pieces.back().hi;
+	  win.t1.set(win.p1 > p1 ? Observing::phase_to_time(binary[j], binary[j], win.p1, telescope) : tfirst.mjd());
+	  win.t2.set(win.p2 < p2 ? Observing::phase_to_time(binary[j], binary[j], win.p2, telescope) : tlast.mjd());
+	  ok[j] = 1;
+	});
+
+      for(size_t j=0; j<binary.size(); j++)
+	if(ok[j]) window.push_back(found[j]);
+    }
+
+    if(window.empty()){
+      std::cout << "\nNo windows found that would cover unobserved phases." << std::endl;
+      return 0;
+    }
+
+    std::stable_sort(window.begin(), window.end());
+    if(window.size() > size_t(nwindow)) window.resize(nwindow);
+
+    Observing::Writer out(std::cout);
+    out << "\n";
+    out.fill(' ').width(lmax).left() << "Star"
+      << "   Start                         End                          Hours   Phases            New\n";
+    out.endl();
+
+    for(size_t i=0; i<window.size(); i++){
+      const Window& win = window[i];
+      double p1 = win.p1 - floor(win.p1);
+      out.fill(' ').width(lmax).left() << binary[win.star].name() << " " << win.t1 << "  " << win.t2 << "  ";
+      out.precision(3).width(6) << 24.*(win.t2.mjd()-win.t1.mjd()) << "  ";
+      out.precision(4).width(6) << p1 << " to ";
+      out.width(6) << p1+(win.p2-win.p1) << "  ";
+      out.precision(3) << win.gain;
+      out.endl();
+    }
+  }
+
+  catch(const std::string& str){
+    std::cerr << str << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  catch(const std::exception& exc){
+    std::cerr << exc.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+}
@@ -0,0 +1,281 @@
+// Observing::Limits: horizon profile and hour angle and declination limits
+// of a telescope, and versions of startime and when_visible that respect
+// them.
+
+#include <cmath>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include "trm/subs.h"
+#include "trm/constants.h"
+#include "trm/time.h"
+#include "trm/position.h"
+#include "trm/telescope.h"
+#include "trm/observing.h"
+#include "trm/limits.h"
+#include "trm/stats.h"
+
+namespace {
+
+  // Linear interpolation in a table of y against increasing x, clamped at the ends
+  double interp(const std::vector<double>& x, const std::vector<double>& y, double xp){
+    if(xp <= x.front()) return y.front();
+    if(xp >= x.back())  return y.back();
+    size_t i = std::upper_bound(x.begin(), x.end(), xp) - x.begin();
+    return y[i-1] + (y[i]-y[i-1])*(xp-x[i-1])/(x[i]-x[i-1]);
+  }
+
+  // Sorts paired vectors on the first
+  void sort_on(std::vector<double>& x, std::vector<double>& y, std::vector<double>* z=0){
+    std::vector<size_t> idx(x.size());
+    for(size_t i=0; i<idx.size(); i++) idx[i] = i;
+    std::sort(idx.begin(), idx.end(), [&x](size_t i, size_t j){return x[i] < x[j];});
+    std::vector<double> xs(x.size()), ys(y.size()), zs(z ? z->size() : 0);
+    for(size_t i=0; i<idx.size(); i++){
+      xs[i] = x[idx[i]];
+      ys[i] = y[idx[i]];
+      if(z) zs[i] = (*z)[idx[i]];
+    }
+    x = xs;
+    y = ys;
+    if(z) *z = zs;
+  }
+
+}
+
+//! Default constructor, with nothing limited
+Observing::Limits::Limits() : none(true), dmin(-90.), dmax(90.), hslope(0.), hor(361, -90.), hlo(181, -12.), hhi(181, 12.) {}
+
+//! Constructor from a file; see load
+Observing::Limits::Limits(const std::string& file) : none(true), dmin(-90.), dmax(90.), hslope(0.), hor(361, -90.), hlo(181, -12.), hhi(181, 12.) {
+  load(file);
+}
+
+/** Reads limits from a file, in the format described in the class
+ * documentation. Throws an Observing_Error if the file cannot be read.
+ * \param file name of the file
+ */
+void Observing::Limits::load(const std::string& file){
+
+  std::ifstream fin(file.c_str());
+  if(!fin) throw Observing_Error("Observing::Limits::load: could not open " + file);
+
+  std::vector<double> az, alt, dec, hmin, hmax;
+  std::string line, key;
+  int nline = 0;
+  while(getline(fin, line)){
+    nline++;
+    std::istringstream istr(line);
+    if(!(istr >> key) || key[0] == '#') continue;
+
+    std::vector<double> val;
+    double x;
+    while(istr >> x) val.push_back(x);
+
+    if(key == "horizon" && val.size() == 2){
+      az.push_back(val[0]);
+      alt.push_back(val[1]);
+    }else if(key == "dec" && val.size() == 2){
+      set_dec(val[0], val[1]);
+    }else if(key == "ha" && val.size() == 2){
+      dec.push_back(0.);
+      hmin.push_back(val[0]);
+      hmax.push_back(val[1]);
+    }else if(key == "ha" && val.size() == 3){
+      dec.push_back(val[0]);
+      hmin.push_back(val[1]);
+      hmax.push_back(val[2]);
+    }else{
+      throw Observing_Error("Observing::Limits::load: could not understand line " + Subs::str(nline) + " of " + file);
+    }
+  }
+  fin.close();
+
+  if(!az.empty())  set_horizon(az, alt);
+  if(!dec.empty()) set_ha(dec, hmin, hmax);
+}
+
+/** Sets the horizon profile, interpolating linearly between the points,
+ * round through azimuth 0.
+ * \param az  azimuths, degrees
+ * \param alt minimum altitudes at each azimuth, degrees
+ */
+void Observing::Limits::set_horizon(const std::vector<double>& az, const std::vector<double>& alt){
+  if(az.empty() || az.size() != alt.size())
+    throw Observing_Error("Observing::Limits::set_horizon: need matching, non-empty azimuths and altitudes");
+
+  std::vector<double> a(az), h(alt);
+  for(size_t i=0; i<a.size(); i++) a[i] -= 360.*floor(a[i]/360.);
+  sort_on(a, h);
+
+  // wrap so that interpolation works all the way round
+  a.insert(a.begin(), a.back()-360.);
+  h.insert(h.begin(), h.back());
+  a.push_back(a[1]+360.);
+  h.push_back(h[1]);
+
+  for(int i=0; i<=360; i++) hor[i] = interp(a, h, double(i));
+  hslope = 0.;
+  for(int i=0; i<360; i++) hslope = std::max(hslope, fabs(hor[i+1]-hor[i]));
+  none = false;
+}
+
+//! Sets the declination range, degrees
+void Observing::Limits::set_dec(double dmin, double dmax){
+  this->dmin = dmin;
+  this->dmax = dmax;
+  none = false;
+}
+
+/** Sets the hour angle limits as a function of declination, interpolating
+ * linearly between the declinations given and holding the end values beyond
+ * them.
+ * \param dec  declinations, degrees
+ * \param hmin most negative (easterly) hour angle at each, hours
+ * \param hmax most positive (westerly) hour angle at each, hours
+ */
+void Observing::Limits::set_ha(const std::vector<double>& dec, const std::vector<double>& hmin, const std::vector<double>& hmax){
+  if(dec.empty() || dec.size() != hmin.size() || dec.size() != hmax.size())
+    throw Observing_Error("Observing::Limits::set_ha: need matching, non-empty declinations and hour angles");
+
+  std::vector<double> d(dec), lo(hmin), hi(hmax);
+  sort_on(d, lo, &hi);
+  for(int i=0; i<=180; i++){
+    hlo[i] = interp(d, lo, double(i-90));
+    hhi[i] = interp(d, hi, double(i-90));
+  }
+  none = false;
+}
+
+//! Minimum altitude at an azimuth (degrees), from the table
+double Observing::Limits::horizon(double az) const {
+  az -= 360.*floor(az/360.);
+  int i = std::min(359, int(az));
+  return hor[i] + (hor[i+1]-hor[i])*(az-i);
+}
+
+//! Hour angle limits at a declination, from the table
+void Observing::Limits::ha_limits(double dec, double& hmin, double& hmax) const {
+  double d = std::max(0., std::min(180., dec+90.));
+  int i = std::min(179, int(d));
+  hmin = hlo[i] + (hlo[i+1]-hlo[i])*(d-i);
+  hmax = hhi[i] + (hhi[i+1]-hhi[i])*(d-i);
+}
+
+/** Returns how far a target is inside the limits, as the smallest of its
+ * height above the horizon profile (or altmin if higher), its distance from
+ * the declination limits and its distance from the hour angle limits, all in
+ * degrees. The target is reachable if this is positive.
+ * \param altaz  position of the target in the sky
+ * \param dec    declination of the target, degrees
+ * \param altmin minimum altitude whatever the horizon, e.g. set by an airmass limit
+ */
+double Observing::Limits::margin(const Subs::Altaz& altaz, double dec, double altmin) const {
+  double m = altaz.alt_true - std::max(altmin, horizon(altaz.az));
+  m = std::min(m, std::min(dec-dmin, dmax-dec));
+
+  double hmin, hmax;
+  ha_limits(dec, hmin, hmax);
+  if(hmin > -12. || hmax < 12.){
+    double ha = altaz.ha - 24.*floor((altaz.ha+12.)/24.);
+    m = std::min(m, 15.*std::min(ha-hmin, hmax-ha));
+  }
+  return m;
+}
+
+/** Computes the next time after start at which an object goes from being
+ * reachable to not or vice versa, with reachable meaning above altitude
+ * altaim and inside the limits. A horizon profile can make this happen
+ * several times a day, so the day after start is scanned in steps and the
+ * crossing then refined by binary chop. The steps are at most 10 minutes,
+ * and short enough that the object cannot cross the limits and come back
+ * between one and the next (see below). If there are no limits this is just
+ * the standard startime.
+ * \param obj     the object
+ * \param tel     the telescope
+ * \param limits  the limits of the telescope
+ * \param start   time to start from
+ * \param altaim  minimum altitude, degrees
+ * \param found   the time found
+ * \return false if the object does not change state within a day
+ */
+bool Observing::startime(const Subs::Position& obj, const Subs::Telescope& tel, const Limits& limits,
+			 const Subs::Time& start, double altaim, Subs::Time& found){
+
+  if(limits.empty()) return startime(obj, tel, start, altaim, found);
+
+  // The margin changes no faster than the altitude or hour angle (RATE,
+  // degrees per hour) plus the steepest slope of the horizon times the rate
+  // of change of azimuth, which is at most RATE*(|sin(lat)| + cos(lat)
+  // tan(alt)) and so grows without limit towards the zenith. Each step is
+  // made short enough that the margin cannot change sign within it, and,
+  // if there is a horizon profile, that the azimuth moves by no more than
+  // the degree between its table entries.
+  const double RATE = 15.05, MAXSTEP = 10./1440., MINSTEP = 10./86400.;
+  const double DR = Constants::TWOPI/360.;
+  const double slat = fabs(sin(DR*tel.latitude())), clat = cos(DR*tel.latitude());
+  const double hslope = limits.horizon_slope();
+
+  double dec  = obj.dec();
+  double mjd1 = start.mjd(), mjd2 = mjd1, crit;
+  Subs::Altaz altaz = obj.altaz(start,tel);
+  OBSERVING_COUNT(ALTAZ);
+  double margin = limits.margin(altaz, dec, altaim);
+  bool   in     = margin > 0.;
+
+  Subs::Time time;
+  for(;;){
+    double alt    = std::min(89.9, fabs(altaz.alt_true) + 24.*RATE*MAXSTEP);
+    double azrate = 24.*RATE*(slat + clat*tan(DR*alt));
+    double step   = std::min(MAXSTEP, fabs(margin)/(24.*RATE + hslope*azrate));
+    if(hslope > 0.) step = std::min(step, 1./azrate);
+    mjd2 = mjd1 + std::max(MINSTEP, step);
+    if(mjd2 > start.mjd() + 1.) return false;
+    time.set(mjd2);
+    altaz  = obj.altaz(time,tel);
+    OBSERVING_COUNT(ALTAZ);
+    margin = limits.margin(altaz, dec, altaim);
+    if((margin > 0.) != in) break;
+    mjd1 = mjd2;
+  }
+
+  while(mjd2-mjd1 > 1.e-5){
+    crit = (mjd1+mjd2)/2.;
+    time.set(crit);
+    OBSERVING_COUNT(ALTAZ);
+    OBSERVING_COUNT(BISECT);
+    if((limits.margin(obj.altaz(time,tel), dec, altaim) > 0.) == in){
+      mjd1 = crit;
+    }else{
+      mjd2 = crit;
+    }
+  }
+  crit = (mjd1+mjd2)/2.;
+  found.set(crit);
+  return true;
+}
+
+/** As the standard when_visible, but also requiring the object to be
+ * within the limits of the telescope. Only the first period of visibility
+ * after tstart is returned.
+ */
+bool Observing::when_visible(const Subs::Position& obj, const Subs::Telescope& telescope, const Limits& limits,
+			     const Subs::Time& tstart, const Subs::Time& tend, double airmass,
+			     Subs::Time& firstvis, Subs::Time& lastvis){
+
+  if(limits.empty()) return when_visible(obj, telescope, tstart, tend, airmass, firstvis, lastvis);
+
+  double altaim = 90.-360.*acos(1./airmass)/Constants::TWOPI;
+
+  firstvis = tstart;
+  OBSERVING_COUNT(ALTAZ);
+  if(limits.margin(obj.altaz(tstart,telescope), obj.dec(), altaim) <= 0. &&
+     (!startime(obj, telescope, limits, tstart, altaim, firstvis) || firstvis > tend)) return false;
+
+  lastvis = tend;
+  firstvis.add_hour(0.001);
+  if(startime(obj, telescope, limits, firstvis, altaim, lastvis) && lastvis > tend) lastvis = tend;
+  firstvis.add_hour(-0.001);
+  return true;
+}
@@ -0,0 +1,65 @@
+// Read-only access to the bytes of a file, used by the readers of .times
+// files. Internal to the library: not installed.
+
+#ifndef TRM_OBSERVING_MAPPED_FILE
+#define TRM_OBSERVING_MAPPED_FILE
+
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+namespace Observing {
+
+  // Read-only memory map of a file, released on destruction. Anything
+  // that cannot be mapped (e.g. a pipe) is read into memory instead.
+  // regular() says whether the bytes came from an ordinary file, which
+  // is what the phase cache needs before it can trust them on a later read.
+  class Mapped_File {
+  public:
+    Mapped_File(const std::string& file) : fd(-1), buff(0), nbyte(0), mapped(false), reg(false) {
+      fd = open(file.c_str(), O_RDONLY);
+      if(fd < 0) return;
+      struct stat st;
+      if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode)){
+	reg = true;
+	if(st.st_size == 0) return;
+	void* p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(p != MAP_FAILED){
+	  buff   = static_cast<const char*>(p);
+	  nbyte  = st.st_size;
+	  mapped = true;
+	  madvise(p, nbyte, MADV_SEQUENTIAL);
+	  return;
+	}
+      }
+      char chunk[65536];
+      ssize_t n;
+      while((n = read(fd, chunk, sizeof(chunk))) > 0)
+	copy.insert(copy.end(), chunk, chunk+n);
+      buff  = copy.empty() ? 0 : &copy[0];
+      nbyte = copy.size();
+    }
+    ~Mapped_File(){
+      if(mapped) munmap(const_cast<char*>(buff), nbyte);
+      if(fd >= 0) close(fd);
+    }
+    bool ok() const {return fd >= 0;}
+    bool regular() const {return reg;}
+    const char* data() const {return buff;}
+    size_t size() const {return nbyte;}
+  private:
+    Mapped_File(const Mapped_File&);
+    Mapped_File& operator=(const Mapped_File&);
+    int fd;
+    const char* buff;
+    size_t nbyte;
+    bool mapped, reg;
+    std::vector<char> copy;
+  };
+
+};
+
+#endif
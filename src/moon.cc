@@ -0,0 +1,183 @@
+// The Moon: exact positions from slalib, and an interpolant over a night
+// for cheap repeated evaluation.
+
+#include <cmath>
+#include <algorithm>
+#include "slalib.h"
+#include "trm/subs.h"
+#include "trm/constants.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+#include "trm/observing.h"
+#include "trm/moon.h"
+
+/** Computes where the Moon is as seen from a telescope. The topocentric
+ * apparent position from slaRdplan is put back onto J2000 so that it can be
+ * compared directly with star positions. The illuminated fraction is
+ * computed from the elongation from the Sun.
+ * \param tel  the telescope
+ * \param time the UTC time
+ */
+Observing::Moon_Info Observing::moon(const Subs::Telescope& tel, const Subs::Time& time){
+
+  const double DR = Constants::TWOPI/360.;
+  double elong = DR*tel.longitude(), phi = DR*tel.latitude();
+  double tt    = time.mjd() + time.dtt()/Constants::DAY;
+
+  double ra, dec, diam;
+  slaRdplan(tt, 3, elong, phi, &ra, &dec, &diam);
+
+  // altitude from the apparent place
+  double last = slaGmst(time.mjd()) + elong + slaEqeqx(tt);
+  double az, el;
+  slaDe2h(last - ra, dec, phi, &az, &el);
+
+  // back to J2000 for comparison with stars and the Sun
+  double rm, dm;
+  slaAmp(ra, dec, tt, 2000., &rm, &dm);
+
+  Subs::Position Sun;
+  Sun.set_to_sun(time, tel);
+  double elongation = slaDsep(rm, dm, DR*15.*Sun.ra(), DR*Sun.dec());
+
+  Moon_Info info;
+  info.ra    = slaDranrm(rm)/(15.*DR);
+  info.dec   = dm/DR;
+  info.alt   = el/DR;
+  info.illum = (1.-cos(elongation))/2.;
+  return info;
+}
+
+/** Angular separation between the Moon and an object.
+ * \param moon the Moon, as returned by Observing::moon
+ * \param obj  the object
+ * \return the separation in degrees
+ */
+double Observing::separation(const Moon_Info& moon, const Subs::Position& obj){
+  const double DR = Constants::TWOPI/360.;
+  return slaDsep(15.*DR*moon.ra, DR*moon.dec, 15.*DR*obj.ra(), DR*obj.dec())/DR;
+}
+
+/** Constructor.
+ * \param tel    the telescope
+ * \param tstart start of the interval
+ * \param tend   end of the interval
+ * \param step   spacing of the points at which the Moon is computed, hours
+ */
+Observing::Moon::Moon(const Subs::Telescope& tel, const Subs::Time& tstart, const Subs::Time& tend, double step){
+  set(tel, tstart, tend, step);
+}
+
+/** Computes the Moon at equally spaced times from tstart to tend, at least
+ * four of them, replacing any earlier interval.
+ * \param tel    the telescope
+ * \param tstart start of the interval
+ * \param tend   end of the interval
+ * \param step   maximum spacing of the points, hours
+ */
+void Observing::Moon::set(const Subs::Telescope& tel, const Subs::Time& tstart, const Subs::Time& tend, double step){
+  if(tend < tstart || step <= 0.)
+    throw Observing_Error("Observing::Moon::set: invalid interval or step");
+
+  double span = tend.mjd() - tstart.mjd();
+  size_t n = std::max(size_t(4), size_t(ceil(24.*span/step)) + 1);
+  t0 = tstart.mjd();
+  dt = span > 0. ? span/(n-1) : step/24.;
+
+  x.resize(n);
+  y.resize(n);
+  z.resize(n);
+  alt.resize(n);
+  illum.resize(n);
+
+  const double DR = Constants::TWOPI/360.;
+  Subs::Time time;
+  for(size_t i=0; i<n; i++){
+    time.set(t0 + dt*i);
+    Moon_Info m = moon(tel, time);
+    double ra = 15.*DR*m.ra, dec = DR*m.dec;
+    x[i]     = cos(dec)*cos(ra);
+    y[i]     = cos(dec)*sin(ra);
+    z[i]     = sin(dec);
+    alt[i]   = m.alt;
+    illum[i] = m.illum;
+  }
+}
+
+//! Interpolated Moon at a UTC MJD
+Observing::Moon_Info Observing::Moon::info(double mjd) const {
+  double v[3];
+  direction(mjd, v);
+  const double DR = Constants::TWOPI/360.;
+  Moon_Info m;
+  m.ra    = slaDranrm(atan2(v[1], v[0]))/(15.*DR);
+  m.dec   = atan2(v[2], sqrt(v[0]*v[0]+v[1]*v[1]))/DR;
+  m.alt   = altitude(mjd);
+  m.illum = illumination(mjd);
+  return m;
+}
+
+//! Interpolated altitude of the Moon at a UTC MJD, degrees
+double Observing::Moon::altitude(double mjd) const {
+  size_t i;
+  double w[4];
+  weights(mjd, i, w);
+  return w[0]*alt[i] + w[1]*alt[i+1] + w[2]*alt[i+2] + w[3]*alt[i+3];
+}
+
+//! Interpolated illuminated fraction of the Moon at a UTC MJD
+double Observing::Moon::illumination(double mjd) const {
+  size_t i;
+  double w[4];
+  weights(mjd, i, w);
+  return std::max(0., std::min(1., w[0]*illum[i] + w[1]*illum[i+1] + w[2]*illum[i+2] + w[3]*illum[i+3]));
+}
+
+/** Angular separation between the Moon and an object.
+ * \param obj the object
+ * \param mjd the UTC MJD
+ * \return the separation in degrees
+ */
+double Observing::Moon::separation(const Subs::Position& obj, double mjd) const {
+  const double DR = Constants::TWOPI/360.;
+  double v[3];
+  direction(mjd, v);
+  double ra = 15.*DR*obj.ra(), dec = DR*obj.dec();
+  double cd = cos(dec);
+  double dot = (cd*cos(ra)*v[0] + cd*sin(ra)*v[1] + sin(dec)*v[2])/sqrt(v[0]*v[0]+v[1]*v[1]+v[2]*v[2]);
+  return acos(std::max(-1., std::min(1., dot)))/DR;
+}
+
+/** Checks a separation limit. The limit only applies while the Moon is
+ * above the horizon.
+ * \param obj    the object
+ * \param mjd    the UTC MJD
+ * \param minsep minimum separation, degrees
+ */
+bool Observing::Moon::too_close(const Subs::Position& obj, double mjd, double minsep) const {
+  return minsep > 0. && altitude(mjd) > 0. && separation(obj, mjd) < minsep;
+}
+
+// First of the four points to interpolate from and their Lagrange weights
+void Observing::Moon::weights(double mjd, size_t& i, double w[4]) const {
+  if(x.size() < 4)
+    throw Observing_Error("Observing::Moon: interpolation has not been set up");
+  double u = (mjd - t0)/dt;
+  long j = std::max(1L, std::min(long(x.size())-3, long(floor(u))));
+  i = size_t(j-1);
+  double s = u - double(j);
+  w[0] = -s*(s-1.)*(s-2.)/6.;
+  w[1] = (s+1.)*(s-1.)*(s-2.)/2.;
+  w[2] = -(s+1.)*s*(s-2.)/2.;
+  w[3] = (s+1.)*s*(s-1.)/6.;
+}
+
+void Observing::Moon::direction(double mjd, double v[3]) const {
+  size_t i;
+  double w[4];
+  weights(mjd, i, w);
+  v[0] = w[0]*x[i] + w[1]*x[i+1] + w[2]*x[i+2] + w[3]*x[i+3];
+  v[1] = w[0]*y[i] + w[1]*y[i+1] + w[2]*y[i+2] + w[3]*y[i+3];
+  v[2] = w[0]*z[i] + w[1]*z[i+1] + w[2]*z[i+2] + w[3]*z[i+3];
+}
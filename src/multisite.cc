@@ -0,0 +1,234 @@
+/*
+
+!!sphinx
+
+*multisite* -- visibility and eclipses from a network of telescopes
+===================================================================
+
+*multisite* does the job of *ephemeris* for several telescopes at once. For
+each star it reports how many nights and hours it is visible from each site,
+then lists every time that it reaches the chosen phase with the sites from
+which that event can be seen. The times of the phase and their heliocentric
+or barycentric corrections do not depend upon the site and are computed only
+once per star, while the nights of each site are computed only once for all
+stars, so adding a site costs little more than finding when each star is up
+there.
+
+Invocation:
+  multisite stars startdate enddate telescopes airmass sunalt phase
+
+Arguments:
+
+  stars :
+    Data file of star positions and ephemerides
+
+  startdate :
+    Date of first night, e.g. 1/5/2002 = 1st May 2002
+
+  enddate :
+    Date of last night
+
+  telescopes :
+    Comma-separated list of telescopes, e.g. wht,ntt,lt
+
+  airmass :
+    Maximum airmass to bother with (>1)
+
+  sunalt :
+    Maximum altitude of sun (in degrees, e.g. -15)
+
+  phase :
+    Phase to report
+
+  all :
+    true to list events that no site can see as well (hidden, default false)
+
+  threads :
+    Number of threads to use (hidden, default 0, meaning one per core)
+
+!!sphinx
+
+*/
+
+#include <cstdlib>
+#include <string>
+#include <exception>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <vector>
+
+#include "trm/subs.h"
+#include "trm/input.h"
+#include "trm/date.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/ephem.h"
+#include "trm/position.h"
+#include "trm/star.h"
+#include "trm/binary_star.h"
+#include "trm/observing.h"
+#include "trm/network.h"
+#include "trm/batch.h"
+#include "trm/writer.h"
+
+int main(int argc, char *argv[]){
+
+  try{
+
+    // Construct Input object
+
+    Subs::Input input(argc, argv, Observing::OBSERVING_ENV, Observing::OBSERVING_DIR);
+
+    // sign-in variables (equivalent to ADAM .ifl files)
+
+    input.sign_in("stars",      Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("startdate",  Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("enddate",    Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("telescopes", Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("airmass",    Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("sunalt",     Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("phase",      Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("all",        Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("threads",    Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+
+    // Get input
+
+    std::string starfile;
+    input.get_value("stars", starfile, "stardata", "file of star positions and ephemerides");
+
+    // Load star data
+
+    std::ifstream file(starfile.c_str());
+    if(!file) throw std::string("Could not open file = ") + starfile;
+
+    Subs::Star   s;
+    Subs::Ephem  eph;
+    std::vector<Subs::Binary>  binary;
+    while(file >> s){
+      if(file >> eph){
+	binary.push_back(Subs::Binary(s,eph));
+      }else{
+	if(file.bad()){
+	  file.close();
+	  throw std::string("File stream corrupted");
+	}
+	file.clear();
+      }
+    }
+    file.close();
+    std::cout << "Found position and ephemeris data on " << binary.size() << " stars" << std::endl;
+    if(binary.size() == 0)
+      throw std::string("Cannot have 0 stars!");
+
+    std::string sdate;
+    input.get_value("startdate", sdate, "17 Nov 1961", "date at start of first night");
+    Subs::Date start(sdate);
+    input.get_value("enddate", sdate, "17 Nov 1961", "date at start of last night");
+    Subs::Date end(sdate);
+    if(start > end) throw std::string("Can't have a start date after the end date!");
+
+    std::string stelescopes;
+    input.get_value("telescopes", stelescopes, "WHT,NTT", "comma-separated list of telescopes");
+    std::vector<std::string> name;
+    std::vector<Subs::Telescope> telescope;
+    {
+      std::string item;
+      std::istringstream lstr(stelescopes);
+      while(getline(lstr, item, ',')){
+	std::istringstream istr(item);
+	std::string tname;
+	if(istr >> tname){
+	  name.push_back(tname);
+	  telescope.push_back(Subs::Telescope(tname));
+	}
+      }
+    }
+    if(telescope.empty()) throw std::string("No telescopes given!");
+
+    double airmass;
+    input.get_value("airmass", airmass, 2., 1.001, 50., "maximum airmass to consider");
+    double sunalt;
+    input.get_value("sunalt", sunalt, -15., -80., 0., "maximum altitude of Sun");
+    double phase;
+    input.get_value("phase", phase, 0., 0., 1., "orbital phase");
+    bool all;
+    input.get_value("all", all, false, "list events that no site can see?");
+    int nthread;
+    input.get_value("threads", nthread, 0, 0, 1024, "number of threads (0 for one per core)");
+
+    // Nights of every site, computed once for all stars
+
+    Observing::Network network(telescope, start, end, sunalt);
+
+    size_t lmax = 4;
+    for(size_t i=0; i<name.size(); i++) lmax = std::max(lmax, name[i].length());
+
+    std::cout << "\nSite" << std::string(lmax-3, ' ') << "Nights" << std::endl;
+    for(size_t i=0; i<network.size(); i++)
+      std::cout << std::setw(lmax) << std::left << name[i] << " " << std::right << std::setw(6)
+		<< network.dark(i).size() << std::endl;
+
+    // The stars are computed in parallel, then reported in order
+
+    std::vector<std::vector<std::vector<Observing::Network::Interval> > > windows(binary.size());
+    std::vector<std::vector<Observing::Network::Event> > events(binary.size());
+    Observing::parallel_for(binary.size(), nthread, [&](size_t j, Observing::Context&){
+	network.windows(binary[j], airmass, windows[j]);
+	network.events(binary[j], binary[j], phase, windows[j], events[j]);
+      });
+
+    Observing::Writer out(std::cout);
+    for(size_t j=0; j<binary.size(); j++){
+
+      const std::vector<std::vector<Observing::Network::Interval> >& win = windows[j];
+      const std::vector<Observing::Network::Event>& ev = events[j];
+
+      out << "\nStar = " << binary[j].name() << ", " << (Subs::Ephem)binary[j] << "\n";
+      out.endl();
+
+      out << "Site" << std::string(lmax-3, ' ') << "Nights   Hours";
+      out.endl();
+      for(size_t i=0; i<win.size(); i++){
+	double hours = 0.;
+	for(size_t n=0; n<win[i].size(); n++) hours += 24.*(win[i][n].second-win[i][n].first);
+	out.width(lmax).left() << name[i] << " ";
+	out.left(false).width(6) << win[i].size() << " ";
+	out.fixed().precision(1).width(7) << hours;
+	out.endl();
+	out.fixed(false);
+      }
+
+      out << "\n  Date            Time           Phase       Sites\n";
+      out.endl();
+      int nseen = 0;
+      for(size_t k=0; k<ev.size(); k++){
+	if(ev[k].site.empty() && !all) continue;
+	if(!ev[k].site.empty()) nseen++;
+	out << Subs::Time(ev[k].mjd) << " ";
+	out.left().precision(8).width(10) << ev[k].cycle << "  ";
+	out.left(false);
+	if(ev[k].site.empty()){
+	  out << "none";
+	}else{
+	  for(size_t i=0; i<ev[k].site.size(); i++)
+	    out << (i ? ", " : "") << name[ev[k].site[i]];
+	}
+	out.endl();
+      }
+      out << "\n" << nseen << " of " << ev.size() << " events visible from at least one site";
+      out.endl();
+    }
+  }
+
+  catch(const std::string& str){
+    std::cerr << str << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  catch(const std::exception& exc){
+    std::cerr << exc.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+}
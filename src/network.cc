@@ -0,0 +1,115 @@
+// Observing::Network: visibility of targets and times of orbital phases
+// from several telescopes at once.
+
+#include <cmath>
+#include <algorithm>
+#include "trm/subs.h"
+#include "trm/date.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+#include "trm/ephem.h"
+#include "trm/observing.h"
+#include "trm/network.h"
+
+/** Constructor. Finds the dark part of every night at every site.
+ * \param sites  the telescopes
+ * \param start  date at the start of the first night
+ * \param end    date at the start of the last night
+ * \param sunalt maximum altitude of the Sun, degrees
+ */
+Observing::Network::Network(const std::vector<Subs::Telescope>& sites, const Subs::Date& start, const Subs::Date& end,
+			    double sunalt) : tel(sites), drk(sites.size()), tfirst(0.), tlast(0.) {
+
+  if(sites.empty())
+    throw Observing_Error("Observing::Network: no sites");
+
+  int nday = int(end.mjd()-start.mjd()+1.5);
+  bool any = false;
+  Night nit;
+  for(size_t i=0; i<tel.size(); i++){
+    Subs::Date date = start;
+    for(int n=0; n<nday; n++, date.add_day(1)){
+      if(night(tel[i], date, sunalt, nit)){
+	drk[i].push_back(Interval(nit.twiend.mjd(), nit.twistart.mjd()));
+	if(!any || nit.twiend.mjd()   < tfirst) tfirst = nit.twiend.mjd();
+	if(!any || nit.twistart.mjd() > tlast)  tlast  = nit.twistart.mjd();
+	any = true;
+      }
+    }
+  }
+}
+
+/** Works out when a target can be seen from each site, night by night.
+ * \param obj     the target
+ * \param airmass maximum airmass
+ * \param win     for each site, the periods of visibility in time order
+ */
+void Observing::Network::windows(const Subs::Position& obj, double airmass, std::vector<std::vector<Interval> >& win) const {
+  win.resize(tel.size());
+  Subs::Time t1, t2, first, last;
+  for(size_t i=0; i<tel.size(); i++){
+    win[i].clear();
+    for(size_t n=0; n<drk[i].size(); n++){
+      t1.set(drk[i][n].first);
+      t2.set(drk[i][n].second);
+      if(when_visible(obj, tel[i], t1, t2, airmass, first, last))
+	win[i].push_back(Interval(first.mjd(), last.mjd()));
+    }
+  }
+}
+
+/** Computes the times at which a target reaches a given phase over the run
+ * and which of the sites can see each one. The timescale correction is
+ * computed once a day, using the first site, and interpolated.
+ * \param obj   the target
+ * \param eph   its ephemeris
+ * \param phase the phase of interest, 0 to 1
+ * \param win   the windows of the target from each site, as returned by windows
+ * \param ev    the events, in time order
+ */
+void Observing::Network::events(const Subs::Position& obj, const Subs::Ephem& eph, double phase,
+				const std::vector<std::vector<Interval> >& win, std::vector<Event>& ev) const {
+
+  ev.clear();
+  if(tlast <= tfirst) return;
+  if(win.size() != tel.size())
+    throw Observing_Error("Observing::Network::events: need windows for every site");
+
+  // timescale correction at 0h UT each day, with a day to spare either end
+  double mjd0 = floor(tfirst) - 1.;
+  int nnode = int(floor(tlast) - mjd0) + 3;
+  std::vector<double> off(nnode);
+  Subs::Time time;
+  for(int k=0; k<nnode; k++){
+    time.set(mjd0+k);
+    off[k] = tcorr(obj, eph, time, tel[0]);
+  }
+
+  const double jd = is_jd(eph) ? MJD2JD : 0.;
+  auto offset = [&](double mjd){
+    double x = std::max(0., std::min(double(nnode-1)-1.e-9, mjd-mjd0));
+    int k = int(x);
+    return off[k] + (off[k+1]-off[k])*(x-k);
+  };
+
+  long c1 = long(ceil(eph.phase(tfirst + offset(tfirst) + jd) - phase));
+  long c2 = long(floor(eph.phase(tlast + offset(tlast) + jd) - phase));
+
+  Event event;
+  for(long c=c1; c<=c2; c++){
+    event.cycle = double(c) + phase;
+    double t    = eph.time(event.cycle) - jd;
+    event.mjd   = t - offset(t);
+    event.mjd   = t - offset(event.mjd);
+
+    event.site.clear();
+    for(size_t i=0; i<win.size(); i++){
+      std::vector<Interval>::const_iterator it =
+	std::upper_bound(win[i].begin(), win[i].end(), Interval(event.mjd, 1.e30));
+      if(it != win[i].begin() && event.mjd <= (--it)->second)
+	event.site.push_back(i);
+    }
+    ev.push_back(event);
+  }
+}
@@ -0,0 +1,199 @@
+/*
+
+!!sphinx
+
+*nextevents* -- lists the next observable phase events
+======================================================
+
+*nextevents* merges the times at which every binary in a file passes through
+a given orbital phase into one time-ordered list and prints the first few
+that can be observed, i.e. that occur with the star below a maximum airmass
+and the Sun below a maximum altitude. Events are generated one at a time per
+star, so only as much of the future is computed as is needed to find the
+events requested, however many stars there are.
+
+Invocation:
+  nextevents stars telescope present (time) ndays number airmass sunalt phase
+
+Arguments:
+
+  stars :
+    Data file of star positions and ephemerides. Stars without ephemerides
+    are skipped.
+
+  telescope :
+    e.g. wht
+
+  present :
+    Start from the present time (from computer) or not
+
+  time :
+    If present = false, then this is the time to start from. String of the
+    form: "11 May 2032, 15:03:34.22" (exactly so, including the quotes).
+
+  ndays :
+    Maximum number of days ahead to search
+
+  number :
+    Maximum number of events to list
+
+  airmass :
+    Maximum airmass for an event to count as observable
+
+  sunalt :
+    Maximum altitude of the Sun (degrees) for an event to count as observable
+
+  phase :
+    Orbital phase of the events, e.g. 0 for primary eclipse
+
+  threads :
+    Number of threads to use (hidden, default 0, meaning one per core)
+
+!!sphinx
+
+*/
+
+#include <cstdlib>
+#include <string>
+#include <exception>
+#include <iostream>
+#include <fstream>
+#include <vector>
+
+#include "trm/subs.h"
+#include "trm/input.h"
+#include "trm/date.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/ephem.h"
+#include "trm/position.h"
+#include "trm/star.h"
+#include "trm/binary_star.h"
+#include "trm/observing.h"
+#include "trm/timeline.h"
+#include "trm/writer.h"
+
+int main(int argc, char *argv[]){
+
+  try{
+
+    // Construct Input object
+
+    Subs::Input input(argc, argv, Observing::OBSERVING_ENV, Observing::OBSERVING_DIR);
+
+    // sign-in variables (equivalent to ADAM .ifl files)
+
+    input.sign_in("stars",     Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("telescope", Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("present",   Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("time",      Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("ndays",     Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("number",    Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("airmass",   Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("sunalt",    Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("phase",     Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("threads",   Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+
+    // Get input
+
+    std::string starfile;
+    input.get_value("stars", starfile, "stardata", "file of star positions and ephemerides");
+
+    // Load star data
+
+    std::ifstream file(starfile.c_str());
+    if(!file) throw std::string("Could not open file = ") + starfile;
+
+    Subs::Star   s;
+    Subs::Ephem  eph;
+    std::vector<Subs::Binary>  binary;
+    while(file >> s){
+      if(file >> eph){
+	binary.push_back(Subs::Binary(s,eph));
+      }else{
+	if(file.bad()){
+	  file.close();
+	  throw std::string("File stream corrupted");
+	}
+	file.clear();
+      }
+    }
+    file.close();
+    std::cout << "Found position and ephemeris data on " << binary.size() << " stars" << std::endl;
+    if(binary.size() == 0)
+      throw std::string("Cannot have 0 stars!");
+
+    size_t lmax = 0;
+    for(size_t j=0; j<binary.size(); j++) lmax = std::max(lmax,binary[j].name().length());
+
+    std::string stelescope;
+    input.get_value("telescope", stelescope, "WHT", "telescope name");
+    Subs::Telescope telescope(stelescope);
+
+    bool present;
+    input.get_value("present", present, true, "start from the present time?");
+
+    Subs::Time tstart;
+    if(present){
+      tstart.set();
+    }else{
+      std::string stime;
+      input.get_value("time", stime, "17 Nov 1961, 01:23:45.67", "time to start from");
+      tstart.set(stime);
+    }
+
+    double ndays;
+    input.get_value("ndays", ndays, 30., 0.01, 100000., "maximum number of days ahead to search");
+    int number;
+    input.get_value("number", number, 10, 1, 1000000, "maximum number of events to list");
+    double airmass;
+    input.get_value("airmass", airmass, 2., 1.001, 50., "maximum airmass to consider");
+    double sunalt;
+    input.get_value("sunalt", sunalt, -15., -80., 0., "maximum altitude of Sun");
+    double phase;
+    input.get_value("phase", phase, 0., 0., 1., "orbital phase");
+    int nthread;
+    input.get_value("threads", nthread, 0, 0, 1024, "number of threads (0 for one per core)");
+
+    Subs::Time tend = tstart;
+    tend.add_hour(24.*ndays);
+
+    Observing::Timeline timeline(telescope, phase, airmass, sunalt);
+    for(size_t j=0; j<binary.size(); j++)
+      timeline.add(binary[j], binary[j]);
+    timeline.set_threads(nthread);
+
+    std::vector<Observing::Event> events;
+    timeline.query(tstart, tend, number, events);
+
+    if(events.size() == 0){
+      std::cout << "\nNo observable events found from " << tstart << " to " << tend << std::endl;
+      return 0;
+    }
+
+    Observing::Writer out(std::cout);
+    out << "\n";
+    out.fill(' ').width(lmax).left() << "Star"
+      << "   Date            Time           Phase     Error  Airmass  Sun's altitude\n";
+    out.endl();
+
+    for(size_t i=0; i<events.size(); i++){
+      const Observing::Event& ev = events[i];
+      out.fill(' ').width(lmax).left() << binary[ev.star].name() << " " << ev.time << " ";
+      out.precision(8).width(10) << ev.cycle << " ";
+      out.precision(4).width(10) << ev.pherr << "   ";
+      out.width(5) << ev.airmass << "    " << ev.sunalt;
+      out.endl();
+    }
+  }
+
+  catch(const std::string& str){
+    std::cerr << str << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  catch(const std::exception& exc){
+    std::cerr << exc.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+}
@@ -0,0 +1,43 @@
+// Computes the times of sunset, the end of evening twilight, the start
+// of morning twilight and sunrise for the night that starts on a given
+// date. Sunset and sunrise are taken as the Sun at -1 degrees, twilight as
+// the Sun at altitude sunalt, unless that is no lower than -1, in which case
+// twilight is taken to end at sunset and start at sunrise. Returns false if
+// any of these cannot be found, e.g. in polar summer. The Sun is computed
+// according to model.
+
+#include "trm/subs.h"
+#include "trm/date.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/observing.h"
+
+bool Observing::night(const Subs::Telescope& tel, const Subs::Date& date, double sunalt, Night& night,
+		      Sun_Model model){
+
+  // Start from around local mid-day
+  Subs::Time time(date);
+  time.add_hour(12.-tel.longitude()/15.);
+
+  if(!suntime(tel, time, -1., night.sunset, model)) return false;
+
+  // A search from sunset for an altitude at or above it would find the
+  // next rising instead
+  if(sunalt >= -1.){
+    time = night.sunset;
+    time.add_hour(0.1);
+    if(!suntime(tel, time, -1., night.sunrise, model)) return false;
+    night.twiend   = night.sunset;
+    night.twistart = night.sunrise;
+    return true;
+  }
+
+  if(!suntime(tel, night.sunset, sunalt, night.twiend, model)) return false;
+
+  time = night.twiend;
+  time.add_hour(0.1);   
+  if(!suntime(tel, time, sunalt, night.twistart, model)) return false;
+  if(!suntime(tel, night.twistart, -1., night.sunrise, model)) return false;
+
+  return true;
+}
@@ -0,0 +1,351 @@
+/*
+
+!!sphinx
+
+*obsd* -- answers queries on targets over a local socket
+========================================================
+
+*obsd* stays running with a catalogue of targets and a telescope in memory
+and answers queries on them sent over a Unix domain socket. Every run of
+programs such as *ephemeris* or *starinfo* starts by reading the star data
+file, setting up the telescope and finding the twilight times of each night;
+*obsd* does this once and keeps the nights, the times each target is
+visible and the timescale corrections it works out for later queries, so a
+program polling it, such as a web page of current airmasses and phases, gets
+its answer without these costs.
+
+Each query is one line, a command followed by its arguments. Dates are
+single words such as 1/5/2002, times are UTC MJDs or 'now', and arguments
+airmass=A and sunalt=S override the limits below for that query only.
+Anything left after the arguments is the name of a target to restrict the
+answer to. The commands are:
+
+  stars [star] :
+    Lines of index, 1 if the target has an ephemeris else 0, and name
+
+  night date :
+    Sunset, end of evening twilight, start of morning twilight and sunrise
+    of the night starting on date, as MJDs
+
+  visible date [star] :
+    Lines of the first and last MJDs that each target is visible between the
+    twilights of a night, and its name
+
+  ephemeris date1 date2 phase [star] :
+    Times at which targets reach a phase between the twilights of the nights
+    starting on date1 to date2, in time order: MJD, cycle number plus phase,
+    phase uncertainty, airmass, Sun's altitude and name. Nights without the
+    twilight wanted are skipped.
+
+  status time [star] :
+    A line of the MJD and Sun's altitude, then lines of the hour angle,
+    airmass, position angle of a vertical slit, azimuth, phase and its
+    uncertainty (or '-' without an ephemeris) and name of each target
+
+  airmass date [star] :
+    Lines of MJD, airmass and name every step=M minutes (default 10) from
+    sunset to sunrise while each target is up
+
+  reload :
+    Reads the star data file again
+
+  help :
+    Lists the commands
+
+  quit :
+    Closes the connection
+
+Each answer is any number of lines followed by 'ok', or by 'error' and a
+message if the query failed. Blank lines and lines starting with # get no
+answer. The socket can be used from a shell with e.g. "socat -
+UNIX-CONNECT:obsd.sock". A hang-up signal makes *obsd* read the star data
+file again; an interrupt or terminate signal stops it and removes the socket.
+
+Invocation:
+  obsd stars telescope socket airmass sunalt
+
+Arguments:
+
+  stars :
+    Data file of star positions and ephemerides
+
+  telescope :
+    e.g. wht
+
+  socket :
+    Path of the socket to create. An old socket of the same name is replaced.
+    Anyone who can connect to it can make *obsd* do work and read the star
+    data, so by default only its owner can (see mode).
+
+  airmass :
+    Maximum airmass, unless a query says otherwise
+
+  sunalt :
+    Maximum altitude of Sun (degrees), unless a query says otherwise
+
+  mode :
+    Permissions of the socket, in octal, e.g. 660 to let members of the
+    group connect as well (hidden, default 600, the owner only). The socket
+    is created with no access beyond the owner's and then set to this.
+
+  threads :
+    Number of threads to use (hidden, default 0, meaning one per core)
+
+  fastsun :
+    true to compute the Sun from a short analytic series good to about an
+    arcminute rather than the full solar ephemeris (hidden, default false)
+
+  stats :
+    Counts of the expensive calls and the time spent in each phase of the
+    run, reported when *obsd* stops: 'none', 'text' for a table or 'json'
+    for JSON, both on stderr, or the name of a file to write JSON to. Only
+    collected if the package was configured with --enable-stats. (hidden,
+    default none)
+
+!!sphinx
+
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <string>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "trm/subs.h"
+#include "trm/input.h"
+#include "trm/observing.h"
+#include "trm/query.h"
+#include "trm/stats.h"
+
+namespace {
+
+  volatile sig_atomic_t stop = 0, hangup = 0;
+
+  extern "C" void on_stop(int){stop = 1;}
+  extern "C" void on_hangup(int){hangup = 1;}
+
+  // longest query line accepted
+  const size_t MAXLINE = 65536;
+
+  // a connection: the socket, what has come in but not yet been answered,
+  // and what is waiting to go out
+  struct Client {
+    int fd;
+    std::string in, out;
+    bool closing;
+  };
+
+  // Creates the listening socket, replacing an old socket of the same name,
+  // and gives it the permissions wanted. It is bound with a umask that
+  // shuts out everyone but the owner so it is never more open than asked.
+  int listen_on(const std::string& path, mode_t mode){
+
+    sockaddr_un addr;
+    if(path.length() >= sizeof(addr.sun_path))
+      throw std::string("Socket name too long = ") + path;
+
+    struct stat st;
+    if(lstat(path.c_str(), &st) == 0){
+      if(!S_ISSOCK(st.st_mode))
+	throw std::string("Will not replace ") + path + " as it is not a socket";
+      unlink(path.c_str());
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0) throw std::string("Could not create a socket: ") + strerror(errno);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    mode_t mask = umask(077);
+    int status = bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    umask(mask);
+    if(status < 0 || chmod(path.c_str(), mode) < 0 || listen(fd, 64) < 0){
+      std::string err = strerror(errno);
+      close(fd);
+      if(status == 0) unlink(path.c_str());
+      throw std::string("Could not listen on ") + path + ": " + err;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+  }
+
+  // Answers every complete line a client has sent
+  void serve(Client& client, Observing::Query& query){
+    size_t n;
+    std::ostringstream ostr;
+    while(!client.closing && (n = client.in.find('\n')) != std::string::npos){
+      if(!query.answer(client.in.substr(0, n), ostr)) client.closing = true;
+      client.in.erase(0, n+1);
+    }
+    if(!client.closing && client.in.length() > MAXLINE){
+      ostr << "error query longer than " << MAXLINE << " characters\n";
+      client.closing = true;
+    }
+    client.out += ostr.str();
+  }
+}
+
+int main(int argc, char *argv[]){
+
+  try{
+
+    // Construct Input object
+
+    Subs::Input input(argc, argv, Observing::OBSERVING_ENV, Observing::OBSERVING_DIR);
+
+    // sign-in variables (equivalent to ADAM .ifl files)
+
+    input.sign_in("stars",     Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("telescope", Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("socket",    Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("airmass",   Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("sunalt",    Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("mode",      Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("threads",   Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("fastsun",   Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("stats",     Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+
+    // Get input
+
+    std::string starfile;
+    input.get_value("stars", starfile, "stardata", "file of star positions and ephemerides");
+    std::string stelescope;
+    input.get_value("telescope", stelescope, "WHT", "telescope name");
+    std::string spath;
+    input.get_value("socket", spath, "obsd.sock", "path of the socket to listen on");
+    double airmass;
+    input.get_value("airmass", airmass, 2., 1.001, 50., "maximum airmass, unless a query says otherwise");
+    double sunalt;
+    input.get_value("sunalt", sunalt, -15., -80., 0., "maximum altitude of Sun, unless a query says otherwise");
+    std::string smode;
+    input.get_value("mode", smode, "600", "permissions of the socket, in octal");
+    char* end;
+    long mode = strtol(smode.c_str(), &end, 8);
+    if(smode.empty() || *end || mode < 0 || mode > 0777)
+      throw std::string("mode must be octal permissions such as 600; found ") + smode;
+    int nthread;
+    input.get_value("threads", nthread, 0, 0, 1024, "number of threads (0 for one per core)");
+    bool fastsun;
+    input.get_value("fastsun", fastsun, false, "use the fast, low-precision Sun?");
+    Observing::Sun_Model smodel = fastsun ? Observing::FAST_SUN : Observing::FULL_SUN;
+    std::string sstats;
+    input.get_value("stats", sstats, "none", "statistics to report (none, text, json or a file for JSON)");
+
+    Observing::Query query(starfile, stelescope, airmass, sunalt, smodel, nthread);
+    std::cerr << "Found data on " << query.catalogue().size() << " stars" << std::endl;
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT,  on_stop);
+    signal(SIGTERM, on_stop);
+    signal(SIGHUP,  on_hangup);
+
+    int lfd = listen_on(spath, mode_t(mode));
+    std::cerr << "Listening on " << spath << std::endl;
+
+    // One thread serves every connection in turn; each query is short, and
+    // the work within one is shared out over threads by the query itself.
+    std::vector<Client> client;
+    std::vector<pollfd> pfd;
+    char buff[16384];
+    while(!stop){
+
+      if(hangup){
+	hangup = 0;
+	try{
+	  query.reload();
+	  std::cerr << "Reloaded " << starfile << ", " << query.catalogue().size() << " stars" << std::endl;
+	}
+	catch(const std::string& err){
+	  std::cerr << err << std::endl;
+	}
+      }
+
+      pfd.resize(client.size()+1);
+      pfd[0].fd = lfd;
+      pfd[0].events = POLLIN;
+      for(size_t i=0; i<client.size(); i++){
+	pfd[i+1].fd = client[i].fd;
+	pfd[i+1].events = client[i].out.empty() ? POLLIN : POLLOUT;
+      }
+      if(poll(&pfd[0], pfd.size(), 1000) < 0){
+	if(errno == EINTR) continue;
+	throw std::string("poll failed: ") + strerror(errno);
+      }
+
+      for(size_t i=0; i<client.size(); i++){
+	Client& c = client[i];
+	short rev = pfd[i+1].revents;
+	if(rev & POLLIN){
+	  ssize_t n = read(c.fd, buff, sizeof(buff));
+	  if(n > 0){
+	    c.in.append(buff, n);
+	    serve(c, query);
+	  }else if(n == 0 || (errno != EAGAIN && errno != EINTR)){
+	    c.closing = true;
+	    c.out.clear();
+	  }
+	}else if(rev & (POLLERR | POLLHUP | POLLNVAL)){
+	  c.closing = true;
+	  c.out.clear();
+	}
+	if((rev & POLLOUT) && !c.out.empty()){
+	  ssize_t n = write(c.fd, c.out.data(), c.out.length());
+	  if(n > 0){
+	    c.out.erase(0, n);
+	  }else if(errno != EAGAIN && errno != EINTR){
+	    c.closing = true;
+	    c.out.clear();
+	  }
+	}
+      }
+
+      // Drop connections that are finished with
+      size_t k = 0;
+      for(size_t i=0; i<client.size(); i++){
+	if(client[i].closing && client[i].out.empty())
+	  close(client[i].fd);
+	else
+	  client[k++] = client[i];
+      }
+      client.resize(k);
+
+      if(pfd[0].revents & POLLIN){
+	int fd;
+	while((fd = accept(lfd, 0, 0)) >= 0){
+	  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	  Client c;
+	  c.fd = fd;
+	  c.closing = false;
+	  client.push_back(c);
+	}
+      }
+    }
+
+    for(size_t i=0; i<client.size(); i++) close(client[i].fd);
+    close(lfd);
+    unlink(spath.c_str());
+    std::cerr << "Stopped" << std::endl;
+
+    Observing::Stats::report(sstats);
+  }
+
+  catch(const std::string& err){
+    std::cerr << err << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  catch(const std::exception& exc){
+    std::cerr << exc.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
@@ -0,0 +1,102 @@
+// Observing::Precise_Ephem: time to phase and back with the cycle count
+// held apart from the fraction of a cycle.
+
+#include <cmath>
+#include "trm/subs.h"
+#include "trm/ephem.h"
+#include "trm/observing.h"
+#include "trm/precise_ephem.h"
+
+namespace {
+
+  // a + b = s + e exactly
+  inline void two_sum(double a, double b, double& s, double& e){
+    s = a + b;
+    double bb = s - a;
+    e = (a - (s - bb)) + (b - bb);
+  }
+
+  // a * b = p + e exactly
+  inline void two_prod(double a, double b, double& p, double& e){
+    p = a * b;
+    e = std::fma(a, b, -p);
+  }
+
+  // Cycles either side of T0 used to recover the coefficients; far enough
+  // that the rounding of the times is spread over many cycles, but still
+  // exact as doubles.
+  const double NCYCLE = 67108864.;
+}
+
+/** Recovers T0, the period and the quadratic term from the times of cycles
+ * 0 and +/-NCYCLE. A time of T0 + n P + Q n^2 is odd in n for the period and
+ * even for the quadratic term, so the two separate cleanly.
+ * \param eph the ephemeris
+ */
+Observing::Precise_Ephem::Precise_Ephem(const Subs::Ephem& eph){
+
+  double t0 = eph.time(0.);
+  double tp = eph.time(NCYCLE), tm = eph.time(-NCYCLE);
+  period = (tp - tm)/(2.*NCYCLE);
+  quad   = ((tp - t0) + (tm - t0))/(2.*NCYCLE*NCYCLE);
+
+  // below this the quadratic term is just rounding in the times above
+  if(fabs(quad)*NCYCLE*NCYCLE < 1.e-14*(fabs(tp) + fabs(tm))) quad = 0.;
+
+  if(is_jd(eph)){
+    two_sum(t0, -MJD2JD, t0hi, t0lo);
+  }else{
+    t0hi = t0;
+    t0lo = 0.;
+  }
+}
+
+/** Splits the phase at an MJD into a whole number of cycles and a fraction
+ * in [0,1). The remainder after the whole cycles is formed exactly, so the
+ * fraction does not lose precision as the cycle count grows. A quadratic
+ * term is dealt with by Newton-Raphson from the linear solution.
+ * \param mjd   the time, an MJD on the timescale of the ephemeris
+ * \param cycle the cycle number
+ * \param frac  the fraction of a cycle
+ */
+void Observing::Precise_Ephem::phase(double mjd, long& cycle, double& frac) const {
+
+  // time since T0, in two parts
+  double dhi, dlo;
+  two_sum(mjd, -t0hi, dhi, dlo);
+  dlo -= t0lo;
+
+  double c = floor((dhi + dlo)/period);
+
+  // remainder dt - c P
+  double p, e;
+  two_prod(c, period, p, e);
+  double r = ((dhi - p) - e) + dlo;
+  double f = r/period;
+
+  if(quad != 0.){
+    // solve P f + Q (c+f)^2 = r
+    for(int i=0; i<4; i++){
+      double n = c + f;
+      f -= (period*f + quad*n*n - r)/(period + 2.*quad*n);
+    }
+  }
+
+  double fl = floor(f);
+  cycle = long(c + fl);
+  frac  = f - fl;
+}
+
+/** MJD at a cycle number plus a fraction of a cycle.
+ * \param cycle the cycle number
+ * \param frac  the fraction of a cycle
+ * \return the MJD on the timescale of the ephemeris
+ */
+double Observing::Precise_Ephem::time(long cycle, double frac) const {
+  double c = double(cycle);
+  double p, e, s, es;
+  two_prod(c, period, p, e);
+  two_sum(t0hi, p, s, es);
+  double n = c + frac;
+  return s + (es + t0lo + e + period*frac + quad*n*n);
+}
@@ -0,0 +1,464 @@
+// Observing::Query: one-line queries on a catalogue, answered from caches of
+// nights, visibility windows and timescale corrections kept between them.
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <exception>
+#include "trm/subs.h"
+#include "trm/date.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+#include "trm/ephem.h"
+#include "trm/observing.h"
+#include "trm/batch.h"
+#include "trm/catalogue.h"
+#include "trm/precise_ephem.h"
+#include "trm/query.h"
+#include "trm/stats.h"
+#include "trm/trace.h"
+
+namespace {
+
+  // once this many nights are held they are all dropped; also the most
+  // nights one query can cover
+  const size_t MAXNIGHT = 1000;
+
+  double to_double(const std::string& str, const std::string& what){
+    std::istringstream istr(str);
+    double x;
+    char c;
+    if(!(istr >> x) || (istr >> c))
+      throw Observing::Observing_Error("could not read " + what + " from '" + str + "'");
+    return x;
+  }
+
+  Subs::Time to_time(const std::string& str){
+    Subs::Time t;
+    if(str == "now")
+      t.set();
+    else
+      t.set(to_double(str, "an MJD"));
+    return t;
+  }
+
+  // an event in the answer to an ephemeris query
+  struct Event {
+    double mjd, cycle, pherr, airmass, sunalt;
+    size_t star;
+    bool operator<(const Event& ev) const {return mjd < ev.mjd;}
+  };
+
+  const char* HELP[] = {
+    "stars [star]",
+    "night date [sunalt=S]",
+    "visible date [airmass=A] [sunalt=S] [star]",
+    "ephemeris date1 date2 phase [airmass=A] [sunalt=S] [star]",
+    "status time|now [star]",
+    "airmass date [step=M] [star]",
+    "reload",
+    "help",
+    "quit"
+  };
+}
+
+/** Constructor. Reads the catalogue and sets up the telescope; nights are
+ * only worked out when first needed.
+ * \param stars     file of star positions and ephemerides
+ * \param telescope telescope name
+ * \param airmass   maximum airmass unless a query says otherwise
+ * \param sunalt    maximum altitude of the Sun unless a query says otherwise
+ * \param model     which model of the Sun to use
+ * \param nthread   number of threads (0 for one per core)
+ */
+Observing::Query::Query(const std::string& stars, const std::string& telescope, double airmass, double sunalt,
+			Sun_Model model, int nthread) :
+  stars(stars), tel(telescope), airmass(airmass), sunalt(sunalt), model(model), nthread(nthread), cat(&own) {
+  load();
+}
+
+/** Constructor from a catalogue that a program has already loaded, to
+ * answer queries on it without reading or copying it. The Query refers to
+ * the catalogue throughout, so it must not be destroyed or changed while
+ * the Query is in use.
+ * \param catalogue the targets
+ * \param telescope the telescope
+ * \param airmass   maximum airmass unless a query says otherwise
+ * \param sunalt    maximum altitude of the Sun unless a query says otherwise
+ * \param model     which model of the Sun to use
+ * \param nthread   number of threads (0 for one per core)
+ */
+Observing::Query::Query(const Catalogue& catalogue, const Subs::Telescope& telescope, double airmass, double sunalt,
+			Sun_Model model, int nthread) :
+  tel(telescope), airmass(airmass), sunalt(sunalt), model(model), nthread(nthread), cat(&catalogue) {}
+
+void Observing::Query::load(){
+  OBSERVING_TIME(LOAD);
+  own = Catalogue(stars);
+}
+
+void Observing::Query::reload(){
+  if(stars.empty()) throw Observing_Error("there is no star data file to read again");
+  load();
+  almanacs.clear();
+}
+
+/** Answers a query, writing the lines of the answer to a stream. Blank lines
+ * and lines starting with # get no answer at all; all others end with 'ok' or
+ * 'error <message>'.
+ * \param line the query
+ * \param ostr the stream for the answer
+ * \return false after 'quit', true otherwise
+ */
+bool Observing::Query::answer(const std::string& line, std::ostream& ostr){
+
+  OBSERVING_SPAN("query");
+  std::istringstream istr(line);
+  std::vector<std::string> word;
+  std::string w;
+  while(istr >> w) word.push_back(w);
+  if(word.empty() || word[0][0] == '#') return true;
+
+  try{
+    const std::string& cmd = word[0];
+    if(cmd == "stars"){
+      Request r = parse(word, 0);
+      for(size_t i=0; i<r.star.size(); i++)
+	ostr << r.star[i] << " " << (cat->has_ephem(r.star[i]) ? 1 : 0) << " " << cat->name(r.star[i]) << "\n";
+    }else if(cmd == "night"){
+      night(word, ostr);
+    }else if(cmd == "visible"){
+      visible(word, ostr);
+    }else if(cmd == "ephemeris"){
+      ephemeris(word, ostr);
+    }else if(cmd == "status"){
+      status(word, ostr);
+    }else if(cmd == "airmass"){
+      airmasses(word, ostr);
+    }else if(cmd == "reload"){
+      reload();
+      ostr << cat->size() << "\n";
+    }else if(cmd == "help"){
+      for(size_t i=0; i<sizeof(HELP)/sizeof(HELP[0]); i++) ostr << HELP[i] << "\n";
+    }else if(cmd == "quit"){
+      ostr << "ok\n";
+      return false;
+    }else{
+      throw Observing_Error("unrecognised command '" + cmd + "'; try 'help'");
+    }
+  }
+  catch(const std::string& err){
+    ostr << "error " << err << "\n";
+    return true;
+  }
+  catch(const std::exception& exc){
+    ostr << "error " << exc.what() << "\n";
+    return true;
+  }
+  ostr << "ok\n";
+  return true;
+}
+
+/** Answers queries read from a stream until it ends or a query is 'quit'.
+ * The first word of each line is a tag, which is put at the start of each
+ * line of the answer; the rest of the line follows the command to make the
+ * query, so that with command 'ephemeris', for instance, the line
+ * "q1 1/5/2002 7/5/2002 0.5 DQ Her" is answered as the query "ephemeris
+ * 1/5/2002 7/5/2002 0.5 DQ Her" with each line starting "q1 ". Each answer
+ * is flushed as soon as it is complete, so a program can feed queries in
+ * and read answers back one at a time.
+ * \param istr    the stream of queries
+ * \param ostr    the stream for the answers
+ * \param command the command to put before each query, or blank
+ */
+void Observing::Query::batch(std::istream& istr, std::ostream& ostr, const std::string& command){
+
+  std::string line, tag, rest;
+  std::ostringstream astr;
+  bool more = true;
+  while(more && getline(istr, line)){
+    std::istringstream lstr(line);
+    if(!(lstr >> tag) || tag[0] == '#') continue;
+    rest.clear();
+    getline(lstr, rest);
+    astr.str("");
+    more = answer(command.empty() ? rest : command + " " + rest, astr);
+
+    // a query with nothing after the tag is blank, but still owed an answer
+    if(astr.str().empty()) astr << "error no query\n";
+
+    const std::string& ans = astr.str();
+    size_t n1 = 0, n2;
+    while((n2 = ans.find('\n', n1)) != std::string::npos){
+      ostr << tag << " ";
+      ostr.write(ans.data()+n1, n2-n1+1);
+      n1 = n2 + 1;
+    }
+    ostr.flush();
+  }
+}
+
+/** Splits the words of a query after the command into the fixed
+ * arguments, key=value limits and the name of a target.
+ * \param word   the words of the query, the command first
+ * \param nfixed number of arguments the command needs
+ */
+Observing::Query::Request Observing::Query::parse(const std::vector<std::string>& word, size_t nfixed){
+
+  Request r;
+  r.airmass = airmass;
+  r.sunalt  = sunalt;
+  r.step    = 10.;
+  std::string name;
+  for(size_t i=1; i<word.size(); i++){
+    size_t n = word[i].find('=');
+    if(n != std::string::npos && word[i].compare(0, n, "airmass") == 0){
+      r.airmass = to_double(word[i].substr(n+1), "the airmass");
+    }else if(n != std::string::npos && word[i].compare(0, n, "sunalt") == 0){
+      r.sunalt = to_double(word[i].substr(n+1), "the altitude of the Sun");
+    }else if(n != std::string::npos && word[i].compare(0, n, "step") == 0){
+      r.step = to_double(word[i].substr(n+1), "the step");
+      if(r.step <= 0.) throw Observing_Error("the step must be > 0");
+    }else if(r.arg.size() < nfixed){
+      r.arg.push_back(word[i]);
+    }else{
+      if(!name.empty()) name += ' ';
+      name += word[i];
+    }
+  }
+  if(r.arg.size() < nfixed)
+    throw Observing_Error("'" + word[0] + "' needs " + Subs::str(nfixed) + " arguments; try 'help'");
+
+  if(name.empty()){
+    r.star.resize(cat->size());
+    for(size_t j=0; j<cat->size(); j++) r.star[j] = j;
+  }else{
+    size_t j = cat->find(name);
+    if(j == cat->size()) throw Observing_Error("no target called '" + name + "'");
+    r.star.push_back(j);
+  }
+  return r;
+}
+
+/** The almanac of the night starting on a date for a given altitude of the
+ * Sun at twilight, computed the first time it is asked for.
+ */
+Observing::Query::Almanac& Observing::Query::almanac(const Subs::Date& date, double sunalt){
+  std::pair<long,double> key(long(floor(date.mjd()+0.5)), sunalt);
+  std::map<std::pair<long,double>,Almanac>::iterator it = almanacs.find(key);
+  if(it != almanacs.end()) return it->second;
+
+  if(almanacs.size() >= MAXNIGHT) almanacs.clear();
+  Almanac& alm = almanacs[key];
+  {
+    OBSERVING_TIME(NIGHTS);
+    alm.ok = Observing::night(tel, date, sunalt, alm.night, model);
+  }
+  alm.vairmass = 0.;
+  alm.off.resize(cat->size());
+  alm.hasoff.resize(cat->size(), 0);
+  return alm;
+}
+
+/** Visibility of every target between the twilights of a night, computed
+ * the first time it is asked for at a given airmass limit.
+ */
+const std::vector<Observing::Visibility>& Observing::Query::visible(Almanac& alm, double airmass){
+  if(alm.vairmass != airmass){
+    OBSERVING_TIME(VISIBILITY);
+    std::vector<const Subs::Position*> obj(cat->size());
+    for(size_t j=0; j<cat->size(); j++) obj[j] = &cat->position(j);
+    Observing::when_visible(obj, tel, alm.night.twiend, alm.night.twistart, airmass, alm.vis, nthread);
+    alm.vairmass = airmass;
+  }
+  return alm.vis;
+}
+
+/** Correction from UTC onto the timescale of the ephemeris of target j
+ * half-way through a night, computed the first time it is asked for. Safe
+ * to call for different targets from different threads.
+ */
+double Observing::Query::offset(Almanac& alm, size_t j){
+  if(!alm.hasoff[j]){
+    Subs::Time mid((alm.night.sunset.mjd()+alm.night.sunrise.mjd())/2.);
+    alm.off[j] = tcorr(cat->position(j), cat->ephem(j), mid, tel);
+    alm.hasoff[j] = 1;
+  }
+  return alm.off[j];
+}
+
+void Observing::Query::night(const std::vector<std::string>& word, std::ostream& ostr){
+  Request r = parse(word, 1);
+  Subs::Date date(r.arg[0]);
+  const Almanac& alm = almanac(date, r.sunalt);
+  if(!alm.ok)
+    throw Observing_Error("no night with the Sun below " + Subs::str(r.sunalt) + " on " + r.arg[0]);
+  ostr << std::fixed << std::setprecision(6) << alm.night.sunset.mjd() << " " << alm.night.twiend.mjd() << " "
+       << alm.night.twistart.mjd() << " " << alm.night.sunrise.mjd() << "\n";
+  ostr.unsetf(std::ios::fixed);
+}
+
+void Observing::Query::visible(const std::vector<std::string>& word, std::ostream& ostr){
+  Request r = parse(word, 1);
+  Subs::Date date(r.arg[0]);
+  Almanac& alm = almanac(date, r.sunalt);
+  if(!alm.ok)
+    throw Observing_Error("no night with the Sun below " + Subs::str(r.sunalt) + " on " + r.arg[0]);
+  const std::vector<Visibility>& vis = visible(alm, r.airmass);
+  ostr << std::fixed << std::setprecision(6);
+  for(size_t i=0; i<r.star.size(); i++){
+    size_t j = r.star[i];
+    if(vis[j].visible)
+      ostr << vis[j].first.mjd() << " " << vis[j].last.mjd() << " " << cat->name(j) << "\n";
+  }
+  ostr.unsetf(std::ios::fixed);
+}
+
+/** Times of a phase over a range of nights, all targets together in time
+ * order. Nights without the twilight wanted are skipped.
+ */
+void Observing::Query::ephemeris(const std::vector<std::string>& word, std::ostream& ostr){
+
+  Request r = parse(word, 3);
+  Subs::Date date(r.arg[0]), end(r.arg[1]);
+  double phase = to_double(r.arg[2], "the phase");
+  int nday = int(end.mjd()-date.mjd()+1.5);
+  if(nday < 1) throw Observing_Error("the first date comes after the last");
+  if(nday > int(MAXNIGHT)) throw Observing_Error("no more than " + Subs::str(MAXNIGHT) + " nights at once");
+
+  std::vector<std::vector<Event> > event(r.star.size());
+  std::vector<Event> all;
+  for(int n=0; n<nday; n++, date.add_day(1)){
+    Almanac& alm = almanac(date, r.sunalt);
+    if(!alm.ok) continue;
+    double mjd1 = alm.night.twiend.mjd(), mjd2 = alm.night.twistart.mjd();
+
+    OBSERVING_TIME(EVENTS);
+    Observing::parallel_for(r.star.size(), nthread, [&](size_t i, Observing::Context&){
+	size_t j = r.star[i];
+	event[i].clear();
+	if(!cat->has_ephem(j)) return;
+	const Subs::Position& pos = cat->position(j);
+	const Subs::Ephem& eph = cat->ephem(j);
+	const Precise_Ephem& peph = cat->precise(j);
+	double off = offset(alm, j);
+	long ie1 = peph.first(mjd1+off, phase);
+	long ie2 = peph.last(mjd2+off, phase);
+	Subs::Time t;
+	Event ev;
+	ev.star = j;
+	for(long ie=ie1; ie<=ie2; ie++){
+	  ev.mjd = peph.time(ie, phase)-off;
+	  t.set(ev.mjd);
+	  ev.airmass = pos.altaz(t,tel).airmass;
+	  OBSERVING_COUNT(ALTAZ);
+	  if(ev.airmass > 0.5 && ev.airmass < r.airmass){
+	    ev.sunalt = Observing::sun_altaz(tel, t, model).alt_obs;
+	    if(ev.sunalt < r.sunalt){
+	      ev.cycle = double(ie)+phase;
+	      ev.pherr = eph.pherr(eph.time(ev.cycle));
+	      event[i].push_back(ev);
+	    }
+	  }
+	}
+      });
+    size_t nold = all.size();
+    for(size_t i=0; i<event.size(); i++) all.insert(all.end(), event[i].begin(), event[i].end());
+    std::stable_sort(all.begin()+nold, all.end());
+  }
+
+  OBSERVING_TIME(OUTPUT);
+  for(size_t k=0; k<all.size(); k++){
+    const Event& ev = all[k];
+    ostr << std::fixed << std::setprecision(6) << ev.mjd << " " << std::setprecision(4) << ev.cycle << " ";
+    ostr.unsetf(std::ios::fixed);
+    ostr << std::setprecision(4) << ev.pherr << " " << std::fixed << std::setprecision(3) << ev.airmass << " "
+	 << std::setprecision(2) << ev.sunalt << " " << cat->name(ev.star) << "\n";
+    ostr.unsetf(std::ios::fixed);
+  }
+}
+
+/** Where each target is in the sky at a given time and, for those with
+ * ephemerides, its orbital phase.
+ */
+void Observing::Query::status(const std::vector<std::string>& word, std::ostream& ostr){
+
+  Request r = parse(word, 1);
+  Subs::Time t = to_time(r.arg[0]);
+
+  std::vector<std::string> line(r.star.size());
+  {
+    OBSERVING_TIME(EVENTS);
+    Observing::parallel_for(r.star.size(), nthread, [&](size_t i, Observing::Context&){
+	size_t j = r.star[i];
+	const Subs::Position& pos = cat->position(j);
+	Subs::Altaz a = pos.altaz(t,tel);
+	OBSERVING_COUNT(ALTAZ);
+	std::ostringstream lstr;
+	lstr << std::fixed << std::setprecision(4) << a.ha << " " << a.airmass << " "
+	     << std::setprecision(2) << a.pa << " " << a.az << " ";
+	if(cat->has_ephem(j)){
+	  const Subs::Ephem& eph = cat->ephem(j);
+	  double mjd = t.mjd() + tcorr(pos, eph, t, tel);
+	  lstr << std::setprecision(8) << cat->precise(j).phase(mjd) << " ";
+	  lstr.unsetf(std::ios::fixed);
+	  lstr << std::setprecision(4) << eph.pherr(is_jd(eph) ? mjd + MJD2JD : mjd) << " ";
+	}else{
+	  lstr << "- - ";
+	}
+	lstr << cat->name(j);
+	line[i] = lstr.str();
+      });
+  }
+
+  OBSERVING_TIME(OUTPUT);
+  ostr << std::fixed << std::setprecision(6) << t.mjd() << " " << std::setprecision(2)
+       << Observing::sun_altaz(tel, t, model).alt_true << "\n";
+  ostr.unsetf(std::ios::fixed);
+  for(size_t i=0; i<line.size(); i++) ostr << line[i] << "\n";
+}
+
+/** Airmass of each target from sunset to sunrise at regular intervals,
+ * while it is above the horizon, target by target.
+ */
+void Observing::Query::airmasses(const std::vector<std::string>& word, std::ostream& ostr){
+
+  // The curves run from sunset to sunrise whatever the twilight limit, so
+  // the night is found for the Sun at the horizon and any night in which it
+  // sets will do
+  Request r = parse(word, 1);
+  Subs::Date date(r.arg[0]);
+  const Almanac& alm = almanac(date, -1.);
+  if(!alm.ok)
+    throw Observing_Error("the Sun does not set on " + r.arg[0]);
+  double mjd1 = alm.night.sunset.mjd(), mjd2 = alm.night.sunrise.mjd();
+  int npoint = int((mjd2-mjd1)*1440./r.step) + 1;
+
+  std::vector<std::string> line(r.star.size());
+  {
+    OBSERVING_TIME(VISIBILITY);
+    Observing::parallel_for(r.star.size(), nthread, [&](size_t i, Observing::Context&){
+	size_t j = r.star[i];
+	std::ostringstream lstr;
+	lstr << std::fixed;
+	Subs::Time t;
+	for(int k=0; k<npoint; k++){
+	  double mjd = mjd1 + r.step*k/1440.;
+	  t.set(mjd);
+	  double am = cat->position(j).altaz(t,tel).airmass;
+	  OBSERVING_COUNT(ALTAZ);
+	  if(am > 0.5)
+	    lstr << std::setprecision(6) << mjd << " " << std::setprecision(4) << am << " " << cat->name(j) << "\n";
+	}
+	line[i] = lstr.str();
+      });
+  }
+
+  OBSERVING_TIME(OUTPUT);
+  for(size_t i=0; i<line.size(); i++) ostr << line[i];
+}
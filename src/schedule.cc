@@ -0,0 +1,328 @@
+/*
+
+!!sphinx
+
+*schedule* -- plans a multi-night run to maximise phase coverage
+================================================================
+
+*schedule* assigns blocks of time over a run of nights to a set of binary
+stars, each wanted over a range of orbital phase with a given priority. It
+tries to maximise the sum over targets of priority times the fraction of
+the wanted phase range covered. Every block costs an overhead for
+acquisition before data taking starts, and blocks cannot overlap.
+
+The plan starts from a greedy choice of blocks by coverage gained per hour,
+which is then improved by local search. Visibility is computed just once per
+target and night, so re-planning, e.g. with the *lost* parameter after a
+night is lost to the weather, is quick.
+
+Invocation:
+  schedule stars targets telescope startdate enddate airmass sunalt overhead
+
+Arguments:
+
+  stars :
+    Data file of star positions and ephemerides
+
+  targets :
+    File listing the targets to schedule, one per line, as the name of the
+    star in the stars file followed by the start and end of the phase range
+    wanted and a priority, e.g. "DQ Her 0.9 1.1 2". The end phase can be less
+    than the start for ranges that run through phase 0. Lines starting with
+    # are ignored.
+
+  telescope :
+    e.g. wht
+
+  startdate :
+    Date of first night, e.g. 1/5/2002 = 1st May 2002
+
+  enddate :
+    Date of last night
+
+  airmass :
+    Maximum airmass
+
+  sunalt :
+    Maximum altitude of Sun (degrees)
+
+  overhead :
+    Overhead per block for acquisition etc, minutes
+
+  minblock :
+    Shortest block worth scheduling, minutes (hidden, default 10)
+
+  niter :
+    Maximum number of passes of local search (hidden, default 3)
+
+  lost :
+    Comma-separated list of nights to leave out, numbered from 1 (hidden,
+    default none). Use this to re-plan the rest of a run.
+
+  times :
+    true to count phases already in each star's .times file as covered
+    (hidden, default false)
+
+  limits :
+    File of horizon, declination and hour angle limits of the telescope in
+    the format described in trm/limits.h, or 'none' to apply only the airmass
+    limit (hidden, default none)
+
+  threads :
+    Number of threads to use (hidden, default 0, meaning one per core)
+
+!!sphinx
+
+*/
+
+#include <cstdlib>
+#include <string>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "trm/subs.h"
+#include "trm/input.h"
+#include "trm/date.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/ephem.h"
+#include "trm/position.h"
+#include "trm/star.h"
+#include "trm/binary_star.h"
+#include "trm/observing.h"
+#include "trm/catalogue.h"
+#include "trm/times_file.h"
+#include "trm/limits.h"
+#include "trm/batch.h"
+#include "trm/scheduler.h"
+#include "trm/writer.h"
+
+int main(int argc, char *argv[]){
+
+  try{
+
+    // Construct Input object
+
+    Subs::Input input(argc, argv, Observing::OBSERVING_ENV, Observing::OBSERVING_DIR);
+
+    // sign-in variables (equivalent to ADAM .ifl files)
+
+    input.sign_in("stars",     Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("targets",   Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("telescope", Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("startdate", Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("enddate",   Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("airmass",   Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("sunalt",    Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("overhead",  Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("minblock",  Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("niter",     Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("lost",      Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("times",     Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("limits",    Subs::Input::GLOBAL, Subs::Input::NOPROMPT);
+    input.sign_in("threads",   Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+
+    // Get input
+
+    std::string starfile;
+    input.get_value("stars", starfile, "stardata", "file of star positions and ephemerides");
+
+    // Load star data
+
+    std::ifstream file(starfile.c_str());
+    if(!file) throw std::string("Could not open file = ") + starfile;
+
+    Subs::Star   s;
+    Subs::Ephem  eph;
+    std::vector<Subs::Binary>  binary;
+    while(file >> s){
+      if(file >> eph){
+	binary.push_back(Subs::Binary(s,eph));
+      }else{
+	if(file.bad()){
+	  file.close();
+	  throw std::string("File stream corrupted");
+	}
+	file.clear();
+      }
+    }
+    file.close();
+    std::cout << "Found position and ephemeris data on " << binary.size() << " stars" << std::endl;
+    if(binary.size() == 0)
+      throw std::string("Cannot have 0 stars!");
+
+    // Load the targets
+
+    std::string targfile;
+    input.get_value("targets", targfile, "targets", "file of targets, phase ranges and priorities");
+    std::ifstream tfile(targfile.c_str());
+    if(!tfile) throw std::string("Could not open file = ") + targfile;
+
+    std::vector<size_t> star;
+    std::vector<double> pstart, pend, priority;
+    std::string line;
+    while(getline(tfile, line)){
+      std::istringstream istr(line);
+      std::vector<std::string> word;
+      std::string w;
+      while(istr >> w) word.push_back(w);
+      if(word.empty() || word[0][0] == '#') continue;
+      if(word.size() < 4) throw std::string("Could not read target from line = ") + line;
+
+      double p1, p2, pr;
+      std::istringstream nstr(word[word.size()-3] + " " + word[word.size()-2] + " " + word[word.size()-1]);
+      if(!(nstr >> p1 >> p2 >> pr)) throw std::string("Could not read target from line = ") + line;
+
+      std::string name = word[0];
+      for(size_t i=1; i<word.size()-3; i++) name += " " + word[i];
+      size_t j;
+      for(j=0; j<binary.size(); j++)
+	if(Observing::clean_name(binary[j].name()) == name) break;
+      if(j == binary.size()) throw std::string("Could not find target = ") + name + " in " + starfile;
+
+      star.push_back(j);
+      pstart.push_back(p1);
+      pend.push_back(p2);
+      priority.push_back(pr);
+    }
+    tfile.close();
+    std::cout << "Found " << star.size() << " targets" << std::endl;
+    if(star.size() == 0)
+      throw std::string("Cannot have 0 targets!");
+
+    size_t lmax = 6;
+    for(size_t j=0; j<star.size(); j++) lmax = std::max(lmax,binary[star[j]].name().length());
+
+    std::string stelescope;
+    input.get_value("telescope", stelescope, "WHT", "telescope name");
+    Subs::Telescope telescope(stelescope);
+
+    std::string sdate;
+    input.get_value("startdate", sdate, "17 Nov 1961", "date at start of first night");
+    Subs::Date start(sdate);
+    input.get_value("enddate", sdate, "17 Nov 1961", "date at start of last night");
+    Subs::Date end(sdate);
+    if(start > end) throw std::string("Can't have a start date after the end date!");
+
+    double airmass;
+    input.get_value("airmass", airmass, 2., 1.001, 50., "maximum airmass to consider");
+    double sunalt;
+    input.get_value("sunalt", sunalt, -15., -80., 0., "maximum altitude of Sun");
+    double overhead;
+    input.get_value("overhead", overhead, 10., 0., 600., "overhead per block (minutes)");
+    double minblock;
+    input.get_value("minblock", minblock, 10., 0., 600., "shortest block to schedule (minutes)");
+    int niter;
+    input.get_value("niter", niter, 3, 0, 1000, "maximum number of passes of local search");
+    std::string slost;
+    input.get_value("lost", slost, "", "nights to leave out (comma-separated, numbered from 1)");
+    bool times;
+    input.get_value("times", times, false, "count phases in the .times files as covered?");
+    std::string slimits;
+    input.get_value("limits", slimits, "none", "file of telescope horizon and pointing limits ('none' to ignore)");
+    Observing::Limits limits;
+    if(slimits != "none") limits.load(slimits);
+    int nthread;
+    input.get_value("threads", nthread, 0, 0, 1024, "number of threads (0 for one per core)");
+
+    std::vector<int> lost;
+    {
+      std::string item;
+      std::istringstream lstr(slost);
+      while(getline(lstr, item, ',')){
+	std::istringstream istr(item);
+	int n;
+	if(istr >> n) lost.push_back(n);
+      }
+    }
+
+    // Set up the scheduler
+
+    Observing::Scheduler scheduler(telescope, airmass, overhead, minblock, limits);
+    scheduler.set_threads(nthread);
+    for(size_t j=0; j<star.size(); j++)
+      scheduler.add_target(binary[star[j]], binary[star[j]], pstart[j], pend[j], priority[j]);
+
+    if(times){
+      Subs::Telescope dummy("WHT");
+      std::vector<Observing::Phase_Range> ranges;
+      for(size_t j=0; j<star.size(); j++){
+	Observing::read_times_cached(binary[star[j]].name() + ".times", binary[star[j]], binary[star[j]], dummy, ranges);
+	for(size_t i=0; i<ranges.size(); i++)
+	  scheduler.add_observed(j, ranges[i].p1, ranges[i].p2);
+      }
+    }
+
+    int nday = int(end.mjd()-start.mjd()+1.5);
+    Subs::Date date = start;
+    std::vector<Subs::Date> days;
+    for(int n=0; n<nday; n++, date.add_day(1)) days.push_back(date);
+    std::vector<Observing::Night> nights;
+    std::vector<char> nok;
+    Observing::night(telescope, days, sunalt, nights, nok, nthread);
+
+    std::vector<Subs::Date> dates;
+    for(int n=0; n<nday; n++){
+      if(!nok[n]){
+	std::cerr << "Could not find twilight times for the night starting " << days[n] << "; skipped" << std::endl;
+	continue;
+      }
+      size_t nn = scheduler.add_night(nights[n]);
+      dates.push_back(days[n]);
+      if(std::find(lost.begin(), lost.end(), n+1) != lost.end()) scheduler.remove_night(nn);
+    }
+
+    scheduler.plan(niter);
+
+    // Report
+
+    std::vector<Observing::Scheduler::Block> block = scheduler.blocks();
+    Observing::Writer out(std::cout);
+    out << "\nBlocks are listed as the time acquisition starts, the start and end of data"
+	<< "\ntaking, the phase range covered and the gain in the objective.";
+    out.endl();
+    size_t nlast = dates.size();
+    for(size_t i=0; i<block.size(); i++){
+      const Observing::Scheduler::Block& b = block[i];
+      if(b.night != nlast){
+	out << "\nNight starting " << dates[b.night] << "\n";
+	out.endl();
+	nlast = b.night;
+      }
+      Subs::Time t0(b.start), t1(b.t1), t2(b.t2);
+      double p1 = b.p1 - floor(b.p1);
+      out.fill(' ').width(lmax).left() << binary[star[b.target]].name() << " " << t0 << "  " << t1 << "  " << t2 << "  ";
+      out.precision(4).width(6) << p1 << " to ";
+      out.width(6) << p1+(b.p2-b.p1) << "  ";
+      out.precision(3) << b.gain;
+      out.endl();
+    }
+
+    out << "\n";
+    out.fill(' ').width(lmax).left() << "Target" << "  Priority  Fraction of phase range covered\n";
+    out.endl();
+    for(size_t j=0; j<star.size(); j++){
+      out.fill(' ').width(lmax).left() << binary[star[j]].name() << "  ";
+      out.width(8).precision(3) << priority[j] << "  " << scheduler.covered(j);
+      out.endl();
+    }
+    out << "\nObjective = ";
+    out.precision(5) << scheduler.objective();
+    out.endl();
+  }
+
+  catch(const std::string& str){
+    std::cerr << str << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  catch(const std::exception& exc){
+    std::cerr << exc.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+}
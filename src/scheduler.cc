@@ -0,0 +1,389 @@
+// Observing::Scheduler: greedy plus local search planning of the blocks
+// of time given to each target over a run of nights.
+
+#include <cmath>
+#include <algorithm>
+#include "trm/subs.h"
+#include "trm/time.h"
+#include "trm/position.h"
+#include "trm/telescope.h"
+#include "trm/ephem.h"
+#include "trm/observing.h"
+#include "trm/coverage.h"
+#include "trm/scheduler.h"
+#include "trm/batch.h"
+
+/** Constructor.
+ * \param tel      the telescope
+ * \param airmass  maximum airmass
+ * \param overhead overhead per block, minutes
+ * \param minblock shortest block worth taking, minutes
+ * \param limits   horizon and pointing limits of the telescope
+ */
+Observing::Scheduler::Scheduler(const Subs::Telescope& tel, double airmass, double overhead, double minblock,
+				 const Limits& limits) :
+  telescope(tel), limits(limits), airmass(airmass), overhead(overhead/1440.), minblock(minblock/1440.), nthr(1), total(0.), trial(false) {}
+
+/** Adds a target. All targets must be added before any nights.
+ * \param obj      position of the target, which must outlive the Scheduler
+ * \param eph      its ephemeris, which must outlive the Scheduler
+ * \param pstart   start of the range of phase wanted
+ * \param pend     end of the range of phase wanted. If less than pstart, 1 is added.
+ * \param priority weight of the target in the objective
+ * \return index of the target
+ */
+size_t Observing::Scheduler::add_target(const Subs::Position& obj, const Subs::Ephem& eph,
+					double pstart, double pend, double priority){
+  if(!night.empty())
+    throw Observing_Error("Observing::Scheduler::add_target: targets must be added before nights");
+  if(pend <= pstart) pend += 1.;
+
+  Target targ;
+  targ.obj      = &obj;
+  targ.eph      = &eph;
+  targ.wanted   = std::min(1., pend - pstart);
+  targ.priority = priority;
+
+  // phases that are not wanted are treated as already covered
+  if(targ.wanted < 1.)
+    targ.observed.push_back(Coverage::Gap(pend, pstart+1.));
+  target.push_back(targ);
+
+  coverage.push_back(Coverage());
+  gained.push_back(0.);
+  target_saved.push_back(0);
+  for(size_t i=0; i<targ.observed.size(); i++)
+    coverage.back().add(targ.observed[i].lo, targ.observed[i].hi);
+  return target.size()-1;
+}
+
+/** Marks a range of phase of a target as already observed, e.g. from a
+ * .times file, so that it does not count towards the objective.
+ */
+void Observing::Scheduler::add_observed(size_t targ, double p1, double p2){
+  target[targ].observed.push_back(Coverage::Gap(p1, p2));
+  coverage[targ].add(p1, p2);
+}
+
+/** Adds a night, working out when each target can be observed during it.
+ * The targets are spread over the threads set by set_threads.
+ * \param nit the night, observations being confined to between twiend and twistart
+ * \return index of the night
+ */
+size_t Observing::Scheduler::add_night(const Night& nit){
+  night.push_back(nit);
+  active.push_back(true);
+  free.push_back(std::vector<Free>(1, Free(nit.twiend.mjd(), nit.twistart.mjd())));
+
+  std::vector<Free> win(target.size(), Free(1., 0.));
+  parallel_for(target.size(), nthr, [&](size_t i, Context&){
+      Subs::Time tfirst, tlast;
+      if(when_visible(*target[i].obj, telescope, limits, nit.twiend, nit.twistart, airmass, tfirst, tlast))
+	win[i] = Free(tfirst.mjd(), tlast.mjd());
+    });
+  window.push_back(win);
+  cand.push_back(std::vector<Block>(target.size()));
+  cand_ok.push_back(std::vector<char>(target.size(), 0));
+  cand_stale.push_back(std::vector<char>(target.size(), 1));
+  night_saved.push_back(0);
+  return night.size()-1;
+}
+
+/** Removes a night, along with any blocks on it. Call plan to re-plan.
+ */
+void Observing::Scheduler::remove_night(size_t nit){
+  active[nit] = false;
+  std::vector<Block> keep;
+  for(size_t i=0; i<block.size(); i++)
+    if(block[i].night != nit) keep.push_back(block[i]);
+  block = keep;
+  rebuild();
+}
+
+/** Plans the run. Any existing plan is discarded.
+ * \param niter maximum number of passes of local search after the greedy start
+ */
+void Observing::Scheduler::plan(int niter){
+  block.clear();
+  rebuild();
+  fill();
+
+  for(int it=0; it<niter; it++){
+    bool improved = false;
+    for(size_t i=0; i<block.size(); i++){
+
+      // Start a trial move. Refilling only appends blocks, so the list of
+      // blocks is put back by trimming it; the nights and targets changed
+      // are saved as they are first touched.
+      trial = true;
+      double before = total;
+      size_t nblock = block.size();
+
+      // Remove block i: give back its time and recompute its target's coverage
+      Block old = block[i];
+      save(old.night, old.target);
+      block.erase(block.begin()+i);
+
+      std::vector<Free>& fr = free[old.night];
+      fr.push_back(Free(old.start, old.t2));
+      std::sort(fr.begin(), fr.end(),
+		[](const Free& f1, const Free& f2){return f1.t1 < f2.t1;});
+      std::vector<Free> merged;
+      for(size_t j=0; j<fr.size(); j++){
+	if(!merged.empty() && fr[j].t1 <= merged.back().t2)
+	  merged.back().t2 = std::max(merged.back().t2, fr[j].t2);
+	else
+	  merged.push_back(fr[j]);
+      }
+      fr = merged;
+
+      Target& targ = target[old.target];
+      Coverage& cov = coverage[old.target];
+      cov.clear();
+      for(size_t j=0; j<targ.observed.size(); j++)
+	cov.add(targ.observed[j].lo, targ.observed[j].hi);
+      for(size_t j=0; j<block.size(); j++)
+	if(block[j].target == old.target) cov.add(block[j].p1, block[j].p2);
+      total -= targ.priority*gained[old.target]/targ.wanted;
+      gained[old.target] = targ.wanted - (1. - cov.fraction());
+      total += targ.priority*gained[old.target]/targ.wanted;
+
+      for(size_t n=0; n<night.size(); n++) cand_stale[n][old.target] = 1;
+      for(size_t t=0; t<target.size(); t++) cand_stale[old.night][t] = 1;
+
+      // Refill and keep the change only if it helps
+      fill();
+      if(total > before + 1.e-9){
+	improved = true;
+	end_trial(true);
+      }else{
+	end_trial(false);
+	block.resize(nblock-1);
+	block.insert(block.begin()+i, old);
+	total = before;
+      }
+    }
+    if(!improved) break;
+  }
+
+  // Back-to-back blocks on the same target can be joined, turning the
+  // overhead of the second into time on target
+  std::sort(block.begin(), block.end());
+  std::vector<Block> joined;
+  for(size_t i=0; i<block.size(); i++){
+    if(!joined.empty() && joined.back().target == block[i].target &&
+       joined.back().night == block[i].night && block[i].start - joined.back().t2 < 1.e-8){
+      joined.back().t2    = block[i].t2;
+      joined.back().p2    = block[i].p2;
+      joined.back().gain += block[i].gain;
+    }else{
+      joined.push_back(block[i]);
+    }
+  }
+  if(joined.size() < block.size()){
+    block = joined;
+    rebuild();
+  }
+}
+
+//! Returns the blocks in time order
+std::vector<Observing::Scheduler::Block> Observing::Scheduler::blocks() const {
+  std::vector<Block> sorted = block;
+  std::sort(sorted.begin(), sorted.end());
+  return sorted;
+}
+
+//! Fraction of the wanted phase range of a target covered by the plan and earlier observations
+double Observing::Scheduler::covered(size_t targ) const {
+  return gained[targ]/target[targ].wanted;
+}
+
+// Finds the best block for a target on a night given the current free time
+// and coverage. Candidates are each separate stretch of wanted phase that
+// falls in a gap, and the span of all of them within each free interval.
+bool Observing::Scheduler::best_block(size_t targ, size_t nit, Block& best){
+  const Free& win = window[nit][targ];
+  const Target& tg = target[targ];
+  if(!active[nit] || win.t1 >= win.t2 || tg.priority <= 0.) return false;
+
+  bool found = false;
+  std::vector<Coverage::Gap> pieces, cphase;
+  std::vector<double> cgain;
+  for(size_t i=0; i<free[nit].size(); i++){
+    const Free& fr = free[nit][i];
+    double a = std::max(win.t1, fr.t1 + overhead), b = std::min(win.t2, fr.t2);
+    if(b - a < minblock) continue;
+
+    Subs::Time ta(a), tb(b);
+    double p1 = time_to_phase(*tg.obj, *tg.eph, ta, telescope);
+    double p2 = time_to_phase(*tg.obj, *tg.eph, tb, telescope);
+    double gspan = coverage[targ].gain(p1, p2, pieces);
+    if(gspan <= 0.) continue;
+
+    cphase = pieces;
+    cgain.resize(pieces.size());
+    for(size_t k=0; k<pieces.size(); k++) cgain[k] = pieces[k].length();
+    if(pieces.size() > 1){
+      cphase.push_back(Coverage::Gap(pieces.front().lo, pieces.back().hi));
+      cgain.push_back(gspan);
+    }
+
+    for(size_t k=0; k<cphase.size(); k++){
+      Block blk;
+      blk.target = targ;
+      blk.night  = nit;
+      blk.p1     = cphase[k].lo;
+      blk.p2     = cphase[k].hi;
+      blk.t1     = blk.p1 > p1 ? phase_to_time(*tg.obj, *tg.eph, blk.p1, telescope) : a;
+      blk.t2     = blk.p2 < p2 ? phase_to_time(*tg.obj, *tg.eph, blk.p2, telescope) : b;
+      if(blk.t2 - blk.t1 < minblock){
+	blk.t2 = std::min(b, blk.t1 + minblock);
+	blk.t1 = std::max(a, blk.t2 - minblock);
+      }
+      blk.start = blk.t1 - overhead;
+      blk.gain  = tg.priority*cgain[k]/tg.wanted;
+      blk.score = blk.gain/(24.*(blk.t2 - blk.start));
+      if(!found || blk.score > best.score){
+	best  = blk;
+	found = true;
+      }
+    }
+  }
+  return found;
+}
+
+// Greedy filling: keep adding the block with the highest gain per hour
+// until nothing more can be gained. Candidates are cached and only
+// recomputed when the night or target they belong to has changed.
+void Observing::Scheduler::fill(){
+  for(;;){
+    bool found = false;
+    size_t bn = 0, bt = 0;
+    for(size_t n=0; n<night.size(); n++){
+      if(!active[n]) continue;
+      for(size_t t=0; t<target.size(); t++){
+	if(cand_stale[n][t]){
+	  cand_ok[n][t]    = best_block(t, n, cand[n][t]);
+	  cand_stale[n][t] = 0;
+	}
+	if(cand_ok[n][t] && (!found || cand[n][t].score > cand[bn][bt].score)){
+	  bn = n;
+	  bt = t;
+	  found = true;
+	}
+      }
+    }
+    if(!found) break;
+
+    save(bn, bt);
+    Block blk = cand[bn][bt];
+    block.push_back(blk);
+    occupy(blk);
+    Target& tg = target[bt];
+    coverage[bt].add(blk.p1, blk.p2);
+    total -= tg.priority*gained[bt]/tg.wanted;
+    gained[bt] = tg.wanted - (1. - coverage[bt].fraction());
+    total += tg.priority*gained[bt]/tg.wanted;
+
+    for(size_t n=0; n<night.size(); n++) cand_stale[n][bt] = 1;
+    for(size_t t=0; t<target.size(); t++) cand_stale[bn][t] = 1;
+  }
+}
+
+// Recomputes everything derived from the list of blocks
+void Observing::Scheduler::rebuild(){
+  for(size_t n=0; n<night.size(); n++){
+    free[n].assign(1, Free(night[n].twiend.mjd(), night[n].twistart.mjd()));
+    if(!active[n]) free[n].clear();
+    for(size_t t=0; t<target.size(); t++) cand_stale[n][t] = 1;
+  }
+  for(size_t t=0; t<target.size(); t++){
+    coverage[t].clear();
+    for(size_t j=0; j<target[t].observed.size(); j++)
+      coverage[t].add(target[t].observed[j].lo, target[t].observed[j].hi);
+  }
+  for(size_t i=0; i<block.size(); i++){
+    occupy(block[i]);
+    coverage[block[i].target].add(block[i].p1, block[i].p2);
+  }
+  total = 0.;
+  for(size_t t=0; t<target.size(); t++){
+    gained[t] = target[t].wanted - (1. - coverage[t].fraction());
+    if(target[t].priority > 0.) total += target[t].priority*gained[t]/target[t].wanted;
+  }
+}
+
+// Removes the time of a block, including its overhead, from the free time of its night
+void Observing::Scheduler::occupy(const Block& blk){
+  std::vector<Free>& fr = free[blk.night];
+  for(size_t i=0; i<fr.size(); i++){
+    if(blk.start < fr[i].t2 && blk.t2 > fr[i].t1){
+      Free before(fr[i].t1, blk.start), after(blk.t2, fr[i].t2);
+      fr.erase(fr.begin()+i);
+      if(after.t2 > after.t1)   fr.insert(fr.begin()+i, after);
+      if(before.t2 > before.t1) fr.insert(fr.begin()+i, before);
+      return;
+    }
+  }
+}
+
+// Saves a night and a target during a trial move, the first time each is
+// touched. The candidates of a night or target not saved depend only on
+// free time and coverage that the move has not changed, so remain valid.
+void Observing::Scheduler::save(size_t nit, size_t targ){
+  if(!trial) return;
+  if(!night_saved[nit]){
+    night_saved[nit] = 1;
+    saved.push_back(Saved());
+    Saved& s = saved.back();
+    s.is_night   = true;
+    s.index      = nit;
+    s.free       = free[nit];
+    s.cand       = cand[nit];
+    s.cand_ok    = cand_ok[nit];
+    s.cand_stale = cand_stale[nit];
+  }
+  if(!target_saved[targ]){
+    target_saved[targ] = 1;
+    saved.push_back(Saved());
+    Saved& s = saved.back();
+    s.is_night = false;
+    s.index    = targ;
+    s.coverage = coverage[targ];
+    s.gained   = gained[targ];
+    for(size_t n=0; n<night.size(); n++){
+      s.cand.push_back(cand[n][targ]);
+      s.cand_ok.push_back(cand_ok[n][targ]);
+      s.cand_stale.push_back(cand_stale[n][targ]);
+    }
+  }
+}
+
+// Ends a trial move. If it is not kept, what was saved is put back in the
+// reverse order of saving, so that a candidate saved with both its night
+// and its target ends up as it was before either was changed.
+void Observing::Scheduler::end_trial(bool keep){
+  for(size_t k=saved.size(); k>0; k--){
+    Saved& s = saved[k-1];
+    if(s.is_night){
+      night_saved[s.index] = 0;
+      if(keep) continue;
+      free[s.index].swap(s.free);
+      cand[s.index].swap(s.cand);
+      cand_ok[s.index].swap(s.cand_ok);
+      cand_stale[s.index].swap(s.cand_stale);
+    }else{
+      target_saved[s.index] = 0;
+      if(keep) continue;
+      coverage[s.index] = s.coverage;
+      gained[s.index]   = s.gained;
+      for(size_t n=0; n<night.size(); n++){
+	cand[n][s.index]       = s.cand[n];
+	cand_ok[n][s.index]    = s.cand_ok[n];
+	cand_stale[n][s.index] = s.cand_stale[n];
+      }
+    }
+  }
+  saved.clear();
+  trial = false;
+}
@@ -0,0 +1,359 @@
+/*
+
+!!sphinx
+
+*simnight* -- simulates a night spent on a sequence of targets
+==============================================================
+
+*simnight* works through a list of targets in a fixed order, each with a
+number of exposures, allowing for the acquisition overhead and the readout
+time of each exposure, and reports when each target actually gets observed,
+at what airmass and orbital phase, and where the sequence breaks the limits
+on airmass and Sun altitude. By default the sequence is followed regardless
+of the limits, as it would be by an observer sticking to a plan; in strict
+mode targets are only observed while they are below the airmass limit and
+before morning twilight, waiting for them to rise if need be.
+
+It can also run the same night many times with random weather, in which
+spells of clear and cloudy sky have exponentially distributed lengths.
+Cloud loses the exposure in progress and the target must be acquired again
+once it clears. The simulation jumps from event to event rather than stepping
+in time so many thousands of nights take only a moment.
+
+Invocation:
+  simnight stars sequence telescope date airmass sunalt readout acquire ntrial [clear cloudy]
+
+Arguments:
+
+  stars :
+    Data file of star positions and ephemerides. Phases are reported for
+    stars with ephemerides.
+
+  sequence :
+    File listing the targets in the order they are to be observed, one per
+    line, as the name of the star in the stars file followed by the number
+    of exposures and the exposure time in seconds, e.g. "DQ Her 100 30". Lines
+    starting with # are ignored.
+
+  telescope :
+    e.g. wht
+
+  date :
+    Date at the start of the night, e.g. 1/5/2002 = 1st May 2002
+
+  airmass :
+    Maximum airmass
+
+  sunalt :
+    Maximum altitude of Sun (degrees), which fixes the start of the sequence
+
+  readout :
+    Readout time per exposure, seconds
+
+  acquire :
+    Acquisition overhead per target, seconds
+
+  ntrial :
+    Number of nights to simulate with random weather, 0 to skip
+
+  clear :
+    Mean length of clear spells, hours
+
+  cloudy :
+    Mean length of cloudy spells, hours
+
+  strict :
+    true to respect the airmass and Sun limits rather than just reporting
+    when they are broken (hidden, default false)
+
+  seed :
+    Seed for the random weather (hidden, default 57473). The random nights
+    are run in blocks of 1000, each with its own generator started from the
+    seed and the number of the block, so that the results depend upon the
+    seed alone and not upon the number of threads.
+
+  limits :
+    File of horizon, declination and hour angle limits of the telescope in
+    the format described in trm/limits.h, or 'none' to apply only the airmass
+    limit (hidden, default none)
+
+  threads :
+    Number of threads to use (hidden, default 0, meaning one per core)
+
+!!sphinx
+
+*/
+
+#include <cstdlib>
+#include <string>
+#include <exception>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <memory>
+
+#include "trm/subs.h"
+#include "trm/input.h"
+#include "trm/date.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/ephem.h"
+#include "trm/position.h"
+#include "trm/star.h"
+#include "trm/binary_star.h"
+#include "trm/observing.h"
+#include "trm/catalogue.h"
+#include "trm/limits.h"
+#include "trm/simulator.h"
+#include "trm/batch.h"
+
+int main(int argc, char *argv[]){
+
+  try{
+
+    // Construct Input object
+
+    Subs::Input input(argc, argv, Observing::OBSERVING_ENV, Observing::OBSERVING_DIR);
+
+    // sign-in variables (equivalent to ADAM .ifl files)
+
+    input.sign_in("stars",     Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("sequence",  Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("telescope", Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("date",      Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("airmass",   Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("sunalt",    Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("readout",   Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("acquire",   Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("ntrial",    Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("clear",     Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("cloudy",    Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("strict",    Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("seed",      Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("limits",    Subs::Input::GLOBAL, Subs::Input::NOPROMPT);
+    input.sign_in("threads",   Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+
+    // Get input
+
+    std::string starfile;
+    input.get_value("stars", starfile, "stardata", "file of star positions and ephemerides");
+
+    // Load star data
+
+    std::ifstream file(starfile.c_str());
+    if(!file) throw std::string("Could not open file = ") + starfile;
+
+    Subs::Star   s;
+    Subs::Ephem  eph;
+    std::vector<std::unique_ptr<Subs::Star> > star;
+    while(file >> s){
+      if(file >> eph){
+	star.push_back(std::unique_ptr<Subs::Star>(new Subs::Binary(s,eph)));
+      }else{
+	if(file.bad()){
+	  file.close();
+	  throw std::string("File stream corrupted");
+	}
+	file.clear();
+	star.push_back(std::unique_ptr<Subs::Star>(new Subs::Star(s)));
+      }
+    }
+    file.close();
+    std::cout << "Found data on " << star.size() << " stars" << std::endl;
+    if(star.size() == 0)
+      throw std::string("Cannot have 0 stars!");
+
+    // Load the sequence
+
+    std::string seqfile;
+    input.get_value("sequence", seqfile, "sequence", "file of targets, numbers of exposures and exposure times");
+    std::ifstream sfile(seqfile.c_str());
+    if(!sfile) throw std::string("Could not open file = ") + seqfile;
+
+    std::vector<size_t> target;
+    std::vector<int>    nexp;
+    std::vector<double> expose;
+    std::string line;
+    while(getline(sfile, line)){
+      std::istringstream istr(line);
+      std::vector<std::string> word;
+      std::string w;
+      while(istr >> w) word.push_back(w);
+      if(word.empty() || word[0][0] == '#') continue;
+      if(word.size() < 3) throw std::string("Could not read target from line = ") + line;
+
+      int ne;
+      double ex;
+      std::istringstream nstr(word[word.size()-2] + " " + word[word.size()-1]);
+      if(!(nstr >> ne >> ex)) throw std::string("Could not read target from line = ") + line;
+
+      std::string name = word[0];
+      for(size_t i=1; i<word.size()-2; i++) name += " " + word[i];
+      size_t j;
+      for(j=0; j<star.size(); j++)
+	if(Observing::clean_name(star[j]->name()) == name) break;
+      if(j == star.size()) throw std::string("Could not find target = ") + name + " in " + starfile;
+
+      target.push_back(j);
+      nexp.push_back(ne);
+      expose.push_back(ex);
+    }
+    sfile.close();
+    std::cout << "Found " << target.size() << " targets in the sequence" << std::endl;
+    if(target.size() == 0)
+      throw std::string("Cannot have 0 targets!");
+
+    size_t lmax = 6;
+    for(size_t i=0; i<target.size(); i++) lmax = std::max(lmax,star[target[i]]->name().length());
+
+    std::string stelescope;
+    input.get_value("telescope", stelescope, "WHT", "telescope name");
+    Subs::Telescope telescope(stelescope);
+
+    std::string sdate;
+    input.get_value("date", sdate, "17 Nov 1961", "date at start of night");
+    Subs::Date date(sdate);
+
+    double airmass;
+    input.get_value("airmass", airmass, 2., 1.001, 50., "maximum airmass");
+    double sunalt;
+    input.get_value("sunalt", sunalt, -15., -80., 0., "maximum altitude of Sun");
+    double readout;
+    input.get_value("readout", readout, 5., 0., 1000., "readout time per exposure (seconds)");
+    double acquire;
+    input.get_value("acquire", acquire, 300., 0., 10000., "acquisition overhead per target (seconds)");
+    int ntrial;
+    input.get_value("ntrial", ntrial, 0, 0, 10000000, "number of nights to simulate with random weather");
+    double clear = 0., cloudy = 0.;
+    if(ntrial > 0){
+      input.get_value("clear", clear, 4., 0.01, 1000., "mean length of clear spells (hours)");
+      input.get_value("cloudy", cloudy, 1., 0.01, 1000., "mean length of cloudy spells (hours)");
+    }
+    bool strict;
+    input.get_value("strict", strict, false, "respect the airmass and Sun limits?");
+    int seed;
+    input.get_value("seed", seed, 57473, 0, 2147483647, "seed for the random weather");
+    std::string slimits;
+    input.get_value("limits", slimits, "none", "file of telescope horizon and pointing limits ('none' to ignore)");
+    Observing::Limits limits;
+    if(slimits != "none") limits.load(slimits);
+    int nthread;
+    input.get_value("threads", nthread, 0, 0, 1024, "number of threads (0 for one per core)");
+
+    Observing::Night night;
+    if(!Observing::night(telescope, date, sunalt, night))
+      throw std::string("Could not find the twilight times of the night");
+
+    std::cout << "Sunset to sunrise: " << night.sunset << " to " << night.sunrise  << std::endl;
+    std::cout << "Sun < " << sunalt << ": " << night.twiend << " to " << night.twistart << std::endl;
+
+    Observing::Simulator sim(telescope, night, airmass, strict, limits);
+    for(size_t i=0; i<target.size(); i++)
+      sim.add(*star[target[i]], nexp[i], expose[i], readout, acquire);
+
+    // First a night with a clear sky, in detail
+
+    std::mt19937 rng(seed);
+    std::vector<Observing::Simulator::Result> result;
+    sim.run(Observing::Simulator::Weather(), rng, result);
+
+    const char* status[] = {"done", "partial", "skipped", "not reached"};
+
+    std::cout << "\nClear night. Each target is listed with the number of exposures taken, the"
+	      << "\ntime acquisition started and the start and end of data taking with the"
+	      << "\nairmass and phase (if known) at each.\n" << std::endl;
+
+    Subs::Time t;
+    for(size_t i=0; i<result.size(); i++){
+      const Observing::Simulator::Result& res = result[i];
+      const Subs::Star* st = star[target[i]].get();
+      std::cout << std::setfill(' ') << std::setw(lmax) << std::left << st->name() << " "
+		<< std::setw(11) << status[res.status] << " " << std::right << std::setw(5) << res.nexp << "/" << std::left << std::setw(5) << nexp[i];
+      if(res.nexp > 0){
+	t.set(res.start);
+	std::cout << " " << t;
+	double tt[2] = {res.t1, res.t2};
+	for(int k=0; k<2; k++){
+	  t.set(tt[k]);
+	  std::cout << "  " << t << " " << std::setprecision(3) << std::setw(5) << st->altaz(t,telescope).airmass;
+	  if(st->has_ephem()){
+	    const Subs::Binary* b = dynamic_cast<const Subs::Binary*>(st);
+	    std::cout << " " << std::setprecision(5) << std::setw(8) << Observing::time_to_phase(*b, *b, t, telescope);
+	  }
+	}
+	if(res.flags & Observing::Simulator::AIRMASS) std::cout << " AIRMASS";
+	if(res.flags & Observing::Simulator::SUN)     std::cout << " SUN";
+      }
+      std::cout << std::endl;
+    }
+
+    // Then many nights with random weather
+
+    if(ntrial > 0){
+
+      // The nights are run in blocks, each with its own generator and
+      // totals, which are added up in order at the end
+      const int NBLOCK = 1000;
+      size_t nblock = (ntrial + NBLOCK - 1) / NBLOCK;
+      std::vector<std::vector<int> > bdone(nblock), bpart(nblock), bflag(nblock);
+      std::vector<std::vector<double> > bsum(nblock);
+      std::vector<double> bhours(nblock, 0.);
+      Observing::Simulator::Weather weather(clear, cloudy);
+      Observing::parallel_for(nblock, nthread, [&](size_t nb, Observing::Context&){
+	  std::seed_seq sseq{seed, int(nb)};
+	  std::mt19937 brng(sseq);
+	  std::vector<Observing::Simulator::Result> bres;
+	  bdone[nb].resize(target.size(), 0);
+	  bpart[nb].resize(target.size(), 0);
+	  bflag[nb].resize(target.size(), 0);
+	  bsum[nb].resize(target.size(), 0.);
+	  int n2 = std::min(ntrial, int((nb+1)*NBLOCK));
+	  for(int n=nb*NBLOCK; n<n2; n++){
+	    bhours[nb] += sim.run(weather, brng, bres);
+	    for(size_t i=0; i<bres.size(); i++){
+	      if(bres[i].status == Observing::Simulator::DONE)    bdone[nb][i]++;
+	      if(bres[i].status == Observing::Simulator::PARTIAL) bpart[nb][i]++;
+	      if(bres[i].flags) bflag[nb][i]++;
+	      bsum[nb][i] += bres[i].nexp;
+	    }
+	  }
+	});
+
+      std::vector<int> ndone(target.size(), 0), npart(target.size(), 0), nflag(target.size(), 0);
+      std::vector<double> nsum(target.size(), 0.);
+      double hours = 0.;
+      for(size_t nb=0; nb<nblock; nb++){
+	hours += bhours[nb];
+	for(size_t i=0; i<target.size(); i++){
+	  ndone[i] += bdone[nb][i];
+	  npart[i] += bpart[nb][i];
+	  nflag[i] += bflag[nb][i];
+	  nsum[i]  += bsum[nb][i];
+	}
+      }
+
+      std::cout << "\nSimulated " << ntrial << " nights with a mean of " << std::setprecision(3)
+		<< hours/ntrial << " clear hours per night.\n\n" << std::setfill(' ') << std::setw(lmax) << std::left << "Target"
+		<< "    Done  Partial  Mean exposures  Limits broken\n" << std::endl;
+      for(size_t i=0; i<target.size(); i++)
+	std::cout << std::setfill(' ') << std::setw(lmax) << std::left << star[target[i]]->name() << " "
+		  << std::right << std::setprecision(3) << std::setw(6) << 100.*ndone[i]/ntrial << "%  "
+		  << std::setw(6) << 100.*npart[i]/ntrial << "%  " << std::setw(14) << nsum[i]/ntrial << "  "
+		  << std::setw(12) << 100.*nflag[i]/ntrial << "%" << std::endl;
+    }
+  }
+
+  catch(const std::string& str){
+    std::cerr << str << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  catch(const std::exception& exc){
+    std::cerr << exc.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+}
@@ -0,0 +1,222 @@
+// Observing::Simulator: event-driven simulation of a night spent working
+// through a sequence of targets, with optional random weather.
+
+#include <cmath>
+#include <queue>
+#include <algorithm>
+#include "trm/subs.h"
+#include "trm/constants.h"
+#include "trm/time.h"
+#include "trm/position.h"
+#include "trm/telescope.h"
+#include "trm/observing.h"
+#include "trm/simulator.h"
+
+namespace {
+
+  // Kinds of event. When two events coincide, the end of a block is dealt
+  // with first so that an exposure finishing just as the sky clouds over
+  // or the night ends still counts.
+  enum Kind {END_BLOCK, CLOSE, OPEN, RISE, STOP};
+
+  struct Sim_Event {
+    Sim_Event(double t, Kind kind, unsigned gen=0) : t(t), kind(kind), gen(gen) {}
+    double   t;
+    Kind     kind;
+    unsigned gen;
+    bool operator<(const Sim_Event& event) const {
+      return t > event.t || (t == event.t && kind > event.kind);
+    }
+  };
+
+  // Length of a spell of weather, in days, given its mean in hours
+  double spell(double mean, std::mt19937& rng){
+    return std::exponential_distribution<double>(1./mean)(rng)/24.;
+  }
+
+}
+
+/** Constructor.
+ * \param tel     the telescope
+ * \param night   the night to simulate
+ * \param airmass maximum airmass
+ * \param strict  true to wait for targets to rise and to stop them when they set or
+ * morning twilight starts; false to follow the sequence regardless and flag the data
+ * taken outside the limits
+ * \param limits  horizon and pointing limits of the telescope
+ */
+Observing::Simulator::Simulator(const Subs::Telescope& tel, const Night& night, double airmass, bool strict,
+				 const Limits& limits) :
+  telescope(tel), limits(limits), nit(night), airmass(airmass), strict(strict) {}
+
+/** Adds a visit to the end of the sequence, working out when its target is
+ * visible during the night.
+ * \param obj     position of the target
+ * \param nexp    number of exposures
+ * \param expose  exposure time, seconds
+ * \param readout readout time per exposure, seconds
+ * \param acquire acquisition overhead, seconds
+ * \return index of the visit
+ */
+size_t Observing::Simulator::add(const Subs::Position& obj, int nexp, double expose, double readout, double acquire){
+  if(nexp < 1 || expose <= 0. || readout < 0. || acquire < 0.)
+    throw Observing_Error("Observing::Simulator::add: invalid exposure parameters");
+
+  Visit vis;
+  Subs::Time tfirst, tlast;
+  if(when_visible(obj, telescope, limits, nit.sunset, nit.sunrise, airmass, tfirst, tlast)){
+    vis.first = tfirst.mjd();
+    vis.last  = tlast.mjd();
+  }else{
+    vis.first = 1.;
+    vis.last  = 0.;
+  }
+  vis.nexp    = nexp;
+  vis.expose  = expose/Constants::DAY;
+  vis.cycle   = (expose+readout)/Constants::DAY;
+  vis.acquire = acquire/Constants::DAY;
+  visit.push_back(vis);
+  return visit.size()-1;
+}
+
+/** Simulates the night once, starting at the end of evening twilight. The
+ * night ends at sunrise or, in strict mode, at the start of morning twilight.
+ * \param weather the weather model
+ * \param rng     random number generator, only used if the weather is not permanently clear
+ * \param results what happened to each visit, in the order they were added
+ * \return hours of clear sky during the night
+ */
+double Observing::Simulator::run(const Weather& weather, std::mt19937& rng, std::vector<Result>& results) const {
+
+  results.assign(visit.size(), Result());
+
+  const double tstart = nit.twiend.mjd(), tdawn = nit.twistart.mjd();
+  const double tend   = strict ? tdawn : nit.sunrise.mjd();
+
+  std::priority_queue<Sim_Event> queue;
+  queue.push(Sim_Event(tend, STOP));
+
+  bool clear = true;
+  const bool changeable = weather.clear > 0. && weather.cloudy > 0.;
+  if(changeable){
+    clear = std::uniform_real_distribution<double>(0.,1.)(rng) < weather.clear/(weather.clear+weather.cloudy);
+    queue.push(Sim_Event(tstart + spell(clear ? weather.clear : weather.cloudy, rng), clear ? CLOSE : OPEN));
+  }
+
+  // State: the visit being worked on, exposures it still needs, whether
+  // the telescope is busy with it (and since when data taking started),
+  // and whether we are waiting for it to rise. gen is bumped whenever a
+  // block is interrupted so that its END_BLOCK event is then ignored.
+  size_t   k = 0;
+  int      left = visit.empty() ? 0 : visit[0].nexp;
+  bool     busy = false, waiting = false;
+  double   tdata = 0., tlim = 0., tclear = tstart, hours = 0.;
+  unsigned gen = 0;
+
+  // Books the exposures of the current block completed by time t
+  auto record = [&](double t){
+    const Visit& vis = visit[k];
+    Result& res = results[k];
+    int ndone = 0;
+    if(t > tdata)
+      ndone = std::min(left, int((t - tdata + vis.cycle - vis.expose)/vis.cycle + 1.e-9));
+    if(ndone > 0){
+      double tfin = tdata + (ndone-1)*vis.cycle + vis.expose;
+      if(res.nexp == 0) res.t1 = tdata;
+      res.t2    = tfin;
+      res.nexp += ndone;
+      left     -= ndone;
+      if(tdata < vis.first || tfin > vis.last) res.flags |= AIRMASS;
+      if(tfin > tdawn) res.flags |= SUN;
+    }
+    busy = false;
+    gen++;
+  };
+
+  // Moves on to the next visit
+  auto finish = [&](){
+    Result& res = results[k];
+    res.status = left == 0 ? DONE : (res.nexp > 0 ? PARTIAL : SKIPPED);
+    if(++k < visit.size()) left = visit[k].nexp;
+  };
+
+  // Starts the next block of observation at time t, if it can
+  auto advance = [&](double t){
+    if(t >= tend) return;
+    while(k < visit.size()){
+      const Visit& vis = visit[k];
+      double tgo = t;
+      tlim = tend;
+      if(strict){
+	tgo  = std::max(t, vis.first);
+	tlim = std::min(vis.last, tdawn);
+	if(vis.first > vis.last || tgo + vis.acquire + vis.expose > tlim){
+	  finish();
+	  continue;
+	}
+	if(tgo > t){
+	  if(!waiting){
+	    queue.push(Sim_Event(tgo, RISE));
+	    waiting = true;
+	  }
+	  return;
+	}
+      }
+      if(!clear) return;
+
+      Result& res = results[k];
+      if(res.nacq == 0) res.start = t;
+      res.nacq++;
+      tdata = t + vis.acquire;
+      queue.push(Sim_Event(std::min(tlim, tdata + left*vis.cycle), END_BLOCK, gen));
+      busy = true;
+      return;
+    }
+  };
+
+  advance(tstart);
+
+  while(!queue.empty()){
+    Sim_Event event = queue.top();
+    queue.pop();
+    double t = event.t;
+
+    switch(event.kind){
+
+    case END_BLOCK:
+      if(!busy || event.gen != gen) break;
+      record(t);
+      if(left == 0 || strict) finish();
+      advance(t);
+      break;
+
+    case CLOSE:
+      clear  = false;
+      hours += 24.*(t - tclear);
+      if(busy) record(t);
+      queue.push(Sim_Event(t + spell(weather.cloudy, rng), OPEN));
+      break;
+
+    case OPEN:
+      clear  = true;
+      tclear = t;
+      queue.push(Sim_Event(t + spell(weather.clear, rng), CLOSE));
+      if(!busy && !waiting) advance(t);
+      break;
+
+    case RISE:
+      waiting = false;
+      if(!busy) advance(t);
+      break;
+
+    case STOP:
+      if(clear) hours += 24.*(t - tclear);
+      if(k < visit.size()){
+	if(busy) record(t);
+	if(results[k].nacq > 0) finish();
+      }
+      return hours;
+    }
+  }
+  return hours;
+}
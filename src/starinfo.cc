@@ -29,14 +29,53 @@ Arguments:
     If present = false, then this is the time that will be used. String of the form:
     "11 May 2032, 15:03:34.22" (exactly so, including the quotes).
 
+  moonsep :
+    If > 0, the altitude and illumination of the Moon and its separation from
+    each star are also printed, with stars closer than moonsep degrees to it
+    while it is up marked with a '*' (hidden, default 0)
+
+  tracks :
+    Comma-separated list of files of positions of moving targets such as
+    comets or asteroids, or 'none' (hidden, default none). Each file has an
+    optional line "name <name>" followed by lines of "MJD RA Dec [distance]",
+    with the UTC as an MJD or JD, the J2000 RA in decimal hours, Dec in decimal
+    degrees and distance in AU.
+
+  threads :
+    Number of threads to use (hidden, default 0, meaning one per core)
+
+  fastsun :
+    true to compute the Sun from a short analytic series good to about an
+    arcminute rather than the full solar ephemeris. This is ample for twilight
+    and much faster over long runs of nights. (hidden, default false)
+
+  stats :
+    Counts of the expensive calls and the time spent in each phase of the
+    run: 'none', 'text' for a table or 'json' for JSON, both on stderr, or
+    the name of a file to write JSON to. Only collected if the package was
+    configured with --enable-stats. (hidden, default none)
+
+  batch :
+    true to answer many queries in one run. advance, present and time are
+    not asked for; instead lines of "tag time [star]" are read from the
+    standard input, the time a UTC MJD or 'now', and all stars included
+    unless one is named. Each answer is a line of the MJD and the Sun's
+    altitude, then for each star a line of hour angle, airmass, position
+    angle, azimuth, phase and phase uncertainty ('-' without an ephemeris)
+    and name, ending with a line 'ok' or 'error' and a message, all starting
+    with the tag of the query. moonsep and tracks do not apply. (hidden,
+    default false)
+
 !!sphinx
 
 */
 
 #include <cstdlib>
 #include <string>
+#include <exception>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <iomanip>
 #include <unistd.h>
 #include <vector>
@@ -48,9 +87,104 @@ Arguments:
 #include "trm/telescope.h"
 #include "trm/position.h"
 #include "trm/star.h"
-#include "trm/binary_star.h"
 #include "trm/input.h"
 #include "trm/observing.h"
+#include "trm/moon.h"
+#include "trm/track.h"
+#include "trm/batch.h"
+#include "trm/catalogue.h"
+#include "trm/stats.h"
+#include "trm/query.h"
+
+// Line of information on a star
+std::string star_line(const Observing::Catalogue& catalogue, size_t j, const Subs::Time& t,
+		      const Subs::Telescope& telescope, size_t lmax, double moonsep, const Observing::Moon_Info& minfo){
+
+  const double MJD2JD = 2400000.5;
+  const Subs::Position& pos = catalogue.position(j);
+  const Subs::Ephem&    eph = catalogue.ephem(j);
+  std::ostringstream ostr;
+  Subs::Altaz a = pos.altaz(t,telescope);
+  OBSERVING_COUNT(ALTAZ);
+  double ha = floor(100.*a.ha+0.5)/100.;
+  double pa = floor(100.*a.pa+0.5)/100.;
+  ostr << std::setfill(' ') << std::setw(lmax) << std::left << catalogue.name(j) << " " 
+       << " HA = " << std::setprecision(3) << std::setw(6) << ha 
+       << ", airmass = " << std::setprecision(3) << std::setw(4) << a.airmass
+       << ", PA = " << std::setprecision(4) << std::setw(5) << pa
+       << ", azimuth = " << std::setprecision(4) << std::setw(5) << a.az;
+
+  if(moonsep > 0.){
+    double sep = Observing::separation(minfo, pos);
+    ostr << ", Moon = " << std::setprecision(3) << std::setw(5) << sep
+	 << (minfo.alt > 0. && sep < moonsep ? "*" : " ");
+  }
+
+  // Phase information
+
+  if(catalogue.has_ephem(j)){
+
+    // adjust offset according to the timescale of the ephemeris
+    double off;
+    if(eph.get_tscale() == Subs::Ephem::HJD || eph.get_tscale() == Subs::Ephem::HMJD){
+      OBSERVING_COUNT(TCORR_HEL);
+      off = pos.tcorr_hel(t, telescope)/Constants::DAY;
+    }else if(eph.get_tscale() == Subs::Ephem::BJD || eph.get_tscale() == Subs::Ephem::BMJD){
+      OBSERVING_COUNT(TCORR_BAR);
+      off = (t.dtt() + pos.tcorr_bar(t, telescope))/Constants::DAY;
+    }else{
+      throw std::string("Could not recognize type of timescale for star = " + catalogue.name(j));
+    }
+
+    ostr << ", phase = " << std::setprecision(10) 
+	 << catalogue.precise(j).phase(t.mjd()+off) << ", error = " << std::setprecision(5);
+    if(eph.get_tscale() == Subs::Ephem::HJD || eph.get_tscale() == Subs::Ephem::BJD){
+      ostr << eph.pherr(MJD2JD+t.mjd()+off);
+    }else{
+      ostr << eph.pherr(t.mjd()+off);
+    }
+  }
+  return ostr.str();
+}
+
+// The same information as for the stars for a moving target, and its distance
+std::string track_line(const Observing::Track& track, const Subs::Time& t, const Subs::Telescope& telescope, size_t lmax,
+		       Observing::Context& context){
+  std::ostringstream ostr;
+  ostr << std::setfill(' ') << std::setw(lmax) << std::left << track.name() << " ";
+  if(!track.covers(t.mjd())){
+    ostr << " outside the table of positions";
+    return ostr.str();
+  }
+  Subs::Altaz a = track.altaz(t,telescope,context);
+  double ha = floor(100.*a.ha+0.5)/100.;
+  double pa = floor(100.*a.pa+0.5)/100.;
+  ostr << " HA = " << std::setprecision(3) << std::setw(6) << ha 
+       << ", airmass = " << std::setprecision(3) << std::setw(4) << a.airmass
+       << ", PA = " << std::setprecision(4) << std::setw(5) << pa
+       << ", azimuth = " << std::setprecision(4) << std::setw(5) << a.az;
+  if(track.distance(t.mjd()) > 0.)
+    ostr << ", distance = " << std::setprecision(5) << track.distance(t.mjd()) << " AU";
+  return ostr.str();
+}
+
+// Prints the lines of all stars then all moving targets, computed in parallel
+void print_lines(const Observing::Catalogue& catalogue, const std::vector<Observing::Track>& track,
+		 const Subs::Time& t, const Subs::Telescope& telescope, size_t lmax, double moonsep,
+		 const Observing::Moon_Info& minfo, int nthread){
+  std::vector<std::string> line(catalogue.size()+track.size());
+  {
+    OBSERVING_TIME(EVENTS);
+    Observing::parallel_for(line.size(), nthread, [&](size_t j, Observing::Context& context){
+	if(j < catalogue.size())
+	  line[j] = star_line(catalogue, j, t, telescope, lmax, moonsep, minfo);
+	else
+	  line[j] = track_line(track[j-catalogue.size()], t, telescope, lmax, context);
+      });
+  }
+  OBSERVING_TIME(OUTPUT);
+  for(size_t j=0; j<line.size(); j++) std::cout << line[j] << std::endl;
+}
 
 int main(int argc, char *argv[]){
 
@@ -67,67 +201,88 @@ int main(int argc, char *argv[]){
     input.sign_in("advance", Subs::Input::LOCAL, Subs::Input::PROMPT);
     input.sign_in("present", Subs::Input::LOCAL, Subs::Input::PROMPT);
     input.sign_in("time", Subs::Input::LOCAL, Subs::Input::PROMPT);
+    input.sign_in("moonsep", Subs::Input::LOCAL, Subs::Input::NOPROMPT);
+    input.sign_in("tracks", Subs::Input::LOCAL, Subs::Input::NOPROMPT);
+    input.sign_in("threads", Subs::Input::LOCAL, Subs::Input::NOPROMPT);
+    input.sign_in("fastsun", Subs::Input::LOCAL, Subs::Input::NOPROMPT);
+    input.sign_in("stats", Subs::Input::LOCAL, Subs::Input::NOPROMPT);
+    input.sign_in("batch", Subs::Input::LOCAL, Subs::Input::NOPROMPT);
 
     // Get input
 
     std::string starfile;
     input.get_value("stars", starfile, "stardata", "file of star positions and ephemerides");
+    bool batch;
+    input.get_value("batch", batch, false, "answer queries read from the standard input?");
 
     // Load star data
 
-    std::ifstream file(starfile.c_str());
-    if(!file) throw std::string("Could not open file = ") + starfile;
-
-    std::vector<Subs::Star*>  star;
-    Subs::Star   s;
-    Subs::Binary b;
-    Subs::Ephem  eph;
-    while(file >> s){
-	if(file >> eph){
-	    star.push_back(new Subs::Binary(s,eph));
-	}else{
-	    if(file.bad()){
-		std::cerr << "File stream corrupted" << std::endl;
-		file.close();
-		exit(EXIT_FAILURE);
-	    }
-	    file.clear();
-	    star.push_back(new Subs::Star(s));
-	}
+    Observing::Catalogue catalogue;
+    {
+      OBSERVING_TIME(LOAD);
+      catalogue.load(starfile);
     }
-    file.close();
-    std::cout << "Found data on " << star.size() << " stars" << std::endl;
-    if(star.size() == 0) throw std::string("Cannot have 0 stars!");
+    (batch ? std::cerr : std::cout) << "Found data on " << catalogue.size() << " stars" << std::endl;
+    if(catalogue.size() == 0) throw std::string("Cannot have 0 stars!");
 
-    size_t lmax = 0;
-    for(size_t j=0; j<star.size(); j++) lmax = std::max(lmax,star[j]->name().length());
+    size_t lmax = catalogue.max_name();
 
     std::string stelescope;
     input.get_value("telescope", stelescope, "WHT", "telescope in question");
 
     Subs::Telescope telescope(stelescope);
 
-    double advance;
-    input.get_value("advance", advance, 1., -12., 12., "number of hours in advance of current time");
+    // times come with each query in batch mode
+    double advance = 0.;
+    if(!batch) input.get_value("advance", advance, 1., -12., 12., "number of hours in advance of current time");
 
-    bool present;
-    input.get_value("present", present, true, "use present time as first time?");
+    bool present = true;
+    if(!batch) input.get_value("present", present, true, "use present time as first time?");
 
     std::string stime;
     Subs::Time time;
-    if(!present){
+    if(!batch && !present){
       input.get_value("time", stime, "17 Nov 1961, 01:23:45.67", "time (overrides present time)");
       time.set(stime);
     }
 
-    const double MJD2JD = 2400000.5;
+    double moonsep;
+    input.get_value("moonsep", moonsep, 0., 0., 180., "minimum separation from the Moon (degrees)");
+    std::string stracks;
+    input.get_value("tracks", stracks, "none", "files of moving target positions (comma-separated, 'none' to ignore)");
+    std::vector<Observing::Track> track;
+    if(stracks != "none"){
+      OBSERVING_TIME(LOAD);
+      std::string item;
+      std::istringstream lstr(stracks);
+      while(getline(lstr, item, ',')){
+	std::istringstream istr(item);
+	std::string tfile;
+	if(istr >> tfile) track.push_back(Observing::Track(tfile));
+      }
+    }
+    for(size_t j=0; j<track.size(); j++) lmax = std::max(lmax,track[j].name().length());
+
+    int nthread;
+    input.get_value("threads", nthread, 0, 0, 1024, "number of threads (0 for one per core)");
+    bool fastsun;
+    input.get_value("fastsun", fastsun, false, "use the fast, low-precision Sun?");
+    Observing::Sun_Model smodel = fastsun ? Observing::FAST_SUN : Observing::FULL_SUN;
+    std::string sstats;
+    input.get_value("stats", sstats, "none", "statistics to report (none, text, json or a file for JSON)");
+
+    // Queries from the standard input, all sharing the catalogue
+    if(batch){
+      Observing::Query query(catalogue, telescope, 2., -15., smodel, nthread);
+      query.batch(std::cin, std::cout, "status");
+      Observing::Stats::report(sstats);
+      return EXIT_SUCCESS;
+    }
+
     char c = 'm';
     Subs::Time t;
-    Subs::Altaz a;
-    std::string str;
-    double off, ha, pa;
-    Subs::Position Sun;
     Subs::Altaz saltaz;
+    Observing::Moon_Info minfo;
     while(c != 'q' && c != 'Q'){
       if(present){
 	t.set();
@@ -135,96 +290,33 @@ int main(int argc, char *argv[]){
 	t = time;
       }
 
-      Sun.set_to_sun(t, telescope);
-      saltaz = Sun.altaz(t,telescope);
+      saltaz = Observing::sun_altaz(telescope, t, smodel);
 
       std::cout << "\n\n\n" << t << ", MJD = " << std::setprecision(10) << t.mjd() 
-		<< ", Sun's altitude = " << std::setprecision(4) << saltaz.alt_true << "\n" << std::endl;
-
-      for(size_t j=0; j<star.size(); j++){
-	a   = star[j]->altaz(t,telescope);
-
-	ha  = floor(100.*a.ha+0.5)/100.;
-	pa  = floor(100.*a.pa+0.5)/100.;
-	std::cout << std::setfill(' ') << std::setw(lmax) << std::left << star[j]->name() << " " 
-		  << " HA = " << std::setprecision(3) << std::setw(6) << ha 
-		  << ", airmass = " << std::setprecision(3) << std::setw(4) << a.airmass
-		  << ", PA = " << std::setprecision(4) << std::setw(5) << pa
-		  << ", azimuth = " << std::setprecision(4) << std::setw(5) << a.az;
-
-
-	// Phase information
-
-	if(star[j]->has_ephem()){
-
-	  // adjust offset according to the timescale of the ephemeris
-	  if(star[j]->get_tscale() == Subs::Ephem::HJD || star[j]->get_tscale() == Subs::Ephem::HMJD){
-	    off = star[j]->tcorr_hel(t, telescope)/Constants::DAY;
-	  }else if(star[j]->get_tscale() == Subs::Ephem::BJD || star[j]->get_tscale() == Subs::Ephem::BMJD){
-	    off = (t.dtt() + star[j]->tcorr_bar(t, telescope))/Constants::DAY;
-	  }else{
-	    throw std::string("Could not recognize type of timescale for star = " + star[j]->name());
-	  }
-
-	  if(star[j]->get_tscale() == Subs::Ephem::HJD || star[j]->get_tscale() == Subs::Ephem::BJD){
-	    std::cout << ", phase = " << std::setprecision(10) 
-		 << star[j]->phase(MJD2JD+t.mjd()+off) << ", error = " << std::setprecision(5)  
-		 << star[j]->pherr(MJD2JD+t.mjd()+off) << std::endl;
-	  }else{
-	    std::cout << ", phase = " << std::setprecision(10) 
-		 << star[j]->phase(t.mjd()+off) << ", error = " << std::setprecision(5)  
-		 << star[j]->pherr(t.mjd()+off) << std::endl;
-	  }
-
-	}else{
-	  std::cout << std::endl;
-	}
+		<< ", Sun's altitude = " << std::setprecision(4) << saltaz.alt_true;
+      if(moonsep > 0.){
+	minfo = Observing::moon(telescope, t);
+	std::cout << ", Moon's altitude = " << std::setprecision(4) << minfo.alt 
+		  << ", illumination = " << std::setprecision(3) << minfo.illum;
       }
+      std::cout << "\n" << std::endl;
+
+      print_lines(catalogue, track, t, telescope, lmax, moonsep, minfo, nthread);
+
       if(advance != 0.){
 
 	t.add_hour(advance);
-	Sun.set_to_sun(t, telescope);
-	saltaz = Sun.altaz(t,telescope);
-
-	std::cout << "\nand in " << advance << " hours time, Sun's altitude = " << saltaz.alt_true 
-		  << " and:\n" << std::endl;
-
-	for(size_t j=0; j<star.size(); j++){
-	  a   = star[j]->altaz(t,telescope);
-	  
-	  ha  = floor(100.*a.ha+0.5)/100.;
-	  pa  = floor(100.*a.pa+0.5)/100.;
-	  std::cout << std::setfill(' ') << std::setw(lmax) << std::left << star[j]->name() 
-		    << " " << " HA = " << std::setprecision(3) << std::setw(6) << ha 
-		    << ", airmass = " << std::setprecision(3) << std::setw(4) << a.airmass
-		    << ", PA = " << std::setprecision(4) << std::setw(5) << pa
-		    << ", azimuth = " << std::setprecision(4) << std::setw(5) << a.az;
-	  
-	  if(star[j]->has_ephem()){
-
-	    // adjust offset according to the timescale of the ephemeris
-	    if(star[j]->get_tscale() == Subs::Ephem::HJD || star[j]->get_tscale() == Subs::Ephem::HMJD){
-	      off = star[j]->tcorr_hel(t, telescope)/Constants::DAY;
-	    }else if(star[j]->get_tscale() == Subs::Ephem::BJD || star[j]->get_tscale() == Subs::Ephem::BMJD){
-	      off = (t.dtt() + star[j]->tcorr_bar(t, telescope))/Constants::DAY;
-	    }else{
-	      throw std::string("Could not recognize type of timescale for star = " + star[j]->name());
-	    }
-	    
-	    if(star[j]->get_tscale() == Subs::Ephem::HJD || star[j]->get_tscale() == Subs::Ephem::BJD){
-	      std::cout << ", phase = " << std::setprecision(10) 
-		   << star[j]->phase(MJD2JD+t.mjd()+off) << ", error = " << std::setprecision(5)  
-		   << star[j]->pherr(MJD2JD+t.mjd()+off) << std::endl;
-	    }else{
-	      std::cout << ", phase = " << std::setprecision(10) 
-		   << star[j]->phase(t.mjd()+off) << ", error = " << std::setprecision(5)  
-		   << star[j]->pherr(t.mjd()+off) << std::endl;
-	    }
-	    
-	  }else{
-	    std::cout << std::endl;
-	  }
+	saltaz = Observing::sun_altaz(telescope, t, smodel);
+
+	std::cout << "\nand in " << advance << " hours time, Sun's altitude = " << saltaz.alt_true;
+	if(moonsep > 0.){
+	  minfo = Observing::moon(telescope, t);
+	  std::cout << ", Moon's altitude = " << std::setprecision(4) << minfo.alt 
+		    << ", illumination = " << std::setprecision(3) << minfo.illum;
 	}
+	std::cout << " and:\n" << std::endl;
+
+	print_lines(catalogue, track, t, telescope, lmax, moonsep, minfo, nthread);
       }
       if(present){
 	std::cout << "\nQ(uit), anything else to continue: ";
@@ -233,12 +325,18 @@ int main(int argc, char *argv[]){
 	c = 'q';
       }
     }
+
+    Observing::Stats::report(sstats);
   }
 
   catch(const std::string& str){
     std::cerr << str << std::endl;
     exit(EXIT_FAILURE);
   }
+  catch(const std::exception& exc){
+    std::cerr << exc.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
   
 }
 
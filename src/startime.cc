@@ -8,11 +8,13 @@
 #include "trm/position.h"
 #include "trm/telescope.h"
 #include "trm/observing.h"
+#include "trm/stats.h"
 
 bool Observing::startime(const Subs::Position& obj, const Subs::Telescope& tel, 
 			 const Subs::Time& start, double altaim, Subs::Time& found){
 
   Subs::Altaz altaz = obj.altaz(start,tel);
+  OBSERVING_COUNT(ALTAZ);
   double now  = altaz.alt_true;
   double ha   = altaz.ha;
   double mjd1 = start.mjd();
@@ -29,6 +31,7 @@ bool Observing::startime(const Subs::Position& obj, const Subs::Telescope& tel,
       transit.add_hour(24.-ha);
     }
     double hi = obj.altaz(transit,tel).alt_true;
+    OBSERVING_COUNT(ALTAZ);
     if(altaim > hi) return false; // never reaches this altitude
 
     mjd2 = transit.mjd();
@@ -38,6 +41,8 @@ bool Observing::startime(const Subs::Position& obj, const Subs::Telescope& tel,
     while(mjd2-mjd1 > 1.e-5){
       crit = (mjd1+mjd2)/2.;
       found.set(crit);
+      OBSERVING_COUNT(ALTAZ);
+      OBSERVING_COUNT(BISECT);
       if(obj.altaz(found,tel).alt_true > altaim){
 	mjd2 = crit;
       }else{
@@ -54,6 +59,7 @@ bool Observing::startime(const Subs::Position& obj, const Subs::Telescope& tel,
     Subs::Time transit = start; 
     transit.add_hour(12.-ha);
     double lo = obj.altaz(transit,tel).alt_true;
+    OBSERVING_COUNT(ALTAZ);
     if(altaim < lo) return false; // never gets this low
 
     mjd2 = transit.mjd();
@@ -61,6 +67,8 @@ bool Observing::startime(const Subs::Position& obj, const Subs::Telescope& tel,
     while(mjd2-mjd1 > 1.e-5){
       crit = (mjd1+mjd2)/2.;
       found.set(crit);
+      OBSERVING_COUNT(ALTAZ);
+      OBSERVING_COUNT(BISECT);
       if(obj.altaz(found,tel).alt_true > altaim){
 	mjd1 = crit;
       }else{
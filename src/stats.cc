@@ -0,0 +1,142 @@
+// Observing::Stats: per-thread counters of the expensive calls and timers
+// of the phases of a program.
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include "trm/observing.h"
+#include "trm/stats.h"
+
+namespace {
+
+  // The counters of one thread. Only the owning thread writes to them, so
+  // a relaxed load and store is enough; atomics just make the reads from
+  // the reporting thread well-defined.
+  struct Block {
+    Block() {for(int i=0; i<Observing::Stats::NCOUNTER; i++) n[i] = 0;}
+    std::atomic<unsigned long> n[Observing::Stats::NCOUNTER];
+  };
+
+  std::mutex& guard(){
+    static std::mutex mtx;
+    return mtx;
+  }
+
+  // Blocks of every thread that has counted anything, kept after the
+  // threads finish
+  std::vector<std::shared_ptr<Block> >& blocks(){
+    static std::vector<std::shared_ptr<Block> > blk;
+    return blk;
+  }
+
+  Block& local(){
+    thread_local std::shared_ptr<Block> block;
+    if(!block){
+      block = std::make_shared<Block>();
+      std::lock_guard<std::mutex> lock(guard());
+      blocks().push_back(block);
+    }
+    return *block;
+  }
+
+  double phase_time[Observing::Stats::NPHASE];
+
+  double now(){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  const char* counter_name[] = {"altaz", "sun_full", "sun_fast", "bisect", "tcorr_hel", "tcorr_bar", "parse_bytes"};
+  const char* phase_name[]   = {"load", "nights", "visibility", "events", "output"};
+}
+
+bool Observing::Stats::enabled(){
+#ifdef OBSERVING_STATS
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Observing::Stats::add(Counter counter, unsigned long n){
+  std::atomic<unsigned long>& c = local().n[counter];
+  c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+unsigned long Observing::Stats::count(Counter counter){
+  std::lock_guard<std::mutex> lock(guard());
+  unsigned long sum = 0;
+  for(size_t i=0; i<blocks().size(); i++)
+    sum += blocks()[i]->n[counter].load(std::memory_order_relaxed);
+  return sum;
+}
+
+double Observing::Stats::seconds(Phase phase){
+  std::lock_guard<std::mutex> lock(guard());
+  return phase_time[phase];
+}
+
+void Observing::Stats::add_time(Phase phase, double seconds){
+  std::lock_guard<std::mutex> lock(guard());
+  phase_time[phase] += seconds;
+}
+
+Observing::Stats::Timer::Timer(Phase phase) : phase(phase), start(now()) {}
+
+Observing::Stats::Timer::~Timer(){
+  add_time(phase, now()-start);
+}
+
+/** Reports the counts and the times of each phase.
+ * \param ostr the stream to write to
+ * \param json true for a JSON object, false for a table
+ */
+void Observing::Stats::report(std::ostream& ostr, bool json){
+
+  if(json){
+    ostr << "{\"enabled\": " << (enabled() ? "true" : "false") << ", \"counts\": {";
+    for(int i=0; i<NCOUNTER; i++)
+      ostr << (i ? ", " : "") << "\"" << counter_name[i] << "\": " << count(Counter(i));
+    ostr << "}, \"seconds\": {";
+    for(int i=0; i<NPHASE; i++)
+      ostr << (i ? ", " : "") << "\"" << phase_name[i] << "\": " << std::setprecision(6) << seconds(Phase(i));
+    ostr << "}}" << std::endl;
+
+  }else if(!enabled()){
+    ostr << "No statistics: configure with --enable-stats to collect them" << std::endl;
+
+  }else{
+    ostr << "\nCall counts:\n" << std::endl;
+    for(int i=0; i<NCOUNTER; i++)
+      ostr << std::setw(12) << std::left << counter_name[i] << " " << std::right << std::setw(14) << count(Counter(i)) << std::endl;
+    ostr << "\nSeconds per phase:\n" << std::endl;
+    for(int i=0; i<NPHASE; i++)
+      ostr << std::setw(12) << std::left << phase_name[i] << " " << std::right << std::setw(14) << std::fixed
+	   << std::setprecision(4) << seconds(Phase(i)) << std::endl;
+    ostr.unsetf(std::ios_base::fixed);
+  }
+}
+
+/** Reports according to the value of a program's 'stats' parameter:
+ * 'none' for nothing, 'text' for a table on stderr, 'json' for JSON on
+ * stderr, anything else being taken as the name of a file to write JSON
+ * to. Throws an Observing_Error if the file cannot be written.
+ * \param mode the value of the parameter
+ */
+void Observing::Stats::report(const std::string& mode){
+  if(mode == "none"){
+    return;
+  }else if(mode == "text"){
+    report(std::cerr, false);
+  }else if(mode == "json"){
+    report(std::cerr, true);
+  }else{
+    std::ofstream fout(mode.c_str());
+    if(!fout) throw Observing_Error("Observing::Stats::report: could not open " + mode);
+    report(fout, true);
+  }
+}
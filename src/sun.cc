@@ -0,0 +1,87 @@
+// Position of the Sun in the sky, either from the full solar ephemeris of
+// Subs::Position::set_to_sun or from a short analytic series that is good
+// enough for twilight and much cheaper.
+
+#include <cmath>
+#include "slalib.h"
+#include "trm/subs.h"
+#include "trm/constants.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+#include "trm/observing.h"
+#include "trm/stats.h"
+
+/** Low-precision apparent RA and declination of the Sun, from the series
+ * of the Astronomical Almanac: mean longitude and mean anomaly linear in
+ * time, two terms of the equation of centre, and the mean obliquity. The
+ * result is referred to the equinox of date and is good to about 0.01
+ * degrees (under an arcminute) from 1950 to 2050, and only slowly worse
+ * outside that range. It costs a few sines and cosines, against the full
+ * planetary theory behind Subs::Position::set_to_sun.
+ * \param tt  TT as an MJD
+ * \param ra  RA, radians
+ * \param dec declination, radians
+ */
+void Observing::fast_sun(double tt, double& ra, double& dec){
+  const double DR = Constants::TWOPI/360.;
+  double n   = tt - 51544.5;
+  double l   = DR*(280.460 + 0.9856474*n);
+  double g   = DR*(357.528 + 0.9856003*n);
+  double lam = l + DR*(1.915*sin(g) + 0.020*sin(2.*g));
+  double eps = DR*(23.439 - 0.0000004*n);
+  ra  = slaDranrm(atan2(cos(eps)*sin(lam), cos(lam)));
+  dec = asin(sin(eps)*sin(lam));
+}
+
+/** Where the Sun is in the sky.
+ *
+ * With FAST_SUN the position comes from fast_sun and the refraction for
+ * alt_obs from slaRefz, for standard conditions at the height of the
+ * telescope as in Track::altaz. This is the refraction model of the full
+ * calculation, held at its value for 3 degrees below the horizon at lower
+ * altitudes, so alt_obs agrees with it to about an arcminute at twilight
+ * altitudes as well as above the horizon. The parallax of the Sun (9
+ * arcseconds) and the equation of the equinoxes (under 20 arcseconds) are
+ * ignored.
+ *
+ * \param tel   the telescope
+ * \param time  the UTC time
+ * \param model how to compute the Sun's position
+ * \return the altitude (true and observed, degrees), azimuth (degrees), hour
+ * angle (hours), position angle and airmass
+ */
+Subs::Altaz Observing::sun_altaz(const Subs::Telescope& tel, const Subs::Time& time, Sun_Model model){
+
+  if(model == FULL_SUN){
+    OBSERVING_COUNT(SUN_FULL);
+    Subs::Position Sun;
+    Sun.set_to_sun(time, tel);
+    return Sun.altaz(time, tel);
+  }
+
+  OBSERVING_COUNT(SUN_FAST);
+  const double DR = Constants::TWOPI/360.;
+  double elong = DR*tel.longitude(), phi = DR*tel.latitude();
+  double tt    = time.mjd() + time.dtt()/Constants::DAY;
+
+  double ra, dec;
+  fast_sun(tt, ra, dec);
+
+  double ha = slaDrange(slaGmst(time.mjd()) + elong - ra);
+  double az, el;
+  slaDe2h(ha, dec, phi, &az, &el);
+
+  double refa, refb, zobs;
+  slaRefcoq(278., 1013.25*exp(-tel.height()/8150.), 0.5, 0.55, &refa, &refb);
+  slaRefz(Constants::TWOPI/4.-el, refa, refb, &zobs);
+
+  Subs::Altaz altaz;
+  altaz.alt_true = el/DR;
+  altaz.alt_obs  = 90. - zobs/DR;
+  altaz.az       = az/DR;
+  altaz.ha       = ha/(15.*DR);
+  altaz.pa       = slaPa(ha, dec, phi)/DR;
+  altaz.airmass  = slaAirmas(zobs);
+  return altaz;
+}
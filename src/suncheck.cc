@@ -0,0 +1,65 @@
+// suncheck: checks that the fast model of the Sun's position (FAST_SUN)
+// gives the observed altitude of the full solar ephemeris (FULL_SUN) at
+// the twilight altitudes of -6, -12 and -18 degrees, where ephemeris and
+// the query daemon compare it with the limit set by the user. The times of
+// the crossings come from the full model, on evenings and mornings spread
+// over several decades at telescopes of both hemispheres. Run by "make
+// check"; it exits with a failure status if any difference exceeds two
+// arcminutes.
+
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <iostream>
+#include "trm/subs.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/observing.h"
+
+int main(){
+
+  try{
+
+    const char* name[] = {"WHT", "VLT", "NTT"};
+    const double twilight[] = {-6., -12., -18.};
+    const double TOL = 2./60.;
+
+    bool ok = true;
+    int ncheck = 0;
+    double worst = 0.;
+    for(size_t nt=0; nt<sizeof(name)/sizeof(char*); nt++){
+      Subs::Telescope tel(name[nt]);
+      for(double mjd=40000.5; mjd<70000.; mjd+=997.3){
+	for(size_t na=0; na<sizeof(twilight)/sizeof(double); na++){
+	  Subs::Time start(mjd), found;
+	  for(int n=0; n<2; n++){
+	    if(!Observing::suntime(tel, start, twilight[na], found, Observing::FULL_SUN)) break;
+	    Subs::Altaz full = Observing::sun_altaz(tel, found, Observing::FULL_SUN);
+	    Subs::Altaz fast = Observing::sun_altaz(tel, found, Observing::FAST_SUN);
+	    double diff = std::max(fabs(fast.alt_obs - full.alt_obs), fabs(fast.alt_true - full.alt_true));
+	    if(diff > worst) worst = diff;
+	    if(diff > TOL){
+	      std::cerr << name[nt] << ", MJD = " << found.mjd() << ": full alt_obs = " << full.alt_obs
+			<< ", alt_true = " << full.alt_true << "; fast alt_obs = " << fast.alt_obs
+			<< ", alt_true = " << fast.alt_true << std::endl;
+	      ok = false;
+	    }
+	    ncheck++;
+	    start = found;
+	    start.add_hour(1.);
+	  }
+	}
+      }
+    }
+
+    if(!ok) exit(EXIT_FAILURE);
+    std::cout << "Fast and full altitudes of the Sun agree to " << 60.*worst
+	      << " arcminutes at " << ncheck << " twilight crossings" << std::endl;
+  }
+  catch(const std::string& err){
+    std::cerr << err << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  return 0;
+}
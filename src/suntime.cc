@@ -1,7 +1,8 @@
 
 // Compute when Sun first reaches altitude altaim
 // after time = start. If Sun does not do so within
-// a day it returns with an error
+// a day it returns with an error. The Sun is computed
+// according to model, see Observing::Sun_Model
 
 #include "trm/subs.h"
 #include "trm/date.h"
@@ -9,13 +10,14 @@
 #include "trm/position.h"
 #include "trm/telescope.h"
 #include "trm/observing.h"
+#include "trm/stats.h"
+#include "trm/trace.h"
 
 bool Observing::suntime(const Subs::Telescope& tel, const Subs::Time& start, double altaim, 
-			Subs::Time& found){
+			Subs::Time& found, Sun_Model model){
 
-  Subs::Position Sun;
-  Sun.set_to_sun(start, tel);
-  Subs::Altaz altaz = Sun.altaz(start,tel);
+  OBSERVING_SPAN("suntime");
+  Subs::Altaz altaz = sun_altaz(tel, start, model);
   double now  = altaz.alt_true;
   double ha   = altaz.ha;
   double mjd1 = start.mjd();
@@ -31,7 +33,7 @@ bool Observing::suntime(const Subs::Telescope& tel, const Subs::Time& start, dou
     }else{
       midday.add_hour(24.-ha);
     }
-    double hi = Sun.altaz(midday,tel).alt_true;
+    double hi = sun_altaz(tel, midday, model).alt_true;
     if(altaim > hi) return false;
 
     mjd2 = midday.mjd();
@@ -39,8 +41,8 @@ bool Observing::suntime(const Subs::Telescope& tel, const Subs::Time& start, dou
     while(mjd2-mjd1 > 1.e-5){
       crit = (mjd1+mjd2)/2.;
       found.set(crit);
-      Sun.set_to_sun(found, tel);
-      if(Sun.altaz(found,tel).alt_true > altaim){
+      OBSERVING_COUNT(BISECT);
+      if(sun_altaz(tel, found, model).alt_true > altaim){
 	mjd2 = crit;
       }else{
 	mjd1 = crit;
@@ -55,7 +57,7 @@ bool Observing::suntime(const Subs::Telescope& tel, const Subs::Time& start, dou
 
     Subs::Time midnight = start; 
     midnight.add_hour(12.-ha);
-    double lo = Sun.altaz(midnight,tel).alt_true;
+    double lo = sun_altaz(tel, midnight, model).alt_true;
     if(altaim < lo) return false;
 
     mjd2 = midnight.mjd();
@@ -63,8 +65,8 @@ bool Observing::suntime(const Subs::Telescope& tel, const Subs::Time& start, dou
     while(mjd2-mjd1 > 1.e-5){
       crit = (mjd1+mjd2)/2.;
       found.set(crit);
-      Sun.set_to_sun(found, tel);
-      if(Sun.altaz(found,tel).alt_true > altaim){
+      OBSERVING_COUNT(BISECT);
+      if(sun_altaz(tel, found, model).alt_true > altaim){
 	mjd1 = crit;
       }else{
 	mjd2 = crit;
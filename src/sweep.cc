@@ -0,0 +1,60 @@
+// Observing::Sweep: totals of weighted samples over a grid of airmass and
+// Sun altitude limits.
+
+#include <algorithm>
+#include "trm/subs.h"
+#include "trm/observing.h"
+#include "trm/sweep.h"
+
+/** Constructor.
+ * \param airmass maximum airmass limits, in increasing order
+ * \param sunalt  maximum Sun altitude limits (degrees), in increasing order
+ */
+Observing::Sweep::Sweep(const std::vector<double>& airmass, const std::vector<double>& sunalt) :
+  alim(airmass), slim(sunalt), bin(airmass.size()*sunalt.size(), 0.), cum(bin), stale(false) {
+  for(size_t i=1; i<alim.size(); i++)
+    if(alim[i] <= alim[i-1]) throw Observing_Error("Observing::Sweep: airmass limits must increase");
+  for(size_t i=1; i<slim.size(); i++)
+    if(slim[i] <= slim[i-1]) throw Observing_Error("Observing::Sweep: Sun altitude limits must increase");
+}
+
+/** Adds a sample. Samples with airmass below 0.5, i.e. below the horizon,
+ * never count.
+ * \param airmass airmass of the sample
+ * \param sunalt  altitude of the Sun, degrees
+ * \param weight  weight of the sample, e.g. 1 for an event or its length for a slice of time
+ */
+void Observing::Sweep::add(double airmass, double sunalt, double weight){
+  if(airmass <= 0.5) return;
+  size_t ia = std::upper_bound(alim.begin(), alim.end(), airmass) - alim.begin();
+  size_t is = std::upper_bound(slim.begin(), slim.end(), sunalt)  - slim.begin();
+  if(ia < alim.size() && is < slim.size()){
+    bin[slim.size()*ia+is] += weight;
+    stale = true;
+  }
+}
+
+//! Removes all samples
+void Observing::Sweep::clear(){
+  std::fill(bin.begin(), bin.end(), 0.);
+  std::fill(cum.begin(), cum.end(), 0.);
+  stale = false;
+}
+
+/** Returns the total weight of the samples with airmass less than the ia-th
+ * airmass limit and the Sun below the is-th altitude limit.
+ */
+double Observing::Sweep::total(size_t ia, size_t is) const {
+  if(stale){
+    size_t ns = slim.size();
+    for(size_t i=0; i<alim.size(); i++){
+      double row = 0.;
+      for(size_t j=0; j<ns; j++){
+	row += bin[ns*i+j];
+	cum[ns*i+j] = i > 0 ? cum[ns*(i-1)+j] + row : row;
+      }
+    }
+    stale = false;
+  }
+  return cum[slim.size()*ia+is];
+}
@@ -0,0 +1,310 @@
+/*
+
+!!sphinx
+
+*sweeplimits* -- how do the airmass and Sun limits trade off?
+=============================================================
+
+*sweeplimits* answers the questions of *ephemeris* and *eclipsers* for a
+whole grid of maximum airmass and maximum Sun altitude at once, rather than
+needing a run per pair of limits. The phase events of all stars and the
+altitude curves of the stars and the Sun are computed just once over the
+run of nights; since anything visible under a pair of limits is visible
+under any looser pair, each event or slice of time is then binned at the
+tightest limits it passes and totals over the grid follow from cumulative
+sums. Three tables are printed, each with a row per airmass limit and a
+column per Sun altitude limit:
+
+ 1. the number of events at the chosen phase that pass the limits, i.e.
+    the number of lines that *ephemeris* would print;
+
+ 2. the number of stars with at least one such event;
+
+ 3. the number of hours, summed over the stars, spent within the phase
+    range pstart to pend while passing the limits, as *eclipsers* shows.
+
+Invocation:
+  sweeplimits stars startdate enddate telescope phase pstart pend airmass1 airmass2 nairmass sunalt1 sunalt2 nsunalt npoint
+
+Arguments:
+
+  stars :
+    Data file of star positions and ephemerides
+
+  startdate :
+    Date of first night, e.g. 1/5/2002 = 1st May 2002
+
+  enddate :
+    Date of last night
+
+  telescope :
+    e.g. wht
+
+  phase :
+    Phase of the events to count
+
+  pstart :
+    Start of the phase range over which to total the hours
+
+  pend :
+    End of the phase range. Can be less than pstart for ranges through
+    phase 0.
+
+  airmass1 :
+    Lowest maximum airmass
+
+  airmass2 :
+    Highest maximum airmass
+
+  nairmass :
+    Number of airmass limits
+
+  sunalt1 :
+    Lowest maximum altitude of the Sun (degrees)
+
+  sunalt2 :
+    Highest maximum altitude of the Sun
+
+  nsunalt :
+    Number of Sun altitude limits
+
+  npoint :
+    Number of points per night used to total the hours
+
+  threads :
+    Number of threads to use (hidden, default 0, meaning one per core)
+
+!!sphinx
+
+*/
+
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <exception>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+
+#include "trm/subs.h"
+#include "trm/input.h"
+#include "trm/date.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/ephem.h"
+#include "trm/position.h"
+#include "trm/star.h"
+#include "trm/binary_star.h"
+#include "trm/observing.h"
+#include "trm/timeline.h"
+#include "trm/sweep.h"
+#include "trm/batch.h"
+
+// Prints one of the tables, with a row per airmass limit
+void table(const std::string& title, const std::vector<double>& alim, const std::vector<double>& slim,
+	   const std::vector<double>& grid, int precision){
+  std::cout << "\n" << title << "\n\nAirmass  Sun altitude:\n        ";
+  for(size_t j=0; j<slim.size(); j++)
+    std::cout << " " << std::setw(8) << std::setprecision(4) << std::right << slim[j];
+  std::cout << "\n" << std::endl;
+  for(size_t i=0; i<alim.size(); i++){
+    std::cout << std::setw(7) << std::setprecision(4) << std::left << alim[i] << " ";
+    for(size_t j=0; j<slim.size(); j++)
+      std::cout << " " << std::setw(8) << std::right << std::fixed << std::setprecision(precision)
+		<< grid[slim.size()*i+j];
+    std::cout.unsetf(std::ios_base::fixed);
+    std::cout << std::endl;
+  }
+}
+
+int main(int argc, char *argv[]){
+
+  try{
+
+    // Construct Input object
+
+    Subs::Input input(argc, argv, Observing::OBSERVING_ENV, Observing::OBSERVING_DIR);
+
+    // sign-in variables (equivalent to ADAM .ifl files)
+
+    input.sign_in("stars",     Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("startdate", Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("enddate",   Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("telescope", Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("phase",     Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("pstart",    Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("pend",      Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("airmass1",  Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("airmass2",  Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("nairmass",  Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("sunalt1",   Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("sunalt2",   Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("nsunalt",   Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("npoint",    Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("threads",   Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+
+    // Get input
+
+    std::string starfile;
+    input.get_value("stars", starfile, "stardata", "file of star positions and ephemerides");
+
+    // Load star data
+
+    std::ifstream file(starfile.c_str());
+    if(!file) throw std::string("Could not open file = ") + starfile;
+
+    Subs::Star   s;
+    Subs::Ephem  eph;
+    std::vector<Subs::Binary>  binary;
+    while(file >> s){
+      if(file >> eph){
+	binary.push_back(Subs::Binary(s,eph));
+      }else{
+	if(file.bad()){
+	  file.close();
+	  throw std::string("File stream corrupted");
+	}
+	file.clear();
+      }
+    }
+    file.close();
+    std::cout << "Found position and ephemeris data on " << binary.size() << " stars" << std::endl;
+    if(binary.size() == 0)
+      throw std::string("Cannot have 0 stars!");
+
+    std::string sdate;
+    input.get_value("startdate", sdate, "17 Nov 1961", "date at start of first night");
+    Subs::Date start(sdate);
+    input.get_value("enddate", sdate, "17 Nov 1961", "date at start of last night");
+    Subs::Date end(sdate);
+    if(start > end) throw std::string("Can't have a start date after the end date!");
+
+    std::string stelescope;
+    input.get_value("telescope", stelescope, "WHT", "telescope name");
+    Subs::Telescope telescope(stelescope);
+
+    double phase;
+    input.get_value("phase", phase, 0., 0., 1., "orbital phase of events");
+    double pstart;
+    input.get_value("pstart", pstart, -0.1, -10., 10., "start of phase range");
+    double pend;
+    input.get_value("pend", pend, 0.1, -10., 10., "end of phase range");
+    double airmass1;
+    input.get_value("airmass1", airmass1, 1.5, 1.001, 50., "lowest maximum airmass");
+    double airmass2;
+    input.get_value("airmass2", airmass2, std::max(3., airmass1), airmass1, 50., "highest maximum airmass");
+    int nairmass;
+    input.get_value("nairmass", nairmass, 4, 1, 1000, "number of airmass limits");
+    double sunalt1;
+    input.get_value("sunalt1", sunalt1, -18., -80., -1., "lowest maximum altitude of Sun");
+    double sunalt2;
+    input.get_value("sunalt2", sunalt2, std::max(-6., sunalt1), sunalt1, -1., "highest maximum altitude of Sun");
+    int nsunalt;
+    input.get_value("nsunalt", nsunalt, 5, 1, 1000, "number of Sun altitude limits");
+    int npoint;
+    input.get_value("npoint", npoint, 200, 2, 100000, "number of points per night for the hours");
+    int nthread;
+    input.get_value("threads", nthread, 0, 0, 1024, "number of threads (0 for one per core)");
+
+    std::vector<double> alim(nairmass), slim(nsunalt);
+    for(int i=0; i<nairmass; i++)
+      alim[i] = nairmass > 1 ? airmass1 + (airmass2-airmass1)*i/(nairmass-1) : airmass1;
+    for(int i=0; i<nsunalt; i++)
+      slim[i] = nsunalt > 1 ? sunalt1 + (sunalt2-sunalt1)*i/(nsunalt-1) : sunalt1;
+
+    double prange = pend - pstart;
+    prange -= floor(prange);
+    if(prange == 0.) prange = 1.;
+
+    // Events and stars with events, and hours in the phase range
+
+    Observing::Sweep events(alim, slim), hours(alim, slim);
+    std::vector<Observing::Sweep> each(binary.size(), Observing::Sweep(alim, slim));
+
+    // All nights are taken out to the highest Sun limit, so one pass serves every limit
+
+    Observing::Timeline timeline(telescope, phase, alim.back(), slim.back());
+    for(size_t j=0; j<binary.size(); j++) timeline.add(binary[j], binary[j]);
+    timeline.set_threads(nthread);
+
+    int nday = int(end.mjd()-start.mjd()+1.5);
+    Subs::Date date = start;
+    std::vector<Subs::Date> days;
+    for(int n=0; n<nday; n++, date.add_day(1)) days.push_back(date);
+    std::vector<Observing::Night> nights;
+    std::vector<char> nok;
+    Observing::night(telescope, days, slim.back(), nights, nok, nthread);
+
+    Observing::Event event;
+
+    // Sun's altitude and, for each star, whether it is in its phase range
+    // and its airmass at each point of a night, computed in parallel then
+    // added in order
+    std::vector<double> psun(npoint);
+    std::vector<std::vector<double> > pam(npoint, std::vector<double>(binary.size()));
+    std::vector<std::vector<char> > pin(npoint, std::vector<char>(binary.size()));
+
+    for(int n=0; n<nday; n++){
+
+      if(!nok[n]){
+	std::cerr << "Could not find twilight times for the night starting " << days[n] << "; skipped" << std::endl;
+	continue;
+      }
+      const Observing::Night& night = nights[n];
+
+      timeline.start(night.twiend);
+      while(timeline.next(night.twistart, event)){
+	events.add(event.airmass, event.sunalt);
+	each[event.star].add(event.airmass, event.sunalt);
+      }
+
+      double dt = (night.twistart.mjd() - night.twiend.mjd())/npoint;
+      Observing::parallel_for(npoint, nthread, [&](size_t i, Observing::Context&){
+	  Subs::Time time(night.twiend.mjd() + (i+0.5)*dt);
+	  Subs::Position Sun;
+	  Sun.set_to_sun(time, telescope);
+	  psun[i] = Sun.altaz(time, telescope).alt_obs;
+	  if(psun[i] >= slim.back()) return;
+	  for(size_t j=0; j<binary.size(); j++){
+	    double p = Observing::time_to_phase(binary[j], binary[j], time, telescope) - pstart;
+	    pin[i][j] = p - floor(p) < prange;
+	    if(pin[i][j]) pam[i][j] = binary[j].altaz(time, telescope).airmass;
+	  }
+	});
+
+      for(int i=0; i<npoint; i++){
+	if(psun[i] >= slim.back()) continue;
+	for(size_t j=0; j<binary.size(); j++)
+	  if(pin[i][j]) hours.add(pam[i][j], psun[i], 24.*dt);
+      }
+    }
+
+    // A star counts under a pair of limits if any of its events do
+
+    size_t ngrid = alim.size()*slim.size();
+    std::vector<double> nevent(ngrid), nstar(ngrid, 0.), nhour(ngrid);
+    for(size_t ia=0, k=0; ia<alim.size(); ia++){
+      for(size_t is=0; is<slim.size(); is++, k++){
+	nevent[k] = events.total(ia,is);
+	nhour[k]  = hours.total(ia,is);
+	for(size_t j=0; j<binary.size(); j++)
+	  if(each[j].total(ia,is) > 0.) nstar[k]++;
+      }
+    }
+
+    table("Number of events at phase " + Subs::str(phase), alim, slim, nevent, 0);
+    table("Number of stars with events", alim, slim, nstar, 0);
+    table("Hours in the phase range " + Subs::str(pstart) + " to " + Subs::str(pend), alim, slim, nhour, 2);
+  }
+
+  catch(const std::string& str){
+    std::cerr << str << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  catch(const std::exception& exc){
+    std::cerr << exc.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+}
@@ -0,0 +1,65 @@
+// Computes the offset in days needed to convert a UTC MJD onto the
+// timescale of an ephemeris, i.e. a heliocentric correction for HJD/HMJD
+// ephemerides and TT-UTC plus a barycentric correction for BJD/BMJD
+// ones. Throws an Observing_Error if the timescale is not recognised.
+// Also conversions between UTC and orbital phase which use it.
+
+#include "trm/subs.h"
+#include "trm/constants.h"
+#include "trm/time.h"
+#include "trm/position.h"
+#include "trm/telescope.h"
+#include "trm/ephem.h"
+#include "trm/observing.h"
+#include "trm/stats.h"
+
+double Observing::tcorr(const Subs::Position& obj, const Subs::Ephem& eph, const Subs::Time& time, 
+			const Subs::Telescope& tel){
+
+  if(eph.get_tscale() == Subs::Ephem::HJD || eph.get_tscale() == Subs::Ephem::HMJD){
+    OBSERVING_COUNT(TCORR_HEL);
+    return obj.tcorr_hel(time,tel)/Constants::DAY;
+  }else if(eph.get_tscale() == Subs::Ephem::BJD || eph.get_tscale() == Subs::Ephem::BMJD){
+    OBSERVING_COUNT(TCORR_BAR);
+    return (time.dtt() + obj.tcorr_bar(time,tel))/Constants::DAY;
+  }else{
+    throw Observing_Error("Observing::tcorr: could not recognize type of timescale");
+  }
+}
+
+bool Observing::is_jd(const Subs::Ephem& eph){
+  return (eph.get_tscale() == Subs::Ephem::HJD || eph.get_tscale() == Subs::Ephem::BJD);
+}
+
+/** Orbital phase at a given UTC time, allowing for the timescale of the
+ * ephemeris.
+ * \param obj  position of the star
+ * \param eph  its ephemeris
+ * \param time the UTC time
+ * \param tel  the telescope
+ */
+double Observing::time_to_phase(const Subs::Position& obj, const Subs::Ephem& eph, const Subs::Time& time, 
+				const Subs::Telescope& tel){
+  double t = time.mjd() + tcorr(obj, eph, time, tel);
+  if(is_jd(eph)) t += MJD2JD;
+  return eph.phase(t);
+}
+
+/** UTC MJD at which a star reaches a given orbital phase, the inverse of
+ * time_to_phase. The timescale correction is computed at the time itself,
+ * refined once.
+ * \param obj   position of the star
+ * \param eph   its ephemeris
+ * \param phase the orbital phase (cycle number plus phase)
+ * \param tel   the telescope
+ */
+double Observing::phase_to_time(const Subs::Position& obj, const Subs::Ephem& eph, double phase, 
+				const Subs::Telescope& tel){
+  double t = eph.time(phase);
+  if(is_jd(eph)) t -= MJD2JD;
+  Subs::Time time(t);
+  double off = tcorr(obj, eph, time, tel);
+  time.set(t - off);
+  off = tcorr(obj, eph, time, tel);
+  return t - off;
+}
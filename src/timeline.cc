@@ -0,0 +1,140 @@
+// Observing::Timeline: lazily generated phase events of many binaries
+// merged into a single time-ordered stream with a heap.
+
+#include <cmath>
+#include "trm/subs.h"
+#include "trm/time.h"
+#include "trm/position.h"
+#include "trm/telescope.h"
+#include "trm/ephem.h"
+#include "trm/observing.h"
+#include "trm/timeline.h"
+#include "trm/batch.h"
+
+/** Constructor.
+ * \param tel     the telescope
+ * \param phase   the orbital phase of the events (0 to 1)
+ * \param airmass maximum airmass for an event to be observable
+ * \param sunalt  maximum altitude of the Sun for an event to be observable
+ */
+Observing::Timeline::Timeline(const Subs::Telescope& tel, double phase, double airmass, double sunalt) :
+  telescope(tel), phase(phase), airmass(airmass), sunalt(sunalt), nthr(1) {}
+
+/** Adds a star. Call start afterwards before asking for events.
+ * \param obj position of the star
+ * \param eph its ephemeris
+ */
+void Observing::Timeline::add(const Subs::Position& obj, const Subs::Ephem& eph){
+  Source src;
+  src.obj   = &obj;
+  src.eph   = &eph;
+  src.cycle = 0;
+  source.push_back(src);
+}
+
+/** Sets up the first event of every star after a given time, discarding 
+ * anything pending. This is the expensive part of a query over many stars,
+ * so the stars are spread over the threads set by set_threads.
+ * \param time the UTC time to start from
+ */
+void Observing::Timeline::start(const Subs::Time& time){
+
+  while(!heap.empty()) heap.pop();
+
+  std::vector<Pending> first(source.size());
+  parallel_for(source.size(), nthr, [&](size_t i, Context&){
+      Source& src = source[i];
+      src.cycle = long(ceil(time_to_phase(*src.obj, *src.eph, time, telescope)-phase));
+
+      // the timescale correction is re-evaluated at the event itself, 
+      // which can put it just before the start time
+      while((first[i].mjd = event_mjd(src)) < time.mjd()) src.cycle++;
+      first[i].star = i;
+    });
+
+  for(size_t i=0; i<first.size(); i++) heap.push(first[i]);
+}
+
+/** Returns the next event of any star irrespective of whether it can be observed.
+ * \param tend  time beyond which to stop
+ * \param event the event, including the airmass and altitude of the Sun
+ * \return false if there are no more events before tend
+ */
+bool Observing::Timeline::next(const Subs::Time& tend, Event& event){
+  if(heap.empty() || heap.top().mjd > tend.mjd()) return false;
+
+  Pending pend = heap.top();
+  heap.pop();
+  Source& src   = source[pend.star];
+  event.time.set(pend.mjd);
+  event.star    = pend.star;
+  event.cycle   = double(src.cycle) + phase;
+  event.pherr   = src.eph->pherr(src.eph->time(event.cycle));
+  event.airmass = src.obj->altaz(event.time,telescope).airmass;
+  Sun.set_to_sun(event.time, telescope);
+  event.sunalt  = Sun.altaz(event.time,telescope).alt_obs;
+
+  src.cycle++;
+  pend.mjd = event_mjd(src);
+  heap.push(pend);
+  return true;
+}
+
+/** Returns the next event of any star that satisfies the airmass and Sun
+ * altitude limits. The Sun's position is only computed for events that pass
+ * the airmass limit.
+ * \param tend  time beyond which to stop
+ * \param event the event
+ * \return false if there are no more observable events before tend
+ */
+bool Observing::Timeline::next_observable(const Subs::Time& tend, Event& event){
+
+  while(!heap.empty() && heap.top().mjd <= tend.mjd()){
+
+    Pending pend = heap.top();
+    heap.pop();
+    Source& src = source[pend.star];
+    event.time.set(pend.mjd);
+    event.star    = pend.star;
+    event.cycle   = double(src.cycle) + phase;
+    event.airmass = src.obj->altaz(event.time,telescope).airmass;
+
+    src.cycle++;
+    Pending nxt;
+    nxt.mjd  = event_mjd(src);
+    nxt.star = pend.star;
+    heap.push(nxt);
+
+    if(event.airmass > 0.5 && event.airmass < airmass){
+      Sun.set_to_sun(event.time, telescope);
+      event.sunalt = Sun.altaz(event.time,telescope).alt_obs;
+      if(event.sunalt < sunalt){
+	event.pherr = src.eph->pherr(src.eph->time(event.cycle));
+	return true;
+      }
+    }
+  }
+  return false;
+}
+
+/** Finds the first nmax observable events after tstart, stopping at tend.
+ * \param tstart start time
+ * \param tend   end time
+ * \param nmax   maximum number of events to return
+ * \param events the events, in time order (cleared on entry)
+ * \return the number of events found
+ */
+size_t Observing::Timeline::query(const Subs::Time& tstart, const Subs::Time& tend, size_t nmax,
+				  std::vector<Event>& events){
+  events.clear();
+  start(tstart);
+  Event event;
+  while(events.size() < nmax && next_observable(tend, event))
+    events.push_back(event);
+  return events.size();
+}
+
+// UTC MJD of the current cycle of a source.
+double Observing::Timeline::event_mjd(const Source& src) const {
+  return phase_to_time(*src.obj, *src.eph, double(src.cycle) + phase, telescope);
+}
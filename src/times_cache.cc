@@ -0,0 +1,192 @@
+// Cached reading of .times files. Observing logs only ever grow by having
+// lines appended, so the phases computed from them are saved in a sidecar
+// file <file>.cache together with the number of bytes they were computed
+// from. On the next read only the lines after that point are converted.
+//
+// The cache is binary:
+//
+// 8 bytes   magic string identifying the format and conversion version
+// uint64    hash of the ephemeris, position and timescale used
+// uint64    number of bytes of the .times file covered
+// uint64    hash of the (up to) TAIL bytes preceding that point
+// uint64    number of phase ranges, n
+// n*3 doubles  p1, p2 and poor (0 or 1) for each range
+//
+// The cache is only used if the ephemeris hash matches, its size agrees
+// with its number of ranges, and the file still has the same bytes just
+// before the cached point; this catches edits as
+// well as a changed ephemeris while costing a fixed amount of work,
+// independent of the size of the file. Lines after the last newline are
+// converted but never cached since they may be incomplete.
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "trm/subs.h"
+#include "trm/time.h"
+#include "trm/position.h"
+#include "trm/telescope.h"
+#include "trm/ephem.h"
+#include "trm/observing.h"
+#include "trm/times_file.h"
+#include "mapped_file.h"
+
+namespace {
+
+  // Identifies the format and the way times are converted to phase. The
+  // digit must be increased whenever either changes (the layout below,
+  // parse_times, phase_range, Precise_Ephem or tcorr), since the key only
+  // covers the parameters of the conversion, not the code.
+  const char MAGIC[8] = {'O','B','S','P','H','C','2','\n'};
+
+  // Number of bytes before the cached point that are checked
+  const size_t TAIL = 4096;
+
+  // 64-bit FNV-1a hash
+  uint64_t fnv1a(const char* buff, size_t nbyte, uint64_t hash=14695981039346656037ULL){
+    for(size_t i=0; i<nbyte; i++){
+      hash ^= static_cast<unsigned char>(buff[i]);
+      hash *= 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  // Hash of everything that affects the conversion of times to phase
+  uint64_t ephem_key(const Subs::Position& obj, const Subs::Ephem& eph, const Subs::Telescope& tel){
+    Subs::Time ref(51544.5);
+    char buff[256];
+    int n = snprintf(buff, sizeof(buff), "%d %.17g %.17g %.17g %.17g", int(eph.get_tscale()),
+		     eph.time(0.), eph.time(1.), eph.time(10000.), Observing::tcorr(obj, eph, ref, tel));
+    return fnv1a(buff, n);
+  }
+
+  struct Header {
+    char     magic[8];
+    uint64_t key, nbyte, tail, nrange;
+  };
+
+  // Reads a cache, returning false if it does not exist or is unusable
+  bool read_cache(const std::string& cache, uint64_t key, const char* buff, size_t nbyte,
+		  size_t& used, std::vector<Observing::Phase_Range>& ranges){
+    std::ifstream fin(cache.c_str(), std::ios::binary | std::ios::ate);
+    if(!fin) return false;
+    std::streamoff size = fin.tellg();
+    fin.seekg(0);
+    Header head;
+    if(!fin.read(reinterpret_cast<char*>(&head), sizeof(head))) return false;
+    if(memcmp(head.magic, MAGIC, sizeof(MAGIC)) != 0 || head.key != key || head.nbyte > nbyte) 
+      return false;
+
+    // the ranges must fill the rest of the file exactly; anything else is a
+    // damaged cache, and its count must not be trusted to size the read
+    const uint64_t RANGE = 3*sizeof(double);
+    if(size < std::streamoff(sizeof(head)) || uint64_t(size - sizeof(head)) != RANGE*head.nrange ||
+       head.nrange > (uint64_t(size) - sizeof(head))/RANGE)
+      return false;
+    size_t ntail = std::min(size_t(head.nbyte), TAIL);
+    if(fnv1a(buff + head.nbyte - ntail, ntail) != head.tail) return false;
+
+    std::vector<double> data(3*head.nrange);
+    if(head.nrange && !fin.read(reinterpret_cast<char*>(&data[0]), data.size()*sizeof(double)))
+      return false;
+    ranges.resize(head.nrange);
+    for(size_t i=0; i<head.nrange; i++)
+      ranges[i] = Observing::Phase_Range(data[3*i], data[3*i+1], data[3*i+2] != 0.);
+    used = head.nbyte;
+    return true;
+  }
+
+  // Writes a cache via a temporary file of unique name, so that readers
+  // never see half of one and writers in parallel do not collide. The cache
+  // gets the permissions of the file it comes from. Failure is not an error:
+  // the cache is just not updated.
+  void write_cache(const std::string& file, const std::string& cache, uint64_t key,
+		   const char* buff, size_t used, const std::vector<Observing::Phase_Range>& ranges){
+    size_t nrange = ranges.size();
+    Header head;
+    memcpy(head.magic, MAGIC, sizeof(MAGIC));
+    head.key    = key;
+    head.nbyte  = used;
+    size_t ntail = std::min(used, TAIL);
+    head.tail   = fnv1a(buff + used - ntail, ntail);
+    head.nrange = nrange;
+
+    std::vector<double> data(3*nrange);
+    for(size_t i=0; i<nrange; i++){
+      data[3*i]   = ranges[i].p1;
+      data[3*i+1] = ranges[i].p2;
+      data[3*i+2] = ranges[i].poor ? 1. : 0.;
+    }
+
+    std::string tmp = cache + ".XXXXXX";
+    std::vector<char> name(tmp.begin(), tmp.end());
+    name.push_back('\0');
+    int fd = mkstemp(&name[0]);
+    if(fd < 0) return;
+    tmp = &name[0];
+    struct stat st;
+    fchmod(fd, stat(file.c_str(), &st) == 0 ? (st.st_mode & 0666) : 0644);
+    FILE* fout = fdopen(fd, "wb");
+    if(!fout){
+      close(fd);
+      unlink(tmp.c_str());
+      return;
+    }
+    bool ok = fwrite(&head, sizeof(head), 1, fout) == 1 &&
+      (nrange == 0 || fwrite(&data[0], sizeof(double), data.size(), fout) == data.size());
+    if(fclose(fout) || !ok || rename(tmp.c_str(), cache.c_str())) unlink(tmp.c_str());
+  }
+
+}
+
+/** Reads a file of observed time or phase ranges as read_times does, but
+ * saves the phases computed in a file called file + ".cache" and re-uses
+ * them on subsequent reads, converting only the lines appended since.
+ * \param file   name of the file
+ * \param obj    position of the star
+ * \param eph    its ephemeris
+ * \param tel    telescope, needed for the barycentric correction
+ * \param ranges the phase ranges, in the order they appear in the file
+ * \return false if the file could not be opened
+ */
+bool Observing::read_times_cached(const std::string& file, const Subs::Position& obj,
+				  const Subs::Ephem& eph, const Subs::Telescope& tel,
+				  std::vector<Phase_Range>& ranges){
+  ranges.clear();
+  Mapped_File map(file);
+  if(!map.ok()) return false;
+  const char* buff = map.data();
+  size_t nbyte = map.size();
+  if(!map.regular()){
+    parse_times(buff, nbyte, file, obj, eph, tel, ranges);
+    return true;
+  }
+
+  std::string cache = file + ".cache";
+  uint64_t key = ephem_key(obj, eph, tel);
+  size_t used = 0;
+  bool cached = read_cache(cache, key, buff, nbyte, used, ranges);
+  if(!cached){
+    ranges.clear();
+    used = 0;
+  }
+
+  // Convert and cache complete lines beyond the cached point, then
+  // convert anything left after the last newline
+  size_t start = used;
+  const char* last = nbyte > used ? static_cast<const char*>(memrchr(buff+used, '\n', nbyte-used)) : 0;
+  if(last){
+    used = last - buff + 1;
+    parse_times(buff+start, used-start, file, obj, eph, tel, ranges);
+  }
+  if(!cached || used > start) write_cache(file, cache, key, buff, used, ranges);
+  if(nbyte > used) parse_times(buff+used, nbyte-used, file, obj, eph, tel, ranges);
+  return true;
+}
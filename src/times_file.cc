@@ -0,0 +1,239 @@
+// Reading of the <star>.times files of observed intervals used by
+// whatphases. Three types of line are recognised:
+//
+// Phase p1 p2                   -- a range of orbital phase
+// UT time1 to time2 [poor]      -- a range of UTC, optionally in poor conditions
+// JD jd1 to jd2                 -- a range of UTC as JDs
+//
+// Anything else is ignored. Files are memory mapped and scanned in place
+// with no per-line allocation. UT times of the form "11 May 2032, 15:03:34.22"
+// are decoded directly; any other format is passed to Subs::Time.
+
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "trm/subs.h"
+#include "trm/time.h"
+#include "trm/position.h"
+#include "trm/telescope.h"
+#include "trm/ephem.h"
+#include "trm/observing.h"
+#include "trm/times_file.h"
+#include "trm/stats.h"
+#include "mapped_file.h"
+
+namespace {
+
+  inline bool is_space(char c){
+    return c == ' ' || c == '\t' || c == '\r';
+  }
+
+  inline const char* skip_space(const char* p, const char* e){
+    while(p < e && is_space(*p)) p++;
+    return p;
+  }
+
+  // Reads a double starting at p, which is left just after it. The token
+  // is copied to the stack so that strtod cannot run off the end of the map.
+  bool get_double(const char*& p, const char* e, double& x){
+    p = skip_space(p, e);
+    const char* q = p;
+    while(q < e && !is_space(*q)) q++;
+    char tok[64];
+    size_t n = q - p;
+    if(n == 0 || n >= sizeof(tok)) return false;
+    memcpy(tok, p, n);
+    tok[n] = '\0';
+    char* end;
+    x = strtod(tok, &end);
+    if(end == tok) return false;
+    p += end - tok;
+    return true;
+  }
+
+  // Reads an unsigned integer of up to ndig digits
+  bool get_uint(const char*& p, const char* e, int ndig, int& n){
+    const char* q = p;
+    n = 0;
+    while(p < e && p-q < ndig && *p >= '0' && *p <= '9') n = 10*n + (*p++ - '0');
+    return p > q;
+  }
+
+  // Locates a string within [b,e), returning e if not found
+  const char* find(const char* b, const char* e, const char* str){
+    size_t n = strlen(str);
+    for(const char* p=b; p+n<=e; p++)
+      if(*p == *str && memcmp(p, str, n) == 0) return p;
+    return e;
+  }
+
+  // Decodes "dd Mon yyyy, hh:mm:ss.sss" into an MJD. Returns false if the
+  // string is not in this form.
+  bool fast_mjd(const char* p, const char* e, double& mjd){
+    static const char MONTH[] = "janfebmaraprmayjunjulaugsepoctnovdec";
+    int day, month, year, hour, min;
+    double sec;
+    p = skip_space(p, e);
+    if(!get_uint(p, e, 2, day) || p == e || !is_space(*p)) return false;
+    p = skip_space(p, e);
+    if(e - p < 3) return false;
+    char mon[3];
+    for(int i=0; i<3; i++) mon[i] = char(tolower(p[i]));
+    month = 0;
+    for(int i=0; i<12; i++)
+      if(memcmp(mon, MONTH+3*i, 3) == 0) month = i+1;
+    if(month == 0) return false;
+    p += 3;
+    if(p == e || !is_space(*p)) return false;
+    p = skip_space(p, e);
+    if(!get_uint(p, e, 4, year)) return false;
+    if(p < e && *p == ',') p++;
+    p = skip_space(p, e);
+    if(!get_uint(p, e, 2, hour) || p == e || *p++ != ':') return false;
+    if(!get_uint(p, e, 2, min)  || p == e || *p++ != ':') return false;
+    if(!get_double(p, e, sec)) return false;
+    if(skip_space(p, e) != e) return false;
+    if(day < 1 || day > 31 || hour > 23 || min > 59 || sec < 0. || sec >= 61.) return false;
+
+    // Gregorian calendar date to MJD
+    long a  = (14 - month)/12;
+    long y  = year + 4800 - a;
+    long m  = month + 12*a - 3;
+    long jd = day + (153*m+2)/5 + 365*y + y/4 - y/100 + y/400 - 32045;
+    mjd = double(jd - 2400001) + (hour + (min + sec/60.)/60.)/24.;
+    return true;
+  }
+
+  // MJD of a UT string
+  double ut_mjd(const char* b, const char* e){
+    double mjd;
+    if(fast_mjd(b, e, mjd)) return mjd;
+    b = skip_space(b, e);
+    return Subs::Time(std::string(b, e)).mjd();
+  }
+
+}
+
+/** Converts a UTC interval into phase. The timescale correction is computed
+ * once, at the middle of the interval.
+ * \param mjd1 start of the interval, UTC MJD
+ * \param mjd2 end of the interval, UTC MJD
+ * \param poor flags poor conditions
+ * \param obj  position of the star
+ * \param eph  its ephemeris
+ * \param tel  the telescope
+ */
+Observing::Phase_Range Observing::phase_range(double mjd1, double mjd2, bool poor,
+					      const Subs::Position& obj, const Subs::Ephem& eph,
+					      const Subs::Telescope& tel){
+  return phase_range(mjd1, mjd2, poor, obj, eph, Precise_Ephem(eph), tel);
+}
+
+/** Converts a UTC interval into phase, as above, with an ephemeris already
+ * set up for precise conversions.
+ * \param mjd1 start of the interval, UTC MJD
+ * \param mjd2 end of the interval, UTC MJD
+ * \param poor flags poor conditions
+ * \param obj  position of the star
+ * \param eph  its ephemeris
+ * \param peph the same ephemeris as a Precise_Ephem
+ * \param tel  the telescope
+ */
+Observing::Phase_Range Observing::phase_range(double mjd1, double mjd2, bool poor,
+					      const Subs::Position& obj, const Subs::Ephem& eph,
+					      const Precise_Ephem& peph, const Subs::Telescope& tel){
+  Subs::Time tim((mjd1+mjd2)/2.);
+  double off = tcorr(obj, eph, tim, tel);
+  return Phase_Range(peph.phase(mjd1+off), peph.phase(mjd2+off), poor);
+}
+
+/** Parses the contents of a .times file.
+ * \param buff   the characters of the file
+ * \param nbyte  the number of characters
+ * \param file   name of the file, for error messages
+ * \param obj    position of the star
+ * \param eph    its ephemeris
+ * \param tel    telescope, needed for the barycentric correction
+ * \param ranges phase ranges found are appended to this
+ * \return the number of bytes up to and including the last newline
+ */
+size_t Observing::parse_times(const char* buff, size_t nbyte, const std::string& file,
+			      const Subs::Position& obj, const Subs::Ephem& eph,
+			      const Subs::Telescope& tel, std::vector<Phase_Range>& ranges){
+
+  OBSERVING_COUNT_N(PARSE_BYTES, nbyte);
+  Precise_Ephem peph(eph);
+  const char* end = buff + nbyte;
+  const char* b   = buff;
+  size_t used = 0;
+  while(b < end){
+    const char* e = static_cast<const char*>(memchr(b, '\n', end-b));
+    const char* next;
+    if(e){
+      next = e + 1;
+      used = next - buff;
+    }else{
+      e = next = end;
+    }
+
+    if(e-b >= 6 && memcmp(b, "Phase ", 6) == 0){
+
+      const char* p = b + 6;
+      double p1, p2;
+      if(!get_double(p, e, p1) || !get_double(p, e, p2))
+	throw Observing_Error("Failed to translate a phase range from " + file);
+      ranges.push_back(Phase_Range(p1, p2, false));
+
+    }else if(e-b >= 3 && memcmp(b, "UT ", 3) == 0){
+
+      const char* n = find(b, e, " to ");
+      if(n == e)
+	throw Observing_Error("Could no find ' to ' in a UT range from " + file);
+      const char* n1 = find(b, e, " poor");
+      bool poor = (n1 != e);
+      double mjd1 = ut_mjd(b+3, n);
+      double mjd2 = ut_mjd(n+4, poor ? n1 : e);
+      if(mjd1 > mjd2) throw Observing_Error("Times out of order in " + file);
+      ranges.push_back(phase_range(mjd1, mjd2, poor, obj, eph, peph, tel));
+
+    }else if(e-b >= 3 && memcmp(b, "JD ", 3) == 0){
+
+      const char* n = find(b, e, " to ");
+      if(n == e)
+	throw Observing_Error("Could no find ' to ' in a JD range from " + file);
+      const char* p1 = b + 3, *p2 = n + 4;
+      double mjd1, mjd2;
+      if(!get_double(p1, n, mjd1) || !get_double(p2, e, mjd2))
+	throw Observing_Error("Failed to translate a JD range from " + file);
+      mjd1 -= MJD2JD;
+      mjd2 -= MJD2JD;
+      if(mjd1 > mjd2) throw Observing_Error("Times out of order in " + file);
+      ranges.push_back(phase_range(mjd1, mjd2, false, obj, eph, peph, tel));
+
+    }
+    b = next;
+  }
+  return used;
+}
+
+/** Reads a file of observed time or phase ranges.
+ * \param file   name of the file
+ * \param obj    position of the star
+ * \param eph    its ephemeris
+ * \param tel    telescope, needed for the barycentric correction
+ * \param ranges the phase ranges, in the order they appear in the file
+ * \return false if the file could not be opened
+ */
+bool Observing::read_times(const std::string& file, const Subs::Position& obj,
+			   const Subs::Ephem& eph, const Subs::Telescope& tel,
+			   std::vector<Phase_Range>& ranges){
+  ranges.clear();
+  Mapped_File map(file);
+  if(!map.ok()) return false;
+  parse_times(map.data(), map.size(), file, obj, eph, tel, ranges);
+  return true;
+}
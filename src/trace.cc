@@ -0,0 +1,173 @@
+// Observing::Trace: spans of work on each thread held in per-thread ring
+// buffers and written as Chrome trace-event JSON.
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include "trm/observing.h"
+#include "trm/trace.h"
+
+namespace {
+
+  struct Event {
+    const char* name;
+    long arg;
+    double ts, dur;
+  };
+
+  // The spans of one thread. Only the owning thread writes; the count is
+  // released after each span is stored so that a reader that acquires it
+  // sees complete spans.
+  struct Ring {
+    Ring(size_t capacity, unsigned generation, int tid) :
+      event(capacity), n(0), gen(generation), tid(tid) {}
+    std::vector<Event> event;
+    std::atomic<size_t> n;
+    unsigned gen;
+    int tid;
+  };
+
+  std::atomic<bool>     on(false);
+  std::atomic<unsigned> generation(0);
+  std::atomic<int>      nthread(0);
+  size_t      capacity = 65536;
+  std::string output;
+  std::chrono::steady_clock::time_point t0;
+
+  std::mutex& guard(){
+    static std::mutex mtx;
+    return mtx;
+  }
+
+  std::vector<std::shared_ptr<Ring> >& rings(){
+    static std::vector<std::shared_ptr<Ring> > rng;
+    return rng;
+  }
+
+  // Numbers threads from 0 in the order they first record a span
+  int thread_id(){
+    thread_local int tid = nthread++;
+    return tid;
+  }
+
+  // The ring of the calling thread, replaced if tracing was restarted
+  Ring& local(){
+    thread_local std::shared_ptr<Ring> ring;
+    unsigned gen = generation.load(std::memory_order_acquire);
+    if(!ring || ring->gen != gen){
+      std::lock_guard<std::mutex> lock(guard());
+      ring = std::make_shared<Ring>(capacity, gen, thread_id());
+      rings().push_back(ring);
+    }
+    return *ring;
+  }
+
+  // Microseconds since tracing started
+  double now(){
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+  }
+
+  // Names are string literals, but quotes and backslashes are escaped anyway
+  std::string quote(const char* str){
+    std::string s = "\"";
+    for(const char* p=str; *p; p++){
+      if(*p == '"' || *p == '\\') s += '\\';
+      s += *p;
+    }
+    return s + "\"";
+  }
+}
+
+/** Switches tracing on. Any spans from an earlier start are discarded.
+ * \param file     the file that stop() writes to
+ * \param capacity number of spans kept for each thread
+ */
+void Observing::Trace::start(const std::string& file, size_t capacity){
+  std::lock_guard<std::mutex> lock(guard());
+  rings().clear();
+  ::capacity = std::max(size_t(1), capacity);
+  output     = file;
+  t0         = std::chrono::steady_clock::now();
+  generation++;
+  on = true;
+}
+
+bool Observing::Trace::active(){
+  return on.load(std::memory_order_relaxed);
+}
+
+/** Switches tracing off and writes the spans to the file given to start.
+ * This should only be called once the threads that recorded spans have
+ * finished, as they have after parallel_for. Throws an Observing_Error if
+ * the file cannot be written.
+ */
+void Observing::Trace::stop(){
+  if(!on) return;
+  on = false;
+  std::ofstream fout(output.c_str());
+  if(!fout) throw Observing_Error("Observing::Trace::stop: could not open " + output);
+  write(fout);
+  if(!fout) throw Observing_Error("Observing::Trace::stop: failed to write " + output);
+}
+
+/** Writes the spans as a trace-event JSON object: complete ('X') events
+ * with times in microseconds, a name for each thread, and the number of
+ * spans dropped when the buffers wrapped around.
+ * \param ostr the stream to write to
+ */
+void Observing::Trace::write(std::ostream& ostr){
+
+  std::lock_guard<std::mutex> lock(guard());
+  std::ios::fmtflags flags = ostr.flags();
+  ostr << std::fixed << std::setprecision(3) << "{\"traceEvents\": [";
+
+  size_t dropped = 0;
+  bool first = true;
+  for(size_t i=0; i<rings().size(); i++){
+    const Ring& ring = *rings()[i];
+    ostr << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << ring.tid
+	 << ", \"args\": {\"name\": \"thread " << ring.tid << "\"}}";
+    first = false;
+
+    size_t n    = ring.n.load(std::memory_order_acquire);
+    size_t size = ring.event.size();
+    size_t k0   = n > size ? n - size : 0;
+    dropped    += k0;
+    for(size_t k=k0; k<n; k++){
+      const Event& ev = ring.event[k % size];
+      ostr << ",\n{\"name\": " << quote(ev.name) << ", \"cat\": \"observing\", \"ph\": \"X\", \"ts\": " << ev.ts
+	   << ", \"dur\": " << ev.dur << ", \"pid\": 1, \"tid\": " << ring.tid;
+      if(ev.arg >= 0) ostr << ", \"args\": {\"n\": " << ev.arg << "}";
+      ostr << "}";
+    }
+  }
+  ostr << "\n], \"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped\": " << dropped << "}}" << std::endl;
+  ostr.flags(flags);
+}
+
+Observing::Trace::Span::Span(const char* name, long arg) : name(0), arg(arg), begin(0.) {
+  if(active()){
+    this->name = name;
+    begin = now();
+  }
+}
+
+Observing::Trace::Span::~Span(){
+  if(name && active()){
+    double end = now();
+    Ring& ring = local();
+    size_t n = ring.n.load(std::memory_order_relaxed);
+    Event& ev = ring.event[n % ring.event.size()];
+    ev.name = name;
+    ev.arg  = arg;
+    ev.ts   = begin;
+    ev.dur  = end - begin;
+    ring.n.store(n+1, std::memory_order_release);
+  }
+}
@@ -0,0 +1,321 @@
+// Observing::Track: moving targets from tables of positions, fitted with
+// piecewise Chebyshev series, and versions of startime and when_visible for
+// them.
+
+#include <cmath>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include "slalib.h"
+#include "trm/subs.h"
+#include "trm/constants.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/position.h"
+#include "trm/observing.h"
+#include "trm/batch.h"
+#include "trm/track.h"
+#include "trm/stats.h"
+
+namespace {
+
+  // Number of intervals of the table per segment, and maximum order of the fits
+  const int NINT = 8;
+  const int NORD = 6;
+
+  // Evaluates a Chebyshev series at x (-1 to 1) by Clenshaw's recurrence
+  double chebyshev(const std::vector<double>& c, double x){
+    double b1 = 0., b2 = 0., t;
+    for(size_t k=c.size()-1; k>0; k--){
+      t  = 2.*x*b1 - b2 + c[k];
+      b2 = b1;
+      b1 = t;
+    }
+    return x*b1 - b2 + c[0];
+  }
+
+  // Least-squares fit of Chebyshev series of order nord to several sets of
+  // values y[k][i] at the same points x[i], by the normal equations, which
+  // are well enough conditioned for the low orders used.
+  void chebfit(const std::vector<double>& x, const std::vector<std::vector<double> >& y, int nord,
+	       std::vector<std::vector<double> >& c){
+
+    size_t nc = nord + 1, ny = y.size();
+    std::vector<double> a(nc*nc, 0.), b(nc*ny, 0.), t(nc);
+    for(size_t i=0; i<x.size(); i++){
+      t[0] = 1.;
+      if(nc > 1) t[1] = x[i];
+      for(size_t k=2; k<nc; k++) t[k] = 2.*x[i]*t[k-1] - t[k-2];
+      for(size_t j=0; j<nc; j++){
+	for(size_t k=0; k<nc; k++) a[nc*j+k] += t[j]*t[k];
+	for(size_t k=0; k<ny; k++) b[ny*j+k] += t[j]*y[k][i];
+      }
+    }
+
+    // Gaussian elimination with partial pivoting
+    for(size_t j=0; j<nc; j++){
+      size_t p = j;
+      for(size_t i=j+1; i<nc; i++)
+	if(fabs(a[nc*i+j]) > fabs(a[nc*p+j])) p = i;
+      if(a[nc*p+j] == 0.)
+	throw Observing::Observing_Error("Observing::Track: singular fit");
+      if(p != j){
+	for(size_t k=0; k<nc; k++) std::swap(a[nc*j+k], a[nc*p+k]);
+	for(size_t k=0; k<ny; k++) std::swap(b[ny*j+k], b[ny*p+k]);
+      }
+      for(size_t i=j+1; i<nc; i++){
+	double f = a[nc*i+j]/a[nc*j+j];
+	for(size_t k=j; k<nc; k++) a[nc*i+k] -= f*a[nc*j+k];
+	for(size_t k=0; k<ny; k++) b[ny*i+k] -= f*b[ny*j+k];
+      }
+    }
+
+    c.assign(ny, std::vector<double>(nc));
+    for(size_t k=0; k<ny; k++){
+      for(size_t j=nc; j-- > 0; ){
+	double sum = b[ny*j+k];
+	for(size_t i=j+1; i<nc; i++) sum -= a[nc*j+i]*c[k][i];
+	c[k][j] = sum/a[nc*j+j];
+      }
+    }
+  }
+
+}
+
+//! Constructor from a file; see load
+Observing::Track::Track(const std::string& file) : hasdist(false) {
+  load(file);
+}
+
+/** Reads a table of positions from a file, in the format described in the
+ * class documentation, and fits it. Throws an Observing_Error if the file
+ * cannot be read or makes no sense.
+ * \param file name of the file
+ */
+void Observing::Track::load(const std::string& file){
+
+  std::ifstream fin(file.c_str());
+  if(!fin) throw Observing_Error("Observing::Track::load: could not open " + file);
+
+  nm = file;
+  seg.clear();
+
+  std::vector<double> t;
+  std::vector<std::vector<double> > y(4);
+  std::string line, key;
+  int nline = 0, ndist = 0;
+  while(getline(fin, line)){
+    nline++;
+    std::istringstream istr(line);
+    if(!(istr >> key) || key[0] == '#') continue;
+
+    if(key == "name"){
+      getline(istr >> std::ws, nm);
+      continue;
+    }
+
+    istr.clear();
+    istr.str(line);
+    double mjd, ra, dec, dist;
+    if(!(istr >> mjd >> ra >> dec))
+      throw Observing_Error("Observing::Track::load: could not understand line " + Subs::str(nline) + " of " + file);
+    if(istr >> dist) ndist++;
+    else dist = 0.;
+
+    if(mjd > MJD2JD) mjd -= MJD2JD;
+    if(!t.empty() && mjd <= t.back())
+      throw Observing_Error("Observing::Track::load: times do not increase at line " + Subs::str(nline) + " of " + file);
+
+    const double DR = Constants::TWOPI/360.;
+    ra  *= 15.*DR;
+    dec *= DR;
+    t.push_back(mjd);
+    y[0].push_back(cos(dec)*cos(ra));
+    y[1].push_back(cos(dec)*sin(ra));
+    y[2].push_back(sin(dec));
+    y[3].push_back(dist);
+  }
+  fin.close();
+
+  if(t.size() < 2)
+    throw Observing_Error("Observing::Track::load: need at least 2 positions in " + file);
+  if(ndist != 0 && ndist != int(t.size()))
+    throw Observing_Error("Observing::Track::load: distances must be given for all or none of the positions in " + file);
+  hasdist = ndist > 0;
+
+  // Split into segments of about NINT intervals each, sharing end points
+  size_t nint = t.size() - 1;
+  size_t nseg = (nint + NINT - 1)/NINT;
+  std::vector<double> x;
+  std::vector<std::vector<double> > ys(4), c;
+  for(size_t s=0; s<nseg; s++){
+    size_t i1 = nint*s/nseg, i2 = nint*(s+1)/nseg;
+    Segment sg;
+    sg.t1 = t[i1];
+    sg.t2 = t[i2];
+    x.clear();
+    for(size_t k=0; k<4; k++) ys[k].clear();
+    for(size_t i=i1; i<=i2; i++){
+      x.push_back((2.*t[i]-sg.t1-sg.t2)/(sg.t2-sg.t1));
+      for(size_t k=0; k<4; k++) ys[k].push_back(y[k][i]);
+    }
+    chebfit(x, ys, std::min(NORD, int(i2-i1)), c);
+    sg.cx = c[0];
+    sg.cy = c[1];
+    sg.cz = c[2];
+    sg.cd = c[3];
+    seg.push_back(sg);
+  }
+}
+
+// Returns the segment covering a time and the argument of its polynomials
+const Observing::Track::Segment& Observing::Track::find(double mjd, double& x) const {
+  if(!covers(mjd))
+    throw Observing_Error("Observing::Track: MJD = " + Subs::str(mjd) + " is outside the table of " + nm);
+  size_t i = std::upper_bound(seg.begin(), seg.end(), mjd, [](double t, const Segment& s){return t < s.t1;}) - seg.begin();
+  const Segment& s = seg[i > 0 ? i-1 : 0];
+  x = (2.*mjd-s.t1-s.t2)/(s.t2-s.t1);
+  return s;
+}
+
+/** J2000 position at a time. Throws an Observing_Error if the time is
+ * outside the table.
+ * \param mjd the UTC MJD
+ * \param ra  RA, hours
+ * \param dec declination, degrees
+ */
+void Observing::Track::radec(double mjd, double& ra, double& dec) const {
+  double x;
+  const Segment& s = find(mjd, x);
+  double vx = chebyshev(s.cx, x), vy = chebyshev(s.cy, x), vz = chebyshev(s.cz, x);
+  const double DR = Constants::TWOPI/360.;
+  ra  = slaDranrm(atan2(vy, vx))/(15.*DR);
+  dec = atan2(vz, sqrt(vx*vx+vy*vy))/DR;
+}
+
+//! Distance in AU at a UTC MJD, 0 if the table has none
+double Observing::Track::distance(double mjd) const {
+  if(!hasdist) return 0.;
+  double x;
+  const Segment& s = find(mjd, x);
+  return chebyshev(s.cd, x);
+}
+
+/** Position in the sky of the target, as for Subs::Position::altaz.
+ * Refraction is for standard conditions at the height of the telescope.
+ * The airmass is 0 when the target is below the horizon.
+ * \param time the UTC time
+ * \param tel  the telescope
+ */
+Subs::Altaz Observing::Track::altaz(const Subs::Time& time, const Subs::Telescope& tel) const {
+  Context context;
+  return altaz(time, tel, context);
+}
+
+/** As altaz(time, tel), but taking the apparent place parameters from a
+ * Context, which saves recomputing them for nearby times.
+ * \param time    the UTC time
+ * \param tel     the telescope
+ * \param context working space of the calling thread
+ */
+Subs::Altaz Observing::Track::altaz(const Subs::Time& time, const Subs::Telescope& tel, Context& context) const {
+
+  OBSERVING_COUNT(ALTAZ);
+
+  const double DR = Constants::TWOPI/360.;
+  double ra, dec;
+  radec(time.mjd(), ra, dec);
+
+  double tt = time.mjd() + time.dtt()/Constants::DAY;
+  double ra_app, dec_app;
+  slaMapqkz(15.*DR*ra, DR*dec, context.amprms(tt), &ra_app, &dec_app);
+
+  double elong = DR*tel.longitude(), phi = DR*tel.latitude();
+  double ha    = slaDrange(slaGmst(time.mjd()) + elong + slaEqeqx(tt) - ra_app);
+  double az, el;
+  slaDe2h(ha, dec_app, phi, &az, &el);
+
+  double refa, refb, zobs;
+  slaRefcoq(278., 1013.25*exp(-tel.height()/8150.), 0.5, 0.55, &refa, &refb);
+  slaRefz(Constants::TWOPI/4.-el, refa, refb, &zobs);
+
+  Subs::Altaz altaz;
+  altaz.alt_true = el/DR;
+  altaz.alt_obs  = 90. - zobs/DR;
+  altaz.az       = slaDranrm(az)/DR;
+  altaz.ha       = ha/(15.*DR);
+  altaz.pa       = slaPa(ha, dec_app, phi)/DR;
+  altaz.airmass  = el > 0. ? slaAirmas(zobs) : 0.;
+  return altaz;
+}
+
+/** Computes the next time after start at which a moving target crosses
+ * altitude altaim. Since the target moves, the day after start (or as much
+ * of it as the table covers) is scanned in steps of 10 minutes and the
+ * crossing then refined by binary chop.
+ * \param obj    the target
+ * \param tel    the telescope
+ * \param start  time to start from
+ * \param altaim the altitude, degrees
+ * \param found  the time found
+ * \return false if no crossing is found
+ */
+bool Observing::startime(const Track& obj, const Subs::Telescope& tel, const Subs::Time& start,
+			 double altaim, Subs::Time& found){
+
+  const double STEP = 10./1440.;
+  if(!obj.covers(start.mjd())) return false;
+  double tmax = std::min(start.mjd()+1., obj.end());
+  double mjd1 = start.mjd(), mjd2 = mjd1, crit;
+  Context context;
+  bool   up   = obj.altaz(start,tel,context).alt_true > altaim;
+
+  Subs::Time time;
+  bool cross = false;
+  while(!cross && mjd1 < tmax){
+    mjd2 = std::min(mjd1 + STEP, tmax);
+    time.set(mjd2);
+    if((obj.altaz(time,tel,context).alt_true > altaim) != up)
+      cross = true;
+    else
+      mjd1 = mjd2;
+  }
+  if(!cross) return false;
+
+  while(mjd2-mjd1 > 1.e-5){
+    crit = (mjd1+mjd2)/2.;
+    time.set(crit);
+    if((obj.altaz(time,tel,context).alt_true > altaim) == up){
+      mjd1 = crit;
+    }else{
+      mjd2 = crit;
+    }
+  }
+  crit = (mjd1+mjd2)/2.;
+  found.set(crit);
+  return true;
+}
+
+/** As the standard when_visible, but for a moving target. Only the part of
+ * tstart to tend covered by the table is considered.
+ */
+bool Observing::when_visible(const Track& obj, const Subs::Telescope& telescope,
+			     const Subs::Time& tstart, const Subs::Time& tend, double airmass,
+			     Subs::Time& firstvis, Subs::Time& lastvis){
+
+  Subs::Time t1(std::max(tstart.mjd(), obj.start())), t2(std::min(tend.mjd(), obj.end()));
+  if(!obj.covers(t1.mjd()) || t2 < t1) return false;
+
+  double altaim = 90.-360.*acos(1./airmass)/Constants::TWOPI;
+
+  firstvis = t1;
+  if(obj.altaz(t1,telescope).alt_true < altaim &&
+     (!startime(obj, telescope, t1, altaim, firstvis) || firstvis > t2)) return false;
+
+  lastvis = t2;
+  firstvis.add_hour(0.001);
+  if(startime(obj, telescope, firstvis, altaim, lastvis) && lastvis > t2) lastvis = t2;
+  firstvis.add_hour(-0.001);
+  return true;
+}
@@ -0,0 +1,295 @@
+/*
+
+!!sphinx
+
+*visibility* -- calendar of when stars satisfy a set of constraints
+===================================================================
+
+*visibility* lists, night by night, when each star meets a rule made of
+constraints on airmass, Sun altitude, hour angle, distance from the Moon,
+orbital phase and UT, combined with & (and), | (or) and parentheses, e.g.
+
+  airmass(2) & sun(-15) & (moon(30) | phase(0.9,1.1))
+
+The constraints are:
+
+  airmass(a)    -- airmass less than a
+
+  sun(s)        -- Sun below s degrees
+
+  ha(h1,h2)     -- hour angle from h1 to h2 hours
+
+  moon(d)       -- at least d degrees from the Moon while it is up
+
+  phase(p1,p2)  -- orbital phase from p1 to p2
+
+  ut(u1,u2)     -- UT from u1 to u2 hours
+
+Ranges whose second value is less than the first run through the wrap point,
+e.g. ut(22,2). The rule is evaluated on a grid of times from sunset to
+sunrise (the Sun at -1 degrees, so twilight is covered and should be ruled
+out with sun() if it is not wanted; in polar night the grid covers the
+whole day, and days when the Sun does not set are skipped) shared by all
+stars, on which the Sun and Moon are computed only once. Cheap constraints
+are tried first and each constraint is only evaluated at times that are
+still in contention, so that, for instance, the orbital phase is never
+computed when the star is too low.
+
+Invocation:
+  visibility stars rule telescope startdate enddate step
+
+Arguments:
+
+  stars :
+    Data file of star positions and ephemerides. Stars without ephemerides
+    are skipped if the rule involves the orbital phase.
+
+  rule :
+    The constraints to satisfy, as above
+
+  telescope :
+    e.g. wht
+
+  startdate :
+    Date of first night, e.g. 1/5/2002 = 1st May 2002
+
+  enddate :
+    Date of last night
+
+  step :
+    Spacing of the time grid, minutes
+
+  threads :
+    Number of threads to use (hidden, default 0, meaning one per core)
+
+  trace :
+    Name of a file to write a timeline of the run to, in the Chrome
+    trace-event JSON format read by chrome://tracing and Perfetto, showing
+    when each thread loads, computes and writes; 'none' for no timeline.
+    (hidden, default none)
+
+!!sphinx
+
+*/
+
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <exception>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "trm/subs.h"
+#include "trm/input.h"
+#include "trm/date.h"
+#include "trm/time.h"
+#include "trm/telescope.h"
+#include "trm/ephem.h"
+#include "trm/position.h"
+#include "trm/star.h"
+#include "trm/binary_star.h"
+#include "trm/observing.h"
+#include "trm/constraint.h"
+#include "trm/batch.h"
+#include "trm/trace.h"
+#include "trm/writer.h"
+
+// Formats the UT of an MJD as hh:mm
+std::string hhmm(double mjd){
+  int min = int(floor(1440.*(mjd-floor(mjd))+0.5)) % 1440;
+  std::ostringstream ostr;
+  ostr << std::setfill('0') << std::setw(2) << min/60 << ":" << std::setw(2) << min % 60;
+  return ostr.str();
+}
+
+int main(int argc, char *argv[]){
+
+  try{
+
+    // Construct Input object
+
+    Subs::Input input(argc, argv, Observing::OBSERVING_ENV, Observing::OBSERVING_DIR);
+
+    // sign-in variables (equivalent to ADAM .ifl files)
+
+    input.sign_in("stars",     Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("rule",      Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("telescope", Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("startdate", Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("enddate",   Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("step",      Subs::Input::LOCAL,  Subs::Input::PROMPT);
+    input.sign_in("threads",   Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("trace",     Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+
+    // Get input
+
+    std::string starfile;
+    input.get_value("stars", starfile, "stardata", "file of star positions and ephemerides");
+    std::string strace;
+    input.get_value("trace", strace, "none", "file for a trace-event timeline of the run ('none' to ignore)");
+    if(strace != "none") Observing::Trace::start(strace);
+
+    // Load star data
+
+    std::vector<std::unique_ptr<Subs::Star> > star;
+    {
+      OBSERVING_SPAN("load");
+      std::ifstream file(starfile.c_str());
+      if(!file) throw std::string("Could not open file = ") + starfile;
+
+      Subs::Star   s;
+      Subs::Ephem  eph;
+      while(file >> s){
+	if(file >> eph){
+	  star.push_back(std::unique_ptr<Subs::Star>(new Subs::Binary(s,eph)));
+	}else{
+	  if(file.bad()){
+	    file.close();
+	    throw std::string("File stream corrupted");
+	  }
+	  file.clear();
+	  star.push_back(std::unique_ptr<Subs::Star>(new Subs::Star(s)));
+	}
+      }
+      file.close();
+    }
+    std::cout << "Found data on " << star.size() << " stars" << std::endl;
+    if(star.size() == 0)
+      throw std::string("Cannot have 0 stars!");
+
+    size_t lmax = 4;
+    for(size_t j=0; j<star.size(); j++) lmax = std::max(lmax,star[j]->name().length());
+
+    std::string rule;
+    input.get_value("rule", rule, "airmass(2) & sun(-15)", "constraints to satisfy");
+    Observing::Constraint_Ptr constraint = Observing::parse_constraint(rule);
+
+    std::string stelescope;
+    input.get_value("telescope", stelescope, "WHT", "telescope name");
+    Subs::Telescope telescope(stelescope);
+
+    std::string sdate;
+    input.get_value("startdate", sdate, "17 Nov 1961", "date at start of first night");
+    Subs::Date start(sdate);
+    input.get_value("enddate", sdate, "17 Nov 1961", "date at start of last night");
+    Subs::Date end(sdate);
+    if(start > end) throw std::string("Can't have a start date after the end date!");
+
+    double step;
+    input.get_value("step", step, 5., 0.1, 600., "spacing of time grid (minutes)");
+    int nthread;
+    input.get_value("threads", nthread, 0, 0, 1024, "number of threads (0 for one per core)");
+
+    // Ephemerides of the stars that have them
+
+    std::vector<const Subs::Ephem*> ephem(star.size(), (const Subs::Ephem*)0);
+    for(size_t j=0; j<star.size(); j++)
+      if(star[j]->has_ephem()) ephem[j] = dynamic_cast<const Subs::Binary*>(star[j].get());
+
+    int nday = int(end.mjd()-start.mjd()+1.5);
+    Subs::Date date = start;
+    Observing::Night night;
+    std::vector<double> total(star.size(), 0.);
+    std::vector<char> skip(star.size(), 0);
+    std::vector<std::vector<std::pair<double,double> > > ivals(star.size());
+    std::vector<std::string> error(star.size());
+    Observing::Writer out(std::cout);
+
+    for(int n=0; n<nday; n++, date.add_day(1)){
+
+      OBSERVING_SPAN_N("night", n);
+      // Only sunset and sunrise are used, so the twilight is put at sunset.
+      // If there is no sunset the Sun is either up or down all day.
+      if(!Observing::night(telescope, date, -1., night)){
+	Subs::Time noon(date);
+	noon.add_hour(12.-telescope.longitude()/15.);
+	Subs::Time midnight = noon;
+	midnight.add_hour(12.);
+	if(Observing::sun_altaz(telescope, midnight).alt_true > -1.){
+	  out.flush();
+	  std::cerr << "The Sun does not set on the night starting " << date << "; skipped" << std::endl;
+	  continue;
+	}
+	night.sunset = night.twiend = noon;
+	noon.add_hour(24.);
+	night.sunrise = night.twistart = noon;
+      }
+
+      out << "\nNight starting " << date << ", sunset to sunrise = "
+	  << hhmm(night.sunset.mjd()) << " to " << hhmm(night.sunrise.mjd()) << "\n";
+      out.endl();
+
+      Observing::Grid grid(telescope, night.sunset, night.sunrise, step);
+      grid.prepare(constraint->needs_moon());
+
+      // The stars are evaluated in parallel, sharing the grid, then reported in order
+      Observing::parallel_for(star.size(), nthread, [&](size_t j, Observing::Context&){
+	  OBSERVING_SPAN_N("target", j);
+	  ivals[j].clear();
+	  if(skip[j]) return;
+	  Observing::Evaluation eval(grid, *star[j], ephem[j]);
+	  std::vector<char> mask(grid.size(), 1);
+	  try{
+	    constraint->apply(eval, mask);
+	  }
+	  catch(const Observing::Observing_Error& err){
+	    error[j] = err;
+	    return;
+	  }
+	  grid.intervals(mask, ivals[j]);
+	});
+
+      OBSERVING_SPAN("output");
+      for(size_t j=0; j<star.size(); j++){
+	if(skip[j]) continue;
+	if(!error[j].empty()){
+	  out.flush();
+	  std::cerr << star[j]->name() << ": " << error[j] << "; skipped" << std::endl;
+	  skip[j] = 1;
+	  continue;
+	}
+	if(ivals[j].empty()) continue;
+
+	double hours = 0.;
+	for(size_t i=0; i<ivals[j].size(); i++) hours += 24.*(ivals[j][i].second-ivals[j][i].first);
+	total[j] += hours;
+
+	out.fill(' ').width(lmax).left() << star[j]->name() << " ";
+	out.left(false).fixed().precision(2).width(5) << hours << " h ";
+	out.fixed(false);
+	for(size_t i=0; i<ivals[j].size(); i++)
+	  out << " " << hhmm(ivals[j][i].first) << "-" << hhmm(ivals[j][i].second);
+	out.endl();
+      }
+    }
+
+    out << "\nTotal hours over the run:\n";
+    out.endl();
+    for(size_t j=0; j<star.size(); j++){
+      if(!skip[j]){
+	out.fill(' ').width(lmax).left() << star[j]->name() << " ";
+	out.left(false).fixed().precision(2).width(6) << total[j];
+	out.endl();
+      }
+    }
+    out.fixed(false);
+    out.flush();
+
+    Observing::Trace::stop();
+  }
+
+  catch(const std::string& str){
+    std::cerr << str << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  catch(const std::exception& exc){
+    std::cerr << exc.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+}
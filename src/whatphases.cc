@@ -9,20 +9,65 @@
 observed.
 
 Invocation:
-  whatphases stars [device]
+  whatphases stars [device] [nbin ngap]
 
 Arguments:
 
   stars :
     Data file of star positions and ephemerides
 
+  device :
+    Plot device
+
+  nbin :
+    Number of phase bins in the coverage histogram printed for each star
+    (hidden, default 10)
+
+  ngap :
+    Number of the largest unobserved phase ranges to print for each star
+    (hidden, default 3)
+
+  threads :
+    Number of threads used to read the .times files (hidden, default 0,
+    meaning one per core)
+
+  cache :
+    Keep the phases computed from each <star>.times file in <star>.times.cache
+    (hidden, default true). Since logs are only ever appended to, later runs
+    then only need to convert lines added since the last one. The cache is
+    ignored and rebuilt if the ephemeris or position of the star changes or
+    if the end of the part of the file already cached has been altered.
+
+  stats :
+    Counts of the expensive calls and the time spent in each phase of the
+    run: 'none', 'text' for a table or 'json' for JSON, both on stderr, or
+    the name of a file to write JSON to. Only collected if the package was
+    configured with --enable-stats. (hidden, default none)
+
+Three types of line in a .times file are recognised, anything else being
+ignored::
+
+  Phase 0.85 1.12
+  UT 11 May 2032, 01:03:34 to 11 May 2032, 03:12:00 [poor]
+  JD 2453773.488 to 2453773.602
+
+Files are memory mapped and parsed in place; UT times in the format above
+are decoded directly, others are passed on to the general time parser.
+
+For each star with a .times file, *whatphases* also prints the fraction of the
+orbit that has been covered, both including and excluding ranges flagged as
+poor, the largest gaps and a histogram of the number of times each phase has
+been observed.
+
 !!sphinx
 
 */
 
 #include <cstdlib>
 #include <string>
+#include <exception>
 #include <iostream>
+#include <iomanip>
 #include <sstream>
 #include <vector>
 
@@ -36,8 +81,12 @@ Arguments:
 #include "trm/ephem.h"
 #include "trm/position.h"
 #include "trm/star.h"
-#include "trm/binary_star.h"
 #include "trm/observing.h"
+#include "trm/coverage.h"
+#include "trm/times_file.h"
+#include "trm/batch.h"
+#include "trm/catalogue.h"
+#include "trm/stats.h"
 
 struct Pr{
   Pr() : plo(0.), phi(1.), ci(1), ptype(1) {}
@@ -57,226 +106,154 @@ int main(int argc, char *argv[]){
     // sign-in variables (equivalent to ADAM .ifl files)
     input.sign_in("stars",  Subs::Input::GLOBAL, Subs::Input::PROMPT);
     input.sign_in("device", Subs::Input::GLOBAL, Subs::Input::PROMPT);
+    input.sign_in("nbin",   Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("ngap",   Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("threads", Subs::Input::LOCAL, Subs::Input::NOPROMPT);
+    input.sign_in("cache",  Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
+    input.sign_in("stats",  Subs::Input::LOCAL,  Subs::Input::NOPROMPT);
 
     // Get input values
     std::string starfile;
     input.get_value("stars", starfile, "stardata", "file of star positions and ephemerides");
 
     // Load star data
-    std::ifstream file(starfile.c_str());
-    if(!file) throw std::string("Could not open file = ") + starfile;
-    Subs::Star   s;
-    Subs::Ephem  eph;
-    std::vector<Subs::Binary>  binary;
-    while(file >> s){
-      if(file >> eph){
-	binary.push_back(Subs::Binary(s,eph));
-      }else{
-	file.close();
-	throw std::string("whatphases only accepts stars with ephemerides");
-      }
+    Observing::Catalogue catalogue;
+    {
+      OBSERVING_TIME(LOAD);
+      catalogue.load(starfile);
     }
-    file.close();
-    std::cout << "Found data on " << binary.size() << " stars" << std::endl;
-    if(binary.size() == 0) throw std::string("Cannot have 0 stars!");
+    for(size_t n=0; n<catalogue.size(); n++)
+      if(!catalogue.has_ephem(n))
+	throw std::string("whatphases only accepts stars with ephemerides");
+    std::cout << "Found data on " << catalogue.size() << " stars" << std::endl;
+    if(catalogue.size() == 0) throw std::string("Cannot have 0 stars!");
 
     std::string device;
     input.get_value("device", device, "/xs", "plot device");
 
-    // Star data loaded. Now look for files of the form 'star.times'
-    // listing the observing times
+    int nbin;
+    input.get_value("nbin", nbin, 10, 1, 1000, "number of bins for phase coverage histograms");
+    int ngap;
+    input.get_value("ngap", ngap, 3, 0, 1000, "number of largest phase gaps to report");
+
+    int nthreads;
+    input.get_value("threads", nthreads, 0, 0, 1024, "number of threads to read .times files (0 for one per core)");
 
-    Subs::Plot plot(device);
+    bool cache;
+    input.get_value("cache", cache, true, "keep the phases computed from each .times file in a .times.cache file?");
 
-    cpgsch(1.5);
-    cpgscf(2);
-    cpgsci(4);
-    cpgsvp(0.25,0.97,0.15,0.87);
-    cpgswin(0.,1.0001,0.,binary.size()+1);
-    cpgbox("BCNST",0.,0," ",0.,0);
-    cpgsci(2);
-    cpglab("Orbital phase"," ","Phase coverage");    
-    cpgsci(1);
+    std::string sstats;
+    input.get_value("stats", sstats, "none", "statistics to report (none, text, json or a file for JSON)");
+
+    // Star data loaded. Now look for files of the form 'star.times'
+    // listing the observing times. These are read and converted to phase
+    // in parallel, one star per thread at a time.
 
     // Dummy telescope to allow the barycentric correction to work.
     Subs::Telescope telescope("WHT");
 
-    const double MJD2JD = 2400000.5;
-    
-    for(size_t nfile=0; nfile<binary.size(); nfile++){
-      cpgsci(2);
-      float y = float(binary.size()-nfile);
-      cpgptxt(-0.02,y,0.,1.,binary[nfile].name().c_str());
-
-      std::string file_of_times = binary[nfile].name() + ".times";
-      std::ifstream fstr(file_of_times.c_str());
-      cpgsci(1);
-      float p1, p2;
-      bool plotline = false, poor = false;
-      while(fstr){
-	std::string line;
-	getline(fstr,line);
-	if(fstr){
-	  plotline = poor = false;
-	  if(line.find("Phase ") == 0){
-
-	    std::istringstream istr(line.substr(6));
-	    istr >> p1 >> p2;
-	    if(!istr) throw std::string("Failed to translate a phase range from ") + file_of_times;
-	    plotline = true;
-
-	  }else if(line.find("UT ") == 0){
-
-	    std::string::size_type n = line.find(" to ");
-	    if(n == std::string::npos) 
-	      throw std::string("Could no find ' to ' in a UT range from ") + file_of_times;
-	    std::string stime1 = line.substr(3,n-3); 
-	    std::string stime2;
-	    std::string::size_type n1 = line.find(" poor");
-	    if(n1 == std::string::npos){
-	      stime2 = line.substr(n+4);
-	    }else{
-	      stime2 = line.substr(n+4,n1-n-4);
-	      poor = true; // indicate poor conditions
-	    }
-	    Subs::Time time1(stime1.substr(stime1.find_first_not_of(" \t")));
-	    Subs::Time time2(stime2.substr(stime2.find_first_not_of(" \t")));
-	    
-	    if(time1 > time2) throw std::string("Times out of order in ") + file_of_times;
-	    
-	    // compute heliocentric corrections with
-	    // single sun position.
-	    
-	    Subs::Time tim;
-	    tim.set((time1.mjd()+time2.mjd())/2.);
-	    
-	    double off;
-	    if(binary[nfile].get_tscale() == Subs::Ephem::HJD || binary[nfile].get_tscale() == Subs::Ephem::HMJD){
-	      off = binary[nfile].tcorr_hel(tim, telescope)/Constants::DAY;
-	    }else if(binary[nfile].get_tscale() == Subs::Ephem::BJD || binary[nfile].get_tscale() == Subs::Ephem::BMJD){
-	      off = (tim.dtt() + binary[nfile].tcorr_bar(tim, telescope))/Constants::DAY;
-	    }else{
-	      throw std::string("Could not recognize type of timescale for star = " + binary[nfile].name());
-	    }
-	    
-	    if(binary[nfile].get_tscale() == Subs::Ephem::HJD || binary[nfile].get_tscale() == Subs::Ephem::BJD){
-	      p1 = binary[nfile].phase(MJD2JD+time1.mjd()+off);
-	      p2 = binary[nfile].phase(MJD2JD+time2.mjd()+off);
-	    }else{
-	      p1 = binary[nfile].phase(time1.mjd()+off);
-	      p2 = binary[nfile].phase(time2.mjd()+off);
-	    }
-
-	    plotline = true;
-
-	  }else if(line.find("JD ") == 0){
-
-	    std::string::size_type n = line.find(" to ");
-	    if(n == std::string::npos) 
-	      throw std::string("Could no find ' to ' in a JD range from ") + file_of_times;
-	    std::string temp;
-	    double mjd1, mjd2;
-	    std::istringstream istr(line.substr(3));
-	    istr >> mjd1 >> temp >> mjd2;
-	    mjd1 -= 2400000.5;
-	    mjd2 -= 2400000.5;
-	    Subs::Time time1(mjd1), time2(mjd2);
-	    
-	    if(time1 > time2) throw std::string("Times out of order in ") + file_of_times;
-	    
-	    // Compute heliocentric corrections with
-	    // single sun position.
-	    
-	    Subs::Time tim;
-	    tim.set((mjd1+mjd2)/2.);
-	    
-	    double off;
-	    if(binary[nfile].get_tscale() == Subs::Ephem::HJD || binary[nfile].get_tscale() == Subs::Ephem::HMJD){
-	      off = binary[nfile].tcorr_hel(tim, telescope)/Constants::DAY;
-	    }else if(binary[nfile].get_tscale() == Subs::Ephem::BJD || binary[nfile].get_tscale() == Subs::Ephem::BMJD){
-	      off = (tim.dtt() + binary[nfile].tcorr_bar(tim, telescope))/Constants::DAY;
-	    }else{
-	      throw std::string("Could not recognize type of timescale for star = " + binary[nfile].name());
-	    }	    
-
-	    if(binary[nfile].get_tscale() == Subs::Ephem::HJD || binary[nfile].get_tscale() == Subs::Ephem::BJD){
-	      p1 = binary[nfile].phase(MJD2JD+time1.mjd()+off);
-	      p2 = binary[nfile].phase(MJD2JD+time2.mjd()+off);
-	    }else{
-	      p1 = binary[nfile].phase(time1.mjd()+off);
-	      p2 = binary[nfile].phase(time2.mjd()+off);
-	    }
-	    plotline = true;
+    std::vector<std::vector<Observing::Phase_Range> > ranges(catalogue.size());
+    {
+      OBSERVING_TIME(EVENTS);
+      Observing::parallel_for(catalogue.size(), nthreads, [&](size_t n, Observing::Context&){
+	  if(cache)
+	    Observing::read_times_cached(catalogue.name(n) + ".times", catalogue.position(n), catalogue.ephem(n), telescope, ranges[n]);
+	  else
+	    Observing::read_times(catalogue.name(n) + ".times", catalogue.position(n), catalogue.ephem(n), telescope, ranges[n]);
+	});
+    }
 
-	  }
+    {
+      OBSERVING_TIME(OUTPUT);
+      Subs::Plot plot(device);
 
-	  if(plotline){
+      cpgsch(1.5);
+      cpgscf(2);
+      cpgsci(4);
+      cpgsvp(0.25,0.97,0.15,0.87);
+      cpgswin(0.,1.0001,0.,catalogue.size()+1);
+      cpgbox("BCNST",0.,0," ",0.,0);
+      cpgsci(2);
+      cpglab("Orbital phase"," ","Phase coverage");    
+      cpgsci(1);
 
-	    cpgsci(3);
-	    // Finally plot
-	    int ip1 = int(floor(p1));
-	    p1 -= ip1;
-	    p2 -= ip1;
-	    float tick = 1./4.;
-	    cpgsls(1);
-	    cpgmove(p1,y-tick);
-	    cpgdraw(p1,y+tick);
+      for(size_t nfile=0; nfile<catalogue.size(); nfile++){
+	cpgsci(2);
+	float y = float(catalogue.size()-nfile);
+	cpgptxt(-0.02,y,0.,1.,catalogue.name(nfile).c_str());
+
+	cpgsci(1);
+	double p1, p2;
+	bool poor;
+	Observing::Coverage coverage;
+	for(size_t i=0; i<ranges[nfile].size(); i++){
+	  p1   = ranges[nfile][i].p1;
+	  p2   = ranges[nfile][i].p2;
+	  poor = ranges[nfile][i].poor;
+	  coverage.add(p1, p2, poor);
+
+	  cpgsci(3);
+	  // Finally plot
+	  int ip1 = int(floor(p1));
+	  p1 -= ip1;
+	  p2 -= ip1;
+	  float tick = 1./4.;
+	  cpgsls(1);
+	  cpgmove(p1,y-tick);
+	  cpgdraw(p1,y+tick);
+	  if(poor) cpgsls(2);
+	  cpgdraw(p1,y);
+	  cpgdraw(std::min(1.,p2),y);
+	  cpgsls(1);
+	  cpgmove(std::min(1.,p2),y-tick);
+	  cpgdraw(std::min(1.,p2),y+tick);
+	  if(p2 > 1.){
+	    cpgmove(0.f,y-tick);
+	    cpgdraw(0.f,y+tick);
 	    if(poor) cpgsls(2);
-	    cpgdraw(p1,y);
-	    cpgdraw(std::min(1.f,p2),y);
+	    cpgmove(0.f,y);
+	    cpgdraw(std::min(1.,p2-1.),y);
 	    cpgsls(1);
-	    cpgmove(std::min(1.f,p2),y-tick);
-	    cpgdraw(std::min(1.f,p2),y+tick);
-	    if(p2 > 1.){
-	      cpgmove(0.f,y-tick);
-	      cpgdraw(0.f,y+tick);
-	      if(poor) cpgsls(2);
-	      cpgmove(0.f,y);
-	      cpgdraw(std::min(1.f,p2-1.f),y);
-	      cpgsls(1);
-	      cpgmove(std::min(1.f,p2-1.f),y-tick);
-	      cpgdraw(std::min(1.f,p2-1.f),y+tick);
-	    }
+	    cpgmove(std::min(1.,p2-1.),y-tick);
+	    cpgdraw(std::min(1.,p2-1.),y+tick);
 	  }
 	}
-      }
-      fstr.close();
-
-      // Over plot the last one in green
-      if(plotline){
-
-	cpgsci(3);
-	int ip1 = int(floor(p1));
-	p1 -= ip1;
-	p2 -= ip1;
-	float tick = 1./4.;
-	cpgsls(1);
-	cpgmove(p1,y-tick);
-	cpgdraw(p1,y+tick);
-	if(poor) cpgsls(2);
-	cpgdraw(p1,y);
-	cpgdraw(std::min(1.f,p2),y);
-	cpgsls(1);
-	cpgmove(std::min(1.f,p2),y-tick);
-	cpgdraw(std::min(1.f,p2),y+tick);
-	if(p2 > 1.){
-	  cpgmove(0.f,y-tick);
-	  cpgdraw(0.f,y+tick);
-	  if(poor) cpgsls(2);
-	  cpgmove(0.f,y);
-	  cpgdraw(std::min(1.f,p2-1.f),y);
-	  cpgsls(1);
-	  cpgmove(std::min(1.f,p2-1.f),y-tick);
-	  cpgdraw(std::min(1.f,p2-1.f),y+tick);
+
+	// Report the coverage
+	if(coverage.size()){
+	  std::cout << "\n" << catalogue.name(nfile) << ": " << coverage.size() << " phase ranges, "
+		    << std::setprecision(4) << 100.*coverage.fraction() << "% of orbit covered, " 
+		    << 100.*coverage.fraction(true) << "% excluding poor conditions" << std::endl;
+
+	  std::vector<Observing::Coverage::Gap> gap;
+	  coverage.gaps(gap);
+	  for(size_t i=0; i<gap.size() && int(i)<ngap; i++){
+	    double hi = gap[i].hi > 1. ? gap[i].hi - 1. : gap[i].hi;
+	    std::cout << "  gap " << i+1 << ": " << std::setprecision(4) << gap[i].lo << " to " 
+		      << hi << " (" << gap[i].length() << ")" << std::endl;
+	  }
+
+	  std::vector<double> hist;
+	  coverage.histogram(nbin, hist);
+	  std::cout << "  times observed per " << std::setprecision(4) << 1./nbin << " in phase:";
+	  for(int i=0; i<nbin; i++)
+	    std::cout << " " << std::setprecision(3) << hist[i];
+	  std::cout << std::endl;
 	}
       }
     }
+
+    Observing::Stats::report(sstats);
   }
 
   catch(const std::string& str){
     std::cerr << "Exception: " << str << std::endl;
     exit(EXIT_FAILURE);
   }
+  catch(const std::exception& exc){
+    std::cerr << "Exception: " << exc.what() << std::endl;
+    exit(EXIT_FAILURE);
+  }
   
 }
 
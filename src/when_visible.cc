@@ -7,15 +7,22 @@ if
 
 */
 
+#include <cmath>
+#include <algorithm>
 #include "trm/constants.h"
 #include "trm/observing.h"
+#include "trm/moon.h"
+#include "trm/stats.h"
+#include "trm/trace.h"
 
 bool Observing::when_visible(const Subs::Position& obj, const Subs::Telescope& telescope, 
 			     const Subs::Time& tstart, const Subs::Time& tend, double airmass,
 			     Subs::Time& firstvis, Subs::Time& lastvis){
 
+  OBSERVING_SPAN("when_visible");
   double altaim   = 90.-360.*acos(1./airmass)/Constants::TWOPI;
   double airstart = obj.altaz(tstart,telescope).alt_true;
+  OBSERVING_COUNT(ALTAZ);
 
   firstvis = tstart;
   if(airstart < altaim && 
@@ -27,3 +34,56 @@ bool Observing::when_visible(const Subs::Position& obj, const Subs::Telescope& t
   firstvis.add_hour(-0.001);
   return true;
 }
+
+/*
+
+As above, but also keeping at least moonsep degrees from the Moon while it
+is up. The Moon is checked every 0.1 hours through the period of low
+airmass and the boundaries refined by bisection. Should the object come
+too close to the Moon in the middle of the period, only the first part
+that is far enough from it is returned.
+
+*/
+
+bool Observing::when_visible(const Subs::Position& obj, const Subs::Telescope& telescope, 
+			     const Subs::Time& tstart, const Subs::Time& tend, double airmass,
+			     const Moon& moon, double moonsep, Subs::Time& firstvis, Subs::Time& lastvis){
+
+  if(!when_visible(obj, telescope, tstart, tend, airmass, firstvis, lastvis)) return false;
+  if(moonsep <= 0.) return true;
+
+  const double STEP = 0.1/24., ACC = 1.e-4/24.;
+  double t1 = firstvis.mjd(), t2 = lastvis.mjd();
+  int nstep = std::max(1, int(ceil((t2-t1)/STEP)));
+  double dt = (t2-t1)/nstep;
+
+  // first acceptable time
+  int i = 0;
+  while(i <= nstep && moon.too_close(obj, t1+dt*i, moonsep)) i++;
+  if(i > nstep) return false;
+  double first = t1 + dt*i;
+  if(i > 0){
+    double lo = first - dt, hi = first;
+    while(hi - lo > ACC){
+      double mid = (lo+hi)/2.;
+      if(moon.too_close(obj, mid, moonsep)) lo = mid; else hi = mid;
+    }
+    first = hi;
+  }
+
+  // and the last one after it
+  while(i <= nstep && !moon.too_close(obj, t1+dt*i, moonsep)) i++;
+  double last = t2;
+  if(i <= nstep){
+    double lo = t1 + dt*(i-1), hi = t1 + dt*i;
+    while(hi - lo > ACC){
+      double mid = (lo+hi)/2.;
+      if(moon.too_close(obj, mid, moonsep)) hi = mid; else lo = mid;
+    }
+    last = lo;
+  }
+
+  firstvis.set(first);
+  lastvis.set(last);
+  return true;
+}
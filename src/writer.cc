@@ -0,0 +1,167 @@
+// Observing::Writer, buffered text output with the formatting of an
+// ostream, and Observing::Columns, tables saved by column in binary.
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#if __cplusplus >= 201703L
+#include <charconv>
+#endif
+#include "trm/observing.h"
+#include "trm/writer.h"
+
+/** Constructor.
+ * \param ostr the stream to write to
+ * \param size size of the buffer, bytes
+ */
+Observing::Writer::Writer(std::ostream& ostr, size_t size) :
+  ostr(ostr), buff(size > 64 ? size : 64), nbuff(0), nprec(int(ostr.precision())), nwidth(0), cfill(ostr.fill()),
+  lft(ostr.flags() & std::ios_base::left), fxd((ostr.flags() & std::ios_base::floatfield) == std::ios_base::fixed) {}
+
+Observing::Writer::~Writer(){
+  flush();
+}
+
+/** Sends the buffer to the stream and leaves the stream's precision,
+ * fill, justification and fixed flag as the Writer has them, so that
+ * output carries on in the same way if the stream is used directly.
+ */
+void Observing::Writer::flush(){
+  if(nbuff){
+    ostr.write(&buff[0], nbuff);
+    nbuff = 0;
+  }
+  ostr.precision(nprec);
+  ostr.fill(cfill);
+  ostr.setf(lft ? std::ios_base::left : std::ios_base::right, std::ios_base::adjustfield);
+  if(fxd)
+    ostr.setf(std::ios_base::fixed, std::ios_base::floatfield);
+  else
+    ostr.unsetf(std::ios_base::floatfield);
+  ostr.flush();
+}
+
+std::ios_base::fmtflags Observing::Writer::flags() const {
+  return (lft ? std::ios_base::left : std::ios_base::right) | (fxd ? std::ios_base::fixed : std::ios_base::fmtflags(0)) | std::ios_base::dec;
+}
+
+void Observing::Writer::append(const char* str, size_t n){
+  if(n > buff.size() - nbuff){
+    flush();
+    if(n > buff.size()){
+      ostr.write(str, n);
+      return;
+    }
+  }
+  memcpy(&buff[nbuff], str, n);
+  nbuff += n;
+}
+
+void Observing::Writer::pad(const char* str, size_t n){
+  size_t npad = nwidth > int(n) ? nwidth - n : 0;
+  nwidth = 0;
+  if(lft) append(str, n);
+  for(size_t i=0; i<npad; i++) put(cfill);
+  if(!lft) append(str, n);
+}
+
+/** Formats a double as operator<< would: like printf's %g with the
+ * precision as the number of significant figures, or %f with it as the
+ * number of decimals if fixed.
+ */
+Observing::Writer& Observing::Writer::operator<<(double x){
+  char str[512];
+  int n;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+  // The general and fixed formats of to_chars with a precision are
+  // defined to be those of printf
+  std::to_chars_result res = std::to_chars(str, str+sizeof(str), x, fxd ? std::chars_format::fixed : std::chars_format::general,
+					   nprec < 0 ? 6 : nprec);
+  n = res.ec == std::errc() ? int(res.ptr - str) : snprintf(str, sizeof(str), fxd ? "%.*f" : "%.*g", nprec < 0 ? 6 : nprec, x);
+#else
+  n = snprintf(str, sizeof(str), fxd ? "%.*f" : "%.*g", nprec < 0 ? 6 : nprec, x);
+#endif
+  if(n < 0 || n >= int(sizeof(str))) return via_stream(x);
+  pad(str, n);
+  return *this;
+}
+
+Observing::Writer& Observing::Writer::operator<<(long n){
+  char str[32];
+  int len = snprintf(str, sizeof(str), "%ld", n);
+  pad(str, len);
+  return *this;
+}
+
+Observing::Writer& Observing::Writer::operator<<(unsigned long n){
+  char str[32];
+  int len = snprintf(str, sizeof(str), "%lu", n);
+  pad(str, len);
+  return *this;
+}
+
+Observing::Writer& Observing::Writer::operator<<(char c){
+  pad(&c, 1);
+  return *this;
+}
+
+Observing::Writer& Observing::Writer::operator<<(const char* str){
+  pad(str, strlen(str));
+  return *this;
+}
+
+Observing::Writer& Observing::Writer::operator<<(const std::string& str){
+  pad(str.data(), str.length());
+  return *this;
+}
+
+/** Constructor.
+ * \param names the names of the columns
+ */
+Observing::Columns::Columns(const std::vector<std::string>& names) :
+  cnames(names), data(names.size()), nrow(0) {}
+
+/** Adds a row.
+ * \param row one value for each column, in order
+ */
+void Observing::Columns::add(const double* row){
+  for(size_t i=0; i<data.size(); i++) data[i].push_back(row[i]);
+  nrow++;
+}
+
+namespace {
+
+  void put_string(std::ofstream& fout, const std::string& str){
+    uint32_t len = str.length();
+    fout.write((const char*)&len, sizeof(len));
+    fout.write(str.data(), len);
+  }
+}
+
+/** Writes the table in the format given in the class documentation.
+ * Throws an Observing_Error if the file cannot be written.
+ * \param file the file to write to
+ */
+void Observing::Columns::write(const std::string& file) const {
+
+  std::ofstream fout(file.c_str(), std::ios::out | std::ios::binary);
+  if(!fout) throw Observing_Error("Observing::Columns::write: could not open " + file);
+
+  fout.write("OBSCOL01", 8);
+  uint32_t ncol = cnames.size();
+  uint64_t nr   = nrow;
+  fout.write((const char*)&ncol, sizeof(ncol));
+  fout.write((const char*)&nr,   sizeof(nr));
+  for(size_t i=0; i<cnames.size(); i++) put_string(fout, cnames[i]);
+  uint32_t nname = tnames.size();
+  fout.write((const char*)&nname, sizeof(nname));
+  for(size_t i=0; i<tnames.size(); i++) put_string(fout, tnames[i]);
+  for(size_t i=0; i<data.size(); i++)
+    if(nrow) fout.write((const char*)&data[i][0], nrow*sizeof(double));
+
+  if(!fout) throw Observing_Error("Observing::Columns::write: failed to write " + file);
+}
@@ -0,0 +1,274 @@
+// writercheck: checks that Observing::Writer gives text identical to the
+// std::ostream code that it replaced in the tables of ephemeris, visibility,
+// nextevents, multisite, gapfill and schedule. Each table is printed both
+// ways, with the manipulators of the old code and with the calls of the new,
+// over a range of awkward numbers, and the two compared line by line. Run
+// by "make check"; it exits with a failure status at the first difference.
+
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <limits>
+
+#include "trm/writer.h"
+
+namespace {
+
+  // stands in for Subs::Time and the like: anything formatted by its own
+  // operator<< with whatever settings the stream has at the time
+  struct Stamp {
+    double mjd;
+  };
+
+  std::ostream& operator<<(std::ostream& ostr, const Stamp& stamp){
+    return ostr << stamp.mjd << " UT";
+  }
+
+  // a row of a table, filled in from the test values
+  struct Row {
+    std::string name;
+    Stamp t1, t2;
+    double a, b, c, d;
+    unsigned long n;
+  };
+
+  const size_t LMAX = 12;
+
+  // ephemeris: the old and new code
+
+  void old_ephemeris(std::ostream& ostr, const Row& r, bool many){
+    if(many){
+      ostr.setf(std::ios_base::left);
+      ostr << std::setfill(' ') << std::setw(20) << std::left << r.name << " ";
+    }
+    ostr << r.t1 << " ";
+    ostr.setf(std::ios_base::left);
+    ostr << std::setprecision(8) << std::setw(10) << std::setfill(' ') << r.a << " "
+	 << std::setprecision(4) << std::setw(10) << std::setfill(' ') << r.b << "   ";
+    ostr.setf(std::ios_base::left);
+    ostr << std::setfill(' ') << std::setw(5) << std::setprecision(4)  << r.c << "    "
+	 << r.d << std::endl;
+  }
+
+  void new_ephemeris(Observing::Writer& out, const Row& r, bool many){
+    if(many){
+      out.left();
+      out.fill(' ').width(20).left() << r.name << " ";
+    }
+    out << r.t1 << " ";
+    out.left();
+    out.precision(8).width(10).fill(' ') << r.a << " ";
+    out.precision(4).width(10).fill(' ') << r.b << "   ";
+    out.left();
+    out.fill(' ').width(5).precision(4) << r.c << "    " << r.d;
+    out.endl();
+  }
+
+  // visibility
+
+  void old_visibility(std::ostream& ostr, const Row& r){
+    ostr << std::setfill(' ') << std::setw(LMAX) << std::left << r.name << " "
+	 << std::right << std::fixed << std::setprecision(2) << std::setw(5) << r.a << " h ";
+    ostr.unsetf(std::ios_base::fixed);
+    ostr << " " << r.t1 << "-" << r.t2 << std::endl;
+    ostr << std::setfill(' ') << std::setw(LMAX) << std::left << r.name << " "
+	 << std::right << std::fixed << std::setprecision(2) << std::setw(6) << r.b << std::endl;
+    ostr.unsetf(std::ios_base::fixed);
+  }
+
+  void new_visibility(Observing::Writer& out, const Row& r){
+    out.fill(' ').width(LMAX).left() << r.name << " ";
+    out.left(false).fixed().precision(2).width(5) << r.a << " h ";
+    out.fixed(false);
+    out << " " << r.t1 << "-" << r.t2;
+    out.endl();
+    out.fill(' ').width(LMAX).left() << r.name << " ";
+    out.left(false).fixed().precision(2).width(6) << r.b;
+    out.endl();
+    out.fixed(false);
+  }
+
+  // nextevents
+
+  void old_nextevents(std::ostream& ostr, const Row& r){
+    ostr << std::setfill(' ') << std::setw(LMAX) << std::left << r.name << " "
+	 << r.t1 << " "
+	 << std::setprecision(8) << std::setw(10) << r.a << " "
+	 << std::setprecision(4) << std::setw(10) << r.b << "   "
+	 << std::setw(5) << r.c << "    " << r.d << std::endl;
+  }
+
+  void new_nextevents(Observing::Writer& out, const Row& r){
+    out.fill(' ').width(LMAX).left() << r.name << " " << r.t1 << " ";
+    out.precision(8).width(10) << r.a << " ";
+    out.precision(4).width(10) << r.b << "   ";
+    out.width(5) << r.c << "    " << r.d;
+    out.endl();
+  }
+
+  // multisite
+
+  void old_multisite(std::ostream& ostr, const Row& r){
+    ostr << std::setw(LMAX) << std::left << r.name << " " << std::right << std::setw(6) << r.n
+	 << " " << std::fixed << std::setprecision(1) << std::setw(7) << r.a << std::endl;
+    ostr.unsetf(std::ios_base::fixed);
+    ostr << r.t1 << " " << std::left << std::setprecision(8) << std::setw(10)
+	 << r.b << "  " << std::right;
+    ostr << "none" << ", " << r.name;
+    ostr << std::endl;
+  }
+
+  void new_multisite(Observing::Writer& out, const Row& r){
+    out.width(LMAX).left() << r.name << " ";
+    out.left(false).width(6) << r.n << " ";
+    out.fixed().precision(1).width(7) << r.a;
+    out.endl();
+    out.fixed(false);
+    out << r.t1 << " ";
+    out.left().precision(8).width(10) << r.b << "  ";
+    out.left(false);
+    out << "none" << ", " << r.name;
+    out.endl();
+  }
+
+  // gapfill
+
+  void old_gapfill(std::ostream& ostr, const Row& r){
+    ostr << std::setfill(' ') << std::setw(LMAX) << std::left << r.name << " "
+	 << r.t1 << "  " << r.t2 << "  "
+	 << std::setprecision(3) << std::setw(6) << r.a << "  "
+	 << std::setprecision(4) << std::setw(6) << r.b << " to " << std::setw(6) << r.c << "  "
+	 << std::setprecision(3) << r.d << std::endl;
+  }
+
+  void new_gapfill(Observing::Writer& out, const Row& r){
+    out.fill(' ').width(LMAX).left() << r.name << " " << r.t1 << "  " << r.t2 << "  ";
+    out.precision(3).width(6) << r.a << "  ";
+    out.precision(4).width(6) << r.b << " to ";
+    out.width(6) << r.c << "  ";
+    out.precision(3) << r.d;
+    out.endl();
+  }
+
+  // schedule
+
+  void old_schedule(std::ostream& ostr, const Row& r){
+    ostr << std::setfill(' ') << std::setw(LMAX) << std::left << r.name << " "
+	 << r.t1 << "  " << r.t2 << "  "
+	 << std::setprecision(4) << std::setw(6) << r.a << " to " << std::setw(6) << r.b << "  "
+	 << std::setprecision(3) << r.c << std::endl;
+    ostr << std::setfill(' ') << std::setw(LMAX) << std::left << r.name << "  "
+	 << std::setw(8) << std::setprecision(3) << r.d << "  " << r.a << std::endl;
+    ostr << "\nObjective = " << std::setprecision(5) << r.b << std::endl;
+  }
+
+  void new_schedule(Observing::Writer& out, const Row& r){
+    out.fill(' ').width(LMAX).left() << r.name << " " << r.t1 << "  " << r.t2 << "  ";
+    out.precision(4).width(6) << r.a << " to ";
+    out.width(6) << r.b << "  ";
+    out.precision(3) << r.c;
+    out.endl();
+    out.fill(' ').width(LMAX).left() << r.name << "  ";
+    out.width(8).precision(3) << r.d << "  " << r.a;
+    out.endl();
+    out << "\nObjective = ";
+    out.precision(5) << r.b;
+    out.endl();
+  }
+
+  // Reports the first line at which two texts differ; returns true if they match
+  bool same(const std::string& table, const std::string& expected, const std::string& got){
+    if(got == expected) return true;
+    std::istringstream iexp(expected), igot(got);
+    std::string lexp, lgot;
+    int nline = 0;
+    while(true){
+      nline++;
+      bool bexp = bool(getline(iexp, lexp)), bgot = bool(getline(igot, lgot));
+      if(!bexp && !bgot) break;
+      if(bexp != bgot || lexp != lgot){
+	std::cerr << table << ": line " << nline << " differs\n  ostream: '" << lexp
+		  << "'\n  Writer:  '" << lgot << "'" << std::endl;
+	return false;
+      }
+    }
+    std::cerr << table << ": texts differ" << std::endl;
+    return false;
+  }
+
+  // Prints every row through both routes, from the given starting state of
+  // the stream, and compares the results. A tiny buffer makes the Writer
+  // flush part way through rows as well.
+  template <class Old, class New>
+  bool check(const std::string& table, const std::vector<Row>& rows, Old old_row, New new_row, size_t size){
+    std::ostringstream expected, got;
+    expected << std::setprecision(3) << std::left;
+    got << std::setprecision(3) << std::left;
+    for(size_t i=0; i<rows.size(); i++) old_row(expected, rows[i]);
+    expected << 1.23456789 << "\n";
+    {
+      Observing::Writer out(got, size);
+      for(size_t i=0; i<rows.size(); i++) new_row(out, rows[i]);
+    }
+    got << 1.23456789 << "\n";
+    return same(table, expected.str(), got.str());
+  }
+
+  void old_ephemeris1(std::ostream& ostr, const Row& r){old_ephemeris(ostr, r, false);}
+  void new_ephemeris1(Observing::Writer& out, const Row& r){new_ephemeris(out, r, false);}
+  void old_ephemerisn(std::ostream& ostr, const Row& r){old_ephemeris(ostr, r, true);}
+  void new_ephemerisn(Observing::Writer& out, const Row& r){new_ephemeris(out, r, true);}
+}
+
+int main(){
+
+  // Numbers that are easily formatted wrongly: signed zero, ties in the
+  // last digit, the switch between fixed and exponent forms of %g, the
+  // limits of double, and values longer than any width used
+  const double inf = std::numeric_limits<double>::infinity();
+  const double value[] = {0., -0., 1., -1., 0.5, 1.5, 2.5, 0.125, 0.0625, 1.e-5, 1.23456789e-5,
+			  9.9995, 0.99995, 99999.95, 123456.5, 1.e7, 12345678.9, 1.e15+0.3,
+			  54321.123456789, 56789.00000001, -3.14159265358979, 123456789.5, 1.e300,
+			  -1.e-300, std::numeric_limits<double>::denorm_min(),
+			  std::numeric_limits<double>::max(), inf, -inf};
+  const size_t nvalue = sizeof(value)/sizeof(double);
+
+  const char* name[] = {"", "a", "HU Aqr", "a_very_long_target_name_indeed", "SDSS J0407+0042"};
+  const size_t nname = sizeof(name)/sizeof(char*);
+
+  std::vector<Row> rows;
+  for(size_t i=0; i<nvalue; i++){
+    for(size_t k=0; k<4; k++){
+      Row r;
+      r.name = name[(i+k) % nname];
+      r.t1.mjd = value[(i+k+1) % nvalue];
+      r.t2.mjd = value[(i+2*k+2) % nvalue];
+      r.a = value[i];
+      r.b = value[(i+k+3) % nvalue];
+      r.c = value[(i+3*k+5) % nvalue];
+      r.d = value[(i+k+7) % nvalue];
+      r.n = (i*k*7919UL) % 1000003;
+      rows.push_back(r);
+    }
+  }
+
+  bool ok = true;
+  const size_t size[] = {1 << 20, 64};
+  for(size_t n=0; n<2; n++){
+    ok = check("ephemeris", rows, old_ephemeris1, new_ephemeris1, size[n]) && ok;
+    ok = check("ephemeris (many stars)", rows, old_ephemerisn, new_ephemerisn, size[n]) && ok;
+    ok = check("visibility", rows, old_visibility, new_visibility, size[n]) && ok;
+    ok = check("nextevents", rows, old_nextevents, new_nextevents, size[n]) && ok;
+    ok = check("multisite", rows, old_multisite, new_multisite, size[n]) && ok;
+    ok = check("gapfill", rows, old_gapfill, new_gapfill, size[n]) && ok;
+    ok = check("schedule", rows, old_schedule, new_schedule, size[n]) && ok;
+  }
+
+  if(!ok) exit(EXIT_FAILURE);
+  std::cout << "Writer output matches std::ostream for " << rows.size() << " rows of each table" << std::endl;
+  return 0;
+}